@@ -3,9 +3,11 @@
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <optional>
 #include <vector>
 
 #include "fwd.hh"
+#include "rtree/DynamicTree.hh"
 #include "rtree/RTree.hh"
 #include "rtree/TGDomain.hh"
 
@@ -52,6 +54,16 @@ struct ECS {
     entity selectedEntity = INVALID;
     /// CAUTION: beware iterator/reference invalidation when using this method
     void deleteEntity(entity id);
+    /// tells the navmeshes that obstructions inside `box` were added or removed
+    void obstructionChanged(const tg::aabb3 &box);
+    /// marks the cover points around `box` for updating in `fixedUpdate`, e. g.
+    /// because the ground there moved (see `Obstacle::updateCover`)
+    void coverChanged(const tg::aabb3 &box);
+    /// counts `obstructionChanged` calls, to know when copies are out of date
+    uint64_t obstructionVersion = 0;
+    /// to be bumped whenever navmeshes are added or removed, so the index
+    /// over them is rebuilt (see `NavMesh::System::updateIndex`)
+    uint64_t navMeshVersion = 0;
 
     // === Systems
     // define them here, such that Components can hold non-owning references
@@ -63,6 +75,7 @@ struct ECS {
     std::unique_ptr<NavMesh::System> navMeshSys;
     std::unique_ptr<Obstacle::System> obstacleSys;
     std::unique_ptr<Terrain::System> terrainSys;
+    std::unique_ptr<Trigger::System> triggerSys;
     std::unique_ptr<Water::System> waterSys;
     std::unique_ptr<SkyBox::System> skyBoxSys;
     std::unique_ptr<WorldFluff::System> worldFluffSys;
@@ -70,6 +83,8 @@ struct ECS {
     std::unique_ptr<SpriteRenderer::System> spriteRendererSys;
     std::unique_ptr<RiggedMesh::System> riggedMeshSys;
     std::unique_ptr<Parrot::System> parrotSys;
+    // after the systems owning the obstacle types, since its searches refer to them
+    std::unique_ptr<NavMesh::Planner> routePlanner;
 
     // === Components
     ComponentMap<Editor *> editables;
@@ -87,6 +102,7 @@ struct ECS {
     ComponentMap<SimpleMesh> simpleMeshes;
     ComponentMap<Terrain::Instance> terrains;
     ComponentMap<Terrain::Rendering> terrainRenderings;
+    ComponentMap<Trigger::Volume> triggers;
     ComponentMap<Water::Instance> waters;
     ComponentMap<SkyBox::Instance> skyBoxes;
     ComponentMap<WorldFluff::Type &> worldFluffs;
@@ -98,12 +114,30 @@ struct ECS {
     ComponentMap<SpriteRenderer::Instance> sprites;
 
     RTree<Obstacle::Obstruction> obstructions;
+    /// places to take cover next to the obstacles, see `Obstacle::buildCover`
+    RTree<Obstacle::CoverPoint> cover;
+    /// where `cover` is out of date, see `coverChanged`
+    std::optional<tg::aabb3> coverStale;
+    /// world-space bounding boxes of the fluff instances, used for picking
+    RTree<Obstacle::Obstruction> fluffBounds;
+    /// objects that move around: humanoids, parrots and scatter lasers, as
+    /// well as trigger volumes. Kept up to date by `updateDynamicTree`
+    DynamicTree<entity> dynamicTree;
+    ComponentMap<DynamicTree<entity>::proxy_t> dynamicProxies;
+    /// broadphase result of the last `updateDynamicTree`: pairs of objects
+    /// with overlapping (fat) bounding boxes, at least one of which was
+    /// inserted or moved significantly during that update
+    std::vector<std::pair<entity, entity>> dynamicPairs;
 
     void init(Game &game);
+    // out of line, so only ECS.cc needs to see all component types.
+    // Without `init`, no systems exist, which is enough for headless tests
+    ECS();
     ~ECS();
 
     void extrapolateUpdate(Snapshot &prev, Snapshot &next);
     void extrapolateRender(Snapshot &upd, Snapshot &render);
+    void updateDynamicTree(Snapshot &prev, Snapshot &next);
     void fixedUpdate();
 
     void cleanup(double time);
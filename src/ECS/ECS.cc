@@ -1,13 +1,19 @@
 // SPDX-License-Identifier: MIT
 #include "Misc.hh"
+#include <algorithm>
+#include <thread>
+
 #include <glow/common/log.hh>
 
 #include <ECS.hh>
+#include <ECS/Join.hh>
 #include <MathUtil.hh>
 #include <combat/Combat.hh>
 #include <demo/Demo.hh>
 #include <effects/Effects.hh>
 #include <navmesh/NavMesh.hh>
+#include <navmesh/Planner.hh>
+#include <obstacles/Cover.hh>
 #include <obstacles/Obstacle.hh>
 #include <obstacles/WorldFluff.hh>
 #include <rendering/MeshViz.hh>
@@ -15,6 +21,7 @@
 #include <terrain/SkyBox.hh>
 #include <terrain/Terrain.hh>
 #include <terrain/Water.hh>
+#include <trigger/Trigger.hh>
 #include <ui/SpriteRenderer.hh>
 #include <environment/Parrot.hh>
 
@@ -32,6 +39,22 @@ ECS::entity ECS::ECS::newEntity() {
 }
 void ECS::ECS::deleteEntity(entity id) {
     editables.erase(id);
+    if (auto obst = obstacles.find(id); obst != obstacles.end()) {
+        // the obstruction tree entry goes stale and is ignored from now on
+        if (auto rigid = instancedRigids.find(id); rigid != instancedRigids.end()) {
+            obstructionChanged(obst->second.worldBounds(rigid->second));
+        }
+    }
+    if (auto iter = dynamicProxies.find(id); iter != dynamicProxies.end()) {
+        dynamicTree.remove(iter->second);
+        dynamicProxies.erase(iter);
+    }
+    // the parrot's trigger volume would keep sending events for nobody
+    if (auto parrot = parrots.find(id); parrot != parrots.end() && parrot->second.trigger != INVALID) {
+        auto trigger = parrot->second.trigger;
+        parrot->second.trigger = INVALID;
+        deleteEntity(trigger);
+    }
 
     humanoids.erase(id);
     mobileUnits.erase(id);
@@ -39,7 +62,7 @@ void ECS::ECS::deleteEntity(entity id) {
     staticRigids.erase(id);
     instancedRigids.erase(id);
     vizMeshes.erase(id);
-    navMeshes.erase(id);
+    if (navMeshes.erase(id)) {navMeshVersion += 1;}
     obstacles.erase(id);
     simpleMeshes.erase(id);
     scatterLasers.erase(id);
@@ -47,6 +70,7 @@ void ECS::ECS::deleteEntity(entity id) {
     startSequenceObjects.erase(id);
     terrains.erase(id);
     terrainRenderings.erase(id);
+    triggers.erase(id);
     waters.erase(id);
     worldFluffs.erase(id);
     riggedMeshes.erase(id);
@@ -56,6 +80,23 @@ void ECS::ECS::deleteEntity(entity id) {
     freeEntities.push_back(id);
 }
 
+void ECS::ECS::obstructionChanged(const tg::aabb3 &box) {
+    obstructionVersion += 1;
+    for (auto &[id, nav] : navMeshes) {
+        if (nav.hierarchy) {nav.editHierarchy().invalidate(box);}
+    }
+    coverChanged(box);
+}
+
+void ECS::ECS::coverChanged(const tg::aabb3 &box) {
+    // deferred, so deleted obstacles are gone from the ECS by then
+    if (coverStale) {
+        coverStale = tg::aabb3(tg::min(coverStale->min, box.min), tg::max(coverStale->max, box.max));
+    } else {
+        coverStale = box;
+    }
+}
+
 tg::mat4x3 ECS::Rigid::transform_mat() const {
     return Util::transformMat(translation, rotation);
 }
@@ -94,6 +135,7 @@ void ECS::ECS::init(Game &game) {
     meshVizSys = std::make_unique<MeshViz::System>(*this);
     obstacleSys = std::make_unique<Obstacle::System>(game);
     terrainSys = std::make_unique<Terrain::System>(*this);
+    triggerSys = std::make_unique<Trigger::System>(*this);
     waterSys = std::make_unique<Water::System>(*this);
     skyBoxSys = std::make_unique<SkyBox::System>(*this);
     worldFluffSys = std::make_unique<WorldFluff::System>(game);
@@ -101,8 +143,11 @@ void ECS::ECS::init(Game &game) {
     spriteRendererSys = std::make_unique<SpriteRenderer::System>(game);
     riggedMeshSys = std::make_unique<RiggedMesh::System>(game);
     parrotSys = std::make_unique<Parrot::System>(game);
+    // leave a core for the main thread
+    routePlanner = std::make_unique<NavMesh::Planner>(std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1);
 }
 
+ECS::ECS::ECS() {}
 ECS::ECS::~ECS() {}
 
 void ECS::ECS::extrapolateUpdate(Snapshot &prev, Snapshot &next) {
@@ -112,9 +157,70 @@ void ECS::ECS::extrapolateUpdate(Snapshot &prev, Snapshot &next) {
     combatSys->extrapolate(prev, next);
 
     combatSys->update(prev, next);
+    updateDynamicTree(prev, next);
+    triggerSys->update(next);
+}
+
+void ECS::ECS::updateDynamicTree(Snapshot &prev, Snapshot &next) {
+    auto update = [&] (entity id, const tg::aabb3 &aabb, const tg::vec3 &displacement) {
+        auto [iter, inserted] = dynamicProxies.try_emplace(id, DynamicTree<entity>::NONE);
+        if (inserted) {
+            iter->second = dynamicTree.insert(aabb, id);
+        } else {
+            dynamicTree.move(iter->second, aabb, displacement);
+        }
+    };
+    for (auto &&tup : Join(next.humanoids, mobileUnits)) {
+        auto &[humpos, mob, id] = tup;
+        auto base = humpos.base.translation;
+        auto top = base + mob.heightVector;
+        tg::vec3 radius(mob.radius);
+        tg::aabb3 aabb = {tg::min(base, top) - radius, tg::max(base, top) + radius};
+        auto prevIter = prev.humanoids.find(id);
+        auto displacement = prevIter == prev.humanoids.end() ? tg::vec3::zero : base - prevIter->second.base.translation;
+        update(id, aabb, displacement);
+    }
+    for (auto &&tup : Join(riggedRigids, parrots)) {
+        auto &[rigid, parrot, id] = tup;
+        auto pos = rigid.translation;
+        update(id, {pos - tg::vec3(.3f, 0, .3f), pos + tg::vec3(.3f, .5f, .3f)}, tg::vec3::zero);
+    }
+    for (auto &pair : scatterLasers) {
+        auto &[id, laser] = pair;
+        tg::vec3 radius(laser.params.radius);
+        update(id, {
+            tg::min(laser.seg.pos0, laser.seg.pos1) - radius,
+            tg::max(laser.seg.pos0, laser.seg.pos1) + radius
+        }, tg::vec3::zero);
+    }
+    for (auto &pair : triggers) {
+        auto &[id, vol] = pair;
+        update(id, vol.aabb(), tg::vec3::zero);
+    }
+    // drop objects that lost their components without being deleted
+    for (auto iter = dynamicProxies.begin(); iter != dynamicProxies.end();) {
+        auto id = iter->first;
+        if (next.humanoids.count(id) || parrots.count(id) || scatterLasers.count(id) || triggers.count(id)) {
+            ++iter;
+            continue;
+        }
+        dynamicTree.remove(iter->second);
+        iter = dynamicProxies.erase(iter);
+    }
+
+    dynamicPairs.clear();
+    dynamicTree.updatePairs([&] (auto a, auto b) {
+        dynamicPairs.emplace_back(dynamicTree.data(a), dynamicTree.data(b));
+    });
 }
 
 void ECS::ECS::fixedUpdate() {
+    // routes are delivered here, once the simulation snapshot is complete
+    routePlanner->tick(*this);
+    if (coverStale) {
+        Obstacle::updateCover(*this, *coverStale);
+        coverStale.reset();
+    }
     parrotSys->behaviorUpdate();
 }
 
@@ -23,8 +23,10 @@
 
 #include <imgui/imgui.h> // UI framework
 
+#include "Picking.hh"
 #include "Util.hh"
 #include <animation/AnimatorManager.hh>
+#include <bench/Bench.hh>
 #include <startsequence/StartSequence.hh>
 #include <animation/rigged/RiggedMesh.hh>
 #include <terrain/SkyBox.hh>
@@ -163,8 +165,12 @@ void Game::render(float elapsedSeconds)
                 mPostProcess.flashWarning(.5f);
             }
         } else {
-            auto const mousePos = input().getMousePosition();
-            mECS.selectedEntity = readPickingBuffer(int(mousePos.x), getWindowHeight() - int(mousePos.y));
+            if (mCpuPicking) {
+                mECS.selectedEntity = Picking::pick(mECS, simSnap(), {mCamera.mPos, mouseWorldDirection()}).id;
+            } else {
+                auto const mousePos = input().getMousePosition();
+                mECS.selectedEntity = readPickingBuffer(int(mousePos.x), getWindowHeight() - int(mousePos.y));
+            }
             glow::info() << "selected entity " << mECS.selectedEntity;
 
             if (!mDevMode) {
@@ -381,7 +387,8 @@ void Game::terrainScene(const ECS::Rigid &pos, bool startIntro) {
     mECS.terrainRenderings.emplace(ent, Terrain::Rendering(terr));
     mECS.waters.emplace(ent, Water::Instance(terr, getWindowSize()));
     mECS.skyBoxes.emplace(ent, SkyBox::Instance(terr));
-    auto &nav = mECS.navMeshes.emplace(ent, NavMesh::Instance(wo, terr)).first->second;
+    auto &nav = mECS.navMeshes.emplace(ent, NavMesh::Instance::cached(wo, terr)).first->second;
+    mECS.navMeshVersion += 1;
     mECS.obstacleSys->spawnObstacles(wo, terr, rng);
     mECS.worldFluffSys->spawnFluff(wo, terr, rng);
     for (auto i : Util::IntRange(10)) {
@@ -441,6 +448,10 @@ void Game::defaultEditorWindow() {
         }
         ImGui::TreePop();
     }
+    if (ImGui::TreeNode("Benchmarks")) {
+        Bench::editorUI(*this);
+        ImGui::TreePop();
+    }
 }
 
 void Game::onGui() {
@@ -462,6 +473,7 @@ void Game::onGui() {
             auto const mouseDelta = input().getMouseDeltaF();
             ImGui::Text("Cursor delta: %.2f %.2f", mouseDelta.x, mouseDelta.y);
             ImGui::Checkbox("Capture mouse during mouselook", &mCaptureMouseOnMouselook);
+            ImGui::Checkbox("CPU picking", &mCpuPicking);
             ImGui::TreePop();
         }
         bool paused = mPaused;
@@ -38,6 +38,8 @@ public:
     std::unique_ptr<Tool> mActiveTool;
     bool mShowWireframe = false;
     bool mCaptureMouseOnMouselook = true;
+    /// select entities with `Picking::pick` instead of reading back the picking buffer
+    bool mCpuPicking = false;
     SharedResources mSharedResources;
     RenderTargets mRenderTargets;
     Camera mCamera;
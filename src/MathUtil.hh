@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <limits>
 #include <random>
 #include <typed-geometry/tg.hh>
 
@@ -59,6 +61,21 @@ inline tg::vec3 triangleNormal(tg::pos3 p1, tg::pos3 p2, tg::pos3 p3) {
     return tg::normalize(tg::cross(p2-p1, p3-p1));
 }
 
+/// ray parameter at which the ray enters the box (0 if it starts inside),
+/// infinity if it misses the box or only reaches it after `maxT`
+inline float rayBoxEntry(const tg::ray3 &ray, const tg::aabb3 &box, float maxT = std::numeric_limits<float>::infinity()) {
+    float tmin = 0.f, tmax = maxT;
+    for (auto axis : {0, 1, 2}) {
+        auto inv = 1.f / ray.dir[axis];
+        auto t0 = (box.min[axis] - ray.origin[axis]) * inv, t1 = (box.max[axis] - ray.origin[axis]) * inv;
+        if (t0 > t1) {std::swap(t0, t1);}
+        // NaN (0 * inf) means the ray is parallel and inside the slab, and is ignored by min/max
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+    }
+    return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+}
+
 inline tg::quat fromToRotation(tg::vec3 fromAxis, tg::vec3 toAxis) {
     auto cross = tg::cross(fromAxis, toAxis);
     if (cross == tg::vec3::zero) {
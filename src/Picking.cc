@@ -0,0 +1,131 @@
+// SPDX-License-Identifier: MIT
+#include "Picking.hh"
+#include <cmath>
+
+#include <typed-geometry/tg.hh>
+
+#include "ECS/Join.hh"
+#include "MathUtil.hh"
+#include "combat/Combat.hh"
+#include "navmesh/NavMesh.hh"
+#include "obstacles/Collision.hh"
+#include "obstacles/Obstacle.hh"
+#include "obstacles/WorldFluff.hh"
+#include "terrain/SkyBox.hh"
+#include "terrain/Terrain.hh"
+
+std::optional<float> Picking::rayCapsule(const tg::ray3 &ray, const tg::pos3 &a, const tg::pos3 &b, float radius) {
+    auto axis = b - a, oa = ray.origin - a;
+    auto axisSq = tg::length_sqr(axis), axisDir = tg::dot(axis, ray.dir), axisOa = tg::dot(axis, oa);
+    // cylinder body: solve |oa + t dir|² - (axis·(oa + t dir))² / axisSq = radius²
+    auto qa = axisSq - axisDir * axisDir;
+    if (qa > 1e-6f * axisSq) {
+        auto qb = axisSq * tg::dot(ray.dir, oa) - axisOa * axisDir;
+        auto qc = axisSq * tg::length_sqr(oa) - axisOa * axisOa - radius * radius * axisSq;
+        auto disc = qb * qb - qa * qc;
+        if (disc < 0.f) {return std::nullopt;}  // misses the infinite cylinder, so the caps as well
+        auto t = (-qb - std::sqrt(disc)) / qa;
+        auto along = axisOa + t * axisDir;
+        if (t >= 0.f && along > 0.f && along < axisSq) {return t;}
+    }
+    // if the body isn't entered, the first hit is on one of the caps
+    std::optional<float> res;
+    for (auto center : {a, b}) {
+        auto oc = ray.origin - center;
+        auto half = tg::dot(ray.dir, oc);
+        auto disc = half * half - (tg::length_sqr(oc) - radius * radius);
+        if (disc < 0.f) {continue;}
+        auto t = -half - std::sqrt(disc);
+        if (t >= 0.f && (!res || t < *res)) {res = t;}
+    }
+    return res;
+}
+
+std::optional<float> Picking::rayOrientedBox(const tg::ray3 &ray, const ECS::Rigid &rigid, const tg::aabb3 &box) {
+    auto inv = ~rigid;
+    auto t = Util::rayBoxEntry({inv * ray.origin, inv * ray.dir}, box);
+    if (!std::isfinite(t)) {return std::nullopt;}
+    return t;
+}
+
+std::optional<Picking::Hit> Picking::pickTerrain(ECS::ECS &ecs, const tg::ray3 &ray, float maxDist) {
+    std::optional<Hit> res;
+    for (auto &&tup : ECS::Join(ecs.staticRigids, ecs.terrains, ecs.navMeshes)) {
+        auto &[rigid, terr, nav, id] = tup;
+        auto limit = res ? res->distance : maxDist;
+        auto ground = nav.intersect(ray);
+        if (ground && ground->second < limit) {
+            res = {id, ground->second};
+            limit = ground->second;
+        }
+        // the water surface carries the terrain's pick ID as well
+        auto inv = ~rigid;
+        auto origin = inv * ray.origin;
+        auto dir = inv * ray.dir;
+        if (dir.y == 0.f) {continue;}
+        auto t = (terr.waterLevel - origin.y) / dir.y;
+        auto hit = origin + t * tg::vec3(dir);
+        auto size = terr.segmentSize * (terr.segmentsAmount - 1);
+        if (t >= 0.f && t < limit && hit.x >= 0.f && hit.x <= size && hit.z >= 0.f && hit.z <= size) {
+            res = {id, t};
+        }
+    }
+    return res;
+}
+
+std::optional<Picking::Hit> Picking::pickObstacles(ECS::ECS &ecs, const tg::ray3 &ray, float maxDist) {
+    auto res = Obstacle::rayCast(ecs, ray, maxDist);
+    if (!res) {return std::nullopt;}
+    return Hit{res->first, res->second};
+}
+
+std::optional<Picking::Hit> Picking::pickFluff(ECS::ECS &ecs, const tg::ray3 &ray, float maxDist) {
+    std::optional<Hit> res;
+    auto limit = [&] {return res ? res->distance : maxDist;};
+    ecs.fluffBounds.visit([&] (const tg::aabb3 &aabb, int level) {
+        return Util::rayBoxEntry(ray, aabb, limit()) < limit();
+    }, [&] (const Obstacle::Obstruction &bounds) {
+        if (!(Util::rayBoxEntry(ray, bounds.aabb, limit()) < limit())) {return true;}
+        auto join = ECS::Join(ecs.worldFluffs, ecs.instancedRigids);
+        auto iter = join.find(bounds.id);
+        if (iter == join.end()) {return true;}
+        auto [type, rigid, id] = *iter;
+        auto t = rayOrientedBox(ray, rigid, type.vaoInfo.bounds);
+        if (t && *t < limit()) {res = {id, *t};}
+        return true;
+    });
+    return res;
+}
+
+std::optional<Picking::Hit> Picking::pickHumanoids(ECS::ECS &ecs, const ECS::Snapshot &snap, const tg::ray3 &ray, float maxDist) {
+    std::optional<Hit> res;
+    auto &tree = ecs.dynamicTree;
+    tree.rayCast(ray, maxDist, [&] (auto proxy) {
+        auto id = tree.data(proxy);
+        auto posIter = snap.humanoids.find(id);
+        auto mobIter = ecs.mobileUnits.find(id);
+        if (posIter == snap.humanoids.end() || mobIter == ecs.mobileUnits.end()) {
+            return std::numeric_limits<float>::infinity();
+        }
+        auto &mob = mobIter->second;
+        auto base = posIter->second.base.translation;
+        auto t = rayCapsule(ray, base, base + mob.heightVector, mob.radius);
+        if (!t || *t >= (res ? res->distance : maxDist)) {return std::numeric_limits<float>::infinity();}
+        res = {id, *t};
+        return *t;
+    });
+    return res;
+}
+
+Picking::Hit Picking::pick(ECS::ECS &ecs, const ECS::Snapshot &snap, const tg::ray3 &ray) {
+    Hit res;
+    // the terrain usually has the nearest hit and is cheap thanks to the
+    // heightfield, so it goes first and bounds the search for everything else
+    if (auto hit = pickTerrain(ecs, ray, res.distance)) {res = *hit;}
+    if (auto hit = pickObstacles(ecs, ray, res.distance)) {res = *hit;}
+    if (auto hit = pickFluff(ecs, ray, res.distance)) {res = *hit;}
+    if (auto hit = pickHumanoids(ecs, snap, ray, res.distance)) {res = *hit;}
+
+    if (res.id == ECS::INVALID && !ecs.skyBoxes.empty()) {res.id = ecs.skyBoxes.begin()->first;}
+    return res;
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <limits>
+#include <optional>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include "ECS.hh"
+
+/// CPU alternative to reading back the picking buffer: intersects a world-space
+/// ray with the same objects that write pick IDs, using their collision or
+/// bounding volumes instead of the rendered triangles. Only reads components
+/// (and the snapshot), so it works without a GL context
+namespace Picking {
+
+struct Hit {
+    ECS::entity id = ECS::INVALID;
+    float distance = std::numeric_limits<float>::infinity();
+};
+
+/// nearest pickable object along the ray. Rays that hit nothing return the
+/// terrain that owns the sky box, since that's what the picking buffer holds there
+Hit pick(ECS::ECS &, const ECS::Snapshot &, const tg::ray3 &);
+
+// the individual categories; each only reports hits nearer than `maxDist`
+std::optional<Hit> pickTerrain(ECS::ECS &, const tg::ray3 &, float maxDist);
+std::optional<Hit> pickObstacles(ECS::ECS &, const tg::ray3 &, float maxDist);
+std::optional<Hit> pickFluff(ECS::ECS &, const tg::ray3 &, float maxDist);
+std::optional<Hit> pickHumanoids(ECS::ECS &, const ECS::Snapshot &, const tg::ray3 &, float maxDist);
+
+/// exact tests used for the bounding volumes, also usable by brute-force references
+std::optional<float> rayCapsule(const tg::ray3 &, const tg::pos3 &a, const tg::pos3 &b, float radius);
+/// box given in the local space of `rigid`
+std::optional<float> rayOrientedBox(const tg::ray3 &, const ECS::Rigid &rigid, const tg::aabb3 &box);
+
+}
@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+
+#include <imgui/imgui.h>
+
+#include <Game.hh>
+
+void Bench::editorUI(Game &game) {
+    static int seed = 1;
+    ImGui::InputInt("Benchmark seed", &seed);
+    std::mt19937 rng(seed);
+    auto &ecs = game.mECS;
+    if (ImGui::Button("Terrain ray casts")) {terrainRays(ecs, rng, 10000);}
+    if (ImGui::Button("CPU picking")) {picking(ecs, rng, 1000);}
+    if (ImGui::Button("Navigate (100 routes)")) {navigateRoutes(ecs, rng, 100);}
+    if (ImGui::Button("HPA* (1000 routes)")) {hierarchicalRoutes(ecs, rng, 1000);}
+    if (ImGui::Button("Landmark heuristic (1000 routes)")) {landmarkHeuristic(ecs, rng, 1000);}
+    if (ImGui::Button("Reachability (1000 pairs)")) {reachability(ecs, rng, 1000);}
+    if (ImGui::Button("Route planner (200 routes)")) {routePlanner(ecs, rng, 200);}
+    if (ImGui::Button("Time-sliced search (256 routes)")) {slicedSearch(ecs, rng, 256);}
+    if (ImGui::Button("Flow field (500 units)")) {flowField(ecs, rng, 500);}
+    if (ImGui::Button("Baked obstacles (1000 routes)")) {bakedObstacles(ecs, rng, 1000);}
+    if (ImGui::Button("Point location (1000 points)")) {pointLocation(ecs, rng, 1000);}
+    if (ImGui::Button("Navmesh cache")) {navmeshCache(ecs);}
+    if (ImGui::Button("Incremental replanning (200 routes)")) {incrementalReplanning(ecs, rng, 200);}
+    if (ImGui::Button("Squad orders (50 per size)")) {squadOrders(ecs, rng, 50);}
+    if (ImGui::Button("Cover queries (10000 per radius)")) {coverQueries(ecs, rng, 10000);}
+    if (ImGui::Button("Navmesh build (200², 800²)")) {navmeshBuild(rng);}
+    if (ImGui::Button("Navmesh islands (1000 queries)")) {navmeshIslands(rng, 1000);}
+    if (ImGui::Button("Crater storm (1000 impacts)")) {craterStorm(rng, 1000);}
+    if (ImGui::Button("Crowd avoidance (1000)")) {crowdAvoidance(rng, 1000, 600);}
+    ImGui::SameLine();
+    if (ImGui::Button("(5000)")) {crowdAvoidance(rng, 5000, 600);}
+    if (ImGui::Button("Dynamic tree churn (10k)")) {dynamicTreeChurn(rng, 10000, 300);}
+    if (ImGui::Button("Parrot triggers (5000 parrots, 500 humanoids)")) {parrotTriggers(rng, 5000, 500, 300);}
+}
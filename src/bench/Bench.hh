@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <fwd.hh>
+
+/// in-game micro-benchmarks. They run on whatever scene is currently loaded
+/// (or on synthetic data) and report through the log
+namespace Bench {
+
+using Clock = std::chrono::steady_clock;
+
+/// runs `fn` once and returns the elapsed wall time in microseconds
+template<typename F>
+double timeMicros(F &&fn) {
+    auto start = Clock::now();
+    fn();
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+struct Samples {
+    std::vector<double> values;
+
+    void add(double v) {values.push_back(v);}
+    double sum() const {
+        double res = 0.;
+        for (auto v : values) {res += v;}
+        return res;
+    }
+    double mean() const {return values.empty() ? 0. : sum() / values.size();}
+    /// `p` in [0, 1]
+    double percentile(double p) {
+        if (values.empty()) {return 0.;}
+        auto idx = std::min(values.size() - 1, size_t(p * values.size()));
+        std::nth_element(values.begin(), values.begin() + idx, values.end());
+        return values[idx];
+    }
+};
+
+void terrainRays(ECS::ECS &, std::mt19937 &, size_t nRays);
+/// CPU picking on the loaded scene, checked against testing every object, see `Picking`.
+/// Returns the number of mismatches
+size_t picking(ECS::ECS &, std::mt19937 &, size_t nRays);
+/// random and long routes across the loaded navmeshes: the crossing search compared
+/// to the search on polymesh handles, and the corridor search compared to both
+void navigateRoutes(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// random routes, `SearchMode::Hierarchical` compared to the full corridor search,
+/// plus the cost of building and incrementally updating the hierarchy
+void hierarchicalRoutes(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// corridor search with the landmark (ALT) heuristic compared to the straight line
+void landmarkHeuristic(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// `Instance::reachable` against what failing searches cost, and the nearest-point suggestions
+void reachability(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// main-thread time of planning routes synchronously vs. through `NavMesh::Planner`,
+/// and whether its results, order and cancellation are deterministic. Returns the
+/// number of mismatches
+size_t routePlanner(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// corridor searches spread over ticks by `NavMesh::SliceScheduler`, checked
+/// against running them in one go, at several per-tick budgets. Returns the number
+/// of mismatches
+size_t slicedSearch(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// units spread over the map going to one point: a search each compared to
+/// following one shared `NavMesh::FlowField`, and the field cache's hit rate
+void flowField(ECS::ECS &, std::mt19937 &, size_t nUnits);
+/// the obstacles baked into the navmesh hierarchy checked against the collision
+/// queries they replace, and the corridor search with and without them
+void bakedObstacles(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// `Instance::closestPoint` and `faceAt` on the heightfield grid, checked against
+/// testing every face and compared to the face tree. Returns the number of mismatches
+size_t pointLocation(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// building the navmesh of each loaded terrain against writing and loading it
+/// through the cache, and whether damaged or stale files are rejected
+void navmeshCache(ECS::ECS &);
+/// obstacles appearing on and disappearing from routes: repairing the routes'
+/// `NavMesh::Replanner` searches compared to replanning from scratch
+void incrementalReplanning(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// squads of 5, 20 and 100 ordered to random places: one search per unit compared
+/// to `Instance::planSquad` sharing one corridor, and how long the routes get
+void squadOrders(ECS::ECS &, std::mt19937 &, size_t nOrders);
+/// building `Obstacle::buildCover` for the loaded obstacles, and `Obstacle::bestCover`
+/// at several radii checked against testing every cover point
+void coverQueries(ECS::ECS &, std::mt19937 &, size_t nQueries);
+/// headless: navmesh startup time on generated 200² and 800² terrains, building
+/// straight from the terrain faces against copying and cleaning up the mesh
+void navmeshBuild(std::mt19937 &);
+/// headless: 1, 16 and 64 adjacent navmesh islands, `NavMesh::System` queries
+/// through its index compared to trying every instance, and routes across the portals
+void navmeshIslands(std::mt19937 &, size_t nQueries);
+/// headless: laser craters dug into 100², 200² and 400² terrains: the per-impact
+/// cost of refitting the terrain, navmesh and hierarchy and replanning the routes
+/// crossing them (from scratch and by repairing their `NavMesh::Replanner`s), and
+/// the refitted navmesh checked against rebuilding it
+void craterStorm(std::mt19937 &, size_t nImpacts);
+/// headless: agents crossing a square, see `Combat::Avoidance`
+void crowdAvoidance(std::mt19937 &, size_t nAgents, size_t ticks);
+/// headless: random movers with 1% churn per tick, see `DynamicTree`
+void dynamicTreeChurn(std::mt19937 &, size_t nObjects, size_t ticks);
+/// headless: humanoids walking past parrot trigger volumes, compared to checking all pairs
+void parrotTriggers(std::mt19937 &, size_t nParrots, size_t nHumanoids, size_t ticks);
+
+void editorUI(Game &);
+
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <optional>
+#include <vector>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <ECS.hh>
+#include <navmesh/NavMesh.hh>
+#include <obstacles/Cover.hh>
+
+void Bench::coverQueries(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    size_t nPoints = 0;
+    auto buildMicros = timeMicros([&] {nPoints = Obstacle::buildCover(ecs);});
+    std::vector<Obstacle::CoverPoint> points;
+    ecs.cover.visit([] (const tg::aabb3 &, int) {return true;}, [&] (const Obstacle::CoverPoint &point) {
+        points.push_back(point);
+        return true;
+    });
+    double crouching = 0., standing = 0.;
+    for (auto &point : points) {
+        crouching += std::bitset<8>(point.crouching).count();
+        standing += std::bitset<8>(point.standing).count();
+    }
+    glow::info() << "cover database: " << ecs.obstacles.size() << " obstacles, " << nPoints << " points built in " << buildMicros / 1000 << "ms";
+    glow::info() << "  sectors covered per point: " << crouching / std::max<size_t>(points.size(), 1) << " crouching, "
+        << standing / std::max<size_t>(points.size(), 1) << " standing (of " << Obstacle::CoverPoint::SECTORS << ")";
+
+    for (auto &[id, nav] : ecs.navMeshes) {
+        if (!nav.graph || !nav.graph->numFaces()) {continue;}
+        auto &g = *nav.graph;
+        std::uniform_int_distribution<int> faceDistr(0, int(g.numFaces()) - 1);
+        std::uniform_real_distribution<float> angleDistr(0.f, 2 * tg::pi_scalar<float>);
+        for (float radius : {5.f, 15.f, 50.f}) {
+            Samples indexed, linear;
+            size_t found = 0, mismatches = 0;
+            for (size_t i = 0; i < nQueries; ++i) {
+                auto pos = g.faceCentroid(uint32_t(faceDistr(rng)));
+                auto angle = angleDistr(rng);
+                // a shooter at about twice the search radius
+                auto threat = pos + 2 * radius * tg::vec3(std::cos(angle), 0, std::sin(angle));
+                bool upright = i % 2;
+                std::optional<Obstacle::CoverPoint> a;
+                indexed.add(timeMicros([&] {a = Obstacle::bestCover(ecs, pos, radius, threat, upright);}));
+                // every point, which is what the index saves
+                std::optional<float> b;
+                linear.add(timeMicros([&] {
+                    for (auto &point : points) {
+                        auto score = Obstacle::coverScore(point, pos, radius, threat, upright);
+                        if (!score || (b && *score <= *b) || !ecs.obstacles.count(point.obstacle)) {continue;}
+                        b = score;
+                    }
+                }));
+                found += a.has_value();
+                mismatches += a.has_value() != b.has_value() || (a && std::abs(*Obstacle::coverScore(*a, pos, radius, threat, upright) - *b) > 1e-4f);
+            }
+            glow::info() << "  best cover within " << radius << "m, " << nQueries << " queries: " << found << " found, " << mismatches << " mismatches";
+            glow::info() << "    indexed: mean " << indexed.mean() << "µs, p99 " << indexed.percentile(.99) << "µs";
+            glow::info() << "    linear:  mean " << linear.mean() << "µs, p99 " << linear.percentile(.99) << "µs (" << linear.mean() / std::max(indexed.mean(), 1e-3) << "x)";
+        }
+    }
+}
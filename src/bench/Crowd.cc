@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <combat/Avoidance.hh>
+
+/// largest overlap between any two agents, relative to their combined radius
+static float maxOverlap(const std::vector<Combat::Avoidance::Agent> &agents, std::vector<uint32_t> &order) {
+    order.resize(agents.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&] (uint32_t a, uint32_t b) {return agents[a].pos.x < agents[b].pos.x;});
+    float res = 0.f;
+    for (size_t i = 0; i < order.size(); ++i) {
+        auto &a = agents[order[i]];
+        for (size_t j = i + 1; j < order.size(); ++j) {
+            auto &b = agents[order[j]];
+            auto combined = a.radius + b.radius;
+            if (b.pos.x - a.pos.x >= combined) {break;}
+            auto dist = tg::distance(a.pos, b.pos);
+            if (dist < combined) {res = std::max(res, 1.f - dist / combined);}
+        }
+    }
+    return res;
+}
+
+void Bench::crowdAvoidance(std::mt19937 &rng, size_t nAgents, size_t ticks) {
+    constexpr float dt = 1.f / 60, speed = 3.f, radius = .5f;
+    auto threads = std::clamp(std::thread::hardware_concurrency(), 1u, 8u) - 1;
+    Combat::Avoidance avoid(threads);
+    // jittered grid with about 10 m² per agent. Everyone walks to the opposite
+    // side of the square, so the crowd has to pass through itself in the middle
+    auto spacing = std::sqrt(10.f), halfSize = .5f * spacing * std::ceil(std::sqrt(float(nAgents)));
+    std::uniform_real_distribution<float> jitter(-.5f * spacing + radius, .5f * spacing - radius);
+    std::vector<tg::pos2> goals;
+    auto perRow = size_t(std::ceil(std::sqrt(float(nAgents))));
+    for (size_t i = 0; i < nAgents; ++i) {
+        tg::pos2 pos(
+            (i / perRow + .5f) * spacing - halfSize + jitter(rng),
+            (i % perRow + .5f) * spacing - halfSize + jitter(rng)
+        );
+        avoid.agents.push_back({pos, tg::vec2::zero, tg::vec2::zero, radius, speed});
+        goals.push_back(tg::pos2(-pos.x, -pos.y));
+    }
+
+    Samples solveTime;
+    std::vector<uint32_t> order;
+    float worstOverlap = 0.f;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        for (size_t i = 0; i < nAgents; ++i) {
+            auto &a = avoid.agents[i];
+            auto toGoal = goals[i] - a.pos;
+            auto dist = tg::length(toGoal);
+            a.prefVel = dist > speed * dt ? toGoal * (speed / dist) : toGoal / dt;
+        }
+        solveTime.add(timeMicros([&] {avoid.solve(dt);}));
+        for (size_t i = 0; i < nAgents; ++i) {
+            auto &a = avoid.agents[i];
+            a.vel = avoid.velocities[i];
+            a.pos += a.vel * dt;
+        }
+        if (tick % 10 == 0) {worstOverlap = std::max(worstOverlap, maxOverlap(avoid.agents, order));}
+    }
+    size_t arrived = 0;
+    for (size_t i = 0; i < nAgents; ++i) {
+        if (tg::distance(avoid.agents[i].pos, goals[i]) < radius) {arrived += 1;}
+    }
+    glow::info() << "crowd avoidance, " << nAgents << " agents, " << ticks << " ticks, " << threads << " worker threads: mean " << solveTime.mean() << "µs, p50 " << solveTime.percentile(.5) << "µs, p99 " << solveTime.percentile(.99) << "µs per tick";
+    glow::info() << "  worst overlap " << 100.f * worstOverlap << "% of combined radius, " << arrived << " agents arrived";
+}
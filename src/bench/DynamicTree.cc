@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <cmath>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <rtree/DynamicTree.hh>
+#include <rtree/RStar.hh>
+#include <rtree/RTree.hh>
+#include <rtree/TGDomain.hh>
+
+namespace {
+struct Mover {
+    tg::pos3 pos;
+    tg::vec3 vel;
+    DynamicTree<uint32_t>::proxy_t proxy;
+
+    tg::aabb3 aabb() const {return {pos - tg::vec3(.5f, 0, .5f), pos + tg::vec3(.5f, 1.8f, .5f)};}
+};
+}
+
+/// entry distance of the ray into the box, or infinity
+static float rayBox(const tg::ray3 &ray, const tg::aabb3 &box) {
+    float tmin = 0.f, tmax = std::numeric_limits<float>::infinity();
+    for (auto axis : {0, 1, 2}) {
+        auto inv = 1.f / ray.dir[axis];
+        auto t0 = (box.min[axis] - ray.origin[axis]) * inv, t1 = (box.max[axis] - ray.origin[axis]) * inv;
+        if (t0 > t1) {std::swap(t0, t1);}
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+    }
+    return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+}
+
+void Bench::dynamicTreeChurn(std::mt19937 &rng, size_t nObjects, size_t ticks) {
+    constexpr float dt = 1.f / 60, worldSize = 500.f, maxSpeed = 5.f;
+    std::uniform_real_distribution<float> coord(0.f, worldSize), snorm(-1.f, 1.f), unit(0.f, 1.f);
+    auto randomMover = [&] {
+        return Mover {
+            {coord(rng), 20.f * unit(rng), coord(rng)},
+            maxSpeed * tg::vec3(snorm(rng), .1f * snorm(rng), snorm(rng)),
+            DynamicTree<uint32_t>::NONE
+        };
+    };
+    DynamicTree<uint32_t> tree;
+    std::vector<Mover> movers;
+    for (uint32_t i = 0; i < nObjects; ++i) {
+        auto &m = movers.emplace_back(randomMover());
+        m.proxy = tree.insert(m.aabb(), i);
+    }
+    tree.updatePairs([] (auto, auto) {});
+
+    Samples moveTime, churnTime, pairTime, queryTime, rayTime, rebuildTime;
+    size_t reinserted = 0, pairs = 0, queryHits = 0, missed = 0;
+    std::uniform_int_distribution<size_t> pick(0, nObjects - 1);
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        moveTime.add(timeMicros([&] {
+            for (auto &m : movers) {
+                m.pos += m.vel * dt;
+                for (auto axis : {0, 2}) {  // bounce off the world borders
+                    if (m.pos[axis] < 0.f || m.pos[axis] > worldSize) {m.vel[axis] = -m.vel[axis];}
+                }
+                reinserted += tree.move(m.proxy, m.aabb(), m.vel * dt);
+            }
+        }));
+        // 1% of the objects despawn and are replaced by new ones somewhere else
+        churnTime.add(timeMicros([&] {
+            for (size_t i = 0; i < nObjects / 100; ++i) {
+                auto idx = pick(rng);
+                tree.remove(movers[idx].proxy);
+                movers[idx] = randomMover();
+                movers[idx].proxy = tree.insert(movers[idx].aabb(), idx);
+            }
+        }));
+        pairTime.add(timeMicros([&] {tree.updatePairs([&] (auto, auto) {pairs += 1;});}));
+
+        std::vector<tg::aabb3> boxes;
+        std::vector<tg::ray3> rays;
+        for (size_t i = 0; i < 100; ++i) {
+            auto center = tg::pos3(coord(rng), 10.f, coord(rng));
+            boxes.push_back({center - tg::vec3(5, 10, 5), center + tg::vec3(5, 10, 5)});
+            rays.push_back({center, tg::normalize(tg::vec3(snorm(rng), .05f * snorm(rng), snorm(rng)))});
+        }
+        queryTime.add(timeMicros([&] {
+            for (auto &box : boxes) {tree.query(box, [&] (auto) {queryHits += 1; return true;});}
+        }));
+        rayTime.add(timeMicros([&] {
+            for (auto &ray : rays) {
+                tree.rayCast(ray, 100.f, [&] (auto proxy) {return rayBox(ray, movers[tree.data(proxy)].aabb());});
+            }
+        }));
+
+        if (tick % 10 == 0) {
+            // for comparison: what rebuilding an R* tree every tick would cost
+            RTree<tg::aabb3, TGDomain<3, float>> rstar;
+            rebuildTime.add(timeMicros([&] {
+                for (auto &m : movers) {decltype(rstar)::RStarInserter::insert(rstar, m.aabb());}
+            }));
+            // all objects actually overlapping the query boxes have to be found
+            for (auto &box : boxes) {
+                std::vector<bool> found(nObjects);
+                tree.query(box, [&] (auto proxy) {found[tree.data(proxy)] = true; return true;});
+                for (uint32_t i = 0; i < nObjects; ++i) {
+                    if (tg::intersects(movers[i].aabb(), box) && !found[i]) {missed += 1;}
+                }
+            }
+        }
+    }
+    glow::info() << "dynamic tree, " << nObjects << " objects, " << ticks << " ticks, height " << tree.height() << (tree.validate() ? "" : " INVALID");
+    glow::info() << "  move all: mean " << moveTime.mean() << "µs, p99 " << moveTime.percentile(.99) << "µs (" << float(reinserted) / ticks << " reinsertions per tick)";
+    glow::info() << "  churn 1%: mean " << churnTime.mean() << "µs, p99 " << churnTime.percentile(.99) << "µs";
+    glow::info() << "  pairs: mean " << pairTime.mean() << "µs, p99 " << pairTime.percentile(.99) << "µs (" << float(pairs) / ticks << " per tick)";
+    glow::info() << "  100 box queries: mean " << queryTime.mean() << "µs (" << float(queryHits) / ticks << " hits per tick), " << missed << " missed";
+    glow::info() << "  100 rays: mean " << rayTime.mean() << "µs, p99 " << rayTime.percentile(.99) << "µs";
+    glow::info() << "  R* rebuild for comparison: mean " << rebuildTime.mean() << "µs";
+}
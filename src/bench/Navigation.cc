@@ -0,0 +1,1260 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <external/lowbias32.hh>
+
+#include <ECS.hh>
+#include <ECS/Join.hh>
+#include <combat/Combat.hh>
+#include <navmesh/Cache.hh>
+#include <navmesh/NavMesh.hh>
+#include <navmesh/Planner.hh>
+#include <navmesh/Replanner.hh>
+#include <navmesh/SliceScheduler.hh>
+#include <navmesh/Squad.hh>
+#include <obstacles/Collision.hh>
+#include <obstacles/Obstacle.hh>
+#include <terrain/Terrain.hh>
+
+namespace {
+struct Crossing {
+    pm::edge_index edge;
+    uint32_t pos;
+
+    bool operator==(const Crossing &other) const {return edge == other.edge && pos == other.pos;}
+};
+struct CrossingHash {
+    size_t operator()(const Crossing &c) const {return lowbias32(c.pos ^ lowbias32(c.edge.value));}
+};
+}
+
+/// `Instance::navigate` as it was before it ran on `NavMesh::Graph`: the same
+/// search, but on polymesh handles and attributes
+static NavMesh::Route navigateMesh(const NavMesh::Instance &nav, const NavMesh::RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider) {
+    auto faceAABB = [&] (pm::face_handle f) {
+        auto min = nav.worldPos[f.any_vertex()], max = min;
+        for (auto v : f.vertices()) {min = tg::min(nav.worldPos[v], min), max = tg::max(nav.worldPos[v], max);}
+        return tg::aabb3(min, max);
+    };
+    auto end_face = nav.mesh->handle_of(req.end_face);
+    auto start_face = nav.mesh->handle_of(req.start_face);
+    struct CrossInfo {
+        float distance, lowerBound;
+        pm::halfedge_index predecessor;
+        uint32_t predPos;
+    };
+    std::unordered_map<Crossing, CrossInfo, CrossingHash> crossInfo;
+    struct WorkListEntry {
+        float lowerBound;
+        pm::halfedge_index halfedge;
+        uint32_t crossPos;
+        bool operator<(const WorkListEntry &other) const {return lowerBound > other.lowerBound;}
+    };
+    float stepSize = 1.f / nsteps, posBase = stepSize / 2;
+    std::priority_queue<WorkListEntry> workList;
+    collider.collectObjects(faceAABB(end_face));
+    for (auto h : end_face.halfedges()) {
+        if (h.opposite().is_boundary()) {continue;}
+        for (uint32_t i = 0; i < nsteps; ++i) {
+            auto p = nav.edgeLerp(h.edge(), i * stepSize + posBase);
+            auto lowerBound = tg::distance(req.end, p);
+            auto dist = tg::distance(p, req.start);
+            if (collider.segmentObstructed(tg::segment3(p, req.end))) {continue;}
+            crossInfo.emplace(Crossing({h.edge(), i}), CrossInfo({dist, lowerBound, {}, 0}));
+            workList.push({lowerBound + dist, h, i});
+        }
+    }
+    pm::halfedge_handle best_he;
+    uint32_t bestPos = 0;
+    while (!workList.empty()) {
+        auto top = workList.top();
+        workList.pop();
+        auto he = nav.mesh->handle_of(top.halfedge);
+        auto &info = crossInfo[{he.edge(), top.crossPos}];
+        if (top.lowerBound > info.lowerBound + info.distance) {continue;}
+        auto p = nav.edgeLerp(he.edge(), stepSize * top.crossPos + posBase);
+        collider.collectObjects(faceAABB(he.opposite().face()));
+        if (he.opposite_face() == start_face && !collider.segmentObstructed(tg::segment3(req.start, p))) {
+            best_he = he;
+            bestPos = top.crossPos;
+            break;
+        }
+        for (auto h = he.opposite().next(); h != he.opposite(); h = h.next()) {
+            if (h.opposite().is_boundary()) {continue;}
+            for (uint32_t i = 0; i < nsteps; ++i) {
+                Crossing crossing_ = {h.edge(), i};
+                auto p_ = nav.edgeLerp(h.edge(), i * stepSize + posBase);
+                if (collider.segmentObstructed(tg::segment3(p_, p))) {continue;}
+                auto lowerBound = info.lowerBound + tg::distance(p, p_);
+                auto iter = crossInfo.find(crossing_);
+                if (iter == crossInfo.end()) {
+                    auto dist = tg::distance(p_, req.start);
+                    crossInfo.emplace(crossing_, CrossInfo({dist, lowerBound, he, top.crossPos}));
+                    workList.push({lowerBound + dist, h, i});
+                } else if (iter->second.lowerBound > lowerBound) {
+                    iter->second.lowerBound = lowerBound;
+                    iter->second.predecessor = he;
+                    iter->second.predPos = top.crossPos;
+                    workList.push({lowerBound + iter->second.distance, h, i});
+                }
+            }
+        }
+    }
+    NavMesh::Route res;
+    while (best_he.is_valid()) {
+        auto pos = bestPos;
+        if (best_he.edge().vertexA() != best_he.vertex_to()) {pos = nsteps - 1 - pos;}
+        res.push_back({best_he.opposite().idx, pos * stepSize + posBase});
+        auto &info = crossInfo[{best_he.edge(), bestPos}];
+        best_he = nav.mesh->handle_of(info.predecessor);
+        bestPos = info.predPos;
+    }
+    return res;
+}
+
+static float routeLength(const NavMesh::Instance &nav, const NavMesh::RouteRequest &req, const NavMesh::Route &route) {
+    auto prev = req.start;
+    float res = 0.f;
+    for (auto [heIdx, param] : route) {
+        auto he = nav.mesh->handle_of(heIdx);
+        auto p = tg::lerp(nav.worldPos[he.vertex_from()], nav.worldPos[he.vertex_to()], param);
+        res += tg::distance(prev, p);
+        prev = p;
+    }
+    return res + tg::distance(prev, req.end);
+}
+
+static tg::pos3 faceCentroid(const NavMesh::Instance &nav, pm::face_index f) {
+    auto sum = tg::vec3::zero;
+    for (auto v : nav.mesh->handle_of(f).vertices()) {sum += tg::vec3(nav.worldPos[v]);}
+    return tg::pos3(sum / 3.f);
+}
+
+void Bench::navigateRoutes(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t nsteps = 5;  // what `MobileUnit::planRoute` uses
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        auto centroid = [&] (pm::face_index f) {return faceCentroid(nav, f);};
+        constexpr auto inf = std::numeric_limits<float>::infinity();
+        tg::aabb3 bounds = {{inf, inf, inf}, {-inf, -inf, -inf}};
+        for (auto v : nav.mesh->vertices()) {
+            bounds.min = tg::min(bounds.min, nav.worldPos[v]);
+            bounds.max = tg::max(bounds.max, nav.worldPos[v]);
+        }
+        auto extent = tg::length(tg::vec3(bounds.max.x - bounds.min.x, 0, bounds.max.z - bounds.min.z));
+        glow::info() << "navigate on navmesh " << id << " (" << nfaces << " faces)";
+
+        auto run = [&] (const char *name, float minDist) {
+            Samples before, after, corridor, lengthRatio;
+            size_t found = 0, mismatches = 0, expanded = 0, scratch = 0;
+            size_t corridorFound = 0, corridorExpanded = 0, fallbacks = 0;
+            for (size_t i = 0; i < nQueries; ++i) {
+                NavMesh::RouteRequest req;
+                do {
+                    req.start_face = pm::face_index(faceDistr(rng));
+                    req.end_face = pm::face_index(faceDistr(rng));
+                    req.start = centroid(req.start_face);
+                    req.end = centroid(req.end_face);
+                } while (req.start_face == req.end_face || tg::distance(req.start, req.end) < minDist);
+
+                NavMesh::Route a, b, c;
+                {
+                    Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                    before.add(timeMicros([&] {a = navigateMesh(nav, req, nsteps, collider);}));
+                }
+                {
+                    Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                    after.add(timeMicros([&] {b = nav.navigate(req, nsteps, collider);}));
+                }
+                expanded += nav.lastSearch.expanded;
+                scratch = std::max(scratch, nav.lastSearch.scratchBytes);
+                {
+                    Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                    corridor.add(timeMicros([&] {c = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Corridor);}));
+                }
+                corridorExpanded += nav.lastSearch.expanded;
+                fallbacks += nav.lastSearch.fellBack;
+                found += !b.empty();
+                corridorFound += !c.empty();
+                if (a.empty() != b.empty()) {
+                    mismatches += 1;
+                } else if (!a.empty()) {
+                    auto lenA = routeLength(nav, req, a), lenB = routeLength(nav, req, b);
+                    if (std::abs(lenA - lenB) > 1e-3f * lenA) {mismatches += 1;}
+                }
+                if (!b.empty() && !c.empty()) {
+                    lengthRatio.add(routeLength(nav, req, c) / routeLength(nav, req, b));
+                }
+            }
+            glow::info() << name << ": " << nQueries << " queries, " << found << " routes found, " << mismatches << " mismatches";
+            glow::info() << "  polymesh, hash map: mean " << before.mean() << "µs, p50 " << before.percentile(.5) << "µs, p99 " << before.percentile(.99) << "µs";
+            glow::info() << "  graph, dense:       mean " << after.mean() << "µs, p50 " << after.percentile(.5) << "µs, p99 " << after.percentile(.99) << "µs";
+            glow::info() << "  " << float(expanded) / nQueries << " crossings expanded per query, " << nQueries / (after.sum() * 1e-6) << " queries/s, " << scratch / 1024 << " KiB search memory per thread";
+            glow::info() << "  corridor + funnel:  mean " << corridor.mean() << "µs, p50 " << corridor.percentile(.5) << "µs, p99 " << corridor.percentile(.99) << "µs";
+            glow::info() << "  " << float(corridorExpanded) / nQueries << " nodes expanded per query, " << corridorFound << " routes found (" << fallbacks << " via fallback), length vs. crossings: mean " << lengthRatio.mean() << ", p99 " << lengthRatio.percentile(.99);
+        };
+        run("random routes", 0.f);
+        // cross-island orders are the ones that hurt
+        run("long routes", .5f * extent);
+    }
+}
+
+void Bench::hierarchicalRoutes(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t nsteps = 5;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        glow::info() << "hierarchical search on navmesh " << id << " (" << nfaces << " faces)";
+
+        nav.hierarchy.reset();
+        {
+            Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+            auto micros = timeMicros([&] {nav.updateHierarchy(collider);});
+            auto &hier = *nav.hierarchy;
+            glow::info() << "  build: " << micros / 1000 << "ms, " << hier.clusters.size() << " clusters, " << hier.entrances.size() << " entrances, " << hier.memoryBytes() / 1024 << " KiB";
+        }
+
+        Samples corridor, hierarchical, lengthRatio;
+        size_t corridorFound = 0, found = 0, mismatches = 0, corridorExpanded = 0, expanded = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+
+            NavMesh::Route a, b;
+            {
+                Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                corridor.add(timeMicros([&] {a = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Corridor);}));
+            }
+            corridorExpanded += nav.lastSearch.expanded;
+            {
+                Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                hierarchical.add(timeMicros([&] {b = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Hierarchical);}));
+            }
+            expanded += nav.lastSearch.expanded;
+            corridorFound += !a.empty();
+            found += !b.empty();
+            if (a.empty() != b.empty()) {
+                mismatches += 1;
+            } else if (!a.empty()) {
+                lengthRatio.add(routeLength(nav, req, b) / routeLength(nav, req, a));
+            }
+        }
+        glow::info() << "  " << nQueries << " queries, " << corridorFound << " / " << found << " routes found, " << mismatches << " mismatches";
+        glow::info() << "  corridor:     mean " << corridor.mean() << "µs, p50 " << corridor.percentile(.5) << "µs, p99 " << corridor.percentile(.99) << "µs, " << float(corridorExpanded) / nQueries << " nodes expanded per query";
+        glow::info() << "  hierarchical: mean " << hierarchical.mean() << "µs, p50 " << hierarchical.percentile(.5) << "µs, p99 " << hierarchical.percentile(.99) << "µs, " << float(expanded) / nQueries << " nodes expanded per query";
+        glow::info() << "  length vs. corridor: mean " << lengthRatio.mean() << ", p99 " << lengthRatio.percentile(.99);
+
+        // an obstacle appearing somewhere: only the clusters around it are recomputed
+        Samples rebuild;
+        auto before = nav.hierarchy->rebuiltClusters;
+        constexpr size_t nChanges = 20;
+        for (size_t i = 0; i < nChanges; ++i) {
+            auto center = faceCentroid(nav, pm::face_index(faceDistr(rng)));
+            nav.editHierarchy().invalidate({center - tg::vec3(1, 1, 1), center + tg::vec3(1, 1, 1)});
+            Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+            rebuild.add(timeMicros([&] {nav.updateHierarchy(collider);}));
+        }
+        glow::info() << "  incremental update: mean " << rebuild.mean() << "µs, " << float(nav.hierarchy->rebuiltClusters - before) / nChanges << " clusters per change";
+    }
+}
+
+void Bench::landmarkHeuristic(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t nsteps = 5;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        auto micros = timeMicros([&] {nav.landmarks = std::make_shared<const NavMesh::Landmarks>(NavMesh::Landmarks::build(*nav.graph));});
+        glow::info() << "landmarks on navmesh " << id << " (" << nfaces << " faces): " << nav.landmarks->count << " landmarks, built in " << micros / 1000 << "ms, " << nav.landmarks->memoryBytes() / 1024 << " KiB";
+
+        auto wasEnabled = nav.landmarkHeuristic;
+        Samples plain, alt;
+        size_t plainExpanded = 0, altExpanded = 0, mismatches = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+
+            NavMesh::Route a, b;
+            nav.landmarkHeuristic = false;
+            {
+                Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                plain.add(timeMicros([&] {a = nav.navigateCorridor(req, collider);}));
+            }
+            plainExpanded += nav.lastSearch.expanded;
+            nav.landmarkHeuristic = true;
+            {
+                Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                alt.add(timeMicros([&] {b = nav.navigateCorridor(req, collider);}));
+            }
+            altExpanded += nav.lastSearch.expanded;
+            if (a.empty() != b.empty()) {
+                mismatches += 1;
+            } else if (!a.empty()) {
+                // ties may be broken differently, so only longer routes count
+                auto lenA = routeLength(nav, req, a), lenB = routeLength(nav, req, b);
+                if (lenB > lenA * 1.01f) {mismatches += 1;}
+            }
+        }
+        nav.landmarkHeuristic = wasEnabled;
+        glow::info() << "  corridor search, " << nQueries << " queries, " << mismatches << " longer with landmarks";
+        glow::info() << "  straight line: mean " << plain.mean() << "µs, p99 " << plain.percentile(.99) << "µs, " << float(plainExpanded) / nQueries << " faces expanded per query";
+        glow::info() << "  landmarks:     mean " << alt.mean() << "µs, p99 " << alt.percentile(.99) << "µs, " << float(altExpanded) / nQueries << " faces expanded per query";
+    }
+}
+
+void Bench::reachability(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        glow::info() << "reachability on navmesh " << id << " (" << nfaces << " faces, " << nav.graph->numComponents << " components, hierarchy " << (nav.hierarchy && nav.hierarchy->regionsValid ? "built" : "missing") << ")";
+
+        Samples check, search, rejected, suggest;
+        size_t nUnreachable = 0, wrong = 0, badSuggestions = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+
+            bool ok = true;
+            check.add(timeMicros([&] {ok = nav.reachable(req.start_face, req.end_face);}));
+            NavMesh::Route route;
+            {
+                // what unreachable queries cost without the check
+                Obstacle::Collider collider(ecs, {0, 1.8f, 0}, .5f);
+                auto micros = timeMicros([&] {route = nav.navigateCorridor(req, collider);});
+                (ok ? search : rejected).add(micros);
+            }
+            if (!ok && !route.empty()) {wrong += 1;}
+            if (ok) {continue;}
+            nUnreachable += 1;
+            std::optional<std::pair<pm::face_index, tg::pos3>> nearest;
+            suggest.add(timeMicros([&] {nearest = nav.nearestReachable(req.start_face, req.end);}));
+            if (!nearest || !nav.reachable(req.start_face, nearest->first)) {badSuggestions += 1;}
+        }
+        glow::info() << "  " << nQueries << " queries, " << nUnreachable << " unreachable, " << wrong << " wrongly rejected, " << badSuggestions << " bad suggestions";
+        glow::info() << "  check: mean " << check.mean() << "µs, p99 " << check.percentile(.99) << "µs";
+        glow::info() << "  corridor search on reachable: mean " << search.mean() << "µs, on unreachable: mean " << rejected.mean() << "µs, p99 " << rejected.percentile(.99) << "µs";
+        glow::info() << "  nearest reachable point: mean " << suggest.mean() << "µs, p99 " << suggest.percentile(.99) << "µs";
+    }
+}
+
+size_t Bench::routePlanner(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    using NavMesh::Planner;
+    size_t mismatches = 0;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1), priorityDistr(0, 3);
+        glow::info() << "route planner on navmesh " << id << " (" << nfaces << " faces)";
+
+        std::vector<Planner::Request> requests(nQueries);
+        for (auto &req : requests) {
+            do {
+                req.route.start_face = pm::face_index(faceDistr(rng));
+                req.route.end_face = pm::face_index(faceDistr(rng));
+            } while (req.route.start_face == req.route.end_face);
+            req.route.start = faceCentroid(nav, req.route.start_face);
+            req.route.end = faceCentroid(nav, req.route.end_face);
+            req.navId = id;
+            req.height = {0, 1.8f, 0};
+            req.radius = .5f;
+            req.priority = priorityDistr(rng);
+        }
+
+        // what `CommandTool` did before: everything on the main thread
+        Samples sync;
+        std::vector<NavMesh::Route> expected;
+        for (auto &req : requests) {
+            Obstacle::Collider collider(ecs, req.height, req.radius);
+            sync.add(timeMicros([&] {expected.push_back(nav.navigate(req.route, req.nsteps, collider, req.mode));}));
+        }
+
+        // no workers: two runs have to deliver the same routes in the same order
+        std::vector<Planner::Ticket> order[2];
+        size_t routeMismatches = 0;
+        for (auto &run : order) {
+            Planner planner(0);
+            std::vector<Planner::Ticket> tickets;
+            for (auto &req : requests) {
+                tickets.push_back(planner.submit(ecs, req, [&] (const Planner::Result &res) {
+                    run.push_back(res.ticket);
+                    auto idx = std::find(tickets.begin(), tickets.end(), res.ticket) - tickets.begin();
+                    if (res.route != expected[idx]) {routeMismatches += 1;}
+                }));
+            }
+            planner.tick(ecs);
+        }
+        auto orderMismatches = size_t(order[0] != order[1]) + size_t(!std::is_sorted(order[0].begin(), order[0].end()));
+
+        // cancelling every third request, and resubmitting for the same owner
+        size_t wronglyDelivered = 0, delivered = 0;
+        {
+            Planner planner(0);
+            std::vector<Planner::Ticket> cancelled;
+            for (size_t i = 0; i < requests.size(); ++i) {
+                auto req = requests[i];
+                if (i % 10 == 1) {req.owner = 1;}  // each cancels the one before
+                auto ticket = planner.submit(ecs, req, [&] (const Planner::Result &res) {
+                    delivered += 1;
+                    if (std::find(cancelled.begin(), cancelled.end(), res.ticket) != cancelled.end()) {wronglyDelivered += 1;}
+                });
+                if (i % 3 == 0 && planner.cancel(ticket)) {cancelled.push_back(ticket);}
+            }
+            planner.tick(ecs);
+        }
+
+        // workers: the main thread only pays for submitting and for the ticks
+        Samples submit, tick;
+        size_t threadMismatches = 0, ticks = 0, received = 0;
+        auto wall = timeMicros([&] {
+            Planner planner(4);
+            std::vector<Planner::Ticket> tickets;
+            for (auto &req : requests) {
+                submit.add(timeMicros([&] {
+                    tickets.push_back(planner.submit(ecs, req, [&] (const Planner::Result &res) {
+                        received += 1;
+                        auto idx = std::find(tickets.begin(), tickets.end(), res.ticket) - tickets.begin();
+                        if (res.route != expected[idx]) {threadMismatches += 1;}
+                    }));
+                }));
+            }
+            while (received < requests.size()) {
+                tick.add(timeMicros([&] {planner.tick(ecs);}));
+                ticks += 1;
+                std::this_thread::sleep_for(std::chrono::microseconds(500));
+            }
+        });
+        glow::info() << "  " << nQueries << " queries, " << routeMismatches << " route mismatches, " << orderMismatches << " order mismatches without workers";
+        glow::info() << "  cancellation: " << delivered << " delivered, " << wronglyDelivered << " cancelled but delivered";
+        glow::info() << "  synchronous: mean " << sync.mean() << "µs, p99 " << sync.percentile(.99) << "µs, max " << sync.percentile(1.) << "µs on the main thread";
+        glow::info() << "  planner: submit mean " << submit.mean() << "µs, p99 " << submit.percentile(.99) << "µs, tick p99 " << tick.percentile(.99) << "µs, max " << tick.percentile(1.) << "µs";
+        glow::info() << "  planner: " << threadMismatches << " mismatches with 4 workers, all done after " << wall / 1000 << "ms (" << ticks << " ticks), synchronous total " << sync.sum() / 1000 << "ms";
+        mismatches += routeMismatches + orderMismatches + wronglyDelivered + threadMismatches;
+    }
+    return mismatches;
+}
+
+size_t Bench::slicedSearch(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr size_t concurrent = 16;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    size_t total = 0;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        glow::info() << "time-sliced search on navmesh " << id << " (" << nfaces << " faces)";
+
+        std::vector<NavMesh::RouteRequest> requests(nQueries);
+        for (auto &req : requests) {
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+        }
+        Samples whole;
+        std::vector<NavMesh::Route> expected;
+        std::vector<size_t> expectedExpanded;
+        for (auto &req : requests) {
+            Obstacle::Collider collider(ecs, height, radius);
+            whole.add(timeMicros([&] {expected.push_back(nav.navigateCorridor(req, collider));}));
+            expectedExpanded.push_back(nav.lastSearch.expanded);
+        }
+        glow::info() << "  in one go: mean " << whole.mean() << "µs, p99 " << whole.percentile(.99) << "µs, max " << whole.percentile(1.) << "µs";
+
+        auto view = Obstacle::ObstructionView::capture(ecs);
+        auto landmarks = nav.landmarkHeuristic ? nav.landmarks : nullptr;
+        // the same obstacles as `navigateCorridor` sees
+        std::shared_ptr<const NavMesh::Hierarchy> baked = nav.bakedObstacles ? nav.hierarchy : nullptr;
+        for (size_t budget : {16, 64, 256, 1024}) {
+            NavMesh::SliceScheduler scheduler;
+            Samples tick;
+            size_t mismatches = 0, expandedMismatches = 0, ticks = 0, walkable = 0, scratch = 0;
+            for (size_t first = 0; first < nQueries; first += concurrent) {
+                std::vector<std::pair<size_t, NavMesh::SliceScheduler::Id>> batch;
+                for (size_t i = first; i < std::min(nQueries, first + concurrent); ++i) {
+                    batch.emplace_back(i, scheduler.submit(nav.graph, landmarks, view, requests[i], height, radius, baked));
+                }
+                bool firstTick = true;
+                while (scheduler.running() > 0) {
+                    tick.add(timeMicros([&] {scheduler.tick(budget);}));
+                    ticks += 1;
+                    if (firstTick) {
+                        // what units could start walking after one tick
+                        for (auto [i, query] : batch) {
+                            auto partial = scheduler.route(query);
+                            if (partial->complete ? !partial->route.empty() : partial->req.end_face != partial->req.start_face && !partial->route.empty()) {walkable += 1;}
+                        }
+                        firstTick = false;
+                    }
+                }
+                for (auto [i, query] : batch) {
+                    auto status = *scheduler.status(query);
+                    auto route = status == NavMesh::CorridorStatus::Found ? scheduler.route(query)->route : NavMesh::Route();
+                    if (route != expected[i]) {mismatches += 1;}
+                    if (scheduler.stats(query)->expanded != expectedExpanded[i]) {expandedMismatches += 1;}
+                    scratch = std::max(scratch, scheduler.stats(query)->scratchBytes);
+                    scheduler.remove(query);
+                }
+            }
+            glow::info() << "  budget " << budget << ": " << mismatches << " route mismatches, " << expandedMismatches << " expansion count mismatches, "
+                << float(ticks) * concurrent / nQueries << " ticks per batch of " << concurrent << ", " << walkable << " walkable after the first tick";
+            glow::info() << "    tick: mean " << tick.mean() << "µs, p99 " << tick.percentile(.99) << "µs, max " << tick.percentile(1.) << "µs, at most " << scratch / 1024 << "KiB per query";
+            total += mismatches + expandedMismatches;
+        }
+    }
+    return total;
+}
+
+void Bench::flowField(ECS::ECS &ecs, std::mt19937 &rng, size_t nUnits) {
+    constexpr uint32_t nsteps = 5;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        glow::info() << "flow field on navmesh " << id << " (" << nfaces << " faces), " << nUnits << " units to one goal";
+        {
+            Obstacle::Collider collider(ecs, height, radius);
+            nav.updateHierarchy(collider);
+        }
+
+        auto goalFace = pm::face_index(faceDistr(rng));
+        auto goal = faceCentroid(nav, goalFace);
+        std::vector<NavMesh::RouteRequest> requests;
+        while (requests.size() < nUnits) {
+            NavMesh::RouteRequest req;
+            req.start_face = pm::face_index(faceDistr(rng));
+            if (req.start_face == goalFace || !nav.reachable(req.start_face, goalFace)) {continue;}
+            req.start = faceCentroid(nav, req.start_face);
+            req.end_face = goalFace;
+            req.end = goal;
+            requests.push_back(req);
+        }
+
+        // what `planRoute` does for each unit
+        std::vector<NavMesh::Route> searched;
+        auto searchMicros = timeMicros([&] {
+            for (auto &req : requests) {
+                Obstacle::Collider collider(ecs, height, radius);
+                searched.push_back(nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Hierarchical));
+            }
+        });
+
+        // one field for everyone, searching only where it doesn't lead to the goal
+        nav.flowFields.clear();
+        std::shared_ptr<const NavMesh::FlowField> field;
+        double buildMicros;
+        {
+            Obstacle::Collider collider(ecs, height, radius);
+            buildMicros = timeMicros([&] {field = nav.flowField(goalFace, collider);});
+        }
+        Samples follow, lengthRatio;
+        size_t fallbacks = 0, found = 0, searchFound = 0;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            auto &req = requests[i];
+            Obstacle::Collider collider(ecs, height, radius);
+            NavMesh::Route route;
+            follow.add(timeMicros([&] {
+                route = nav.flowRoute(*field, req, collider);
+                if (route.empty()) {
+                    fallbacks += 1;
+                    route = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Hierarchical);
+                }
+            }));
+            found += !route.empty();
+            searchFound += !searched[i].empty();
+            if (!route.empty() && !searched[i].empty()) {
+                lengthRatio.add(routeLength(nav, req, route) / routeLength(nav, req, searched[i]));
+            }
+        }
+        glow::info() << "  per-unit searches: " << searchMicros / 1000 << "ms, " << searchFound << " routes found";
+        glow::info() << "  flow field: built in " << buildMicros / 1000 << "ms (" << field->memoryBytes() / 1024 << " KiB), following "
+            << follow.sum() / 1000 << "ms (mean " << follow.mean() << "µs, p99 " << follow.percentile(.99) << "µs), " << found << " routes found, "
+            << fallbacks << " fell back to searching";
+        glow::info() << "  speedup " << searchMicros / (buildMicros + follow.sum()) << "x, length vs. search: mean " << lengthRatio.mean() << ", p99 " << lengthRatio.percentile(.99);
+
+        // a few more goals than the cache holds, in a skewed order
+        nav.flowFields.clear();
+        nav.flowFields.hits = nav.flowFields.misses = 0;
+        std::vector<pm::face_index> goals;
+        for (int i = 0; i < 24; ++i) {goals.push_back(pm::face_index(faceDistr(rng)));}
+        std::geometric_distribution<int> goalDistr(.15);
+        Samples lookup;
+        for (int i = 0; i < 200; ++i) {
+            auto target = goals[std::min(goals.size() - 1, size_t(goalDistr(rng)))];
+            Obstacle::Collider collider(ecs, height, radius);
+            lookup.add(timeMicros([&] {nav.flowField(target, collider);}));
+        }
+        glow::info() << "  cache: " << nav.flowFields.hits << " hits, " << nav.flowFields.misses << " misses, lookup p50 " << lookup.percentile(.5) << "µs, p99 " << lookup.percentile(.99) << "µs";
+    }
+}
+
+void Bench::bakedObstacles(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t nsteps = 5;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto &g = *nav.graph;
+        auto nfaces = nav.mesh->faces().size();
+        std::uniform_int_distribution<int> faceDistr(0, int(nfaces) - 1);
+        glow::info() << "baked obstacles on navmesh " << id << " (" << nfaces << " faces)";
+        nav.hierarchy.reset();
+        {
+            Obstacle::Collider collider(ecs, height, radius);
+            auto micros = timeMicros([&] {nav.updateHierarchy(collider);});
+            glow::info() << "  baked in " << micros / 1000 << "ms";
+        }
+
+        // the baked bits against the collision queries they stand in for
+        size_t checked = 0, blocked = 0, disagreements = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            auto f = uint32_t(faceDistr(rng));
+            auto &links = g.faces[f];
+            Obstacle::Collider collider(ecs, height, radius);
+            collider.collectObjects(g.faceAABB(f));
+            for (int a = 0; a < 3; ++a) {
+                for (int b = 0; b < 3; ++b) {
+                    if (a == b) {continue;}
+                    auto from = g.edgeMid[NavMesh::Graph::edgeOf(links.halfedge[a])], to = g.edgeMid[NavMesh::Graph::edgeOf(links.halfedge[b])];
+                    bool live = collider.segmentObstructed(tg::segment3(from, to));
+                    checked += 1;
+                    blocked += live;
+                    disagreements += live != nav.hierarchy->blocked(f, a, b);
+                }
+            }
+        }
+        glow::info() << "  " << checked << " sampled segments, " << blocked << " obstructed, " << disagreements << " disagreements";
+
+        auto wasEnabled = nav.bakedObstacles;
+        Samples live, baked;
+        size_t liveTests = 0, bakedTests = 0, mismatches = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+
+            NavMesh::Route a, b;
+            nav.bakedObstacles = false;
+            {
+                Obstacle::Collider collider(ecs, height, radius);
+                live.add(timeMicros([&] {a = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Corridor);}));
+                liveTests += collider.query.nObstructionTests;
+            }
+            nav.bakedObstacles = true;
+            {
+                Obstacle::Collider collider(ecs, height, radius);
+                baked.add(timeMicros([&] {b = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Corridor);}));
+                bakedTests += collider.query.nObstructionTests;
+            }
+            if (a != b) {mismatches += 1;}
+        }
+        nav.bakedObstacles = wasEnabled;
+        glow::info() << "  corridor search, " << nQueries << " queries, " << mismatches << " routes differ";
+        glow::info() << "  collision queries: mean " << live.mean() << "µs, p99 " << live.percentile(.99) << "µs, " << float(liveTests) / nQueries << " obstruction tests per query";
+        glow::info() << "  baked:             mean " << baked.mean() << "µs, p99 " << baked.percentile(.99) << "µs, " << float(bakedTests) / nQueries << " obstruction tests per query";
+    }
+}
+
+size_t Bench::pointLocation(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    size_t mismatches = 0;
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.heightfield) {continue;}
+        auto nfaces = nav.mesh->faces().size();
+        glow::info() << "point location on navmesh " << id << " (" << nfaces << " faces)";
+        constexpr auto inf = std::numeric_limits<float>::infinity();
+        tg::aabb3 bounds = {{inf, inf, inf}, {-inf, -inf, -inf}};
+        for (auto v : nav.mesh->vertices()) {
+            bounds.min = tg::min(bounds.min, nav.worldPos[v]);
+            bounds.max = tg::max(bounds.max, nav.worldPos[v]);
+        }
+        // a margin around the mesh, so some points are off the grid and some over water
+        std::uniform_real_distribution<float> xDistr(bounds.min.x - 10, bounds.max.x + 10), yDistr(bounds.min.y - 2, bounds.max.y + 2), zDistr(bounds.min.z - 10, bounds.max.z + 10);
+
+        Samples grid, tree, gridAt, treeAt;
+        size_t closestMismatches = 0, treeMismatches = 0, faceMismatches = 0, within = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            tg::pos3 pos = {xDistr(rng), yDistr(rng), zDistr(rng)};
+            std::optional<std::pair<pm::face_index, float>> a, b;
+            grid.add(timeMicros([&] {a = nav.closestPoint(pos);}));
+            tree.add(timeMicros([&] {b = nav.closestPointTree(pos);}));
+            // the exact answer, from every face
+            auto best = inf;
+            for (auto f : nav.mesh->faces()) {best = std::min(best, nav.distanceTo(f, pos));}
+            if (!a || std::abs(a->second - best) > 1e-4f) {closestMismatches += 1;}
+            if (best <= 1.f) {
+                within += 1;
+                if (!b || std::abs(b->second - best) > 1e-4f) {treeMismatches += 1;}
+            }
+
+            std::optional<pm::face_index> c, d;
+            gridAt.add(timeMicros([&] {c = nav.faceAt(pos);}));
+            treeAt.add(timeMicros([&] {d = nav.faceAtTree(pos);}));
+            if (c.has_value() != d.has_value() || (c && *c != *d)) {faceMismatches += 1;}
+        }
+        glow::info() << "  closestPoint, " << nQueries << " points: " << closestMismatches << " mismatches against all faces, tree " << treeMismatches << " of " << within << " within its range";
+        glow::info() << "    grid: mean " << grid.mean() << "µs, p99 " << grid.percentile(.99) << "µs";
+        glow::info() << "    tree: mean " << tree.mean() << "µs, p99 " << tree.percentile(.99) << "µs";
+        glow::info() << "  faceAt: " << faceMismatches << " mismatches";
+        glow::info() << "    grid: mean " << gridAt.mean() << "µs, p99 " << gridAt.percentile(.99) << "µs";
+        glow::info() << "    tree: mean " << treeAt.mean() << "µs, p99 " << treeAt.percentile(.99) << "µs";
+        mismatches += closestMismatches + treeMismatches + faceMismatches;
+    }
+    return mismatches;
+}
+
+void Bench::navmeshCache(ECS::ECS &ecs) {
+    const std::string dir = "navmesh-cache-bench";
+    for (auto &&tup : ECS::Join(ecs.terrains, ecs.simSnap->rigids)) {
+        auto &[terr, wo, id] = tup;
+        glow::info() << "navmesh cache for terrain " << id;
+        double keyMicros;
+        uint64_t key;
+        keyMicros = timeMicros([&] {key = NavMesh::cacheKey(wo, terr);});
+        auto path = NavMesh::cachePath(dir, key);
+        std::error_code err;
+        std::filesystem::remove(path, err);
+
+        std::optional<NavMesh::Instance> built, cold, warm;
+        auto buildMicros = timeMicros([&] {built.emplace(wo, terr);});
+        auto coldMicros = timeMicros([&] {cold.emplace(NavMesh::Instance::cached(wo, terr, dir));});
+        auto warmMicros = timeMicros([&] {warm.emplace(NavMesh::Instance::cached(wo, terr, dir));});
+        glow::info() << "  key: " << keyMicros / 1000 << "ms, file " << std::filesystem::file_size(path, err) / 1024 << " KiB";
+        glow::info() << "  build without cache " << buildMicros / 1000 << "ms, cold (build + write) " << coldMicros / 1000 << "ms, warm (load) " << warmMicros / 1000 << "ms";
+
+        // the loaded navmesh has to be the built one, index for index
+        size_t mismatches = 0;
+        if (!built->graph || !warm->graph) {
+            mismatches += 1;
+        } else {
+            auto &a = *built->graph, &b = *warm->graph;
+            mismatches += a.halfedgeTo != b.halfedgeTo;
+            mismatches += a.halfedgeFace != b.halfedgeFace;
+            mismatches += a.edgeMid != b.edgeMid;
+            mismatches += built->landmarks->dist != warm->landmarks->dist;
+            mismatches += built->heightfield.has_value() != warm->heightfield.has_value();
+            if (built->heightfield && warm->heightfield) {mismatches += built->heightfield->cellFaces != warm->heightfield->cellFaces;}
+            for (auto v : built->mesh->all_vertices()) {mismatches += built->worldPos[v] != warm->worldPos[warm->mesh->handle_of(v.idx)];}
+        }
+        glow::info() << "  " << mismatches << " mismatches between the built and the loaded navmesh";
+
+        // a flipped byte has to be caught, and a stale key has to miss
+        {
+            std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekg(-1, std::ios::end);
+            char c = char(file.get() ^ 0x20);
+            file.seekp(-1, std::ios::end);
+            file.put(c);
+        }
+        bool corruptRejected = !NavMesh::loadCache(path, key, wo);
+        bool staleRejected = !NavMesh::loadCache(path, key + 1, wo);
+        glow::info() << "  corrupt file " << (corruptRejected ? "rejected" : "ACCEPTED") << ", stale key " << (staleRejected ? "rejected" : "ACCEPTED");
+        std::filesystem::remove_all(dir, err);
+    }
+}
+
+/// how `NavMesh::Instance` used to be built: copy the whole terrain, remove
+/// the faces under water and whatever they leave behind, then compact
+static NavMesh::Instance copyRemoveCompactify(const ECS::Rigid &wo, const Terrain::Instance &terrain) {
+    NavMesh::Instance res;
+    res.mesh->copy_from(*terrain.mesh);
+    res.localPos.copy_from(terrain.posAttr);
+    auto xform = wo.transform_mat();
+    for (auto v : res.mesh->all_vertices()) {res.worldPos[v] = tg::pos3(xform * tg::vec4(res.localPos[v], 1));}
+    for (auto f : res.mesh->faces()) {
+        bool keep = false;
+        for (auto v : f.vertices()) {
+            if (res.worldPos[v].y >= terrain.waterLevel) {keep = true;}
+        }
+        if (!keep) {res.mesh->faces().remove(f);}
+    }
+    for (auto e : res.mesh->edges()) {
+        if (e.halfedgeA().is_boundary() && e.halfedgeB().is_boundary()) {res.mesh->edges().remove(e);}
+    }
+    for (auto v : res.mesh->vertices()) {
+        if (v.is_isolated()) {res.mesh->vertices().remove(v);}
+    }
+    res.mesh->compactify();
+    res.canonicalizeMesh();
+    res.buildFaceTree();
+    if (auto graph = NavMesh::Graph::build(*res.mesh, res.worldPos)) {
+        res.graph = std::make_shared<NavMesh::Graph>(std::move(*graph));
+        res.landmarks = std::make_shared<const NavMesh::Landmarks>(NavMesh::Landmarks::build(*res.graph));
+    }
+    res.heightfield = NavMesh::Heightfield::build(res, wo, terrain.segmentsAmount - 1, terrain.segmentSize);
+    return res;
+}
+
+void Bench::navmeshBuild(std::mt19937 &rng) {
+    // where the game puts its terrain
+    ECS::Rigid wo({0, 0, 0}, tg::quat::from_axis_angle(tg::dir3(0, 1, 0), 135_deg));
+    for (uint32_t segments : {200u, 800u}) {
+        Terrain::Instance terr(rng, segments);
+        glow::info() << "navmesh build on a " << segments << "² terrain (" << terr.mesh->faces().size() << " faces)";
+        std::optional<NavMesh::Instance> legacy, direct;
+        auto legacyMicros = timeMicros([&] {legacy.emplace(copyRemoveCompactify(wo, terr));});
+        auto directMicros = timeMicros([&] {direct.emplace(wo, terr);});
+
+        // both have to come out the same, index for index
+        size_t mismatches = 0;
+        auto &a = *legacy, &b = *direct;
+        mismatches += a.mesh->vertices().size() != b.mesh->vertices().size();
+        mismatches += a.mesh->faces().size() != b.mesh->faces().size();
+        if (mismatches == 0) {
+            for (auto v : a.mesh->vertices()) {
+                auto w = b.mesh->handle_of(v.idx);
+                mismatches += a.localPos[v] != b.localPos[w] || a.worldPos[v] != b.worldPos[w];
+            }
+            for (auto f : a.mesh->faces()) {mismatches += NavMesh::canonicalTriangle(f) != NavMesh::canonicalTriangle(b.mesh->handle_of(f.idx));}
+        }
+        mismatches += bool(a.graph) != bool(b.graph);
+        if (a.graph && b.graph) {
+            mismatches += a.graph->halfedgeTo != b.graph->halfedgeTo;
+            mismatches += a.graph->halfedgeFace != b.graph->halfedgeFace;
+            mismatches += a.landmarks->dist != b.landmarks->dist;
+        }
+        mismatches += a.heightfield.has_value() != b.heightfield.has_value();
+        if (a.heightfield && b.heightfield) {mismatches += a.heightfield->cellFaces != b.heightfield->cellFaces;}
+        size_t treeFaces = 0;
+        b.faceTree.visit([] (const tg::aabb3 &, decltype(b.faceTree)::level_t) {return true;}, [&] (const NavMesh::FaceInfo &) {
+            treeFaces += 1;
+            return true;
+        });
+        mismatches += treeFaces != b.mesh->faces().size();
+
+        glow::info() << "  " << b.mesh->faces().size() << " faces, " << mismatches << " mismatches";
+        glow::info() << "  copy, remove, compactify: " << legacyMicros / 1000 << "ms";
+        glow::info() << "  direct:                   " << directMicros / 1000 << "ms (" << legacyMicros / directMicros << "x)";
+    }
+}
+
+/// the obstacles in the scene plus `extra`, for obstacle changes that leave the ECS alone
+static std::shared_ptr<const Obstacle::ObstructionView> captureWith(ECS::ECS &ecs, const std::vector<Obstacle::ObstructionView::Object> &extra) {
+    auto res = std::make_shared<Obstacle::ObstructionView>();
+    for (auto &&tup : ECS::Join(ecs.obstacles, ecs.instancedRigids)) {
+        auto &[type, rigid, id] = tup;
+        decltype(res->tree)::RStarInserter::insert(res->tree, {type.worldBounds(rigid), rigid, type.collisionMesh.get()});
+    }
+    for (auto &obj : extra) {decltype(res->tree)::RStarInserter::insert(res->tree, obj);}
+    return res;
+}
+
+void Bench::incrementalReplanning(ECS::ECS &ecs, std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t nsteps = 5;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    if (ecs.obstacles.empty()) {
+        glow::warning() << "incremental replanning needs an obstacle type to place";
+        return;
+    }
+    auto &rock = ecs.obstacles.begin()->second;
+    auto base = captureWith(ecs, {});
+    for (auto &&tup : ECS::Join(ecs.navMeshes, ecs.terrains)) {
+        auto &[nav, terr, id] = tup;
+        if (!nav.graph) {continue;}
+        auto &g = *nav.graph;
+        std::uniform_int_distribution<int> faceDistr(0, int(g.numFaces()) - 1);
+        glow::info() << "incremental replanning on navmesh " << id << " (" << g.numFaces() << " faces)";
+
+        Samples initial, repair, full, corridor, hierarchy;
+        size_t changes = 0, mismatches = 0, restarts = 0, repairExpanded = 0, fullExpanded = 0, memory = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(rng));
+                req.end_face = pm::face_index(faceDistr(rng));
+            } while (req.start_face == req.end_face);
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+            Obstacle::Collider collider(base, height, radius);
+            nav.updateHierarchy(collider);
+            std::optional<NavMesh::Replanner> planner;
+            initial.add(timeMicros([&] {planner.emplace(nav.replanner(req, collider));}));
+            auto route = nav.replan(*planner, collider);
+            if (route.empty()) {continue;}
+            memory += planner->memoryBytes();
+
+            // an obstacle appears on the way, somewhere along the route, and goes away again
+            auto [heIdx, param] = route[std::uniform_int_distribution<size_t>(0, route.size() - 1)(rng)];
+            auto he = uint32_t(heIdx.value);
+            ECS::Rigid rigid(tg::lerp(g.vertex(g.halfedgeTo[NavMesh::Graph::opposite(he)]), g.vertex(g.halfedgeTo[he]), param));
+            auto bounds = rock.worldBounds(rigid);
+            auto blocked = captureWith(ecs, {{bounds, rigid, rock.collisionMesh.get()}});
+            for (auto &view : {blocked, base}) {
+                Obstacle::Collider changed(view, height, radius);
+                nav.editHierarchy().invalidate(bounds);
+                hierarchy.add(timeMicros([&] {nav.updateHierarchy(changed);}));
+                repair.add(timeMicros([&] {nav.replan(*planner, changed);}));
+                repairExpanded += planner->expanded;
+                restarts += planner->restarted;
+
+                std::optional<NavMesh::Replanner> fresh;
+                full.add(timeMicros([&] {
+                    fresh.emplace(nav.replanner(req, changed));
+                    nav.replan(*fresh, changed);
+                }));
+                fullExpanded += fresh->expanded;
+                corridor.add(timeMicros([&] {nav.navigate(req, nsteps, changed, NavMesh::SearchMode::Corridor);}));
+                changes += 1;
+                // the repaired search has to find what searching from scratch finds
+                auto a = planner->cost(), b = fresh->cost();
+                if (std::isinf(a) != std::isinf(b) || (!std::isinf(a) && std::abs(a - b) > 1e-3f * b)) {mismatches += 1;}
+            }
+        }
+        glow::info() << "  " << changes << " obstacle changes on " << changes / 2 << " routes, " << mismatches << " mismatches, " << restarts << " restarts";
+        glow::info() << "  initial search: mean " << initial.mean() << "µs, " << memory / std::max<size_t>(changes / 2, 1) / 1024 << " KiB per route";
+        glow::info() << "  hierarchy update: mean " << hierarchy.mean() << "µs";
+        glow::info() << "  repair:         mean " << repair.mean() << "µs, p99 " << repair.percentile(.99) << "µs, " << float(repairExpanded) / changes << " nodes expanded per change";
+        glow::info() << "  full replan:    mean " << full.mean() << "µs, p99 " << full.percentile(.99) << "µs, " << float(fullExpanded) / changes << " nodes expanded per change";
+        glow::info() << "  corridor search: mean " << corridor.mean() << "µs, p99 " << corridor.percentile(.99) << "µs";
+    }
+}
+
+void Bench::squadOrders(ECS::ECS &ecs, std::mt19937 &rng, size_t nOrders) {
+    constexpr uint32_t nsteps = 5;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f, spacing = 2.f;
+    for (auto &[id, nav] : ecs.navMeshes) {
+        if (!nav.graph) {continue;}
+        auto &g = *nav.graph;
+        std::uniform_int_distribution<int> faceDistr(0, int(g.numFaces()) - 1);
+        glow::info() << "squad orders on navmesh " << id << " (" << g.numFaces() << " faces)";
+        for (size_t squadSize : {5, 20, 100}) {
+            // the units stand in a square, `spacing` apart
+            auto side = size_t(std::ceil(std::sqrt(float(squadSize))));
+            Samples single, squad;
+            size_t orders = 0, units = 0, derived = 0, searched = 0, singleFound = 0, squadFound = 0, compared = 0;
+            double singleLength = 0., squadLength = 0.;
+            for (size_t i = 0; i < nOrders; ++i) {
+                auto center = faceCentroid(nav, pm::face_index(faceDistr(rng)));
+                std::vector<std::pair<pm::face_index, tg::pos3>> starts;
+                for (size_t k = 0; k < squadSize; ++k) {
+                    auto pos = center + spacing * tg::vec3(k % side - (side - 1) / 2.f, 0, k / side - (side - 1) / 2.f);
+                    auto face = nav.faceAt(pos);
+                    auto h = face ? nav.heightAt(nav.mesh->handle_of(*face), pos) : std::nullopt;
+                    if (h) {starts.emplace_back(*face, tg::pos3(pos.x, *h, pos.z));}
+                }
+                if (starts.size() < squadSize) {continue;}  // not all of the square is on the navmesh
+                auto goalFace = pm::face_index(faceDistr(rng));
+                auto goal = faceCentroid(nav, goalFace);
+                Obstacle::Collider collider(ecs, height, radius);
+                nav.updateHierarchy(collider);  // so that neither side pays for building it
+
+                NavMesh::SquadRoutes res;
+                squad.add(timeMicros([&] {res = nav.planSquad(starts, goalFace, goal, nsteps, collider);}));
+                // what ordering each unit on its own costs, to the same places
+                std::vector<NavMesh::Route> routes(starts.size());
+                single.add(timeMicros([&] {
+                    for (size_t j = 0; j < starts.size(); ++j) {
+                        auto &req = res.reqs[j];
+                        if (req.start_face != req.end_face) {routes[j] = nav.navigate(req, nsteps, collider, NavMesh::SearchMode::Hierarchical);}
+                    }
+                }));
+                for (size_t j = 0; j < starts.size(); ++j) {
+                    auto &req = res.reqs[j];
+                    if (req.start_face == req.end_face) {continue;}
+                    singleFound += !routes[j].empty();
+                    squadFound += !res.routes[j].empty();
+                    if (routes[j].empty() || res.routes[j].empty()) {continue;}
+                    singleLength += routeLength(nav, req, routes[j]);
+                    squadLength += routeLength(nav, req, res.routes[j]);
+                    compared += 1;
+                }
+                orders += 1;
+                units += starts.size();
+                derived += res.derived;
+                searched += res.searched;
+            }
+            glow::info() << "  squads of " << squadSize << ": " << orders << " orders, " << units << " units";
+            glow::info() << "    search per unit: mean " << single.mean() << "µs per order, p99 " << single.percentile(.99) << "µs, " << singleFound << " routes found";
+            glow::info() << "    shared corridor: mean " << squad.mean() << "µs per order, p99 " << squad.percentile(.99) << "µs, " << squadFound << " routes found ("
+                << single.mean() / std::max(squad.mean(), 1e-3) << "x)";
+            glow::info() << "    " << derived << " units on the shared corridor, " << searched << " searched on their own; routes "
+                << squadLength / std::max(singleLength, 1e-3) << "x as long where both were found";
+        }
+    }
+}
+
+void Bench::navmeshIslands(std::mt19937 &rng, size_t nQueries) {
+    constexpr uint32_t segments = 40;
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    for (uint32_t side : {1u, 4u, 8u}) {
+        ECS::ECS ecs;
+        NavMesh::System sys(ecs);
+        float tileSize = 0.f;
+        for (uint32_t x = 0; x < side; ++x) {
+            for (uint32_t z = 0; z < side; ++z) {
+                Terrain::Instance terr(rng, segments);
+                // water below the flattened border, so neighbouring islands touch and get portals
+                terr.waterLevel = -1000.f;
+                tileSize = terr.segmentSize * (segments - 1);
+                ecs.navMeshes.emplace(ecs.newEntity(), NavMesh::Instance(ECS::Rigid({x * tileSize, 0, z * tileSize}), terr));
+            }
+        }
+        ecs.navMeshVersion += 1;
+        auto indexMicros = timeMicros([&] {sys.updateIndex();});
+        glow::info() << side * side << " navmesh islands: index and " << sys.portals().size() << " portals built in " << indexMicros / 1000 << "ms";
+
+        std::uniform_real_distribution<float> posDistr(0.f, side * tileSize), tiltDistr(-.3f, .3f);
+        Samples indexed, linear, indexedClosest, linearClosest;
+        size_t rayMismatches = 0, closestMismatches = 0;
+        for (size_t i = 0; i < nQueries; ++i) {
+            tg::ray3 ray = {{posDistr(rng), 50.f, posDistr(rng)}, tg::normalize(tg::vec3(tiltDistr(rng), -1.f, tiltDistr(rng)))};
+            std::optional<std::tuple<ECS::entity, pm::face_index, float>> a, b;
+            indexed.add(timeMicros([&] {a = sys.intersect(ray);}));
+            // what `System::intersect` used to do
+            linear.add(timeMicros([&] {
+                for (auto &[id, nav] : ecs.navMeshes) {
+                    auto hit = nav.intersect(ray);
+                    if (hit && (!b || hit->second < std::get<2>(*b))) {b = {{id, hit->first, hit->second}};}
+                }
+            }));
+            if (a.has_value() != b.has_value() || (a && std::abs(std::get<2>(*a) - std::get<2>(*b)) > 1e-4f)) {rayMismatches += 1;}
+
+            tg::pos3 pos = {posDistr(rng), tiltDistr(rng) * 30.f, posDistr(rng)};
+            std::optional<std::tuple<ECS::entity, pm::face_index, float>> c, d;
+            indexedClosest.add(timeMicros([&] {c = sys.closestPoint(pos);}));
+            linearClosest.add(timeMicros([&] {
+                for (auto &[id, nav] : ecs.navMeshes) {
+                    auto closest = nav.closestPoint(pos);
+                    if (closest && (!d || closest->second < std::get<2>(*d))) {d = {{id, closest->first, closest->second}};}
+                }
+            }));
+            if (c.has_value() != d.has_value() || (c && std::abs(std::get<2>(*c) - std::get<2>(*d)) > 1e-4f)) {closestMismatches += 1;}
+        }
+        glow::info() << "  intersect, " << nQueries << " rays, " << rayMismatches << " mismatches";
+        glow::info() << "    indexed: mean " << indexed.mean() << "µs, p99 " << indexed.percentile(.99) << "µs";
+        glow::info() << "    linear:  mean " << linear.mean() << "µs, p99 " << linear.percentile(.99) << "µs";
+        glow::info() << "  closestPoint, " << closestMismatches << " mismatches";
+        glow::info() << "    indexed: mean " << indexedClosest.mean() << "µs, p99 " << indexedClosest.percentile(.99) << "µs";
+        glow::info() << "    linear:  mean " << linearClosest.mean() << "µs, p99 " << linearClosest.percentile(.99) << "µs";
+
+        // routes between random islands, which have to join up at the portals
+        std::vector<ECS::entity> ids;
+        for (auto &[id, nav] : ecs.navMeshes) {ids.push_back(id);}
+        std::uniform_int_distribution<size_t> navDistr(0, ids.size() - 1);
+        auto randomPlace = [&] {
+            auto id = ids[navDistr(rng)];
+            auto &nav = ecs.navMeshes.at(id);
+            auto face = pm::face_index(std::uniform_int_distribution<int>(0, int(nav.mesh->faces().size()) - 1)(rng));
+            return NavMesh::Place{id, face, faceCentroid(nav, face)};
+        };
+        Samples routes, legs;
+        size_t found = 0, gaps = 0;
+        for (size_t i = 0; i < nQueries / 10; ++i) {
+            auto from = randomPlace(), to = randomPlace();
+            if (from.nav == to.nav && from.face == to.face) {continue;}
+            Obstacle::Collider collider(ecs, height, radius);
+            std::vector<NavMesh::Leg> res;
+            routes.add(timeMicros([&] {res = sys.navigate(from, to, collider);}));
+            if (res.empty()) {continue;}
+            found += 1;
+            legs.add(double(res.size()));
+            for (size_t j = 0; j + 1 < res.size(); ++j) {gaps += tg::distance(res[j].req.end, res[j + 1].req.start) > .1f;}
+        }
+        glow::info() << "  routes: " << found << " of " << routes.values.size() << " found, " << legs.mean() << " legs on average, " << gaps << " gaps between legs";
+        glow::info() << "    mean " << routes.mean() << "µs, p99 " << routes.percentile(.99) << "µs";
+    }
+}
+
+void Bench::craterStorm(std::mt19937 &rng, size_t nImpacts) {
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f, tolerance = 1e-3f;
+    constexpr size_t nUnits = 50;
+    ECS::Rigid wo({0, 0, 0}, tg::quat::from_axis_angle(tg::dir3(0, 1, 0), 135_deg));
+    for (uint32_t segments : {100u, 200u, 400u}) {
+        ECS::ECS ecs;
+        ECS::Snapshot snap;
+        ecs.simSnap = &snap;
+        Terrain::Instance terr(rng, segments);
+        // every face, so that a navmesh rebuilt from the dented terrain has the same faces
+        terr.waterLevel = -1000.f;
+        auto &navItem = *ecs.navMeshes.emplace(ecs.newEntity(), NavMesh::Instance(wo, terr)).first;
+        auto &nav = navItem.second;
+        ecs.navMeshVersion += 1;
+        if (!nav.graph) {continue;}
+        Obstacle::Collider collider(ecs, height, radius);
+        nav.updateHierarchy(collider);
+        auto nFaces = int(nav.graph->numFaces());
+        std::uniform_int_distribution<int> faceDistr(0, nFaces - 1);
+        glow::info() << "crater storm on a " << segments << "² terrain (" << nFaces << " faces)";
+
+        // units walking between random faces, whose routes the craters may cross
+        Combat::MobileUnit mobTempl;
+        mobTempl.cruiseSpeed = 10.f;
+        mobTempl.acceleration = 7.f;
+        mobTempl.radius = radius;
+        mobTempl.heightVector = wo.rotation * height;
+        struct Unit {
+            Combat::MobileUnit mob;
+            /// kept from the unit's first replan on, like `Combat::MobileUnit::replanner`
+            std::optional<NavMesh::Replanner> replanner;
+        };
+        std::vector<Unit> units;
+        for (size_t i = 0; i < nUnits; ++i) {
+            NavMesh::RouteRequest req;
+            req.start_face = pm::face_index(faceDistr(rng));
+            req.end_face = pm::face_index(faceDistr(rng));
+            if (req.start_face == req.end_face) {continue;}
+            req.start = faceCentroid(nav, req.start_face);
+            req.end = faceCentroid(nav, req.end_face);
+            auto mob = mobTempl;
+            if (mob.planRoute(navItem, req, ecs)) {units.push_back({std::move(mob), std::nullopt});}
+        }
+
+        std::uniform_real_distribution<float> radiusDistr(1.f, 3.f);
+        Samples terrain, navmesh, hierarchy, routes, repairs, uploaded, invalidated;
+        size_t started = 0, restarted = 0;
+        for (size_t i = 0; i < nImpacts; ++i) {
+            Terrain::Crater crater = {faceCentroid(nav, pm::face_index(faceDistr(rng))), radiusDistr(rng), .3f};
+            crater.radius = std::max(crater.radius, .75f * terr.segmentSize);  // like `Terrain::System::crater`
+            Terrain::GridRect rect;
+            terrain.add(timeMicros([&] {rect = terr.applyCrater({~wo * crater.center, crater.radius, crater.depth});}));
+            // what `Rendering::updateHeights` uploads, which needs a GL context
+            uploaded.add(rect.empty() ? 0. : double((rect.x1 - rect.x0 + 1) * (rect.z1 - rect.z0 + 1)));
+            std::optional<tg::aabb3> changed;
+            navmesh.add(timeMicros([&] {changed = nav.applyCrater(crater);}));
+            hierarchy.add(timeMicros([&] {nav.updateHierarchy(collider);}));
+            // like `Combat::System::replanCrossing`, to the same destination
+            std::vector<std::pair<Unit *, NavMesh::RouteRequest>> crossing;
+            for (auto &unit : units) {
+                if (!changed || !unit.mob.crosses(*changed, snap.worldTime)) {continue;}
+                NavMesh::RouteRequest req;
+                req.start = unit.mob.knots.front().pos;
+                req.end = unit.mob.knots.back().pos;
+                auto start = nav.closestPoint(req.start), end = nav.closestPoint(req.end);
+                if (!start || !end) {continue;}
+                req.start_face = start->first;
+                req.end_face = end->first;
+                crossing.emplace_back(&unit, req);
+            }
+            invalidated.add(double(crossing.size()));
+            // searching from scratch, on copies
+            std::vector<Combat::MobileUnit> scratch;
+            for (auto &[unit, req] : crossing) {scratch.push_back(unit->mob);}
+            routes.add(timeMicros([&] {
+                for (size_t j = 0; j < crossing.size(); ++j) {scratch[j].planRoute(navItem, crossing[j].second, ecs);}
+            }));
+            // repairing the kept searches, which the game does on the planner's workers
+            repairs.add(timeMicros([&] {
+                for (auto &[unit, req] : crossing) {
+                    if (!unit->replanner) {
+                        unit->replanner.emplace(nav.replanner(req, collider));
+                        started += 1;
+                    } else {
+                        unit->replanner->moveStart(req.start_face, req.start);
+                    }
+                    auto route = nav.replan(*unit->replanner, collider);
+                    restarted += unit->replanner->restarted;
+                    unit->mob.applyRoute(navItem, req, route, ecs);
+                }
+            }));
+        }
+
+        // the refitted navmesh against one built from the dented terrain
+        std::optional<NavMesh::Instance> rebuilt;
+        auto rebuildMicros = timeMicros([&] {rebuilt.emplace(wo, terr);});
+        size_t mismatches = 0;
+        auto &a = nav, &b = *rebuilt;
+        mismatches += a.mesh->vertices().size() != b.mesh->vertices().size();
+        mismatches += a.mesh->faces().size() != b.mesh->faces().size();
+        if (mismatches == 0 && a.graph && b.graph) {
+            for (auto v : a.mesh->vertices()) {
+                auto w = b.mesh->handle_of(v.idx);
+                mismatches += tg::distance(a.worldPos[v], b.worldPos[w]) > tolerance || tg::distance(a.localPos[v], b.localPos[w]) > tolerance;
+                mismatches += std::abs(a.graph->vy[v.idx.value] - b.graph->vy[v.idx.value]) > tolerance;
+            }
+            for (size_t e = 0; e < a.graph->numEdges(); ++e) {
+                mismatches += std::abs(a.graph->edgeLength[e] - b.graph->edgeLength[e]) > tolerance;
+                mismatches += tg::distance(a.graph->edgeMid[e], b.graph->edgeMid[e]) > tolerance;
+            }
+            std::unordered_map<int, tg::aabb3> boxes;
+            b.faceTree.visit([] (const tg::aabb3 &, decltype(b.faceTree)::level_t) {return true;}, [&] (const NavMesh::FaceInfo &info) {
+                boxes[info.idx.value] = info.aabb;
+                return true;
+            });
+            a.faceTree.visit([] (const tg::aabb3 &, decltype(a.faceTree)::level_t) {return true;}, [&] (const NavMesh::FaceInfo &info) {
+                auto iter = boxes.find(info.idx.value);
+                mismatches += iter == boxes.end() || tg::distance(iter->second.min, info.aabb.min) > tolerance || tg::distance(iter->second.max, info.aabb.max) > tolerance;
+                return true;
+            });
+            // the refitted nodes have to contain their faces, or queries would miss them
+            for (uint32_t f = 0; f < a.graph->numFaces(); ++f) {
+                auto aabb = a.graph->faceAABB(f);
+                bool found = false;
+                a.faceTree.visit([&] (const tg::aabb3 &node, decltype(a.faceTree)::level_t) {
+                    return node.min.x <= aabb.min.x && node.min.y <= aabb.min.y && node.min.z <= aabb.min.z
+                        && aabb.max.x <= node.max.x && aabb.max.y <= node.max.y && aabb.max.z <= node.max.z;
+                }, [&] (const NavMesh::FaceInfo &info) {
+                    found = info.idx.value == int(f);
+                    return !found;
+                });
+                mismatches += !found;
+            }
+        }
+        mismatches += a.heightfield.has_value() != b.heightfield.has_value();
+        if (a.heightfield && b.heightfield) {
+            for (size_t level = 0; level < a.heightfield->levels.size(); ++level) {
+                for (size_t j = 0; j < a.heightfield->levels[level].size(); ++j) {
+                    auto &ra = a.heightfield->levels[level][j], &rb = b.heightfield->levels[level][j];
+                    mismatches += std::abs(ra.min - rb.min) > tolerance || std::abs(ra.max - rb.max) > tolerance;
+                }
+            }
+        }
+        glow::info() << "  " << nImpacts << " impacts, " << units.size() << " units, " << mismatches << " mismatches against a rebuild";
+        glow::info() << "    terrain:   mean " << terrain.mean() << "µs, p99 " << terrain.percentile(.99) << "µs, " << uploaded.mean() << " heights uploaded on average";
+        glow::info() << "    navmesh:   mean " << navmesh.mean() << "µs, p99 " << navmesh.percentile(.99) << "µs";
+        glow::info() << "    hierarchy: mean " << hierarchy.mean() << "µs, p99 " << hierarchy.percentile(.99) << "µs";
+        glow::info() << "    routes:    mean " << routes.mean() << "µs, p99 " << routes.percentile(.99) << "µs, " << invalidated.mean() << " replanned on average";
+        glow::info() << "    repaired:  mean " << repairs.mean() << "µs, p99 " << repairs.percentile(.99) << "µs, "
+            << started << " searches started, " << restarted << " restarted (see `NavMesh::Replanner`)";
+        glow::info() << "    rebuilding the navmesh instead: " << rebuildMicros / 1000 << "ms";
+    }
+}
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <cmath>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <ECS.hh>
+#include <ECS/Join.hh>
+#include <Picking.hh>
+#include <combat/Combat.hh>
+#include <navmesh/NavMesh.hh>
+#include <obstacles/WorldFluff.hh>
+
+namespace {
+struct PickStats {
+    Bench::Samples time;
+    size_t hits = 0, mismatches = 0;
+
+    void report(const char *name) {
+        glow::info() << name << ": " << time.values.size() << " rays, " << hits << " object hits, " << mismatches << " mismatches";
+        glow::info() << "  mean " << time.mean() << "µs, p50 " << time.percentile(.5) << "µs, p99 " << time.percentile(.99) << "µs";
+    }
+};
+}
+
+/// what the trees should find, by testing every fluff instance and humanoid
+static Picking::Hit bruteForce(ECS::ECS &ecs, ECS::Snapshot &snap, const tg::ray3 &ray) {
+    Picking::Hit res;
+    if (auto hit = Picking::pickTerrain(ecs, ray, res.distance)) {res = *hit;}
+    if (auto hit = Picking::pickObstacles(ecs, ray, res.distance)) {res = *hit;}
+    for (auto &&tup : ECS::Join(ecs.worldFluffs, ecs.instancedRigids)) {
+        auto &[type, rigid, id] = tup;
+        auto t = Picking::rayOrientedBox(ray, rigid, type.vaoInfo.bounds);
+        if (t && *t < res.distance) {res = {id, *t};}
+    }
+    for (auto &&tup : ECS::Join(snap.humanoids, ecs.mobileUnits)) {
+        auto &[pos, mob, id] = tup;
+        auto base = pos.base.translation;
+        auto t = Picking::rayCapsule(ray, base, base + mob.heightVector, mob.radius);
+        if (t && *t < res.distance) {res = {id, *t};}
+    }
+    if (res.id == ECS::INVALID && !ecs.skyBoxes.empty()) {res.id = ecs.skyBoxes.begin()->first;}
+    return res;
+}
+
+static void pickRay(ECS::ECS &ecs, ECS::Snapshot &snap, const tg::ray3 &ray, PickStats &stats) {
+    Picking::Hit hit;
+    stats.time.add(Bench::timeMicros([&] {hit = Picking::pick(ecs, snap, ray);}));
+    if (!ecs.terrains.count(hit.id)) {stats.hits += 1;}
+    auto ref = bruteForce(ecs, snap, ray);
+    if (hit.id != ref.id && std::abs(hit.distance - ref.distance) > 1e-4f * ref.distance) {stats.mismatches += 1;}
+}
+
+size_t Bench::picking(ECS::ECS &ecs, std::mt19937 &rng, size_t nRays) {
+    auto &snap = *ecs.simSnap;
+    size_t mismatches = 0;
+    glow::info() << "picking scene: " << ecs.obstacles.size() << " obstacles, " << ecs.worldFluffs.size() << " fluff instances, " << snap.humanoids.size() << " humanoids";
+    for (auto &&tup : ECS::Join(ecs.terrains, ecs.navMeshes)) {
+        auto &[terr, nav, id] = tup;
+        auto p0 = nav.worldPos[nav.mesh->vertices().first()];
+        tg::aabb3 bounds = {p0, p0};
+        for (auto v : nav.mesh->vertices()) {
+            bounds.min = tg::min(bounds.min, nav.worldPos[v]);
+            bounds.max = tg::max(bounds.max, nav.worldPos[v]);
+        }
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        auto randomPos = [&] (float ymin, float ymax) {
+            return tg::pos3(
+                tg::lerp(bounds.min.x, bounds.max.x, unit(rng)),
+                tg::lerp(ymin, ymax, unit(rng)),
+                tg::lerp(bounds.min.z, bounds.max.z, unit(rng))
+            );
+        };
+
+        // clicks from a typical camera height
+        PickStats random;
+        for (size_t i = 0; i < nRays; ++i) {
+            auto origin = randomPos(bounds.max.y + 5.f, bounds.max.y + 50.f);
+            auto target = randomPos(bounds.min.y, bounds.max.y);
+            pickRay(ecs, snap, {origin, tg::normalize(target - origin)}, random);
+        }
+        random.report("random picks");
+
+        // worst case: eye-level rays just above the ground, through as much
+        // fluff and as many obstacles as possible before hitting anything
+        PickStats grazing;
+        for (size_t i = 0; i < nRays; ++i) {
+            auto origin = randomPos(bounds.min.y, bounds.max.y);
+            if (auto ground = nav.intersect({origin + tg::vec3(0, 1000, 0), tg::dir3(0, -1, 0)})) {
+                origin.y += 1000.f - ground->second + 1.7f;
+            }
+            auto angle = tg::angle32::from_degree(360.f * unit(rng));
+            auto slope = tg::angle32::from_degree(tg::lerp(-1.f, 1.f, unit(rng)));
+            pickRay(ecs, snap, {origin, tg::normalize(tg::vec3(tg::cos(angle), tg::sin(slope), tg::sin(angle)))}, grazing);
+        }
+        grazing.report("grazing picks");
+        mismatches += random.mismatches + grazing.mismatches;
+    }
+    return mismatches;
+}
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+#include <cmath>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <ECS.hh>
+#include <navmesh/NavMesh.hh>
+
+namespace {
+struct RayStats {
+    Bench::Samples grid, tree;
+    size_t hits = 0, mismatches = 0;
+
+    void report(const char *name) {
+        glow::info() << name << ": " << grid.values.size() << " rays, " << hits << " hits, " << mismatches << " mismatches";
+        glow::info() << "  heightfield: mean " << grid.mean() << "µs, p50 " << grid.percentile(.5) << "µs, p99 " << grid.percentile(.99) << "µs";
+        glow::info() << "  face tree:   mean " << tree.mean() << "µs, p50 " << tree.percentile(.5) << "µs, p99 " << tree.percentile(.99) << "µs";
+    }
+};
+}
+
+static void castRay(const NavMesh::Instance &nav, const tg::ray3 &ray, RayStats &stats) {
+    std::optional<std::pair<pm::face_index, float>> a, b;
+    stats.grid.add(Bench::timeMicros([&] {a = nav.heightfield->intersect(nav, ray);}));
+    stats.tree.add(Bench::timeMicros([&] {b = nav.intersectTree(ray);}));
+    if (a.has_value() != b.has_value()) {
+        stats.mismatches += 1;
+    } else if (a) {
+        stats.hits += 1;
+        if (a->first != b->first && std::abs(a->second - b->second) > 1e-4f * b->second) {stats.mismatches += 1;}
+    }
+}
+
+void Bench::terrainRays(ECS::ECS &ecs, std::mt19937 &rng, size_t nRays) {
+    for (auto &pair : ecs.navMeshes) {
+        auto &[id, nav] = pair;
+        if (!nav.heightfield) {
+            glow::info() << "navmesh " << id << " has no heightfield";
+            continue;
+        }
+        auto p0 = nav.worldPos[nav.mesh->vertices().first()];
+        tg::aabb3 bounds = {p0, p0};
+        for (auto v : nav.mesh->vertices()) {
+            bounds.min = tg::min(bounds.min, nav.worldPos[v]);
+            bounds.max = tg::max(bounds.max, nav.worldPos[v]);
+        }
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        auto randomPos = [&] (float ymin, float ymax) {
+            return tg::pos3(
+                tg::lerp(bounds.min.x, bounds.max.x, unit(rng)),
+                tg::lerp(ymin, ymax, unit(rng)),
+                tg::lerp(bounds.min.z, bounds.max.z, unit(rng))
+            );
+        };
+
+        RayStats random;
+        for (size_t i = 0; i < nRays; ++i) {
+            auto origin = randomPos(bounds.max.y + 20.f, bounds.max.y + 100.f);
+            auto target = randomPos(bounds.min.y, bounds.max.y);
+            castRay(nav, {origin, tg::normalize(target - origin)}, random);
+        }
+        random.report("random rays");
+
+        // almost horizontal rays starting just above the ground: these have to
+        // walk a long way through the grid and are the worst case for the pyramid
+        RayStats grazing;
+        std::uniform_int_distribution<int> faceDistr(0, int(nav.mesh->faces().size()) - 1);
+        for (size_t i = 0; i < nRays; ++i) {
+            auto f = nav.mesh->handle_of(pm::face_index(faceDistr(rng)));
+            auto sum = tg::vec3::zero;
+            size_t n = 0;
+            for (auto v : f.vertices()) {sum += tg::vec3(nav.worldPos[v]); n += 1;}
+            auto angle = tg::angle32::from_degree(360.f * unit(rng));
+            auto slope = tg::angle32::from_degree(tg::lerp(-2.f, 2.f, unit(rng)));
+            auto dir = tg::normalize(tg::vec3(tg::cos(angle), tg::sin(slope), tg::sin(angle)));
+            auto origin = tg::pos3(sum / n) + tg::vec3(0, .5f, 0) - 50.f * dir;
+            castRay(nav, {origin, dir}, grazing);
+        }
+        grazing.report("grazing rays");
+    }
+}
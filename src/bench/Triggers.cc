@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+#include "Bench.hh"
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <ECS.hh>
+#include <ECS/Misc.hh>
+#include <combat/Combat.hh>
+#include <environment/Parrot.hh>
+#include <trigger/Trigger.hh>
+
+void Bench::parrotTriggers(std::mt19937 &rng, size_t nParrots, size_t nHumanoids, size_t ticks) {
+    constexpr float dt = 1.f / 60, worldSize = 800.f, frightenDist = 10.f, speed = 5.f;
+    std::uniform_real_distribution<float> coord(0.f, worldSize), snorm(-1.f, 1.f);
+    // headless ECS: no systems, we only fill in the components the trigger system looks at
+    ECS::ECS ecs;
+    ECS::Snapshot snaps[2];
+    Trigger::System triggers(ecs);
+
+    std::vector<ECS::entity> parrots, humanoids;
+    std::vector<tg::pos3> parrotPos;
+    for (size_t i = 0; i < nParrots; ++i) {
+        auto id = ecs.nextEntity++, vol = ecs.nextEntity++;
+        tg::pos3 pos(coord(rng), 0, coord(rng));
+        ecs.riggedRigids.emplace(id, ECS::Rigid(pos));
+        ecs.parrots.emplace(id, Parrot::Instance()).first->second.trigger = vol;
+        ecs.triggers.emplace(vol, Trigger::Volume::cylinder(id, pos, frightenDist, 50.f));
+        parrots.push_back(id);
+        parrotPos.push_back(pos);
+    }
+    Combat::MobileUnit mobTempl;
+    mobTempl.radius = .5f;
+    mobTempl.heightVector = {0, 1.8f, 0};
+    std::vector<tg::vec3> velocities;
+    for (size_t i = 0; i < nHumanoids; ++i) {
+        auto id = ecs.nextEntity++;
+        ecs.mobileUnits.emplace(id, mobTempl);
+        snaps[0].humanoids[id].base.translation = tg::pos3(coord(rng), 0, coord(rng));
+        humanoids.push_back(id);
+        velocities.push_back(speed * tg::vec3(snorm(rng), 0, snorm(rng)));
+    }
+
+    Samples treeTime, triggerTime, bruteTime;
+    std::vector<bool> inside(nParrots * nHumanoids);
+    size_t triggerEvents = 0, bruteEvents = 0;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        auto &prev = snaps[tick % 2], &next = snaps[(tick + 1) % 2];
+        next.worldTime = prev.worldTime + dt;
+        for (size_t i = 0; i < nHumanoids; ++i) {
+            auto pos = prev.humanoids[humanoids[i]].base.translation + velocities[i] * dt;
+            for (auto axis : {0, 2}) {
+                if (pos[axis] < 0.f || pos[axis] > worldSize) {velocities[i][axis] = -velocities[i][axis];}
+            }
+            next.humanoids[humanoids[i]].base.translation = pos;
+        }
+        ecs.simSnap = &next;
+
+        treeTime.add(timeMicros([&] {ecs.updateDynamicTree(prev, next);}));
+        triggerTime.add(timeMicros([&] {triggers.update(next);}));
+        triggerEvents += triggers.events.size();
+
+        // what `Parrot::System` used to do: check everything against everything
+        bruteTime.add(timeMicros([&] {
+            for (size_t p = 0; p < nParrots; ++p) {
+                for (size_t h = 0; h < nHumanoids; ++h) {
+                    auto &pos = next.humanoids[humanoids[h]].base.translation;
+                    bool now = tg::distance_sqr(tg::pos2(pos.x, pos.z), tg::pos2(parrotPos[p].x, parrotPos[p].z)) <= frightenDist * frightenDist;
+                    if (now != inside[p * nHumanoids + h]) {
+                        inside[p * nHumanoids + h] = now;
+                        bruteEvents += 1;
+                    }
+                }
+            }
+        }));
+    }
+    glow::info() << "parrot triggers, " << nParrots << " parrots, " << nHumanoids << " humanoids, " << ticks << " ticks";
+    glow::info() << "  dynamic tree update: mean " << treeTime.mean() << "µs, p99 " << treeTime.percentile(.99) << "µs";
+    glow::info() << "  trigger update: mean " << triggerTime.mean() << "µs, p99 " << triggerTime.percentile(.99) << "µs, " << triggers.candidates() << " candidate pairs at the end";
+    glow::info() << "  brute force: mean " << bruteTime.mean() << "µs, p99 " << bruteTime.percentile(.99) << "µs";
+    glow::info() << "  " << triggerEvents << " events, brute force saw " << bruteEvents << (triggerEvents == bruteEvents ? "" : " MISMATCH");
+}
@@ -0,0 +1,326 @@
+// SPDX-License-Identifier: MIT
+#include "Avoidance.hh"
+#include <algorithm>
+#include <cmath>
+
+#include <typed-geometry/tg.hh>
+
+using namespace Combat;
+
+static constexpr float epsilon = 1e-5f;
+
+static float det(tg::vec2 a, tg::vec2 b) {return a.x * b.y - a.y * b.x;}
+
+// the linear programs below follow the reference implementation (RVO2):
+// find the velocity closest to the preferred one that is inside the
+// disk of radius `maxSpeed` and all half-planes
+
+/// optimizes along line `lineNo`, respecting all lines before it
+template<typename Line>
+static bool linearProgram1(const std::vector<Line> &lines, size_t lineNo, float radius, tg::vec2 optVel, bool directionOpt, tg::vec2 &result) {
+    auto &line = lines[lineNo];
+    auto dot = tg::dot(line.point, line.dir);
+    auto discriminant = dot * dot + radius * radius - tg::length_sqr(line.point);
+    if (discriminant < 0.f) {return false;}  // the speed disk invalidates the line completely
+    auto sqrtDisc = std::sqrt(discriminant);
+    auto tLeft = -dot - sqrtDisc, tRight = -dot + sqrtDisc;
+    for (size_t i = 0; i < lineNo; ++i) {
+        auto denom = det(line.dir, lines[i].dir);
+        auto numer = det(lines[i].dir, line.point - lines[i].point);
+        if (std::abs(denom) <= epsilon) {  // (almost) parallel lines
+            if (numer < 0.f) {return false;}
+            continue;
+        }
+        auto t = numer / denom;
+        if (denom >= 0.f) {
+            tRight = std::min(tRight, t);
+        } else {
+            tLeft = std::max(tLeft, t);
+        }
+        if (tLeft > tRight) {return false;}
+    }
+    if (directionOpt) {
+        result = line.point + (tg::dot(optVel, line.dir) > 0.f ? tRight : tLeft) * line.dir;
+    } else {
+        auto t = std::clamp(tg::dot(line.dir, optVel - line.point), tLeft, tRight);
+        result = line.point + t * line.dir;
+    }
+    return true;
+}
+
+/// returns the index of the first line that could not be satisfied, or `lines.size()` on success
+template<typename Line>
+static size_t linearProgram2(const std::vector<Line> &lines, float radius, tg::vec2 optVel, bool directionOpt, tg::vec2 &result) {
+    if (directionOpt) {
+        result = optVel * radius;
+    } else if (tg::length_sqr(optVel) > radius * radius) {
+        result = tg::normalize(optVel) * radius;
+    } else {
+        result = optVel;
+    }
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (det(lines[i].dir, lines[i].point - result) > 0.f) {
+            auto prev = result;
+            if (!linearProgram1(lines, i, radius, optVel, directionOpt, result)) {
+                result = prev;
+                return i;
+            }
+        }
+    }
+    return lines.size();
+}
+
+/// infeasible case: minimize the maximum violation of the lines from `begin` on.
+/// `projLines` is scratch memory
+template<typename Line>
+static void linearProgram3(const std::vector<Line> &lines, size_t begin, float radius, tg::vec2 &result, std::vector<Line> &projLines) {
+    float distance = 0.f;
+    for (size_t i = begin; i < lines.size(); ++i) {
+        if (det(lines[i].dir, lines[i].point - result) <= distance) {continue;}
+        projLines.clear();
+        for (size_t j = 0; j < i; ++j) {
+            Line line;
+            auto determinant = det(lines[i].dir, lines[j].dir);
+            if (std::abs(determinant) <= epsilon) {
+                if (tg::dot(lines[i].dir, lines[j].dir) > 0.f) {continue;}  // same direction
+                line.point = .5f * (lines[i].point + lines[j].point);
+            } else {
+                line.point = lines[i].point + (det(lines[j].dir, lines[i].point - lines[j].point) / determinant) * lines[i].dir;
+            }
+            line.dir = tg::normalize(lines[j].dir - lines[i].dir);
+            projLines.push_back(line);
+        }
+        auto prev = result;
+        if (linearProgram2(projLines, radius, tg::vec2(-lines[i].dir.y, lines[i].dir.x), true, result) < projLines.size()) {
+            // can only happen due to floating point error, keep the previous result
+            result = prev;
+        }
+        distance = det(lines[i].dir, lines[i].point - result);
+    }
+}
+
+Avoidance::Avoidance(size_t threads) : mScratch(threads + 1) {
+    for (size_t i = 0; i < threads; ++i) {mWorkers.emplace_back([this, i] {work(i + 1);});}
+}
+
+Avoidance::~Avoidance() {
+    {
+        std::lock_guard lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto &thread : mWorkers) {thread.join();}
+}
+
+template<typename T>
+void Avoidance::Grid::build(const std::vector<T> &items, float minCellSize) {
+    auto n = items.size();
+    if (n == 0) {
+        cellsX = cellsZ = 0;
+        cellStart.assign(1, 0);
+        entries.clear();
+        pos.clear();
+        return;
+    }
+    tg::pos2 min = items[0].pos, max = min;
+    for (auto &item : items) {
+        min = tg::min(min, item.pos);
+        max = tg::max(max, item.pos);
+    }
+    // cells of half the neighbor distance, so dense crowds don't have to scan
+    // too many agents, but don't let the grid get much larger than the number
+    // of agents if they are spread out widely
+    auto extent = max - min;
+    cellSize = std::max(minCellSize, std::sqrt(extent.x * extent.y / float(4 * n)));
+    origin = min;
+    cellsX = int32_t(extent.x / cellSize) + 1;
+    cellsZ = int32_t(extent.y / cellSize) + 1;
+
+    auto cellOf = [&] (tg::pos2 p) {
+        auto x = std::min(int32_t((p.x - origin.x) / cellSize), cellsX - 1);
+        auto z = std::min(int32_t((p.y - origin.y) / cellSize), cellsZ - 1);
+        return size_t(x) * cellsZ + z;
+    };
+    cellStart.assign(size_t(cellsX) * cellsZ + 1, 0);
+    for (auto &item : items) {cellStart[cellOf(item.pos) + 1] += 1;}
+    for (size_t i = 1; i < cellStart.size(); ++i) {cellStart[i] += cellStart[i - 1];}
+    entries.resize(n);
+    pos.resize(n);
+    auto fill = cellStart;
+    for (uint32_t i = 0; i < n; ++i) {
+        auto slot = fill[cellOf(items[i].pos)]++;
+        entries[slot] = i;
+        pos[slot] = items[i].pos;
+    }
+}
+
+void Avoidance::scanGrid(const Grid &grid, tg::pos2 pos, uint32_t self, uint32_t bit, float &rangeSq, Scratch &scratch) const {
+    if (grid.entries.empty()) {return;}
+    auto &neighbors = scratch.neighbors;
+    auto reach = int32_t(std::ceil(neighborDist / grid.cellSize));
+    // the position may be outside of the grid (for the standing units' one)
+    auto cx = int32_t(std::floor((pos.x - grid.origin.x) / grid.cellSize));
+    auto cz = int32_t(std::floor((pos.y - grid.origin.y) / grid.cellSize));
+    auto z0 = std::max(cz - reach, 0), z1 = std::min(cz + reach, grid.cellsZ - 1);
+    if (z0 > z1) {return;}
+    for (auto x = std::max(cx - reach, 0); x <= std::min(cx + reach, grid.cellsX - 1); ++x) {
+        auto dx = std::max({0.f, grid.origin.x + x * grid.cellSize - pos.x, pos.x - grid.origin.x - (x + 1) * grid.cellSize});
+        if (dx * dx >= rangeSq) {continue;}
+        // the cells of a column are next to each other in the CSR arrays
+        auto first = size_t(x) * grid.cellsZ;
+        for (auto i = grid.cellStart[first + z0], end = grid.cellStart[first + z1 + 1]; i < end; ++i) {
+            auto distSq = tg::distance_sqr(pos, grid.pos[i]);
+            if (distSq >= rangeSq) {continue;}
+            auto other = grid.entries[i] | bit;
+            if (other == self) {continue;}
+            // keep the closest `maxNeighbors`, sorted by distance
+            if (neighbors.size() < maxNeighbors) {neighbors.emplace_back();}
+            auto j = neighbors.size() - 1;
+            for (; j > 0 && neighbors[j - 1].first > distSq; --j) {neighbors[j] = neighbors[j - 1];}
+            neighbors[j] = {distSq, other};
+            if (neighbors.size() == maxNeighbors) {rangeSq = neighbors.back().first;}
+        }
+    }
+}
+
+void Avoidance::collectNeighbors(uint32_t idx, Scratch &scratch) const {
+    scratch.neighbors.clear();
+    auto pos = agents[idx].pos;
+    auto rangeSq = neighborDist * neighborDist;
+    scanGrid(mMoving, pos, idx, 0, rangeSq, scratch);
+    scanGrid(mStanding, pos, idx, standingBit, rangeSq, scratch);
+}
+
+tg::vec2 Avoidance::computeVelocity(uint32_t idx, Scratch &scratch) const {
+    auto &agent = agents[idx];
+    auto &lines = scratch.lines;
+    lines.clear();
+    auto invHorizon = 1.f / timeHorizon;
+    for (auto [distSq, otherIdx] : scratch.neighbors) {
+        tg::pos2 otherPos;
+        tg::vec2 otherVel;
+        float otherRadius;
+        bool reciprocal = !(otherIdx & standingBit);
+        if (reciprocal) {
+            auto &other = agents[otherIdx];
+            otherPos = other.pos;
+            otherVel = other.vel;
+            otherRadius = other.radius;
+        } else {
+            auto &other = standing[otherIdx & ~standingBit];
+            otherPos = other.pos;
+            otherVel = tg::vec2::zero;
+            otherRadius = other.radius;
+        }
+        auto relPos = otherPos - agent.pos;
+        auto relVel = agent.vel - otherVel;
+        auto combinedRadius = agent.radius + otherRadius;
+        auto combinedRadiusSq = combinedRadius * combinedRadius;
+        Line line;
+        tg::vec2 u;
+        if (distSq > combinedRadiusSq) {
+            // no collision yet: project onto the truncated velocity obstacle cone
+            auto w = relVel - invHorizon * relPos;
+            auto wLengthSq = tg::length_sqr(w);
+            auto dot = tg::dot(w, relPos);
+            if (dot < 0.f && dot * dot > combinedRadiusSq * wLengthSq) {
+                // project on the cut-off circle
+                auto wLength = std::sqrt(wLengthSq);
+                auto unitW = w / wLength;
+                line.dir = {unitW.y, -unitW.x};
+                u = (combinedRadius * invHorizon - wLength) * unitW;
+            } else {
+                // project on the legs
+                auto leg = std::sqrt(distSq - combinedRadiusSq);
+                if (det(relPos, w) > 0.f) {
+                    line.dir = tg::vec2(relPos.x * leg - relPos.y * combinedRadius, relPos.x * combinedRadius + relPos.y * leg) / distSq;
+                } else {
+                    line.dir = -tg::vec2(relPos.x * leg + relPos.y * combinedRadius, -relPos.x * combinedRadius + relPos.y * leg) / distSq;
+                }
+                u = tg::dot(relVel, line.dir) * line.dir - relVel;
+            }
+        } else {
+            // already overlapping: get apart within this time step
+            auto w = relVel - relPos / mDt;
+            auto wLength = tg::length(w);
+            auto unitW = wLength > epsilon ? w / wLength : tg::vec2(1, 0);
+            line.dir = {unitW.y, -unitW.x};
+            u = (combinedRadius / mDt - wLength) * unitW;
+        }
+        line.point = agent.vel + (reciprocal ? .5f : 1.f) * u;
+        lines.push_back(line);
+    }
+
+    tg::vec2 result;
+    auto fail = linearProgram2(lines, agent.maxSpeed, agent.prefVel, false, result);
+    if (fail < lines.size()) {linearProgram3(lines, fail, agent.maxSpeed, result, scratch.projLines);}
+    return result;
+}
+
+// agents per chunk: enough that the workers don't fight over the counter,
+// few enough that they finish at about the same time
+static constexpr size_t chunkSize = 64;
+
+void Avoidance::solveChunks(Scratch &scratch) {
+    auto &order = mMoving.entries;
+    while (true) {
+        auto begin = mNextChunk.fetch_add(chunkSize, std::memory_order_relaxed);
+        if (begin >= order.size()) {return;}
+        auto end = std::min(begin + chunkSize, order.size());
+        for (auto k = begin; k < end; ++k) {
+            auto i = order[k];
+            collectNeighbors(i, scratch);
+            if (scratch.neighbors.empty()) {
+                // nobody around, no need for the linear program
+                auto &agent = agents[i];
+                auto speedSq = tg::length_sqr(agent.prefVel);
+                velocities[i] = speedSq > agent.maxSpeed * agent.maxSpeed ? agent.prefVel * (agent.maxSpeed / std::sqrt(speedSq)) : agent.prefVel;
+                continue;
+            }
+            velocities[i] = computeVelocity(i, scratch);
+        }
+    }
+}
+
+void Avoidance::work(size_t thread) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mMutex);
+            mWake.wait(lock, [&] {return mStop || mGeneration != seen;});
+            if (mStop) {return;}
+            seen = mGeneration;
+        }
+        solveChunks(mScratch[thread]);
+        std::lock_guard lock(mMutex);
+        if (--mBusy == 0) {mDone.notify_one();}
+    }
+}
+
+void Avoidance::solve(float dt) {
+    velocities.resize(agents.size());
+    if (agents.empty()) {return;}
+    mMoving.build(agents, .5f * neighborDist);
+    auto sameStanding = [] (const Standing &a, const Standing &b) {return a.pos.x == b.pos.x && a.pos.y == b.pos.y && a.radius == b.radius;};
+    if (!std::equal(standing.begin(), standing.end(), mStandingBuilt.begin(), mStandingBuilt.end(), sameStanding)) {
+        mStanding.build(standing, .5f * neighborDist);
+        mStandingBuilt = standing;
+    }
+    // the agents go in grid order, so neighboring agents are processed together
+    mDt = dt;
+    mNextChunk = 0;
+    bool parallel = !mWorkers.empty() && agents.size() > chunkSize;
+    if (parallel) {
+        {
+            std::lock_guard lock(mMutex);
+            mGeneration += 1;
+            mBusy = mWorkers.size();
+        }
+        mWake.notify_all();
+    }
+    solveChunks(mScratch[0]);
+    if (parallel) {
+        std::unique_lock lock(mMutex);
+        mDone.wait(lock, [&] {return mBusy == 0;});
+    }
+}
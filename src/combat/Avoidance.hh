@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+namespace Combat {
+
+/// local avoidance between units using optimal reciprocal collision avoidance
+/// (ORCA, as in van den Berg et al. "Reciprocal n-body Collision Avoidance").
+/// Works in the XZ plane and knows nothing about the ECS, so it can be driven
+/// headless. Neighbors are found through uniform grids: the one of the moving
+/// agents is rebuilt on every `solve`, the one of the standing units only
+/// when they change. The agents are solved in chunks on worker threads; with
+/// 0 threads, `solve` does all of them itself.
+struct Avoidance {
+    struct Agent {
+        tg::pos2 pos;
+        tg::vec2 vel;  ///< current velocity
+        tg::vec2 prefVel;  ///< velocity the agent would have without anyone else around
+        float radius, maxSpeed;
+    };
+    /// standing units don't react to the agents, who take full responsibility
+    /// for avoiding them
+    struct Standing {
+        tg::pos2 pos;
+        float radius;
+    };
+
+    float timeHorizon = 1.f;
+    float neighborDist = 4.f;
+    uint32_t maxNeighbors = 10;
+
+    std::vector<Agent> agents;
+    std::vector<Standing> standing;
+    /// output of `solve`, one per agent
+    std::vector<tg::vec2> velocities;
+
+    explicit Avoidance(size_t threads = 0);
+    ~Avoidance();
+
+    /// `dt` is the time step, used to resolve agents that already overlap
+    void solve(float dt);
+
+private:
+    /// half-plane of permitted velocities: left of `point + t * dir`
+    struct Line {
+        tg::vec2 point, dir;
+    };
+    /// entries sorted by cell (CSR), with their positions copied for a cache-friendly scan
+    struct Grid {
+        tg::pos2 origin;
+        float cellSize = 1.f;
+        int32_t cellsX = 0, cellsZ = 0;
+        std::vector<uint32_t> cellStart, entries;
+        std::vector<tg::pos2> pos;
+
+        template<typename T>
+        void build(const std::vector<T> &items, float minCellSize);
+    };
+    /// per thread, so the workers don't share memory they write to
+    struct Scratch {
+        std::vector<Line> lines, projLines;
+        /// (squared distance, index); standing units have `standingBit` set
+        std::vector<std::pair<float, uint32_t>> neighbors;
+    };
+    static constexpr uint32_t standingBit = 1u << 31;
+
+    Grid mMoving, mStanding;
+    /// what `mStanding` was built from
+    std::vector<Standing> mStandingBuilt;
+    std::vector<Scratch> mScratch;  ///< the first one is for the thread calling `solve`
+
+    std::mutex mMutex;
+    std::condition_variable mWake, mDone;
+    uint64_t mGeneration = 0;
+    size_t mBusy = 0;
+    bool mStop = false;
+    float mDt = 0.f;
+    std::atomic<size_t> mNextChunk{0};
+    std::vector<std::thread> mWorkers;
+
+    void work(size_t thread);
+    /// solves chunks of agents (in grid order) until there are none left
+    void solveChunks(Scratch &);
+    void collectNeighbors(uint32_t agent, Scratch &) const;
+    void scanGrid(const Grid &, tg::pos2, uint32_t self, uint32_t bit, float &rangeSq, Scratch &) const;
+    tg::vec2 computeVelocity(uint32_t agent, Scratch &) const;
+};
+
+}
@@ -2,6 +2,8 @@
 #include "Combat.hh"
 #include <algorithm>
 #include <cinttypes>
+#include <thread>
+#include <tuple>
 
 #include <typed-geometry/tg-std.hh>
 #include <glow/common/scoped_gl.hh>
@@ -17,8 +19,10 @@
 #include <ECS/Join.hh>
 #include <effects/Effects.hh>
 #include <navmesh/NavMesh.hh>
+#include <obstacles/Cover.hh>
 #include <obstacles/Obstacle.hh>
 #include <rendering/MainRenderPass.hh>
+#include <terrain/Terrain.hh>
 #include <util/SphericalDistributions.hh>
 
 using namespace Combat;
@@ -32,6 +36,7 @@ void System::spawnSquad(NavMesh::Instance &nav, unsigned units, float radius, st
     mobTempl.acceleration = 7.f;
     auto unitHeight = 1.8f, spawnDist = mobTempl.radius * 1.5f;
     auto &ecs = mGame.mECS;
+    auto squad = ++mSquads;
 
     while (true) {  // FIXME: what to do if we can't ever find a suitable place?
         auto face = nav.mesh->handle_of(pm::face_index(faceDistr(rng)));
@@ -95,6 +100,7 @@ void System::spawnSquad(NavMesh::Instance &nav, unsigned units, float radius, st
                 ecs.editables.emplace(ent, &*ecs.combatSys);
                 auto &hum = ecs.humanoids[ent];
                 hum.allegiance = 1;
+                hum.squad = squad;
                 hum.scatterLaserParams.color = {1.0, 0.0, 0.0, 1};
                 hum.scatterLaserParams.color2 = {1.0, 0.0, 0.22, 1};
                 auto &mob = ecs.mobileUnits.emplace(ent, mobTempl).first->second;
@@ -108,7 +114,7 @@ void System::spawnSquad(NavMesh::Instance &nav, unsigned units, float radius, st
     }
 }
 
-System::System(Game& game) : mGame(game) {
+System::System(Game& game) : mGame(game), mAvoidance(std::clamp(std::thread::hardware_concurrency(), 1u, 8u) - 1) {
     mGoodGuyMesh.loadMesh("../data/meshes/good_guy.dae", "");
     mBadGuyMesh.loadMesh("../data/meshes/bad_guy.dae", "");
     mSimpleShader = game.mSharedResources.simple;
@@ -144,6 +150,71 @@ System::System(Game& game) : mGame(game) {
     mPathVao = glow::VertexArray::create(mPathABO, GL_TRIANGLE_STRIP);
 }
 
+size_t System::replanCrossing(ECS::entity navId, const tg::aabb3 &box) {
+    auto &ecs = mGame.mECS;
+    auto navIter = ecs.navMeshes.find(navId);
+    if (navIter == ecs.navMeshes.end()) {return 0;}
+    auto &nav = navIter->second;
+    auto now = ecs.simSnap->worldTime;
+    // on the changed navmesh, so both ends are looked up again
+    auto place = [&] (tg::pos3 pos) -> std::optional<std::pair<pm::face_index, tg::pos3>> {
+        auto closest = nav.closestPoint(pos);
+        if (!closest) {return {};}
+        auto height = nav.heightAt(nav.mesh->handle_of(closest->first), pos);
+        if (height) {pos.y = *height;}
+        return {{closest->first, pos}};
+    };
+    size_t replanned = 0;
+    for (auto &&tup : ECS::Join(ecs.mobileUnits, ecs.humanoids)) {
+        auto &[mob, hum, id] = tup;
+        if (mob.nav != navId || hum.steps.empty() || !mob.crosses(box, now) || ecs.routePlanner->waiting(id)) {continue;}
+        auto humpos = ecs.simSnap->humanoids.find(id);
+        if (humpos == ecs.simSnap->humanoids.end()) {continue;}
+        auto start = place(humpos->second.base.translation), end = place(mob.knots.back().pos);
+        if (!start || !end) {continue;}
+        NavMesh::Planner::Request req;
+        req.owner = id;
+        req.navId = navId;
+        std::tie(req.route.start_face, req.route.start) = *start;
+        std::tie(req.route.end_face, req.route.end) = *end;
+        req.height = mob.heightVector;
+        req.radius = mob.radius;
+        // only the faces the crater changed are searched again
+        req.keepSearch = true;
+        req.replanner = std::move(mob.replanner);
+        // keep the orientation the walk was going to end in
+        auto endOrient = tg::mat3(hum.steps.back().pos.base.rotation);
+        orderWalk(ecs, req, tg::dir3(endOrient[1]), -endOrient[2]);
+        replanned += 1;
+    }
+    return replanned;
+}
+
+bool System::takeCover(ECS::entity id, Humanoid &hum, const HumanoidPos &humpos, tg::pos3 threat) {
+    auto &ecs = mGame.mECS;
+    // a unit waiting for a route has been given somewhere else to go
+    if (!(hum.coverRadius > 0) || ecs.routePlanner->waiting(id)) {return false;}
+    auto mob = ecs.mobileUnits.find(id);
+    if (mob == ecs.mobileUnits.end()) {return false;}
+    auto navIter = ecs.navMeshes.find(mob->second.nav);
+    if (navIter == ecs.navMeshes.end()) {return false;}
+    auto &nav = navIter->second;
+    auto pos = humpos.base.translation;
+    auto cover = Obstacle::bestCover(ecs, pos, hum.coverRadius, threat);
+    if (!cover || tg::distance(cover->pos, pos) < mob->second.radius) {return false;}
+    auto start = nav.closestPoint(pos), end = nav.closestPoint(cover->pos);
+    if (!start || !end) {return false;}
+    NavMesh::Planner::Request req;
+    req.owner = id;
+    req.navId = mob->second.nav;
+    req.route = {pos, cover->pos, start->first, end->first};
+    req.height = mob->second.heightVector;
+    req.radius = mob->second.radius;
+    glow::info() << "unit " << id << " takes cover at " << cover->pos;
+    orderWalk(ecs, req, humpos.base.rotation * tg::dir3(0, 1, 0), threat - cover->pos);
+    return true;
+}
+
 void System::editorUI(ECS::entity ent) {
     auto join = ECS::Join(mGame.mECS.humanoids, mGame.mECS.mobileUnits);
     auto iter = join.find(ent);
@@ -159,6 +230,7 @@ void System::editorUI(ECS::entity ent) {
     ImGui::InputFloat("Attack range", &humanoid.attackRange);
     ImGui::InputInt("Allegiance", &humanoid.allegiance);
     ImGui::InputInt("HP", &humanoid.hp);
+    ImGui::InputFloat("Cover radius", &humanoid.coverRadius);
     bool update = false;
     if (ImGui::TreeNodeEx("Pelvis", ImGuiTreeNodeFlags_DefaultOpen)) {
         update |= ImGui::SliderFloat("width", &hum.pelvicSize.width, .25f, .45f);
@@ -205,9 +277,10 @@ void System::extrapolate(ECS::Snapshot &prev, ECS::Snapshot &next) {
         auto navIter = mGame.mECS.navMeshes.find(mob.nav);
         if (navIter == mGame.mECS.navMeshes.end()) {continue;}
 
-        MovementContext {
-            mGame.mECS, hum, mob, navIter->second
-        }.interpolate(next.humanoids[id], time);
+        MovementContext ctx {mGame.mECS, hum, mob, navIter->second};
+        auto &humpos = next.humanoids[id];
+        ctx.interpolate(humpos, time);
+        if (mob.avoidOffset != tg::vec3::zero) {ctx.applyOffset(humpos, mob.avoidOffset);}
     }
     float dt = time - prev.worldTime;
     if (dt <= 0.f) {return;}  // don't divide by 0 when paused
@@ -258,10 +331,56 @@ bool System::lineOfSight(const tg::pos3 &pos, const tg::vec3 &distVec) const {
     return true;
 }
 
+void System::updateAvoidance(ECS::Snapshot &prev, ECS::Snapshot &next) {
+    float dt = next.worldTime - prev.worldTime;
+    if (dt <= 0.f) {return;}
+    auto &agents = mAvoidance.agents;
+    agents.clear();
+    mAvoidance.standing.clear();
+    // walking units and their planned velocity, same order as the agents
+    std::vector<std::pair<MobileUnit *, tg::vec2>> units;
+    for (auto &&tup : ECS::Join(mGame.mECS.humanoids, mGame.mECS.mobileUnits, next.humanoids)) {
+        auto &[hum, mob, humpos, id] = tup;
+        auto pos = humpos.base.translation;
+        // same condition under which `update` ends the walk
+        bool walking = !hum.steps.empty() && hum.steps.back().time > next.worldTime;
+        if (!walking) {
+            // whatever offset the unit had is now part of its resting position
+            mob.avoidOffset = mob.avoidVelocity = tg::vec3::zero;
+            mAvoidance.standing.push_back({{pos.x, pos.z}, mob.radius});
+            continue;
+        }
+        auto range = mob.timeRange();
+        auto planned = tg::vec3::zero;
+        if (range && next.worldTime >= range->first) {planned = mob.interpolate(next.worldTime).second;}
+        tg::vec2 plannedVel(planned.x, planned.z);
+        // steer back towards the planned route
+        auto pref = plannedVel - tg::vec2(mob.avoidOffset.x, mob.avoidOffset.z) / .5f;
+        units.emplace_back(&mob, plannedVel);
+        agents.push_back({
+            {pos.x, pos.z}, {mob.avoidVelocity.x, mob.avoidVelocity.z}, pref,
+            mob.radius, mob.cruiseSpeed
+        });
+    }
+    mAvoidance.solve(dt);
+    for (size_t i = 0; i < units.size(); ++i) {
+        auto &[mob, plannedVel] = units[i];
+        auto vel = mAvoidance.velocities[i];
+        auto dev = vel - plannedVel;
+        mob->avoidOffset += tg::vec3(dev.x, 0, dev.y) * dt;
+        // don't drift off so far that the route becomes meaningless
+        auto maxOffset = 4 * mob->radius, len = tg::length(mob->avoidOffset);
+        if (len > maxOffset) {mob->avoidOffset *= maxOffset / len;}
+        mob->avoidVelocity = {vel.x, 0, vel.y};
+    }
+}
+
 void System::update(ECS::Snapshot &prev, ECS::Snapshot &next) {
+    updateAvoidance(prev, next);
     auto &humMap = mGame.mECS.humanoids;
     auto humanoids = ECS::Join(humMap, next.humanoids);
     std::vector<ECS::entity> kills;
+    std::vector<Terrain::Crater> impacts;
     for (auto &&tup : humanoids) {
         auto [hum_, humpos, id] = tup;
         auto &hum = hum_;  // I love you too, C++ standard
@@ -309,6 +428,8 @@ void System::update(ECS::Snapshot &prev, ECS::Snapshot &next) {
             if (bestEnt != ECS::INVALID) {
                 glow::info() << "unit " << id << " acquired target " << bestEnt;
                 hum.curTarget = bestEnt;
+                bool walking = !hum.steps.empty() && hum.steps.back().time > next.worldTime;
+                if (!walking) {takeCover(id, hum, humpos, next.humanoids.at(bestEnt).base.translation);}
             } else {
                 continue;  // can't aim without a target
             }
@@ -336,6 +457,12 @@ void System::update(ECS::Snapshot &prev, ECS::Snapshot &next) {
         mGame.mECS.effectsSys->spawnScatterLaser(
             {muzzlePos, bodyCenter}, hum.scatterLaserParams
         );
+        {
+            // the scattered beam digs into the ground under the target
+            tg::ray3 down {bodyCenter, humpos2.base.rotation * tg::dir3(0, -1, 0)};
+            auto ground = mGame.mECS.navMeshSys->intersect(down);
+            if (ground) {impacts.push_back({down[std::get<2>(*ground)], hum.craterRadius, hum.craterDepth});}
+        }
         if (hum2.hp > hum.attackDamage) {
             hum2.hp -= hum.attackDamage;
         } else if (hum2.hp > 0) {
@@ -349,6 +476,8 @@ void System::update(ECS::Snapshot &prev, ECS::Snapshot &next) {
     for (auto id : kills) {
         mGame.mECS.deleteEntity(id);
     }
+    // after the loop, since they can change the routes of other units
+    for (auto &crater : impacts) {mGame.mECS.terrainSys->crater(crater);}
 }
 
 void System::prepareRender(ECS::Snapshot &snap) {
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <memory>
 #include <random>
 #include <vector>
 
@@ -9,6 +10,7 @@
 
 #include <ECS.hh>
 #include <ECS/Misc.hh>
+#include "Avoidance.hh"
 #include <effects/Effects.hh>
 #include <animation/rigged/RiggedMesh.hh>
 
@@ -33,9 +35,25 @@ struct MobileUnit {
     };
     std::vector<Knot> knots;
 
+    // === local avoidance
+    /// displacement from the planned route caused by dodging other units,
+    /// reset whenever a new walk is planned
+    tg::vec3 avoidOffset = tg::vec3::zero;
+    /// velocity chosen by the last avoidance tick (including the planned motion)
+    tg::vec3 avoidVelocity = tg::vec3::zero;
+
+    /// search state of the route, kept to repair it when the ground changes
+    /// (see `NavMesh::Planner::Request::keepSearch`); null while a search has it
+    std::shared_ptr<NavMesh::Replanner> replanner;
+
+    /// searches on the main thread, then `applyRoute`
     bool planRoute(std::pair<const ECS::entity, NavMesh::Instance> &navItem, const NavMesh::RouteRequest &req, ECS::ECS &ecs);
+    /// turns a `NavMesh::Route` for `req` (e. g. from `NavMesh::Planner`) into knots, starting now
+    bool applyRoute(std::pair<const ECS::entity, NavMesh::Instance> &navItem, const NavMesh::RouteRequest &req, const std::vector<std::pair<pm::halfedge_index, float>> &route, ECS::ECS &ecs);
     std::pair<tg::pos3, tg::vec3> interpolate(double time) const;
     std::optional<std::pair<double, double>> timeRange() const;
+    /// if the part of the route still ahead at `time` passes over `box` in the ground plane
+    bool crosses(const tg::aabb3 &box, double time) const;
 };
 
 struct Stance {
@@ -95,6 +113,9 @@ struct Humanoid {
     // === combat
     int allegiance = 0;  // 0 = player, everything else is enemy
     ECS::entity curTarget = ECS::INVALID;
+    /// nonzero for units spawned together by `System::spawnSquad`, which are
+    /// given orders as a group
+    unsigned squad = 0;
 
     double shotReadyAt = 0.;
     float cooldown = 2.f;
@@ -102,6 +123,9 @@ struct Humanoid {
     int hp = 100, maxHP = 100;
 
     float attackRange = 30.f, attackCos = tg::cos(45_deg);
+    /// of the crater that the scattered laser leaves in the ground under the target.
+    /// The terrain widens craters that could miss all of its grid vertices
+    float craterRadius = 3.f, craterDepth = .3f;
     tg::angle32 turningSpeed = 270_deg;  // per second
 
     // === walking cycle parameters
@@ -137,6 +161,9 @@ struct Humanoid {
     float gunOffset = .75f;
 
     float lowCoverDistance = 2.f;
+    /// how far a unit that isn't walking goes to take cover from a new
+    /// target; 0 (the default) to stay put
+    float coverRadius = 0.f;
 
     Stance baseStance, stepStance, crouchStance;
     ECS::Rigid stepGunPos[2];
@@ -217,6 +244,13 @@ class System final : public ECS::Editor {
     glow::SharedVertexArray mShotgunVao, mHPGaugeVao, mPathVao;
     glow::SharedArrayBuffer mPathABO;
     std::vector<size_t> mPathRanges;
+    Avoidance mAvoidance;
+    unsigned mSquads = 0;
+
+    void updateAvoidance(ECS::Snapshot &prev, ECS::Snapshot &next);
+    /// sends the unit to the best cover from `threat` within `Humanoid::coverRadius`
+    /// (see `Obstacle::bestCover`), through the route planner
+    bool takeCover(ECS::entity, Humanoid &, const HumanoidPos &, tg::pos3 threat);
 
 public:
     System(Game &game);
@@ -232,6 +266,12 @@ public:
     void renderUI(MainRenderPass &);
 
     void spawnSquad(NavMesh::Instance &nav, unsigned units, float radius, std::mt19937 &);
+    /// submits new routes to the same destination for the units on `nav`
+    /// whose way ahead crosses `box`, e. g. because the ground there changed,
+    /// repairing their last search where possible. Units still waiting for a
+    /// route are left alone: it is placed on the changed navmesh when it
+    /// arrives. Returns how many were submitted
+    size_t replanCrossing(ECS::entity nav, const tg::aabb3 &box);
 };
 
 }
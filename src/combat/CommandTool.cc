@@ -1,6 +1,9 @@
 // SPDX-License-Identifier: MIT
 #include "CommandTool.hh"
 #include <cinttypes>
+#include <optional>
+#include <utility>
+#include <vector>
 
 #include <typed-geometry/tg-std.hh>
 #include <imgui/imgui.h>
@@ -10,6 +13,8 @@
 #include <combat/Walking.hh>
 #include <ECS/Join.hh>
 #include <navmesh/NavMesh.hh>
+#include <navmesh/Planner.hh>
+#include <navmesh/Squad.hh>
 #include <obstacles/Obstacle.hh>
 
 using namespace Combat;
@@ -46,6 +51,19 @@ bool CommandTool::findDestination(const tg::ray3 &ray) {
         glow::warning() << "point too close to obstacle";
         return false;
     }
+    auto navIter = mECS.navMeshes.find(navId);
+    auto humpos = mECS.simSnap->humanoids.find(mECS.selectedEntity);
+    if (navIter != mECS.navMeshes.end() && humpos != mECS.simSnap->humanoids.end()) {
+        auto &nav = navIter->second;
+        auto start = nav.closestPoint(humpos->second.base.translation);
+        if (start && !nav.reachable(start->first, face)) {
+            // don't let the search find out the hard way
+            auto nearest = nav.nearestReachable(start->first, pos);
+            if (!nearest) {return false;}
+            glow::warning() << "destination unreachable, using the nearest reachable point " << nearest->second;
+            std::tie(face, pos) = *nearest;
+        }
+    }
     mDestination = {{navId, face, pos}};
     mOrient.reset();
     return true;
@@ -80,20 +98,98 @@ bool CommandTool::navigate(const tg::ray3 &ray) {
 
     if (!mOrient) {return false;}
     auto mat = tg::mat3(*mOrient);
+    if (hum.squad != 0) {
+        if (!orderSquad(hum.squad, *navIter, req.end_face, req.end, tg::dir3(mat[1]), -mat[2])) {return false;}
+        mECS.selectedEntity = ECS::INVALID;
+        std::unique_ptr<Game::Tool> dummy;
+        std::swap(mActiveTool, dummy);
+        return true;
+    }
 
-    if (!mob.planRoute(*navIter, req, mECS)) {
+    NavMesh::Planner::Request planReq;
+    planReq.owner = mECS.selectedEntity;
+    planReq.navId = navId;
+    planReq.route = req;
+    planReq.height = mob.heightVector;
+    planReq.radius = mob.radius;
+    // a long way across the map shouldn't hold up the other units' routes;
+    // the unit sets off on the best route so far every 10 ticks
+    planReq.mode = NavMesh::SearchMode::Corridor;
+    planReq.sliced = true;
+    planReq.partialEvery = 10;
+    auto ticket = orderWalk(mECS, planReq, tg::dir3(mat[1]), -mat[2]);
+    if (!ticket) {
         mDestination.reset();
         return false;
     }
-    MovementContext {mECS, hum, mob, nav}.planWalk(
-        humpos->second, tg::dir3(mat[1]), -mat[2]
-    );
     mECS.selectedEntity = ECS::INVALID;
     std::unique_ptr<Game::Tool> dummy;
     std::swap(mActiveTool, dummy);
     return true;
 }
 
+bool CommandTool::orderSquad(unsigned squad, std::pair<const ECS::entity, NavMesh::Instance> &navItem, pm::face_index goalFace, tg::pos3 goal, tg::dir3 up, tg::vec3 endFwd) {
+    auto &nav = navItem.second;
+    auto humJoin = ECS::Join(mECS.mobileUnits, mECS.humanoids);
+    std::vector<ECS::entity> members;
+    std::vector<std::pair<pm::face_index, tg::pos3>> starts;
+    NavMesh::Planner::Request planReq;
+    planReq.navId = navItem.first;
+    for (auto &&tup : humJoin) {
+        auto &[mob, hum, id] = tup;
+        if (hum.squad != squad) {continue;}
+        auto humpos = mECS.simSnap->humanoids.find(id);
+        if (humpos == mECS.simSnap->humanoids.end()) {continue;}
+        auto pos = humpos->second.base.translation;
+        auto closest = nav.closestPoint(pos);
+        if (!closest) {continue;}
+        if (members.empty()) {
+            planReq.height = mob.heightVector;
+            planReq.radius = mob.radius;
+        }
+        members.push_back(id);
+        starts.emplace_back(closest->first, pos);
+    }
+    if (members.empty()) {return false;}
+    // one search for the squad instead of one per unit, on the planner's workers
+    auto &ecs = mECS;
+    auto ticket = mECS.routePlanner->submitSquad(mECS, planReq, members, nav.placeSquad(starts, goalFace, goal), [&ecs, planReq, up, endFwd] (const NavMesh::Planner::Result &res) {
+        auto &routes = res.squad;
+        glow::info() << "squad of " << res.owners.size() << ": " << routes.derived << " routes from the shared corridor, " << routes.searched << " searched";
+        auto navIter = ecs.navMeshes.find(res.navId);
+        if (navIter == ecs.navMeshes.end()) {return;}
+        auto &nav = navIter->second;
+        auto humJoin = ECS::Join(ecs.mobileUnits, ecs.humanoids);
+        for (size_t i = 0; i < res.owners.size(); ++i) {
+            if (res.owners[i] == ECS::INVALID) {continue;}
+            auto humIter = humJoin.find(res.owners[i]);
+            if (humIter == humJoin.end()) {continue;}
+            auto humpos = ecs.simSnap->humanoids.find(res.owners[i]);
+            if (humpos == ecs.simSnap->humanoids.end()) {continue;}
+            auto [mob, hum, id] = *humIter;
+            auto req = routes.reqs[i];
+            auto route = routes.routes[i];
+            if (route.empty() && req.start_face != req.end_face) {continue;}
+            auto pos = humpos->second.base.translation;
+            if (!nav.reanchor(req, route, pos)) {
+                // it has left its route since: plan it on its own, to the same place
+                auto start = nav.closestPoint(pos);
+                if (!start) {continue;}
+                auto single = planReq;
+                single.owner = id;
+                single.route = routes.reqs[i];
+                single.route.start = pos;
+                single.route.start_face = start->first;
+                orderWalk(ecs, single, up, endFwd);
+                continue;
+            }
+            if (!mob.applyRoute(*navIter, req, route, ecs)) {continue;}
+            MovementContext {ecs, hum, mob, nav}.planWalk(humpos->second, up, endFwd);
+        }
+    });
+    return ticket != 0;
+}
+
 bool CommandTool::onClick(const tg::ray3 &ray) {
     if (!mDestination) {
         return findDestination(ray);
@@ -2,6 +2,7 @@
 #pragma once
 #include <memory>
 #include <optional>
+#include <utility>
 
 #include <polymesh/Mesh.hh>
 
@@ -21,6 +22,8 @@ class CommandTool final : public Game::Tool {
 
     bool findDestination(const tg::ray3 &);
     bool navigate(const tg::ray3 &);
+    /// moves all units of the squad to `goal`, keeping their formation
+    bool orderSquad(unsigned squad, std::pair<const ECS::entity, NavMesh::Instance> &navItem, pm::face_index goalFace, tg::pos3 goal, tg::dir3 up, tg::vec3 endFwd);
 public:
     CommandTool(Game &, tg::angle32 viewAngle, float innerRadius, float outerRadius);
     bool onClick(const tg::ray3 &) override;
@@ -50,6 +50,15 @@ static double integrateTime(const MobileUnit::Knot &prev, const MobileUnit::Knot
 }
 
 bool MobileUnit::planRoute(std::pair<const ECS::entity, NavMesh::Instance> &navItem, const NavMesh::RouteRequest &req, ECS::ECS &ecs) {
+    NavMesh::Route route;
+    if (req.start_face != req.end_face) {
+        Obstacle::Collider collider(ecs, heightVector, radius);
+        route = navItem.second.navigate(req, 5, collider, NavMesh::SearchMode::Hierarchical);
+    }
+    return applyRoute(navItem, req, route, ecs);
+}
+
+bool MobileUnit::applyRoute(std::pair<const ECS::entity, NavMesh::Instance> &navItem, const NavMesh::RouteRequest &req, const NavMesh::Route &route, ECS::ECS &ecs) {
     auto &mob = *this;
     mob.nav = navItem.first;
     auto &nav = navItem.second;
@@ -62,8 +71,6 @@ bool MobileUnit::planRoute(std::pair<const ECS::entity, NavMesh::Instance> &navI
     auto timeToCruise = mob.cruiseSpeed / mob.acceleration;
     auto distToCruise = .5f * mob.cruiseSpeed * timeToCruise;
     if (req.start_face != req.end_face) {
-        Obstacle::Collider collider(ecs, mob.heightVector, mob.radius);
-        auto route = nav.navigate(req, 5, collider);
         for (auto &&c : route) {
             auto &cross = mob.knots.emplace_back();
             cross.he = c.first;
@@ -120,6 +127,27 @@ bool MobileUnit::planRoute(std::pair<const ECS::entity, NavMesh::Instance> &navI
 }
 
 
+bool MobileUnit::crosses(const tg::aabb3 &box, double time) const {
+    for (size_t i = 1; i < knots.size(); ++i) {
+        if (knots[i].time <= time) {continue;}  // already walked
+        // clip the segment against the box in X and Z
+        auto a = knots[i - 1].pos, b = knots[i].pos;
+        float t0 = 0.f, t1 = 1.f;
+        for (auto axis : {0, 2}) {
+            auto d = b[axis] - a[axis];
+            if (d == 0.f) {
+                if (a[axis] < box.min[axis] || a[axis] > box.max[axis]) {t1 = -1.f;}
+                continue;
+            }
+            auto [ta, tb] = Util::ordered((box.min[axis] - a[axis]) / d, (box.max[axis] - a[axis]) / d);
+            t0 = std::max(t0, ta);
+            t1 = std::min(t1, tb);
+        }
+        if (t0 <= t1) {return true;}
+    }
+    return false;
+}
+
 std::pair<tg::pos3, tg::vec3> MobileUnit::interpolate(double time) const {
     auto &mob = *this;
     auto nextKnot = std::upper_bound(
@@ -1,8 +1,10 @@
 // SPDX-License-Identifier: MIT
 #include "Walking.hh"
 #include <MathUtil.hh>
+#include <ECS/Join.hh>
 #include <Util.hh>
 #include <navmesh/NavMesh.hh>
+#include <obstacles/Cover.hh>
 #include <obstacles/Obstacle.hh>
 
 using namespace Combat;
@@ -153,6 +155,18 @@ void MovementContext::interpolate(HumanoidPos &humpos, double time) const {
     }
 }
 
+void MovementContext::applyOffset(HumanoidPos &humpos, tg::vec3 offset) const {
+    auto pos = humpos.base.translation + offset;
+    tg::ray3 ray {pos + tg::vec3(0, hum.hipHeight, 0), tg::dir3(0, -1, 0)};
+    auto ints = nav.intersect(ray);
+    if (ints && ints->second < 2 * hum.hipHeight) {
+        offset = ray[ints->second] - humpos.base.translation;
+    }
+    humpos.base.translation += offset;
+    humpos.upperBody.translation += offset;
+    for (auto &foot : humpos.feet) {foot.translation += offset;}
+}
+
 ECS::Rigid Stance::upperBody() const {
     return {tg::pos3(0, height, 0), upperBodyOrient};
 }
@@ -173,12 +187,14 @@ HumanoidPos MovementContext::posFromKeyFrame(const KeyFrame &key) const {
 
 HumanoidPos MovementContext::restPos(const ECS::Rigid &base) const {
     const Stance *stance = &hum.baseStance;
-    auto closest = ecs.obstacleSys->closest(base.translation);
-    if (closest && closest->second < hum.lowCoverDistance) {
+    // crouch where only low cover protects from a shooter somewhere in front
+    auto ahead = base.translation + 50.f * (base.rotation * tg::vec3(0, 0, -1));
+    if (auto cover = Obstacle::bestCover(ecs, base.translation, hum.lowCoverDistance, ahead)) {
+        if (!cover->protects(ahead - cover->pos, true)) {stance = &hum.crouchStance;}
+    } else if (auto closest = ecs.obstacleSys->closest(base.translation); closest && closest->second < hum.lowCoverDistance) {
+        // no cover point here (e. g. it was too close to another obstacle): crouch next to low obstacles
         auto iter = ecs.obstacles.find(closest->first);
-        if (iter != ecs.obstacles.end() && !iter->second.highCover) {
-            stance = &hum.crouchStance;
-        }
+        if (iter != ecs.obstacles.end() && !iter->second.highCover) {stance = &hum.crouchStance;}
     }
     auto res = HumanoidPos::fromStance(*stance, base);
     setFeet(res, *stance);
@@ -190,6 +206,8 @@ HumanoidPos MovementContext::restPos(const ECS::Rigid &base) const {
 void MovementContext::planWalk(const HumanoidPos &startPos, const tg::dir3 &up, const tg::vec3 &endFwd) {
     TG_ASSERT(!mob.knots.empty());
     Stepper stepper(mob, hum, up, hum.stepsPerSecond);
+    // `startPos` already includes any avoidance offset
+    mob.avoidOffset = tg::vec3::zero;
     hum.steps.clear();
     hum.steps.push_back({stepper.start, 0.f, startPos});
     for (auto i : Util::IntRange(unsigned(1), stepper.steps)) {
@@ -302,3 +320,41 @@ ArmPos HumanoidPos::armPos(int side, const ECS::Rigid &chest, const Humanoid &hu
     ))};
     return {upperArm, lowerArm, hand};
 }
+
+NavMesh::Planner::Ticket Combat::orderWalk(ECS::ECS &ecs, const NavMesh::Planner::Request &req, tg::dir3 up, tg::vec3 endFwd) {
+    // the caller is gone by the time the route arrives, so look everything up again then
+    return ecs.routePlanner->submit(ecs, req, [&ecs, req, up, endFwd] (const NavMesh::Planner::Result &res) {
+        if (res.route.empty() && (!res.complete || res.req.start_face != res.req.end_face)) {return;}  // no route
+        auto navIter = ecs.navMeshes.find(res.navId);
+        if (navIter == ecs.navMeshes.end()) {return;}
+        auto &nav = navIter->second;
+        auto humpos = ecs.simSnap->humanoids.find(res.owner);
+        if (humpos == ecs.simSnap->humanoids.end()) {return;}
+        auto humJoin = ECS::Join(ecs.mobileUnits, ecs.humanoids);
+        auto humIter = humJoin.find(res.owner);
+        if (humIter == humJoin.end()) {return;}
+        auto [mob, hum, id] = *humIter;
+        // a route without one ends the old search too; partial routes come from
+        // sliced searches, which never keep theirs
+        if (res.complete) {mob.replanner = res.replanner;}
+        auto pos = humpos->second.base.translation;
+        auto routeReq = res.req;
+        auto route = res.route;
+        if (!nav.reanchor(routeReq, route, pos)) {
+            if (!res.complete) {return;}  // the final route comes anyway
+            // the old walk keeps the unit moving, so the next one may not fit either
+            if (req.retries >= 1) {return;}
+            auto start = nav.closestPoint(pos);
+            if (!start) {return;}
+            auto again = req;
+            again.retries += 1;
+            again.replanner = std::move(mob.replanner);
+            again.route.start = pos;
+            again.route.start_face = start->first;
+            orderWalk(ecs, again, up, endFwd);
+            return;
+        }
+        if (!mob.applyRoute(*navIter, routeReq, route, ecs)) {return;}
+        MovementContext {ecs, hum, mob, nav}.planWalk(humpos->second, up, endFwd);
+    });
+}
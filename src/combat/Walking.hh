@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <navmesh/Planner.hh>
 #include "Combat.hh"
 
 namespace Combat {
@@ -43,9 +44,19 @@ struct MovementContext {
     void setFeet(HumanoidPos &pos, const Stance &stance) const;
 
     void interpolate(HumanoidPos &humpos, double time) const;
+    /// shifts the unit horizontally by `offset`, keeping it on the ground
+    void applyOffset(HumanoidPos &humpos, tg::vec3 offset) const;
     HumanoidPos posFromKeyFrame(const KeyFrame &) const;
     HumanoidPos restPos(const ECS::Rigid &) const;
     void planWalk(const HumanoidPos &startPos, const tg::dir3 &up, const tg::vec3 &endFwd);
 };
 
+/// plans the route of `req.owner` through `ECS::routePlanner`, replacing its
+/// pending one, and walks it from where the unit is once it arrives (see
+/// `NavMesh::Instance::reanchor`). If the unit has left the route by then, it
+/// is planned again from there, once; if that doesn't fit either, the unit
+/// keeps its old walk. Partial routes of a `sliced` request are walked until
+/// the next one (or the final route) replaces them. Returns 0 if nothing was submitted
+NavMesh::Planner::Ticket orderWalk(ECS::ECS &, const NavMesh::Planner::Request &req, tg::dir3 up, tg::vec3 endFwd);
+
 }
@@ -3,6 +3,7 @@
 #include <combat/Combat.hh>
 #include <ECS/Misc.hh>
 #include <Game.hh>
+#include <trigger/Trigger.hh>
 
 using namespace Parrot;
 
@@ -10,27 +11,27 @@ System::System(Game& game) : mGame{game}, mSharedResources(game.mSharedResources
 
 }
 void System::behaviorUpdate() {
-    RiggedMesh::Data& parrotMesh = mGame.mSharedResources.mParrotMesh;
-    for (auto &&tup : ECS::Join(mGame.mECS.riggedRigids, mGame.mECS.riggedMeshes, mGame.mECS.parrots))
-    {
-        auto &[wo, instance, parrot, id] = tup;
-        if(parrot.wasFrightened) {
-            continue;
-        }
-        // FIXME: Implement KDTree for faster proximity check, but this will suffice for now
-        const tg::pos2 parrotPos(wo.translation.x, wo.translation.z);
-        tg::pos2 humanoidPos;
-        for (auto const& [humEnt, hum] : mGame.mECS.simSnap->humanoids)
-        {
-            const tg::pos3& humTrans = hum.base.translation;
-            humanoidPos.x = humTrans.x;
-            humanoidPos.y = humTrans.z;
-            if (tg::distance(parrotPos, humanoidPos) < parrotFrightenDistance)
-            {
-                instance.animator->setNewAnimation(instance.meshData->animations[mSharedResources.ANIM_PARROT_START_FLY]);
-                instance.animator->enqueAnimation(mSharedResources.mParrotMesh.animations[mSharedResources.ANIM_PARROT_FLY]);
-                parrot.wasFrightened = true;
-            }
-        }
+    auto &ecs = mGame.mECS;
+    // every parrot that can still be frightened gets a trigger volume;
+    // it will start reporting humanoids from the next update on
+    for (auto &&tup : ECS::Join(ecs.riggedRigids, ecs.parrots)) {
+        auto &[wo, parrot, id] = tup;
+        if (parrot.wasFrightened || parrot.trigger != ECS::INVALID) {continue;}
+        parrot.trigger = ecs.triggerSys->spawn(Trigger::Volume::cylinder(id, wo.translation, parrotFrightenDistance, parrotFrightenHalfHeight));
+    }
+    for (auto &event : ecs.triggerSys->events) {
+        if (!event.enter) {continue;}
+        auto parrotIter = ecs.parrots.find(event.owner);
+        if (parrotIter == ecs.parrots.end() || parrotIter->second.trigger != event.volume) {continue;}
+        auto meshIter = ecs.riggedMeshes.find(event.owner);
+        if (meshIter == ecs.riggedMeshes.end()) {continue;}
+        auto &parrot = parrotIter->second;
+        auto &instance = meshIter->second;
+        instance.animator->setNewAnimation(instance.meshData->animations[mSharedResources.ANIM_PARROT_START_FLY]);
+        instance.animator->enqueAnimation(mSharedResources.mParrotMesh.animations[mSharedResources.ANIM_PARROT_FLY]);
+        parrot.wasFrightened = true;
+        // doesn't touch the event list
+        ecs.deleteEntity(parrot.trigger);
+        parrot.trigger = ECS::INVALID;
     }
 }
@@ -1,15 +1,20 @@
 // SPDX-License-Identifier: MIT
 #pragma once
 #include "fwd.hh"
+#include <ECS.hh>
 
 namespace Parrot
 {
     struct Instance {
         bool wasFrightened = false;
+        /// trigger volume that frightens the parrot, INVALID once it was frightened
+        ECS::entity trigger = ECS::INVALID;
     };
 
     class System {
         float parrotFrightenDistance = 10;
+        /// the check is horizontal, like it always was; this only bounds the volume in the tree
+        float parrotFrightenHalfHeight = 50;
 
         Game& mGame;
         SharedResources& mSharedResources;
@@ -38,11 +38,14 @@ namespace MeshViz {
 
 namespace NavMesh {
     struct Instance;
+    class Planner;
+    class Replanner;
     struct RouteRequest;
     class System;
 }
 
 namespace Obstacle {
+    struct CoverPoint;
     struct Obstruction;
     class System;
     struct Type;
@@ -54,6 +57,11 @@ namespace Terrain {
     class System;
 }
 
+namespace Trigger {
+    struct Volume;
+    class System;
+}
+
 namespace Water {
     struct Instance;
     class System;
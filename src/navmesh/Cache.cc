@@ -0,0 +1,358 @@
+// SPDX-License-Identifier: MIT
+#include "Cache.hh"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <terrain/Terrain.hh>
+#include "NavMesh.hh"
+
+using namespace NavMesh;
+
+namespace {
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t payloadSize;
+    uint64_t checksum;  ///< of the payload
+};
+constexpr char MAGIC[4] = {'N', 'A', 'V', 'M'};
+
+struct Writer {
+    std::vector<char> data;
+
+    template<typename T>
+    void value(const T &v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        auto p = reinterpret_cast<const char *>(&v);
+        data.insert(data.end(), p, p + sizeof(T));
+    }
+    template<typename T>
+    void array(const std::vector<T> &v) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        value(uint64_t(v.size()));
+        auto p = reinterpret_cast<const char *>(v.data());
+        data.insert(data.end(), p, p + v.size() * sizeof(T));
+    }
+};
+
+/// bounds-checked reads from the mapped file; once anything is out of
+/// bounds, `ok` stays false and everything reads as zero
+struct Reader {
+    const char *pos, *end;
+    bool ok = true;
+
+    template<typename T>
+    T value() {
+        T res{};
+        if (!ok || size_t(end - pos) < sizeof(T)) {
+            ok = false;
+            return res;
+        }
+        std::memcpy(&res, pos, sizeof(T));
+        pos += sizeof(T);
+        return res;
+    }
+    template<typename T>
+    void array(std::vector<T> &v) {
+        auto n = value<uint64_t>();
+        if (!ok || n > size_t(end - pos) / sizeof(T)) {
+            ok = false;
+            return;
+        }
+        v.resize(n);
+        std::memcpy(v.data(), pos, n * sizeof(T));
+        pos += n * sizeof(T);
+    }
+};
+}
+
+/// FNV-1a on 64-bit words, with the tail padded by zeros
+static uint64_t hashBytes(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325) {
+    constexpr uint64_t prime = 0x100000001b3;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, size - i);
+        hash = (hash ^ word) * prime;
+    }
+    return hash ^ (hash >> 29);
+}
+
+uint64_t NavMesh::cacheKey(const ECS::Rigid &wo, const Terrain::Instance &terrain) {
+    Writer inputs;
+    inputs.value(CACHE_VERSION);
+    inputs.value(wo.translation);
+    inputs.value(wo.rotation);
+    inputs.value(terrain.segmentsAmount);
+    inputs.value(terrain.segmentSize);
+    inputs.value(terrain.noiseScale);
+    inputs.value(terrain.noiseOctaves);
+    inputs.value(terrain.mountainHeight);
+    inputs.value(terrain.noiseOffset);
+    inputs.value(terrain.waterLevel);
+    inputs.value(terrain.waterdepth);
+    inputs.value(terrain.beachSteepness);
+    // the generator may change without its settings changing
+    inputs.value(uint64_t(terrain.mesh->all_vertices().size()));
+    inputs.value(uint64_t(terrain.mesh->all_faces().size()));
+    for (auto v : terrain.mesh->all_vertices()) {inputs.value(terrain.posAttr[v]);}
+    return hashBytes(inputs.data.data(), inputs.data.size());
+}
+
+std::string NavMesh::cachePath(const std::string &cacheDir, uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "navmesh-%016llx.bin", (unsigned long long)key);
+    return (std::filesystem::path(cacheDir) / name).string();
+}
+
+bool NavMesh::saveCache(const std::string &path, uint64_t key, const Instance &nav) {
+    if (!nav.graph || !nav.landmarks) {return false;}
+    Writer out;
+    std::vector<tg::pos3> local, world;
+    for (auto v : nav.mesh->all_vertices()) {
+        local.push_back(nav.localPos[v]);
+        world.push_back(nav.worldPos[v]);
+    }
+    out.array(local);
+    out.array(world);
+    std::vector<uint32_t> triangles;
+    for (auto f : nav.mesh->all_faces()) {
+        auto tri = canonicalTriangle(f);
+        triangles.insert(triangles.end(), tri.begin(), tri.end());
+    }
+    out.array(triangles);
+
+    auto &g = *nav.graph;
+    out.array(g.vx), out.array(g.vy), out.array(g.vz);
+    out.array(g.faces);
+    out.array(g.faceComponent);
+    out.value(g.numComponents);
+    out.array(g.halfedgeFace), out.array(g.halfedgeTo);
+    out.array(g.edgeA), out.array(g.edgeB);
+    out.array(g.edgeLength), out.array(g.edgeMid);
+
+    auto &lm = *nav.landmarks;
+    out.value(lm.count);
+    out.value(lm.scale);
+    out.array(lm.edges), out.array(lm.dist);
+
+    out.value(uint8_t(nav.heightfield.has_value()));
+    if (auto &hf = nav.heightfield) {
+        out.value(hf->cells);
+        out.value(hf->cellSize);
+        out.array(hf->cellStart), out.array(hf->cellFaces);
+        out.value(uint64_t(hf->levels.size()));
+        for (auto &level : hf->levels) {out.array(level);}
+    }
+
+    Header header;
+    std::memcpy(header.magic, MAGIC, 4);
+    header.version = CACHE_VERSION;
+    header.key = key;
+    header.payloadSize = out.data.size();
+    header.checksum = hashBytes(out.data.data(), out.data.size());
+
+    // write to the side and rename, so a crash can't leave a half-written file behind
+    std::error_code err;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), err);
+    auto tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(out.data.data(), std::streamsize(out.data.size()));
+        if (!file) {return false;}
+    }
+    std::filesystem::rename(tmp, path, err);
+    return !err;
+}
+
+std::optional<Instance> NavMesh::loadCache(const std::string &path, uint64_t key, const ECS::Rigid &wo) {
+    MappedFile file(path);
+    if (!file.data()) {return std::nullopt;}
+    auto reject = [&] (const char *reason) {
+        glow::warning() << "navmesh cache " << path << " " << reason << ", rebuilding";
+        return std::nullopt;
+    };
+    Header header;
+    if (file.size() < sizeof(header)) {return reject("is truncated");}
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, 4) != 0) {return reject("is not a navmesh cache");}
+    if (header.version != CACHE_VERSION) {return reject("is from another version");}
+    if (header.key != key) {return reject("is for another terrain");}
+    auto payload = file.data() + sizeof(header);
+    if (header.payloadSize != file.size() - sizeof(header)) {return reject("is truncated");}
+    if (hashBytes(payload, header.payloadSize) != header.checksum) {return reject("is corrupt");}
+
+    Reader in{payload, payload + header.payloadSize};
+    std::optional<Instance> res(std::in_place);
+    auto &nav = *res;
+    std::vector<tg::pos3> local, world;
+    std::vector<uint32_t> triangles;
+    in.array(local), in.array(world), in.array(triangles);
+    if (!in.ok || local.size() != world.size() || triangles.size() % 3 != 0) {return reject("has a broken mesh");}
+    for (size_t i = 0; i < local.size(); ++i) {
+        auto v = nav.mesh->vertices().add();
+        nav.localPos[v] = local[i];
+        nav.worldPos[v] = world[i];
+    }
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+        auto a = triangles[i], b = triangles[i + 1], c = triangles[i + 2];
+        if (a >= local.size() || b >= local.size() || c >= local.size() || a == b || b == c || c == a) {return reject("has a broken mesh");}
+        nav.mesh->faces().add(nav.mesh->vertices()[a], nav.mesh->vertices()[b], nav.mesh->vertices()[c]);
+    }
+
+    Graph g;
+    in.array(g.vx), in.array(g.vy), in.array(g.vz);
+    in.array(g.faces);
+    in.array(g.faceComponent);
+    g.numComponents = in.value<uint32_t>();
+    in.array(g.halfedgeFace), in.array(g.halfedgeTo);
+    in.array(g.edgeA), in.array(g.edgeB);
+    in.array(g.edgeLength), in.array(g.edgeMid);
+    Landmarks lm;
+    lm.count = in.value<uint32_t>();
+    lm.scale = in.value<float>();
+    in.array(lm.edges), in.array(lm.dist);
+    if (!in.ok) {return reject("is truncated");}
+
+    // the graph has to match the mesh it is used with, index for index
+    auto nf = nav.mesh->all_faces().size(), ne = nav.mesh->all_edges().size();
+    auto nv = local.size();
+    bool matches = g.faces.size() == nf && g.faceComponent.size() == nf
+        && g.vx.size() == nv && g.vy.size() == nv && g.vz.size() == nv
+        && g.halfedgeTo.size() == 2 * ne && g.halfedgeFace.size() == 2 * ne
+        && g.edgeA.size() == ne && g.edgeB.size() == ne && g.edgeLength.size() == ne && g.edgeMid.size() == ne
+        && lm.edges.size() == lm.count && lm.dist.size() == size_t(lm.count) * ne;
+    for (auto h : nav.mesh->all_halfedges()) {
+        if (!matches) {break;}
+        matches = g.halfedgeTo[h.idx.value] == uint32_t(h.vertex_to().idx.value)
+            && g.halfedgeFace[h.idx.value] == (h.is_boundary() ? Graph::NONE : uint32_t(h.face().idx.value));
+    }
+    for (auto e : nav.mesh->all_edges()) {
+        if (!matches) {break;}
+        matches = g.edgeA[e.idx.value] == uint32_t(e.vertexA().idx.value) && g.edgeB[e.idx.value] == uint32_t(e.vertexB().idx.value);
+    }
+    for (auto f : nav.mesh->all_faces()) {
+        if (!matches) {break;}
+        auto &links = g.faces[f.idx.value];
+        size_t i = 0;
+        for (auto h : f.halfedges()) {
+            matches = matches && i < 3 && links.halfedge[i] == uint32_t(h.idx.value)
+                && links.neighbor[i] == g.halfedgeFace[Graph::opposite(h.idx.value)];
+            i += 1;
+        }
+        matches = matches && i == 3 && g.faceComponent[f.idx.value] < g.numComponents;
+    }
+    for (auto e : lm.edges) {matches = matches && e < ne;}
+    if (!matches) {return reject("doesn't match its mesh");}
+    nav.graph = std::make_shared<Graph>(std::move(g));
+    nav.landmarks = std::make_shared<const Landmarks>(std::move(lm));
+
+    if (in.value<uint8_t>()) {
+        Heightfield hf;
+        hf.transform = wo;
+        hf.cells = in.value<uint32_t>();
+        hf.cellSize = in.value<float>();
+        in.array(hf.cellStart), in.array(hf.cellFaces);
+        auto nlevels = in.value<uint64_t>();
+        for (uint64_t i = 0; i < nlevels && in.ok; ++i) {in.array(hf.levels.emplace_back());}
+        bool valid = in.ok && hf.cells > 0 && hf.cellStart.size() == size_t(hf.cells) * hf.cells + 1
+            && hf.cellStart.front() == 0 && hf.cellStart.back() == hf.cellFaces.size()
+            && std::is_sorted(hf.cellStart.begin(), hf.cellStart.end());
+        for (auto f : hf.cellFaces) {valid = valid && f.value >= 0 && size_t(f.value) < nf;}
+        // the pyramid goes up to a single block, see `Heightfield::build`
+        valid = valid && !hf.levels.empty() && hf.levels.size() <= 32;
+        for (size_t level = 0; valid && level < hf.levels.size(); ++level) {
+            auto size = size_t(hf.levelSize(level));
+            bool top = level + 1 == hf.levels.size();
+            valid = hf.levels[level].size() == size * size && (size == 1) == top;
+        }
+        if (!valid) {return reject("has a broken heightfield");}
+        nav.heightfield = std::move(hf);
+    }
+    if (in.pos != in.end) {return reject("has trailing data");}
+    nav.buildFaceTree();
+    return res;
+}
+
+Instance Instance::cached(const ECS::Rigid &wo, const Terrain::Instance &terrain, const std::string &cacheDir) {
+    auto key = cacheKey(wo, terrain);
+    auto path = cachePath(cacheDir, key);
+    if (auto res = loadCache(path, key, wo)) {
+        glow::info() << "navmesh loaded from " << path;
+        return std::move(*res);
+    }
+    Instance res(wo, terrain);
+    if (saveCache(path, key, res)) {
+        glow::info() << "navmesh cached in " << path;
+    } else {
+        glow::warning() << "could not write navmesh cache " << path;
+    }
+    return res;
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &path) {
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        mFile = nullptr;
+        return;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0) {return;}
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mMapping) {return;}
+    mData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if (mData) {mSize = size_t(size.QuadPart);}
+}
+
+MappedFile::~MappedFile() {
+    if (mData) {UnmapViewOfFile(mData);}
+    if (mMapping) {CloseHandle(mMapping);}
+    if (mFile) {CloseHandle(mFile);}
+}
+#else
+MappedFile::MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {return;}
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        auto addr = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            mData = static_cast<const char *>(addr);
+            mSize = size_t(st.st_size);
+        }
+    }
+    close(fd);  // the mapping stays valid
+}
+
+MappedFile::~MappedFile() {
+    if (mData) {munmap(const_cast<char *>(mData), mSize);}
+}
+#endif
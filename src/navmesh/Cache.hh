@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include <fwd.hh>
+
+namespace NavMesh {
+
+/// layout of the cache files; bump it whenever the file layout or the way
+/// navmeshes are built changes, so old files are rebuilt instead of loaded
+constexpr uint32_t CACHE_VERSION = 4;
+
+/// hash of everything a navmesh is built from: the terrain's settings and
+/// vertices, and where it is placed
+uint64_t cacheKey(const ECS::Rigid &, const Terrain::Instance &);
+std::string cachePath(const std::string &cacheDir, uint64_t key);
+
+/// writes the mesh, graph, landmarks and heightfield grid. The face tree is
+/// cheap to rebuild from the faces, so it isn't stored
+bool saveCache(const std::string &path, uint64_t key, const Instance &);
+/// nullopt if there is no file, or it is truncated, corrupt, from another
+/// version or for another key. `wo` has to be the transform it was built with
+std::optional<Instance> loadCache(const std::string &path, uint64_t key, const ECS::Rigid &wo);
+
+/// read-only memory mapping of a whole file
+class MappedFile {
+    const char *mData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN32
+    void *mFile = nullptr, *mMapping = nullptr;
+#endif
+
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// null if the file couldn't be mapped
+    const char *data() const {return mData;}
+    size_t size() const {return mSize;}
+};
+
+}
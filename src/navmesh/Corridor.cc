@@ -0,0 +1,255 @@
+// SPDX-License-Identifier: MIT
+#include "Corridor.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+#include <typed-geometry/tg.hh>
+
+using namespace NavMesh;
+
+namespace {
+/// portal as seen when walking through it, shrunk by the unit radius
+struct Portal {
+    tg::pos3 left, right;
+};
+
+struct Corner {
+    tg::pos3 pos;
+    size_t portal;
+};
+}
+
+/// twice the signed area of the triangle projected to the ground plane,
+/// positive if `c` is on the left of `a → b`
+static float area2(tg::pos3 a, tg::pos3 b, tg::pos3 c) {
+    return (b.x - a.x) * (c.z - a.z) - (b.z - a.z) * (c.x - a.x);
+}
+
+/// the "simple stupid funnel algorithm" (Mononen): shortest path through the
+/// portals in the ground plane. The first and last portals have to be the
+/// degenerate start and end portals
+static void pullString(const std::vector<Portal> &portals, std::vector<Corner> &corners) {
+    auto apex = portals[0].left, left = apex, right = apex;
+    size_t apexIdx = 0, leftIdx = 0, rightIdx = 0;
+    corners.push_back({apex, 0});
+    for (size_t i = 1; i < portals.size(); ++i) {
+        auto &portal = portals[i];
+        if (area2(apex, right, portal.right) >= 0.f) {
+            if (apex == right || area2(apex, left, portal.right) < 0.f) {  // narrow the funnel
+                right = portal.right;
+                rightIdx = i;
+            } else {  // right crossed over left: left is a corner, restart from there
+                corners.push_back({left, leftIdx});
+                apex = right = left;
+                apexIdx = rightIdx = leftIdx;
+                i = apexIdx;
+                continue;
+            }
+        }
+        if (area2(apex, left, portal.left) <= 0.f) {
+            if (apex == left || area2(apex, right, portal.left) > 0.f) {
+                left = portal.left;
+                leftIdx = i;
+            } else {
+                corners.push_back({right, rightIdx});
+                apex = left = right;
+                apexIdx = leftIdx = rightIdx;
+                i = apexIdx;
+                continue;
+            }
+        }
+    }
+    if (corners.back().portal != portals.size() - 1) {corners.push_back({portals.back().left, portals.size() - 1});}
+}
+
+Route Searcher::corridor(const RouteRequest &req, Obstacle::Collider &collider, const std::vector<uint8_t> *clusters) {
+    assert(req.start_face != req.end_face);  // empty vector is the error result
+    CorridorSearch search(SearchContext<FaceNode>::local(), graph, landmarks, req, collider.radius(), hierarchy, clusters,
+        bakedObstacles ? hierarchy : nullptr);
+    search.expand(collider);
+    stats = search.stats();
+    if (search.status() != CorridorSearch::Status::Found) {return {};}
+    return search.route(collider);
+}
+
+template<class Context>
+BasicCorridorSearch<Context>::BasicCorridorSearch(Context &ctx, const Graph &g, const Landmarks *landmarks, const RouteRequest &req, float radius,
+    const Hierarchy *hierarchy, const std::vector<uint8_t> *clusters, const Hierarchy *baked
+) : mCtx{ctx}, mGraph{g}, mEstimate(g, landmarks, req.end, uint32_t(req.end_face.value)), mReq{req},
+    mStartFace{uint32_t(req.start_face.value)}, mEndFace{uint32_t(req.end_face.value)},
+    mRadius{radius}, mHierarchy{hierarchy}, mClusters{clusters}, mBaked{baked}, mBest{mStartFace} {
+    assert(!clusters || hierarchy);
+    ctx.begin(g.numFaces());
+    ctx.open(mStartFace) = {0.f, Graph::NONE, Graph::NONE, false, req.start};
+    ctx.push(mStartFace, tg::distance(req.start, req.end));
+}
+
+template<class Context>
+size_t BasicCorridorSearch<Context>::expand(Obstacle::Collider &collider, size_t budget) {
+    auto &g = mGraph;
+    auto &ctx = mCtx;
+    size_t done = 0;
+    // A* over the faces, measuring along the portal midpoints
+    while (mStatus == Status::Running && done < budget) {
+        if (ctx.queueEmpty()) {
+            mStatus = Status::Failed;
+            break;
+        }
+        auto [key, face] = ctx.pop();
+        // a copy: opening the neighbours may move the nodes of a sparse context
+        auto node = ctx.node(face);
+        ctx.node(face).closed = true;
+        mStats.expanded += 1;
+        done += 1;
+        if (face == mEndFace) {
+            mStatus = Status::Found;
+            break;
+        }
+        if (key - node.cost < mBestEstimate) {  // the key is cost + estimate
+            mBestEstimate = key - node.cost;
+            mBest = face;
+        }
+        auto &links = g.faces[face];
+        // past the start face, the face is entered at an edge midpoint, which
+        // is where the baked obstacles are measured from
+        int entry = -1;
+        if (face != mStartFace && mBaked && mBaked->baked(face, collider)) {
+            auto in = Graph::edgeOf(node.halfedge);
+            for (auto i : {0, 1, 2}) {
+                if (Graph::edgeOf(links.halfedge[i]) == in) {entry = i;}
+            }
+        }
+        if (entry < 0) {collider.collectObjects(g.faceAABB(face));}
+        for (auto i : {0, 1, 2}) {
+            auto next = links.neighbor[i];
+            if (next == Graph::NONE || (ctx.isOpen(next) && ctx.node(next).closed)) {continue;}
+            if (mClusters && !(*mClusters)[mHierarchy->faceCluster[next]]) {continue;}
+            auto h = links.halfedge[i];
+            auto edge = Graph::edgeOf(h);
+            if (g.edgeLength[edge] <= 2 * mRadius) {continue;}  // too narrow to pass
+            auto p = g.edgeMid[edge];
+            mStats.connections += 1;
+            if (entry >= 0 ? mBaked->blocked(face, entry, i) : collider.segmentObstructed(tg::segment3(node.point, p))) {continue;}
+            auto cost = node.cost + tg::distance(node.point, p);
+            if (!ctx.isOpen(next)) {
+                ctx.open(next) = {cost, h, face, false, p};
+                ctx.push(next, cost + mEstimate(edge, p));
+            } else if (cost < ctx.node(next).cost) {
+                auto &nextNode = ctx.node(next);
+                nextNode.cost = cost;
+                nextNode.halfedge = h;
+                nextNode.predecessor = face;
+                nextNode.point = p;
+                ctx.push(next, cost + mEstimate(edge, p));
+            }
+        }
+    }
+    mStats.opened = ctx.opened;
+    mStats.scratchBytes = ctx.memoryBytes();
+    return done;
+}
+
+template<class Context>
+Route BasicCorridorSearch<Context>::route(Obstacle::Collider &collider) const {
+    assert(mStatus == Status::Found);
+    return routeTo(mEndFace, mReq.end, collider);
+}
+
+template<class Context>
+PartialRoute BasicCorridorSearch<Context>::partial(Obstacle::Collider &collider) const {
+    PartialRoute res;
+    res.req = mReq;
+    if (mStatus == Status::Found) {
+        res.route = route(collider);
+        res.complete = true;
+        return res;
+    }
+    // stop on the portal into the best face, in the face before it; the
+    // start face means staying put
+    res.req.end = mCtx.node(mBest).point;
+    if (mBest == mStartFace) {
+        res.req.end_face = res.req.start_face;
+        return res;
+    }
+    res.req.end_face = pm::face_index(int(mCtx.node(mBest).predecessor));
+    res.route = routeTo(mBest, res.req.end, collider);
+    if (!res.route.empty()) {res.route.pop_back();}  // that is the portal the route ends on
+    return res;
+}
+
+template<class Context>
+Route BasicCorridorSearch<Context>::routeTo(uint32_t endFace, tg::pos3 end, Obstacle::Collider &collider) const {
+    // collect the corridor, from start to end
+    std::vector<uint32_t> halfedges;
+    for (auto face = endFace; face != mStartFace; face = mCtx.node(face).predecessor) {
+        halfedges.push_back(mCtx.node(face).halfedge);
+    }
+    std::reverse(halfedges.begin(), halfedges.end());
+    return NavMesh::pullCorridor(mGraph, halfedges, mReq.start, end, mRadius, collider);
+}
+
+template class NavMesh::BasicCorridorSearch<SearchContext<FaceNode>>;
+template class NavMesh::BasicCorridorSearch<SparseSearchContext<FaceNode>>;
+
+Route NavMesh::pullCorridor(const Graph &g, const std::vector<uint32_t> &halfedges, tg::pos3 start, tg::pos3 end, float radius, Obstacle::Collider &collider) {
+    std::vector<Portal> portals;
+    portals.reserve(halfedges.size() + 2);
+    portals.push_back({start, start});
+    for (auto h : halfedges) {
+        auto &links = g.faces[g.halfedgeFace[h]];
+        uint32_t third = 0;
+        for (auto i : {0, 1, 2}) {
+            if (links.halfedge[i] == h) {third = g.halfedgeTo[links.halfedge[(i + 1) % 3]];}
+        }
+        auto from = g.vertex(g.halfedgeTo[Graph::opposite(h)]), to = g.vertex(g.halfedgeTo[h]);
+        auto shrink = radius / g.edgeLength[Graph::edgeOf(h)];
+        auto a = tg::lerp(from, to, shrink), b = tg::lerp(from, to, 1 - shrink);
+        // the face we come from is behind the portal, so it tells us which side is which
+        if (area2(g.vertex(third), from, to) > 0.f) {
+            portals.push_back({b, a});
+        } else {
+            portals.push_back({a, b});
+        }
+    }
+    portals.push_back({end, end});
+    std::vector<Corner> corners;
+    pullString(portals, corners);
+
+    // turn the path into crossings of the corridor portals
+    Route res;
+    res.reserve(halfedges.size());
+    size_t leg = 0;
+    for (size_t i = 1; i + 1 < portals.size(); ++i) {
+        while (corners[leg + 1].portal < i) {leg += 1;}
+        auto pa = corners[leg].pos, pb = corners[leg + 1].pos;
+        auto h = halfedges[i - 1];
+        auto from = g.vertex(g.halfedgeTo[Graph::opposite(h)]), to = g.vertex(g.halfedgeTo[h]);
+        // intersect the leg with the portal line in the ground plane
+        auto denom = area2(from, to, from + (pb - pa));
+        float param;
+        if (std::abs(denom) > 1e-12f) {
+            param = area2(pa, pb, from) / denom;
+        } else {  // leg is parallel to the portal or degenerate
+            auto dir = to - from;
+            param = tg::dot(pa - from, dir) / tg::dot(dir, dir);
+        }
+        auto shrink = radius / g.edgeLength[Graph::edgeOf(h)];
+        res.push_back({pm::halfedge_index(int(h)), tg::clamp(param, shrink, 1 - shrink)});
+    }
+
+    // funnel legs cut corners the midpoint search did not check
+    auto prev = start;
+    for (size_t i = 0; i <= res.size(); ++i) {
+        auto p = end;
+        if (i < res.size()) {
+            auto h = uint32_t(res[i].first.value);
+            p = tg::lerp(g.vertex(g.halfedgeTo[Graph::opposite(h)]), g.vertex(g.halfedgeTo[h]), res[i].second);
+        }
+        collider.collectObjects({tg::min(prev, p), tg::max(prev, p)});
+        if (collider.segmentObstructed(tg::segment3(prev, p))) {return {};}
+        prev = p;
+    }
+    return res;
+}
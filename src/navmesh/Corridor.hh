@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include "NavMesh.hh"
+#include "Search.hh"
+
+namespace NavMesh {
+
+struct FaceNode {
+    float cost;  // length of the path through portal midpoints up to here
+    uint32_t halfedge;  // portal through which the face was entered (halfedge of the predecessor)
+    uint32_t predecessor;  // face
+    bool closed;
+    tg::pos3 point;  // where the portal is crossed
+};
+
+/// a route that may stop short of the goal
+struct PartialRoute {
+    RouteRequest req;  ///< `end` and `end_face` are where the route stops
+    Route route;
+    bool complete = false;
+};
+
+/// string-pulls the way from `start` to `end` through the portals `halfedges`
+/// (each in the face being left), shrunk by the unit radius. Empty if the
+/// pulled path is obstructed
+Route pullCorridor(const Graph &, const std::vector<uint32_t> &halfedges, tg::pos3 start, tg::pos3 end, float radius, Obstacle::Collider &);
+
+enum class CorridorStatus {Running, Found, Failed};
+
+/// state of one corridor search (see `Searcher::corridor`), so the face A*
+/// can be run a few expansions at a time. The search only lives in `ctx`,
+/// which has to stay untouched by other searches until this one is done.
+/// With `baked`, the obstacles baked into its faces are used instead of
+/// collision queries wherever they are up to date for the collider.
+/// `Context` is `SearchContext<FaceNode>` or `SparseSearchContext<FaceNode>`
+template<class Context>
+class BasicCorridorSearch {
+public:
+    using Status = CorridorStatus;
+
+    BasicCorridorSearch(Context &ctx, const Graph &, const Landmarks *, const RouteRequest &, float radius,
+        const Hierarchy * = nullptr, const std::vector<uint8_t> *clusters = nullptr, const Hierarchy *baked = nullptr);
+
+    /// runs up to `budget` expansions and returns how many it did
+    size_t expand(Obstacle::Collider &, size_t budget = std::numeric_limits<size_t>::max());
+    Status status() const {return mStatus;}
+    const SearchStats &stats() const {return mStats;}
+    /// string-pulled route once `Found`; empty if the pulled path is obstructed
+    Route route(Obstacle::Collider &) const;
+    /// route to the entry of the expanded face that looks closest to the end,
+    /// for callers that want to start walking before the search is done. The
+    /// final route once `Found`
+    PartialRoute partial(Obstacle::Collider &) const;
+
+private:
+    Context &mCtx;
+    const Graph &mGraph;
+    GoalEstimate mEstimate;
+    RouteRequest mReq;
+    uint32_t mStartFace, mEndFace;
+    float mRadius;
+    const Hierarchy *mHierarchy;
+    const std::vector<uint8_t> *mClusters;
+    const Hierarchy *mBaked;
+    Status mStatus = Status::Running;
+    SearchStats mStats;
+    uint32_t mBest;  ///< expanded face with the lowest estimate
+    float mBestEstimate = std::numeric_limits<float>::infinity();
+
+    Route routeTo(uint32_t face, tg::pos3 end, Obstacle::Collider &) const;
+};
+/// on the per-thread dense context, for searches run in one go
+using CorridorSearch = BasicCorridorSearch<SearchContext<FaceNode>>;
+/// with its own sparse context, for searches that are kept across ticks
+using SparseCorridorSearch = BasicCorridorSearch<SparseSearchContext<FaceNode>>;
+extern template class BasicCorridorSearch<SearchContext<FaceNode>>;
+extern template class BasicCorridorSearch<SparseSearchContext<FaceNode>>;
+
+}
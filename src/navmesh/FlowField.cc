@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: MIT
+#include "FlowField.hh"
+#include <cassert>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+
+#include "Corridor.hh"
+#include "NavMesh.hh"
+#include "Search.hh"
+
+using namespace NavMesh;
+
+namespace {
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+struct EdgeNode {
+    float cost;
+};
+}
+
+FlowField FlowField::build(const Graph &g, const Hierarchy &hier, Obstacle::Collider &collider, uint32_t goalFace, tg::pos3 goal) {
+    FlowField res;
+    res.goalFace = goalFace;
+    res.goal = goal;
+    res.version = hier.version;
+    res.edgeCost.assign(g.numEdges(), INF);
+
+    // Dijkstra over the edge midpoints, outwards from the goal
+    auto &ctx = SearchContext<EdgeNode>::local();
+    ctx.begin(g.numEdges());
+    collider.collectObjects(g.faceAABB(goalFace));
+    for (auto h : g.faces[goalFace].halfedge) {
+        auto e = Graph::edgeOf(h);
+        if (g.edgeLength[e] <= 2 * hier.radius) {continue;}
+        if (collider.segmentObstructed(tg::segment3(goal, g.edgeMid[e]))) {continue;}
+        auto cost = tg::distance(goal, g.edgeMid[e]);
+        ctx.open(e) = {cost};
+        ctx.heap.push(e, cost);
+    }
+    while (!ctx.heap.empty()) {
+        auto [cost, e] = ctx.heap.pop();
+        res.edgeCost[e] = cost;
+        for (auto side : {0u, 1u}) {
+            auto f = g.halfedgeFace[2 * e + side];
+            if (f == Graph::NONE || f == goalFace) {continue;}
+            auto &links = g.faces[f];
+            int i = 0;
+            while (Graph::edgeOf(links.halfedge[i]) != e) {i += 1;}
+            for (int j = 0; j < 3; ++j) {
+                auto e2 = Graph::edgeOf(links.halfedge[j]);
+                if (j == i || res.edgeCost[e2] < INF || g.edgeLength[e2] <= 2 * hier.radius) {continue;}
+                if (hier.blocked(f, j, i)) {continue;}  // units walk towards the goal
+                auto cost2 = cost + tg::distance(g.edgeMid[e], g.edgeMid[e2]);
+                if (!ctx.isOpen(e2)) {
+                    ctx.open(e2) = {cost2};
+                    ctx.heap.push(e2, cost2);
+                } else if (cost2 < ctx.nodes[e2].cost) {
+                    ctx.nodes[e2].cost = cost2;
+                    ctx.heap.push(e2, cost2);
+                }
+            }
+        }
+    }
+
+    res.exit.assign(g.numFaces(), NONE);
+    res.faceCost.assign(g.numFaces(), INF);
+    res.faceCost[goalFace] = tg::distance(g.faceCentroid(goalFace), goal);
+    for (uint32_t f = 0; f < g.numFaces(); ++f) {
+        if (f == goalFace) {continue;}
+        auto center = g.faceCentroid(f);
+        for (auto h : g.faces[f].halfedge) {
+            auto e = Graph::edgeOf(h);
+            auto cost = tg::distance(center, g.edgeMid[e]) + res.edgeCost[e];
+            if (cost < res.faceCost[f]) {
+                res.faceCost[f] = cost;
+                res.exit[f] = h;
+            }
+        }
+    }
+    return res;
+}
+
+bool FlowField::corridor(const Graph &g, const Hierarchy &hier, uint32_t startFace, tg::pos3 start, std::vector<uint32_t> &halfedges) const {
+    halfedges.clear();
+    auto face = startFace;
+    auto pos = start;
+    uint32_t entry = NONE;  // edge we came through
+    while (face != goalFace) {
+        auto &links = g.faces[face];
+        int in = -1;
+        for (int i = 0; i < 3; ++i) {
+            if (Graph::edgeOf(links.halfedge[i]) == entry) {in = i;}
+        }
+        uint32_t best = NONE;
+        float bestCost = INF;
+        for (int j = 0; j < 3; ++j) {
+            if (j == in || links.neighbor[j] == Graph::NONE) {continue;}
+            if (in >= 0 && hier.blocked(face, in, j)) {continue;}
+            auto e = Graph::edgeOf(links.halfedge[j]);
+            auto cost = tg::distance(pos, g.edgeMid[e]) + edgeCost[e];
+            if (cost < bestCost) {
+                bestCost = cost;
+                best = links.halfedge[j];
+            }
+        }
+        if (best == NONE) {return false;}
+        auto next = Graph::edgeOf(best);
+        // the costs have to go down, or we could go in circles
+        if (entry != NONE && !(edgeCost[next] < edgeCost[entry])) {return false;}
+        halfedges.push_back(best);
+        entry = next;
+        pos = g.edgeMid[next];
+        face = g.halfedgeFace[Graph::opposite(best)];
+    }
+    return true;
+}
+
+size_t FlowField::memoryBytes() const {
+    return (edgeCost.capacity() + faceCost.capacity()) * sizeof(float) + exit.capacity() * sizeof(uint32_t);
+}
+
+std::shared_ptr<const FlowField> FlowFieldCache::find(uint32_t goalFace, uint64_t version) {
+    for (auto iter = mFields.begin(); iter != mFields.end(); ++iter) {
+        if ((*iter)->goalFace != goalFace) {continue;}
+        if ((*iter)->version != version) {
+            mFields.erase(iter);
+            break;
+        }
+        mFields.splice(mFields.begin(), mFields, iter);
+        hits += 1;
+        return mFields.front();
+    }
+    misses += 1;
+    return nullptr;
+}
+
+void FlowFieldCache::insert(std::shared_ptr<const FlowField> field) {
+    mFields.remove_if([&] (auto &other) {return other->goalFace == field->goalFace;});
+    mFields.push_front(std::move(field));
+    if (mFields.size() > mCapacity) {mFields.pop_back();}
+}
+
+std::shared_ptr<const FlowField> Instance::flowField(pm::face_index goalFace, Obstacle::Collider &collider) {
+    if (!graph) {return nullptr;}
+    updateHierarchy(collider);
+    auto face = uint32_t(goalFace.value);
+    if (auto res = flowFields.find(face, hierarchy->version)) {return res;}
+    auto res = std::make_shared<const FlowField>(FlowField::build(*graph, *hierarchy, collider, face, graph->faceCentroid(face)));
+    flowFields.insert(res);
+    return res;
+}
+
+Route Instance::flowRoute(const FlowField &field, const RouteRequest &req, Obstacle::Collider &collider) const {
+    assert(uint32_t(req.end_face.value) == field.goalFace);
+    assert(req.start_face != req.end_face);  // empty vector is the error result
+    if (!graph || !hierarchy) {return {};}
+    std::vector<uint32_t> halfedges;
+    if (!field.corridor(*graph, *hierarchy, uint32_t(req.start_face.value), req.start, halfedges)) {return {};}
+    return pullCorridor(*graph, halfedges, req.start, req.end, collider.radius(), collider);
+}
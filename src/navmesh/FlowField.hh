@@ -0,0 +1,57 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <obstacles/Collision.hh>
+#include "Graph.hh"
+#include "Hierarchy.hh"
+
+namespace NavMesh {
+
+/// distances from every edge to one goal, from a single Dijkstra pass, so
+/// any number of units going there can just follow the field instead of
+/// searching. Measured along edge midpoints like the corridor search, with
+/// the obstacles and unit size of the `Hierarchy` it was built from
+struct FlowField {
+    static constexpr uint32_t NONE = -1;
+
+    uint32_t goalFace;
+    tg::pos3 goal;
+    uint64_t version;  ///< of the hierarchy
+    std::vector<float> edgeCost;  ///< from the edge midpoint to the goal, infinite if unreachable
+    /// per face, the halfedge to leave through from its centroid, NONE in
+    /// the goal face and where the goal can't be reached
+    std::vector<uint32_t> exit;
+    std::vector<float> faceCost;  ///< per face, from its centroid
+
+    /// the collider checks the way from the goal to the edges of its face
+    static FlowField build(const Graph &, const Hierarchy &, Obstacle::Collider &, uint32_t goalFace, tg::pos3 goal);
+
+    /// follows the field from `start` in `startFace` to the goal face, writing
+    /// the portals passed to `halfedges`. False if the field doesn't lead there
+    bool corridor(const Graph &, const Hierarchy &, uint32_t startFace, tg::pos3 start, std::vector<uint32_t> &halfedges) const;
+    size_t memoryBytes() const;
+};
+
+/// the flow fields for the most recently used goal faces
+class FlowFieldCache {
+    size_t mCapacity;
+    std::list<std::shared_ptr<const FlowField>> mFields;  ///< most recently used first
+
+public:
+    size_t hits = 0, misses = 0;
+
+    explicit FlowFieldCache(size_t capacity = 16) : mCapacity{capacity} {}
+    /// null if there is no field for the face, or it is out of date
+    std::shared_ptr<const FlowField> find(uint32_t goalFace, uint64_t version);
+    /// evicts the least recently used field if the cache is full
+    void insert(std::shared_ptr<const FlowField>);
+    void clear() {mFields.clear();}
+};
+
+}
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: MIT
+#include "Graph.hh"
+#include <algorithm>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+using namespace NavMesh;
+
+std::optional<Graph> Graph::build(const pm::Mesh &mesh, const pm::vertex_attribute<tg::pos3> &worldPos) {
+    Graph g;
+    auto nv = mesh.all_vertices().size();
+    g.vx.resize(nv), g.vy.resize(nv), g.vz.resize(nv);
+    for (auto v : mesh.all_vertices()) {
+        auto p = worldPos[v];
+        g.vx[v.idx.value] = p.x, g.vy[v.idx.value] = p.y, g.vz[v.idx.value] = p.z;
+    }
+
+    auto ne = mesh.all_edges().size();
+    g.halfedgeFace.assign(2 * ne, NONE);
+    g.halfedgeTo.resize(2 * ne);
+    g.edgeA.resize(ne), g.edgeB.resize(ne);
+    g.edgeLength.resize(ne), g.edgeMid.resize(ne);
+    for (auto e : mesh.all_edges()) {
+        auto idx = e.idx.value;
+        TG_ASSERT(e.halfedgeA().idx.value == 2 * idx && e.halfedgeB().idx.value == 2 * idx + 1);
+        for (auto h : {e.halfedgeA(), e.halfedgeB()}) {
+            g.halfedgeTo[h.idx.value] = h.vertex_to().idx.value;
+            if (!h.is_boundary()) {g.halfedgeFace[h.idx.value] = h.face().idx.value;}
+        }
+        auto a = worldPos[e.vertexA()], b = worldPos[e.vertexB()];
+        g.edgeA[idx] = e.vertexA().idx.value;
+        g.edgeB[idx] = e.vertexB().idx.value;
+        g.edgeLength[idx] = tg::distance(a, b);
+        g.edgeMid[idx] = tg::lerp(a, b, .5f);
+    }
+
+    g.faces.resize(mesh.all_faces().size());
+    for (auto f : mesh.all_faces()) {
+        auto &links = g.faces[f.idx.value];
+        size_t i = 0;
+        for (auto h : f.halfedges()) {
+            if (i == 3) {
+                glow::warning() << "navmesh face " << f.idx.value << " is not a triangle";
+                return std::nullopt;
+            }
+            links.halfedge[i] = h.idx.value;
+            links.neighbor[i] = g.halfedgeFace[opposite(h.idx.value)];
+            i += 1;
+        }
+        if (i != 3) {return std::nullopt;}
+    }
+
+    g.faceComponent.assign(g.faces.size(), NONE);
+    std::vector<uint32_t> stack;
+    for (uint32_t seed = 0; seed < g.faces.size(); ++seed) {
+        if (g.faceComponent[seed] != NONE) {continue;}
+        auto component = g.numComponents++;
+        g.faceComponent[seed] = component;
+        stack.push_back(seed);
+        while (!stack.empty()) {
+            auto f = stack.back();
+            stack.pop_back();
+            for (auto next : g.faces[f].neighbor) {
+                if (next == NONE || g.faceComponent[next] != NONE) {continue;}
+                g.faceComponent[next] = component;
+                stack.push_back(next);
+            }
+        }
+    }
+    return g;
+}
+
+tg::pos3 Graph::edgeLerp(uint32_t e, float param) const {
+    return tg::lerp(vertex(edgeA[e]), vertex(edgeB[e]), param);
+}
+
+tg::aabb3 Graph::faceAABB(uint32_t f) const {
+    auto &links = faces[f];
+    auto p = vertex(halfedgeTo[links.halfedge[0]]);
+    tg::aabb3 res = {p, p};
+    for (auto i : {1, 2}) {
+        p = vertex(halfedgeTo[links.halfedge[i]]);
+        res.min = tg::min(res.min, p), res.max = tg::max(res.max, p);
+    }
+    return res;
+}
+
+tg::pos3 Graph::faceCentroid(uint32_t f) const {
+    auto sum = tg::vec3::zero;
+    for (auto h : faces[f].halfedge) {sum += tg::vec3(vertex(halfedgeTo[h]));}
+    return tg::pos3(sum / 3.f);
+}
+
+void Graph::logChanges(const std::vector<uint32_t> &changed) {
+    version += 1;
+    for (auto f : changed) {changeLog.emplace_back(version, f);}
+    // same trimming as `Hierarchy::update`: keep the newest half, whole versions only
+    if (changeLog.size() > faces.size()) {
+        auto keep = changeLog.end() - faces.size() / 2;
+        auto cut = std::find_if(keep, changeLog.end(), [&] (auto &entry) {return entry.first != keep[-1].first;});
+        logStart = cut == changeLog.end() ? version : cut[-1].first;
+        changeLog.erase(changeLog.begin(), cut);
+    }
+}
+
+bool Graph::changedSince(uint64_t since, std::vector<uint32_t> &out) const {
+    if (since < logStart || since > version) {return false;}
+    auto iter = std::upper_bound(changeLog.begin(), changeLog.end(), since, [] (uint64_t v, auto &entry) {return v < entry.first;});
+    for (; iter != changeLog.end(); ++iter) {out.push_back(iter->second);}
+    return true;
+}
@@ -0,0 +1,69 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+#include <polymesh/Mesh.hh>
+
+namespace NavMesh {
+
+/// flat copy of the navmesh topology and geometry, which is all the searches
+/// need. Indices are the same as in the (compactified) `pm::Mesh`, so results
+/// can be turned back into handles. Like polymesh, we store the two halfedges
+/// of edge `e` at `2e` and `2e + 1`, so `opposite` and `edgeOf` are bit tricks
+struct Graph {
+    static constexpr uint32_t NONE = -1;
+
+    // vertex positions (world space), SoA
+    std::vector<float> vx, vy, vz;
+
+    struct FaceLinks {
+        uint32_t halfedge[3];  ///< the halfedges of the face, in order
+        uint32_t neighbor[3];  ///< face across `halfedge[i]`, NONE on the border
+    };
+    std::vector<FaceLinks> faces;
+    /// connected components of the faces, ignoring obstacles
+    std::vector<uint32_t> faceComponent;
+    uint32_t numComponents = 0;
+
+    // per halfedge
+    std::vector<uint32_t> halfedgeFace;  ///< NONE for boundary halfedges
+    std::vector<uint32_t> halfedgeTo;  ///< target vertex
+
+    // per edge
+    std::vector<uint32_t> edgeA, edgeB;  ///< same as `pm::edge_handle::vertexA/B`
+    std::vector<float> edgeLength;
+    std::vector<tg::pos3> edgeMid;
+
+    /// bumped by every geometry change (see `logChanges`)
+    uint64_t version = 0;
+    /// (version, face) for each face whose geometry changed, like
+    /// `Hierarchy::blockedLog`: only the changes since `logStart` are kept
+    std::vector<std::pair<uint64_t, uint32_t>> changeLog;
+    uint64_t logStart = 0;
+
+    /// fails if the mesh has non-triangle faces
+    static std::optional<Graph> build(const pm::Mesh &, const pm::vertex_attribute<tg::pos3> &worldPos);
+
+    static uint32_t opposite(uint32_t he) {return he ^ 1;}
+    static uint32_t edgeOf(uint32_t he) {return he >> 1;}
+    size_t numFaces() const {return faces.size();}
+    size_t numEdges() const {return edgeA.size();}
+
+    tg::pos3 vertex(uint32_t v) const {return {vx[v], vy[v], vz[v]};}
+    /// point at `param` on the edge, going from A to B
+    tg::pos3 edgeLerp(uint32_t e, float param) const;
+    tg::aabb3 faceAABB(uint32_t f) const;
+    tg::pos3 faceCentroid(uint32_t f) const;
+
+    /// records that the vertices of `faces` have been moved, as one new version
+    void logChanges(const std::vector<uint32_t> &faces);
+    /// appends the faces whose geometry changed after `since` (possibly more
+    /// than once). False if the log doesn't reach back that far
+    bool changedSince(uint64_t since, std::vector<uint32_t> &faces) const;
+};
+
+}
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: MIT
+#include "Heightfield.hh"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+
+#include "NavMesh.hh"
+
+using namespace NavMesh;
+
+static constexpr float cellEpsilon = 1e-4f;
+
+std::optional<Heightfield> Heightfield::build(const Instance &nav, const ECS::Rigid &transform, uint32_t cells, float cellSize) {
+    if (cells == 0 || !(cellSize > 0)) {return std::nullopt;}
+    Heightfield hf;
+    hf.transform = transform;
+    hf.cells = cells;
+    hf.cellSize = cellSize;
+
+    struct Footprint {
+        pm::face_index face;
+        uint32_t x0, x1, z0, z1;
+        float ymin, ymax;
+    };
+    std::vector<Footprint> footprints;
+    footprints.reserve(nav.mesh->faces().size());
+    auto extent = cells * cellSize, eps = cellEpsilon * cellSize;
+    for (auto f : nav.mesh->faces()) {
+        auto p0 = nav.localPos[f.any_vertex()];
+        tg::aabb3 aabb = {p0, p0};
+        for (auto v : f.vertices()) {
+            auto p = nav.localPos[v];
+            aabb.min = tg::min(aabb.min, p), aabb.max = tg::max(aabb.max, p);
+        }
+        if (aabb.min.x < -eps || aabb.min.z < -eps || aabb.max.x > extent + eps || aabb.max.z > extent + eps) {
+            return std::nullopt;  // not a grid-derived mesh
+        }
+        auto cell = [&] (float coord) {
+            return uint32_t(std::clamp(int64_t(std::floor(coord / cellSize)), int64_t(0), int64_t(cells - 1)));
+        };
+        footprints.push_back({
+            f.idx,
+            cell(aabb.min.x - eps), cell(aabb.max.x + eps),
+            cell(aabb.min.z - eps), cell(aabb.max.z + eps),
+            aabb.min.y, aabb.max.y
+        });
+    }
+
+    // bucket the faces into the cells they overlap
+    hf.cellStart.assign(size_t(cells) * cells + 1, 0);
+    for (auto &fp : footprints) {
+        for (auto x = fp.x0; x <= fp.x1; ++x) {
+            for (auto z = fp.z0; z <= fp.z1; ++z) {hf.cellStart[x * cells + z + 1] += 1;}
+        }
+    }
+    for (size_t i = 1; i < hf.cellStart.size(); ++i) {hf.cellStart[i] += hf.cellStart[i - 1];}
+    hf.cellFaces.resize(hf.cellStart.back());
+    auto fill = hf.cellStart;
+    auto &base = hf.levels.emplace_back(size_t(cells) * cells, Range {
+        std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()
+    });
+    for (auto &fp : footprints) {
+        for (auto x = fp.x0; x <= fp.x1; ++x) {
+            for (auto z = fp.z0; z <= fp.z1; ++z) {
+                auto idx = x * cells + z;
+                hf.cellFaces[fill[idx]++] = fp.face;
+                base[idx].min = std::min(base[idx].min, fp.ymin);
+                base[idx].max = std::max(base[idx].max, fp.ymax);
+            }
+        }
+    }
+
+    // min/max pyramid
+    for (size_t level = 1; hf.levelSize(level - 1) > 1; ++level) {
+        auto size = hf.levelSize(level), childSize = hf.levelSize(level - 1);
+        std::vector<Range> ranges(size_t(size) * size, Range {
+            std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()
+        });
+        auto &children = hf.levels[level - 1];
+        for (uint32_t x = 0; x < childSize; ++x) {
+            for (uint32_t z = 0; z < childSize; ++z) {
+                auto &child = children[x * childSize + z];
+                auto &r = ranges[(x >> 1) * size + (z >> 1)];
+                r.min = std::min(r.min, child.min);
+                r.max = std::max(r.max, child.max);
+            }
+        }
+        hf.levels.push_back(std::move(ranges));
+    }
+    return hf;
+}
+
+void Heightfield::refit(const Instance &nav, const tg::aabb3 &box) {
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    auto eps = cellEpsilon * cellSize;
+    auto cell = [&] (float coord) {
+        return uint32_t(std::clamp(int64_t(std::floor(coord / cellSize)), int64_t(0), int64_t(cells - 1)));
+    };
+    // the faces overlapping these cells include all that reach into the box
+    auto x0 = cell(box.min.x - eps), x1 = cell(box.max.x + eps);
+    auto z0 = cell(box.min.z - eps), z1 = cell(box.max.z + eps);
+    auto &base = levels[0];
+    for (auto x = x0; x <= x1; ++x) {
+        for (auto z = z0; z <= z1; ++z) {
+            auto idx = x * cells + z;
+            Range range = {inf, -inf};
+            for (auto i = cellStart[idx]; i < cellStart[idx + 1]; ++i) {
+                for (auto v : nav.mesh->handle_of(cellFaces[i]).vertices()) {
+                    range.min = std::min(range.min, nav.localPos[v].y);
+                    range.max = std::max(range.max, nav.localPos[v].y);
+                }
+            }
+            base[idx] = range;
+        }
+    }
+    for (size_t level = 1; level < levels.size(); ++level) {
+        x0 >>= 1, x1 >>= 1, z0 >>= 1, z1 >>= 1;
+        auto size = levelSize(level), childSize = levelSize(level - 1);
+        for (auto x = x0; x <= x1; ++x) {
+            for (auto z = z0; z <= z1; ++z) {
+                Range range = {inf, -inf};
+                for (auto cx = 2 * x; cx <= std::min(2 * x + 1, childSize - 1); ++cx) {
+                    for (auto cz = 2 * z; cz <= std::min(2 * z + 1, childSize - 1); ++cz) {
+                        auto &child = levels[level - 1][cx * childSize + cz];
+                        range.min = std::min(range.min, child.min);
+                        range.max = std::max(range.max, child.max);
+                    }
+                }
+                levels[level][x * size + z] = range;
+            }
+        }
+    }
+}
+
+std::optional<std::pair<pm::face_index, float>> Heightfield::intersect(const Instance &nav, const tg::ray3 &ray) const {
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    std::optional<std::pair<pm::face_index, float>> res;
+    int top = int(levels.size()) - 1;
+    auto &root = levels[top][0];
+    if (root.min > root.max) {return res;}  // no faces at all
+
+    auto inv = ~transform;
+    auto o = inv * ray.origin;
+    auto d = inv * ray.dir;
+
+    // clip the ray against the bounding box of the grid
+    float tmin = 0.f, tmax = inf;
+    auto extent = cells * cellSize;
+    auto eps = cellEpsilon * cellSize;
+    tg::aabb3 box = {{0, root.min - eps, 0}, {extent, root.max + eps, extent}};
+    for (auto axis : {0, 1, 2}) {
+        if (d[axis] == 0.f) {
+            if (o[axis] < box.min[axis] || o[axis] > box.max[axis]) {return res;}
+            continue;
+        }
+        auto ta = (box.min[axis] - o[axis]) / d[axis], tb = (box.max[axis] - o[axis]) / d[axis];
+        if (ta > tb) {std::swap(ta, tb);}
+        tmin = std::max(tmin, ta);
+        tmax = std::min(tmax, tb);
+    }
+    if (tmin > tmax) {return res;}
+
+    // hierarchical DDA: walk the blocks of the current level in ray order,
+    // descend into blocks whose height range the ray overlaps, and ascend again
+    // whenever the walk leaves the parent block
+    auto blockAt = [&] (float coord, int level, uint32_t lo, uint32_t hi) {
+        auto size = cellSize * float(1u << level);
+        auto idx = int64_t(std::floor(coord / size));
+        return uint32_t(std::clamp(idx, int64_t(lo), int64_t(hi)));
+    };
+    int level = top;
+    float t = tmin;
+    uint32_t cx = blockAt(o.x + d.x * t, level, 0, levelSize(level) - 1);
+    uint32_t cz = blockAt(o.z + d.z * t, level, 0, levelSize(level) - 1);
+    int sx = d.x > 0 ? 1 : -1, sz = d.z > 0 ? 1 : -1;
+    while (true) {
+        if (res && res->second <= t) {return res;}
+        auto size = cellSize * float(1u << level);
+        auto txExit = d.x > 0 ? ((cx + 1) * size - o.x) / d.x : d.x < 0 ? (cx * size - o.x) / d.x : inf;
+        auto tzExit = d.z > 0 ? ((cz + 1) * size - o.z) / d.z : d.z < 0 ? (cz * size - o.z) / d.z : inf;
+        auto tExit = std::max(t, std::min({txExit, tzExit, tmax}));
+
+        auto &r = range(level, cx, cz);
+        auto y0 = o.y + d.y * t, y1 = o.y + d.y * tExit;
+        bool overlap = r.min <= r.max && std::min(y0, y1) <= r.max + eps && std::max(y0, y1) >= r.min - eps;
+        if (overlap && level > 0) {
+            level -= 1;
+            auto childMax = levelSize(level) - 1;
+            cx = blockAt(o.x + d.x * t, level, 2 * cx, std::min(2 * cx + 1, childMax));
+            cz = blockAt(o.z + d.z * t, level, 2 * cz, std::min(2 * cz + 1, childMax));
+            continue;
+        }
+        if (overlap) {
+            auto cell = cx * cells + cz;
+            for (auto i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+                auto f = cellFaces[i];
+                auto depth = nav.intersectionTest(nav.mesh->handle_of(f), ray);
+                if (depth && (!res || res->second > *depth)) {
+                    res = {f, *depth};
+                }
+            }
+            if (res && res->second <= tExit) {return res;}
+        }
+        if (tExit >= tmax) {break;}
+        t = tExit;
+
+        auto ox = cx, oz = cz;
+        if (txExit <= tzExit) {
+            if ((sx < 0 && cx == 0) || (sx > 0 && cx + 1 >= levelSize(level))) {break;}
+            cx += sx;
+        } else {
+            if ((sz < 0 && cz == 0) || (sz > 0 && cz + 1 >= levelSize(level))) {break;}
+            cz += sz;
+        }
+        while (level < top && ((cx >> 1) != (ox >> 1) || (cz >> 1) != (oz >> 1))) {
+            cx >>= 1, cz >>= 1, ox >>= 1, oz >>= 1;
+            level += 1;
+        }
+    }
+    return res;
+}
+
+std::optional<std::pair<pm::face_index, float>> Heightfield::closestPoint(const Instance &nav, tg::pos3 pos) const {
+    std::optional<std::pair<pm::face_index, float>> res;
+    auto local = ~transform * pos;
+    auto cell = [&] (float coord) {
+        return int64_t(std::clamp(int64_t(std::floor(coord / cellSize)), int64_t(0), int64_t(cells - 1)));
+    };
+    auto cx = cell(local.x), cz = cell(local.z);
+    auto test = [&] (int64_t x, int64_t z) {
+        if (x < 0 || z < 0 || x >= cells || z >= cells) {return;}
+        auto idx = x * cells + z;
+        for (auto i = cellStart[idx]; i < cellStart[idx + 1]; ++i) {
+            auto f = cellFaces[i];
+            auto dist = nav.distanceTo(nav.mesh->handle_of(f), pos);
+            if (!res || dist < res->second) {res = {f, dist};}
+        }
+    };
+    // every face is listed in all cells its bounding box overlaps, so its
+    // closest point is in one of them; cells in ring `r` are at least
+    // `r - 1` cells away from the point (also if it is off the grid)
+    for (int64_t r = 0; r < int64_t(cells); ++r) {
+        if (res && res->second < float(r - 1) * cellSize) {break;}
+        if (r == 0) {
+            test(cx, cz);
+            continue;
+        }
+        for (auto d = -r; d <= r; ++d) {
+            test(cx + d, cz - r);
+            test(cx + d, cz + r);
+        }
+        for (auto d = -r + 1; d < r; ++d) {
+            test(cx - r, cz + d);
+            test(cx + r, cz + d);
+        }
+    }
+    return res;
+}
+
+std::optional<pm::face_index> Heightfield::faceAt(const Instance &nav, tg::pos3 pos) const {
+    auto local = ~transform * pos;
+    auto extent = cells * cellSize, eps = cellEpsilon * cellSize;
+    if (local.x < -eps || local.z < -eps || local.x > extent + eps || local.z > extent + eps) {return std::nullopt;}
+    auto cell = [&] (float coord) {
+        return uint32_t(std::clamp(int64_t(std::floor(coord / cellSize)), int64_t(0), int64_t(cells - 1)));
+    };
+    auto idx = cell(local.x) * cells + cell(local.z);
+    std::optional<pm::face_index> res;
+    float best = std::numeric_limits<float>::infinity();
+    for (auto i = cellStart[idx]; i < cellStart[idx + 1]; ++i) {
+        auto height = nav.heightAt(nav.mesh->handle_of(cellFaces[i]), pos);
+        if (height && std::abs(*height - pos.y) < best) {
+            best = std::abs(*height - pos.y);
+            res = cellFaces[i];
+        }
+    }
+    return res;
+}
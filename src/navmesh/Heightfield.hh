@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+#include <polymesh/Mesh.hh>
+
+#include <ECS/Misc.hh>
+
+namespace NavMesh {
+
+struct Instance;
+
+/// ray casting acceleration for navmeshes derived from a regular terrain grid.
+/// Rays are marched over the cells of the grid (2D DDA in the local XZ plane);
+/// a pyramid of min/max heights lets them skip whole blocks of cells that
+/// they pass above or below.
+struct Heightfield {
+    struct Range {
+        float min, max;
+    };
+
+    ECS::Rigid transform;  ///< local → world, same as the navmesh
+    uint32_t cells;  ///< number of cells along each side
+    float cellSize;
+
+    // faces overlapping each cell (in XZ), CSR layout. Usually two triangles,
+    // but delaunay flips may produce triangles spanning neighbouring cells
+    std::vector<uint32_t> cellStart;
+    std::vector<pm::face_index> cellFaces;
+    /// levels[0] has one entry per cell, levels[k] one per 2^k × 2^k block
+    std::vector<std::vector<Range>> levels;
+
+    static std::optional<Heightfield> build(const Instance &, const ECS::Rigid &transform, uint32_t cells, float cellSize);
+
+    /// recomputes the height ranges of the cells under `localBox` (in XZ)
+    /// and of the blocks above them, after the faces there moved in height
+    void refit(const Instance &, const tg::aabb3 &localBox);
+
+    uint32_t levelSize(size_t level) const {return ((cells - 1) >> level) + 1;}
+    const Range &range(size_t level, uint32_t x, uint32_t z) const {
+        return levels[level][x * levelSize(level) + z];
+    }
+
+    /// same result as `Instance::intersectTree`, i. e. the closest navmesh face hit by the (world-space) ray
+    std::optional<std::pair<pm::face_index, float>> intersect(const Instance &, const tg::ray3 &ray) const;
+    /// closest face to the (world-space) point, at any distance: the cells are
+    /// searched in rings around it until the next ring can't be any closer
+    std::optional<std::pair<pm::face_index, float>> closestPoint(const Instance &, tg::pos3 pos) const;
+    /// same result as `Instance::faceAtTree`, from the faces of the point's cell
+    std::optional<pm::face_index> faceAt(const Instance &, tg::pos3 pos) const;
+};
+
+}
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: MIT
+#include "Hierarchy.hh"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <tuple>
+
+#include <typed-geometry/tg.hh>
+
+#include "NavMesh.hh"
+#include "Search.hh"
+
+using namespace NavMesh;
+
+namespace {
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+struct EdgeNode {
+    float cost;
+    bool closed;
+};
+struct EntranceNode {
+    float cost;
+    uint32_t predecessor;
+    bool closed;
+};
+}
+
+Hierarchy Hierarchy::build(const Graph &g, const Obstacle::Collider &collider, size_t facesPerCluster) {
+    Hierarchy res;
+    res.radius = collider.radius();
+    res.height = collider.height();
+    auto nf = g.numFaces(), ne = g.numEdges();
+    res.faceCluster.resize(nf);
+    res.faceBlocked.assign(nf, 0);
+    res.edgeEntrance.assign(ne, NONE);
+    res.edgeRegion.assign(ne, NONE);
+    if (nf == 0) {return res;}
+
+    // clusters are the occupied cells of a grid in the XZ plane
+    auto bounds = g.faceAABB(0);
+    for (uint32_t f = 1; f < nf; ++f) {
+        auto box = g.faceAABB(f);
+        bounds.min = tg::min(bounds.min, box.min), bounds.max = tg::max(bounds.max, box.max);
+    }
+    auto extent = bounds.max - bounds.min;
+    auto nCells = std::max<size_t>(1, nf / facesPerCluster);
+    auto cellSize = std::sqrt(std::max(extent.x * extent.z, 1e-6f) / nCells);
+    auto nx = uint32_t(extent.x / cellSize) + 1, nz = uint32_t(extent.z / cellSize) + 1;
+    std::vector<uint32_t> cellCluster(size_t(nx) * nz, NONE);
+    for (uint32_t f = 0; f < nf; ++f) {
+        auto box = g.faceAABB(f);
+        auto center = tg::lerp(box.min, box.max, .5f);
+        auto cx = std::min(nx - 1, uint32_t((center.x - bounds.min.x) / cellSize));
+        auto cz = std::min(nz - 1, uint32_t((center.z - bounds.min.z) / cellSize));
+        auto &cluster = cellCluster[cz * nx + cx];
+        if (cluster == NONE) {
+            cluster = uint32_t(res.clusters.size());
+            res.clusters.emplace_back().bounds = box;
+        }
+        auto &c = res.clusters[cluster];
+        c.faces.push_back(f);
+        c.bounds.min = tg::min(c.bounds.min, box.min), c.bounds.max = tg::max(c.bounds.max, box.max);
+        res.faceCluster[f] = cluster;
+    }
+
+    // border edges between the same two clusters that touch each other form an entrance
+    std::vector<uint32_t> parent(ne, NONE);
+    auto find = [&] (uint32_t e) {
+        while (parent[e] != e) {e = parent[e] = parent[parent[e]];}
+        return e;
+    };
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t>, uint32_t> byVertex;
+    std::vector<uint32_t> border;
+    for (uint32_t e = 0; e < ne; ++e) {
+        auto f0 = g.halfedgeFace[2 * e], f1 = g.halfedgeFace[2 * e + 1];
+        if (f0 == Graph::NONE || f1 == Graph::NONE) {continue;}
+        auto a = res.faceCluster[f0], b = res.faceCluster[f1];
+        if (a == b || g.edgeLength[e] <= 2 * res.radius) {continue;}
+        border.push_back(e);
+        parent[e] = e;
+        for (auto v : {g.edgeA[e], g.edgeB[e]}) {
+            auto [iter, inserted] = byVertex.emplace(std::make_tuple(std::min(a, b), std::max(a, b), v), e);
+            if (!inserted) {parent[find(e)] = find(iter->second);}
+        }
+    }
+    // the representative is the edge closest to the center of the run
+    std::map<uint32_t, std::pair<tg::vec3, size_t>> centers;
+    for (auto e : border) {
+        auto &[sum, count] = centers[find(e)];
+        sum += tg::vec3(g.edgeMid[e]);
+        count += 1;
+    }
+    std::map<uint32_t, std::pair<float, uint32_t>> best;
+    for (auto e : border) {
+        auto root = find(e);
+        auto &[sum, count] = centers[root];
+        auto dist = tg::distance_sqr(g.edgeMid[e], tg::pos3(sum / float(count)));
+        auto [iter, inserted] = best.emplace(root, std::make_pair(dist, e));
+        if (!inserted && dist < iter->second.first) {iter->second = {dist, e};}
+    }
+    for (auto &[root, pair] : best) {
+        auto e = pair.second;
+        auto idx = uint32_t(res.entrances.size());
+        auto &ent = res.entrances.emplace_back();
+        ent.edge = e;
+        for (auto k : {0, 1}) {
+            auto &cluster = res.clusters[res.faceCluster[g.halfedgeFace[2 * e + k]]];
+            ent.cluster[k] = res.faceCluster[g.halfedgeFace[2 * e + k]];
+            ent.local[k] = uint32_t(cluster.entrances.size());
+            cluster.entrances.push_back(idx);
+        }
+        res.edgeEntrance[e] = idx;
+    }
+    return res;
+}
+
+void Hierarchy::invalidate(const tg::aabb3 &box) {
+    // same volume as swept by `Obstacle::Collider::segmentObstructed`
+    auto grown = box;
+    grown.min -= tg::max(height, tg::vec3::zero);
+    grown.max -= tg::min(height, tg::vec3::zero);
+    grown.min -= radius;
+    grown.max += radius;
+    for (auto &cluster : clusters) {
+        if (tg::intersects(cluster.bounds, grown)) {
+            cluster.dirty = true;
+            regionsValid = false;
+        }
+    }
+}
+
+void Hierarchy::update(const Graph &g, Obstacle::Collider &collider) {
+    for (uint32_t c = 0; c < clusters.size(); ++c) {
+        auto &cluster = clusters[c];
+        if (!cluster.dirty) {continue;}
+        for (auto f : cluster.faces) {
+            auto &links = g.faces[f];
+            collider.collectObjects(g.faceAABB(f));
+            uint8_t blocked = 0;
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) {
+                    if (i == j) {continue;}
+                    auto a = g.edgeMid[Graph::edgeOf(links.halfedge[i])], b = g.edgeMid[Graph::edgeOf(links.halfedge[j])];
+                    if (collider.segmentObstructed(tg::segment3(a, b))) {blocked |= blockedBit(i, j);}
+                }
+            }
+            if (blocked != faceBlocked[f]) {blockedLog.emplace_back(version + 1, f);}
+            faceBlocked[f] = blocked;
+        }
+        auto n = cluster.entrances.size();
+        cluster.cost.assign(n * n, INF);
+        for (size_t i = 0; i < n; ++i) {
+            clusterCosts(g, c, {{entrances[cluster.entrances[i]].edge, 0.f}}, &cluster.cost[i * n]);
+        }
+        cluster.dirty = false;
+        rebuiltClusters += 1;
+    }
+    if (!regionsValid) {
+        updateRegions(g);
+        version += 1;
+    }
+    // the whole log is never needed: a search that far behind is cheaper to restart
+    if (blockedLog.size() > faceBlocked.size()) {
+        auto keep = blockedLog.end() - faceBlocked.size() / 2;
+        auto cut = std::find_if(keep, blockedLog.end(), [&] (auto &entry) {return entry.first != keep[-1].first;});
+        logStart = cut == blockedLog.end() ? version : cut[-1].first;
+        blockedLog.erase(blockedLog.begin(), cut);
+    }
+}
+
+bool Hierarchy::changedSince(uint64_t since, std::vector<uint32_t> &faces) const {
+    if (since < logStart) {return false;}
+    auto iter = std::upper_bound(blockedLog.begin(), blockedLog.end(), since, [] (uint64_t v, auto &entry) {return v < entry.first;});
+    for (; iter != blockedLog.end(); ++iter) {faces.push_back(iter->second);}
+    return true;
+}
+
+void Hierarchy::updateRegions(const Graph &g) {
+    auto ne = g.numEdges();
+    std::vector<uint32_t> parent(ne);
+    for (uint32_t e = 0; e < ne; ++e) {parent[e] = e;}
+    auto find = [&] (uint32_t e) {
+        while (parent[e] != e) {e = parent[e] = parent[parent[e]];}
+        return e;
+    };
+    for (uint32_t f = 0; f < g.numFaces(); ++f) {
+        auto &links = g.faces[f];
+        for (auto [i, j] : {std::pair(0, 1), std::pair(0, 2), std::pair(1, 2)}) {
+            if (blocked(f, i, j) && blocked(f, j, i)) {continue;}  // one way through is enough to connect
+            auto a = Graph::edgeOf(links.halfedge[i]), b = Graph::edgeOf(links.halfedge[j]);
+            if (g.edgeLength[a] <= 2 * radius || g.edgeLength[b] <= 2 * radius) {continue;}
+            parent[find(a)] = find(b);
+        }
+    }
+    edgeRegion.resize(ne);
+    for (uint32_t e = 0; e < ne; ++e) {
+        edgeRegion[e] = g.edgeLength[e] <= 2 * radius ? NONE : find(e);
+    }
+    regionsValid = true;
+}
+
+void Hierarchy::clusterCosts(const Graph &g, uint32_t cluster, const std::vector<std::pair<uint32_t, float>> &seeds, float *out) const {
+    auto &ctx = SearchContext<EdgeNode>::local();
+    ctx.begin(g.numEdges());
+    auto n = clusters[cluster].entrances.size();
+    std::fill(out, out + n, INF);
+    auto relax = [&] (uint32_t e, float cost) {
+        if (!ctx.isOpen(e)) {
+            ctx.open(e) = {cost, false};
+            ctx.heap.push(e, cost);
+        } else if (!ctx.nodes[e].closed && cost < ctx.nodes[e].cost) {
+            ctx.nodes[e].cost = cost;
+            ctx.heap.push(e, cost);
+        }
+    };
+    for (auto [e, cost] : seeds) {relax(e, cost);}
+    size_t remaining = n;
+    while (!ctx.heap.empty() && remaining > 0) {
+        auto [cost, e] = ctx.heap.pop();
+        ctx.nodes[e].closed = true;
+        if (auto ent = edgeEntrance[e]; ent != NONE) {
+            for (auto k : {0, 1}) {
+                if (entrances[ent].cluster[k] == cluster) {
+                    out[entrances[ent].local[k]] = cost;
+                    remaining -= 1;
+                }
+            }
+        }
+        for (auto side : {0u, 1u}) {
+            auto f = g.halfedgeFace[2 * e + side];
+            if (f == Graph::NONE || faceCluster[f] != cluster) {continue;}
+            auto &links = g.faces[f];
+            int i = 0;
+            while (Graph::edgeOf(links.halfedge[i]) != e) {i += 1;}
+            for (int j = 0; j < 3; ++j) {
+                auto e2 = Graph::edgeOf(links.halfedge[j]);
+                if (j == i || g.edgeLength[e2] <= 2 * radius) {continue;}
+                if (blocked(f, i, j)) {continue;}
+                relax(e2, cost + tg::distance(g.edgeMid[e], g.edgeMid[e2]));
+            }
+        }
+    }
+}
+
+size_t Hierarchy::memoryBytes() const {
+    size_t res = faceCluster.capacity() * sizeof(uint32_t) + faceBlocked.capacity()
+        + (edgeEntrance.capacity() + edgeRegion.capacity()) * sizeof(uint32_t) + entrances.capacity() * sizeof(Entrance)
+        + blockedLog.capacity() * sizeof(blockedLog[0]);
+    for (auto &cluster : clusters) {
+        res += sizeof(Cluster) + (cluster.faces.capacity() + cluster.entrances.capacity()) * sizeof(uint32_t)
+            + cluster.cost.capacity() * sizeof(float);
+    }
+    return res;
+}
+
+Route Searcher::hierarchical(const RouteRequest &req, Obstacle::Collider &collider) {
+    assert(req.start_face != req.end_face);  // empty vector is the error result
+    stats = {};
+    if (!hierarchy) {return {};}
+    auto &g = graph;
+    auto &hier = *hierarchy;
+    auto start_face = uint32_t(req.start_face.value), end_face = uint32_t(req.end_face.value);
+    if (!reachable(start_face, end_face)) {
+        stats.unreachable = true;
+        return {};
+    }
+    auto startCluster = hier.faceCluster[start_face], endCluster = hier.faceCluster[end_face];
+    std::vector<uint8_t> allowed(hier.clusters.size(), 0);
+    if (startCluster == endCluster) {
+        allowed[startCluster] = 1;
+        auto res = corridor(req, collider, &allowed);
+        if (!res.empty()) {return res;}
+    }
+
+    // connect start and end to the entrances of their clusters
+    auto seeds = [&] (tg::pos3 pos, uint32_t face) {
+        std::vector<std::pair<uint32_t, float>> res;
+        collider.collectObjects(g.faceAABB(face));
+        for (auto h : g.faces[face].halfedge) {
+            auto e = Graph::edgeOf(h);
+            if (g.edgeLength[e] <= 2 * hier.radius) {continue;}
+            if (collider.segmentObstructed(tg::segment3(pos, g.edgeMid[e]))) {continue;}
+            res.push_back({e, tg::distance(pos, g.edgeMid[e])});
+        }
+        return res;
+    };
+    auto &startEntrances = hier.clusters[startCluster].entrances;
+    std::vector<float> startCost(startEntrances.size()), endCost(hier.clusters[endCluster].entrances.size());
+    hier.clusterCosts(g, startCluster, seeds(req.start, start_face), startCost.data());
+    hier.clusterCosts(g, endCluster, seeds(req.end, end_face), endCost.data());
+
+    // A* over the entrances; node `entrances.size()` is the end
+    auto &ctx = SearchContext<EntranceNode>::local();
+    auto goal = uint32_t(hier.entrances.size());
+    ctx.begin(goal + 1);
+    GoalEstimate toEnd(g, landmarks, req.end, end_face);
+    auto relax = [&] (uint32_t node, float cost, uint32_t predecessor) {
+        auto edge = node == goal ? 0 : hier.entrances[node].edge;
+        auto estimate = node == goal ? 0.f : toEnd(edge, g.edgeMid[edge]);
+        if (!ctx.isOpen(node)) {
+            ctx.open(node) = {cost, predecessor, false};
+            ctx.heap.push(node, cost + estimate);
+        } else if (!ctx.nodes[node].closed && cost < ctx.nodes[node].cost) {
+            ctx.nodes[node].cost = cost;
+            ctx.nodes[node].predecessor = predecessor;
+            ctx.heap.push(node, cost + estimate);
+        }
+    };
+    for (size_t i = 0; i < startEntrances.size(); ++i) {
+        if (startCost[i] < INF) {relax(startEntrances[i], startCost[i], NONE);}
+    }
+    SearchStats abstract;
+    bool found = false;
+    while (!ctx.heap.empty()) {
+        auto node = ctx.heap.pop().second;
+        auto &info = ctx.nodes[node];
+        info.closed = true;
+        abstract.expanded += 1;
+        if (node == goal) {
+            found = true;
+            break;
+        }
+        auto &ent = hier.entrances[node];
+        for (auto k : {0, 1}) {
+            auto &cluster = hier.clusters[ent.cluster[k]];
+            auto n = cluster.entrances.size();
+            auto row = &cluster.cost[ent.local[k] * n];
+            for (size_t j = 0; j < n; ++j) {
+                if (j == ent.local[k] || !(row[j] < INF)) {continue;}
+                abstract.connections += 1;
+                relax(cluster.entrances[j], info.cost + row[j], node);
+            }
+            if (ent.cluster[k] == endCluster && endCost[ent.local[k]] < INF) {
+                relax(goal, info.cost + endCost[ent.local[k]], node);
+            }
+        }
+    }
+    abstract.opened = ctx.opened;
+    abstract.scratchBytes = ctx.memoryBytes();
+    if (!found) {
+        stats = abstract;
+        return {};
+    }
+
+    // refine: search the faces, but only in the clusters along the abstract path
+    allowed[startCluster] = allowed[endCluster] = 1;
+    for (auto node = ctx.nodes[goal].predecessor; node != NONE; node = ctx.nodes[node].predecessor) {
+        for (auto c : hier.entrances[node].cluster) {allowed[c] = 1;}
+    }
+    auto res = corridor(req, collider, &allowed);
+    stats.opened += abstract.opened;
+    stats.expanded += abstract.expanded;
+    stats.connections += abstract.connections;
+    stats.scratchBytes += abstract.scratchBytes + hier.memoryBytes();
+    return res;
+}
@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <obstacles/Collision.hh>
+#include "Graph.hh"
+
+namespace NavMesh {
+
+/// abstraction of a `Graph` for hierarchical search (HPA*): the faces are
+/// grouped into clusters on a grid, and each run of border edges between two
+/// clusters becomes one entrance. For every cluster we keep the path costs
+/// between its entrances, measured along edge midpoints like the corridor
+/// search does, for the unit size the hierarchy was built with.
+/// Obstacles only change the costs, so a changed obstruction just marks the
+/// clusters around it dirty, and `update` recomputes those.
+struct Hierarchy {
+    static constexpr uint32_t NONE = -1;
+
+    struct Cluster {
+        tg::aabb3 bounds;
+        std::vector<uint32_t> faces;
+        std::vector<uint32_t> entrances;
+        /// entrance to entrance, row-major, infinite if there is no path
+        std::vector<float> cost;
+        bool dirty = true;
+    };
+    struct Entrance {
+        uint32_t edge;  ///< representative of the border edges
+        uint32_t cluster[2];
+        uint32_t local[2];  ///< index in `Cluster::entrances`
+    };
+
+    // unit size the costs are computed for
+    float radius;
+    tg::vec3 height;
+    std::vector<uint32_t> faceCluster;
+    /// obstacles baked into the faces: bit `blockedBit(i, j)` is set if the
+    /// way from the midpoint of edge `i` to that of edge `j` is obstructed.
+    /// Both directions are kept, since the volume swept by
+    /// `Collider::segmentObstructed` isn't symmetric
+    std::vector<uint8_t> faceBlocked;
+    std::vector<uint32_t> edgeEntrance;  ///< NONE unless the edge represents an entrance
+    std::vector<Cluster> clusters;
+    std::vector<Entrance> entrances;
+    /// connected components of the edges in the midpoint graph, taking
+    /// obstacles and unit size into account. NONE for edges too narrow to pass
+    std::vector<uint32_t> edgeRegion;
+    bool regionsValid = false;  ///< false while clusters are dirty
+    size_t rebuiltClusters = 0;  ///< counter, for benchmarks
+    /// bumped by every `update` that changes something, so derived data knows when it is stale
+    uint64_t version = 0;
+    /// (version, face) for each face whose `faceBlocked` changed, in version
+    /// order, so incremental searches can catch up (see `changedSince`).
+    /// Only the last few changes are kept: `logStart` is the oldest version
+    /// that is still complete
+    std::vector<std::pair<uint64_t, uint32_t>> blockedLog;
+    uint64_t logStart = 0;
+
+    static constexpr uint8_t blockedBit(int from, int to) {return uint8_t(1 << (2 * from + (to > from ? to - 1 : to)));}
+    bool blocked(uint32_t face, int from, int to) const {return faceBlocked[face] & blockedBit(from, to);}
+    /// if the hierarchy was built for the collider's unit size
+    bool fits(const Obstacle::Collider &collider) const {return collider.radius() == radius && collider.height() == height;}
+    /// if `faceBlocked` is up to date for the face and fits the collider, so
+    /// it can answer for collision queries between edge midpoints
+    bool baked(uint32_t face, const Obstacle::Collider &collider) const {return !clusters[faceCluster[face]].dirty && fits(collider);}
+
+    /// partitions the faces into clusters of about `facesPerCluster` faces,
+    /// for units of the collider's size. Costs are only computed by `update`
+    static Hierarchy build(const Graph &, const Obstacle::Collider &, size_t facesPerCluster = 256);
+
+    /// marks the clusters that an obstruction change inside `box` can affect
+    void invalidate(const tg::aabb3 &box);
+    /// recomputes the costs of dirty clusters and then the regions; the
+    /// collider should have the unit size from `build`
+    void update(const Graph &, Obstacle::Collider &);
+    void updateRegions(const Graph &);
+    /// appends the faces whose `faceBlocked` changed after `since` (possibly
+    /// more than once). False if the log doesn't reach back that far
+    bool changedSince(uint64_t since, std::vector<uint32_t> &faces) const;
+
+    /// Dijkstra over the midpoints of the edges in `cluster`, starting from
+    /// `seeds` (edge, cost). Writes the cost to each of the cluster's entrances to `out`
+    void clusterCosts(const Graph &, uint32_t cluster, const std::vector<std::pair<uint32_t, float>> &seeds, float *out) const;
+    size_t memoryBytes() const;
+};
+
+}
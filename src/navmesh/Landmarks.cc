@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT
+#include "Landmarks.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+
+#include "Search.hh"
+
+using namespace NavMesh;
+
+namespace {
+constexpr float INF = std::numeric_limits<float>::infinity();
+
+struct EdgeNode {
+    float cost;
+};
+}
+
+/// single-source distances over the midpoint graph, INF where unreachable
+static void distancesFrom(const Graph &g, uint32_t source, std::vector<float> &out) {
+    out.assign(g.numEdges(), INF);
+    auto &ctx = SearchContext<EdgeNode>::local();
+    ctx.begin(g.numEdges());
+    ctx.open(source) = {0.f};
+    ctx.heap.push(source, 0.f);
+    while (!ctx.heap.empty()) {
+        auto [cost, e] = ctx.heap.pop();
+        out[e] = cost;
+        for (auto he : {2 * e, 2 * e + 1}) {
+            auto f = g.halfedgeFace[he];
+            if (f == Graph::NONE) {continue;}
+            for (auto h : g.faces[f].halfedge) {
+                auto e2 = Graph::edgeOf(h);
+                if (e2 == e || out[e2] < INF) {continue;}
+                auto cost2 = cost + tg::distance(g.edgeMid[e], g.edgeMid[e2]);
+                if (!ctx.isOpen(e2)) {
+                    ctx.open(e2) = {cost2};
+                    ctx.heap.push(e2, cost2);
+                } else if (cost2 < ctx.nodes[e2].cost) {
+                    ctx.nodes[e2].cost = cost2;
+                    ctx.heap.push(e2, cost2);
+                }
+            }
+        }
+    }
+}
+
+Landmarks Landmarks::build(const Graph &g, uint32_t count) {
+    Landmarks res;
+    auto ne = g.numEdges();
+    if (ne == 0) {return res;}
+    // greedy farthest-point selection; edges not reached by any landmark yet
+    // are the farthest of all, so every connected part gets one early on
+    std::vector<std::vector<float>> tables;
+    std::vector<float> nearest(ne, INF);
+    uint32_t next = 0;
+    for (uint32_t l = 0; l < count; ++l) {
+        auto &table = tables.emplace_back();
+        distancesFrom(g, next, table);
+        res.edges.push_back(next);
+        for (size_t e = 0; e < ne; ++e) {nearest[e] = std::min(nearest[e], table[e]);}
+        next = uint32_t(std::max_element(nearest.begin(), nearest.end()) - nearest.begin());
+        if (nearest[next] == 0.f) {break;}  // fewer edges than landmarks
+    }
+    res.count = uint32_t(res.edges.size());
+
+    float maxDist = 0.f;
+    for (auto &table : tables) {
+        for (auto d : table) {
+            if (d < INF) {maxDist = std::max(maxDist, d);}
+        }
+    }
+    res.scale = std::max(maxDist, 1e-3f) / (UNREACHABLE - 1);
+    res.dist.resize(ne * res.count);
+    for (size_t e = 0; e < ne; ++e) {
+        for (uint32_t l = 0; l < res.count; ++l) {
+            auto d = tables[l][e];
+            res.dist[e * res.count + l] = d < INF ? uint16_t(std::min(float(UNREACHABLE - 1), std::floor(d / res.scale))) : UNREACHABLE;
+        }
+    }
+    return res;
+}
+
+float Landmarks::lowerBound(uint32_t a, uint32_t b) const {
+    auto da = &dist[a * count], db = &dist[b * count];
+    int best = 0;
+    for (uint32_t l = 0; l < count; ++l) {
+        if (da[l] == UNREACHABLE || db[l] == UNREACHABLE) {
+            if (da[l] != db[l]) {return INF;}  // one of them is in another part of the mesh
+            continue;
+        }
+        best = std::max(best, std::abs(int(da[l]) - int(db[l])));
+    }
+    // both values are rounded down, so the difference may be one step too large
+    return std::max(0, best - 1) * scale;
+}
+
+GoalEstimate::GoalEstimate(const Graph &g, const Landmarks *landmarks, tg::pos3 goal, uint32_t face) : mLandmarks{landmarks}, mGoal{goal} {
+    if (mLandmarks && mLandmarks->count == 0) {mLandmarks = nullptr;}
+    for (auto i : {0, 1, 2}) {
+        mEdges[i] = Graph::edgeOf(g.faces[face].halfedge[i]);
+        mExtra[i] = tg::distance(g.edgeMid[mEdges[i]], goal);
+    }
+}
+
+float GoalEstimate::operator()(uint32_t edge, tg::pos3 pos) const {
+    auto res = tg::distance(pos, mGoal);
+    if (!mLandmarks) {return res;}
+    auto bound = INF;
+    for (auto i : {0, 1, 2}) {bound = std::min(bound, mLandmarks->lowerBound(edge, mEdges[i]) + mExtra[i]);}
+    return std::max(res, bound);
+}
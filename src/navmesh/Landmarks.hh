@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Graph.hh"
+
+namespace NavMesh {
+
+/// distances from a few landmark edges to every edge of a `Graph`, along edge
+/// midpoints (like the corridor search measures). By the triangle inequality,
+/// |d(L, a) - d(L, b)| ≤ d(a, b) for every landmark L, which gives a much
+/// better A* heuristic than the straight line wherever the way goes around
+/// water. Distances are quantized to 16 bits, stored per edge for all landmarks
+struct Landmarks {
+    static constexpr uint16_t UNREACHABLE = 0xffff;
+
+    uint32_t count = 0;
+    float scale = 0.f;  ///< length of one quantization step
+    std::vector<uint32_t> edges;  ///< the landmarks
+    std::vector<uint16_t> dist;  ///< `dist[e * count + l]`
+
+    /// landmarks are picked greedily, each farthest from the ones before
+    static Landmarks build(const Graph &, uint32_t count = 16);
+
+    /// lower bound for the midpoint-path length between two edges, infinite
+    /// if they are not connected
+    float lowerBound(uint32_t a, uint32_t b) const;
+    size_t memoryBytes() const {return edges.capacity() * sizeof(uint32_t) + dist.capacity() * sizeof(uint16_t);}
+};
+
+/// A* estimate for the way from a point on an edge to a goal point in a face:
+/// the better of the straight line and the landmark bound to one of the face's edges
+class GoalEstimate {
+    const Landmarks *mLandmarks;  ///< null: straight line only
+    tg::pos3 mGoal;
+    uint32_t mEdges[3];
+    float mExtra[3];  ///< from the edge midpoint to the goal
+
+public:
+    GoalEstimate(const Graph &, const Landmarks *, tg::pos3 goal, uint32_t face);
+    float operator()(uint32_t edge, tg::pos3 pos) const;
+};
+
+}
@@ -1,42 +1,39 @@
 // SPDX-License-Identifier: MIT
 #include "NavMesh.hh"
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
+#include <future>
+#include <limits>
+#include <tuple>
+#include <utility>
 #include <vector>
-#include <queue>
 
 #include <typed-geometry/tg-std.hh>
 #include <glow/common/log.hh>
 #include <glow/objects.hh>
 #include <imgui/imgui.h>
 
-#include <external/lowbias32.hh>
-
+#include <MathUtil.hh>
 #include <ECS/Join.hh>
 #include <rendering/MeshViz.hh>
 #include <rtree/RStar.hh>
 #include <terrain/Terrain.hh>
+#include "Search.hh"
 
 using namespace NavMesh;
 
 namespace {
-struct Crossing {
-    pm::edge_index edge;
-    uint32_t pos;
-
-    bool operator==(const Crossing &other) const {
-        return edge == other.edge && pos == other.pos;
-    }
+/// a point on an edge where routes may cross it. Crossing `pos` of edge `e`
+/// is node `e * nsteps + pos` in the search
+struct CrossInfo {
+    float distance;  // geometric distance from this edge to the target
+    float lowerBound;  // lower bound for the path length up to here
+    uint32_t halfedge;  // direction in which the crossing is passed, towards the start
+    uint32_t predecessor;  // node
 };
 }
 
-template<>
-class std::hash<Crossing> {
-public:
-    size_t operator() (const Crossing &c) const {
-        return lowbias32(c.pos ^ lowbias32(c.edge.value));
-    }
-};
-
 static tg::aabb3 faceAABB(pm::face_handle f, pm::vertex_attribute<tg::pos3> &position) {
     auto min = position[f.any_vertex()], max = min;
     for (auto v : f.vertices()) {
@@ -54,143 +51,338 @@ tg::pos3 NavMesh::Instance::edgeLerp(const pm::edge_handle &edge, float param) c
     );
 }
 
-std::vector<std::pair<pm::halfedge_index, float>> Instance::navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider) {
+Searcher Instance::searcher() const {
+    return {*graph, landmarkHeuristic ? landmarks.get() : nullptr, hierarchy.get(), bakedObstacles};
+}
+
+void Instance::updateHierarchy(Obstacle::Collider &collider) {
+    if (!graph) {return;}
+    if (!hierarchy) {hierarchy = std::make_shared<Hierarchy>(Hierarchy::build(*graph, collider));}
+    // `update` is cheap when nothing is dirty, so only copy if it will do something
+    if (!hierarchy->regionsValid) {editHierarchy().update(*graph, collider);}
+}
+
+Hierarchy &Instance::editHierarchy() {
+    // only the main thread hands out references, so a count of 1 stays 1
+    if (hierarchy.use_count() > 1) {hierarchy = std::make_shared<Hierarchy>(*hierarchy);}
+    return *hierarchy;
+}
+
+Graph &Instance::editGraph() {
+    // like the hierarchy, it is only handed out on the main thread
+    if (graph.use_count() > 1) {graph = std::make_shared<Graph>(*graph);}
+    return *graph;
+}
+
+Route Instance::navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode) {
+    lastSearch = {};
+    if (!graph) {return {};}
+    auto obstructionTests = collider.query.nObstructionTests;
+    if (mode == SearchMode::Hierarchical || (mode == SearchMode::Corridor && bakedObstacles && (!hierarchy || hierarchy->fits(collider)))) {
+        updateHierarchy(collider);
+    }
+    auto search = searcher();
+    auto res = search.navigate(req, nsteps, collider, mode);
+    lastSearch = search.stats;
+    lastSearch.obstructionTests = collider.query.nObstructionTests - obstructionTests;
+    return res;
+}
+
+Route Instance::navigateCrossings(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider) {
+    lastSearch = {};
+    if (!graph) {return {};}
+    auto search = searcher();
+    auto res = search.crossings(req, nsteps, collider);
+    lastSearch = search.stats;
+    return res;
+}
+
+Route Instance::navigateCorridor(const RouteRequest &req, Obstacle::Collider &collider, const std::vector<uint8_t> *clusters) {
+    lastSearch = {};
+    if (!graph) {return {};}
+    auto search = searcher();
+    auto res = search.corridor(req, collider, clusters);
+    lastSearch = search.stats;
+    return res;
+}
+
+Route Instance::navigateHierarchical(const RouteRequest &req, Obstacle::Collider &collider) {
+    lastSearch = {};
+    if (!graph) {return {};}
+    updateHierarchy(collider);
+    auto search = searcher();
+    auto res = search.hierarchical(req, collider);
+    lastSearch = search.stats;
+    return res;
+}
+
+bool Instance::reanchor(RouteRequest &req, Route &route, tg::pos3 pos) const {
+    if (!graph) {return false;}
+    auto closest = closestPoint(pos);
+    if (!closest) {return false;}
+    auto face = closest->first;
+    if (face != req.start_face) {
+        // the crossing into the unit's face, in the face before it
+        auto iter = std::find_if(route.begin(), route.end(), [&] (auto &crossing) {
+            return graph->halfedgeFace[Graph::opposite(uint32_t(crossing.first.value))] == uint32_t(face.value);
+        });
+        if (iter == route.end()) {return false;}
+        route.erase(route.begin(), iter + 1);
+        req.start_face = face;
+    }
+    req.start = pos;
+    return true;
+}
+
+Route Searcher::navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode) {
+    stats = {};
+    if (graph.faceComponent[req.start_face.value] != graph.faceComponent[req.end_face.value]) {
+        stats.unreachable = true;
+        return {};
+    }
+    if (mode != SearchMode::Crossings) {
+        auto res = mode == SearchMode::Corridor ? corridor(req, collider) : hierarchical(req, collider);
+        if (!res.empty() || stats.unreachable) {return res;}
+        res = crossings(req, nsteps, collider);
+        stats.fellBack = true;
+        return res;
+    }
+    return crossings(req, nsteps, collider);
+}
+
+Route Searcher::crossings(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider) {
     assert(req.start_face != req.end_face);  // empty vector is the error result
-    auto end_face = this->mesh->handle_of(req.end_face);
-    auto start_face = this->mesh->handle_of(req.start_face);
-    struct CrossInfo {
-        float distance;  // geometric distance from this edge to the target
-        float lowerBound;  // lower bound for the path length up to here
-        pm::halfedge_index predecessor;
-        uint32_t predPos;
-    };
-    std::unordered_map<Crossing, CrossInfo> crossInfo;
-    struct WorkListEntry {
-        float lowerBound;  // lower bound for the entire path, not just the given edge
-        pm::halfedge_index halfedge;
-        uint32_t crossPos;
-        bool operator<(const WorkListEntry &other) const {
-            return lowerBound > other.lowerBound;
-        }
-    };
+    auto &g = graph;
+    auto end_face = uint32_t(req.end_face.value), start_face = uint32_t(req.start_face.value);
+    auto &ctx = SearchContext<CrossInfo>::local();
+    ctx.begin(g.numEdges() * nsteps);
+    stats = {};
     float stepSize = 1.f / nsteps, posBase = stepSize / 2;
-    std::priority_queue<WorkListEntry> workList;
-    auto aabb = faceAABB(end_face, this->worldPos);
-    collider.collectObjects(aabb);
-    for (auto h : end_face.halfedges()) {
-        if (h.opposite().is_boundary()) {continue;}
-        auto a = this->worldPos[h.edge().vertexA()];
-        auto b = this->worldPos[h.edge().vertexB()];
-        for (uint32_t i = 0; i < nsteps; ++i) {
-            auto p = tg::lerp(a, b, i * stepSize + posBase);
+    collider.collectObjects(g.faceAABB(end_face));
+    for (auto i : {0, 1, 2}) {
+        if (g.faces[end_face].neighbor[i] == Graph::NONE) {continue;}
+        auto h = g.faces[end_face].halfedge[i];
+        auto edge = Graph::edgeOf(h);
+        for (uint32_t j = 0; j < nsteps; ++j) {
+            auto p = g.edgeLerp(edge, j * stepSize + posBase);
             auto lowerBound = tg::distance(req.end, p);
             auto dist = tg::distance(p, req.start);
             if (collider.segmentObstructed(tg::segment3(p, req.end))) {continue;}
-            crossInfo.emplace(Crossing({h.edge(), i}), CrossInfo({dist, lowerBound, {}}));
-            workList.push({lowerBound + dist, h, i});
+            auto node = edge * nsteps + j;
+            ctx.open(node) = {dist, lowerBound, h, Graph::NONE};
+            ctx.heap.push(node, lowerBound + dist);
         }
     }
-    pm::halfedge_handle best_he;
-    uint32_t bestPos = 0;
-    size_t nconnections = 0;
-    while (!workList.empty()) {
-        auto top = workList.top();
-        workList.pop();
-        auto he = this->mesh->halfedges()[top.halfedge];
-        auto edge = he.edge();
-        Crossing crossing = {he.edge(), top.crossPos};
-        TG_ASSERT(!he.is_boundary());
-        auto &info = crossInfo[crossing];
-        // discard stale entries
-        if (top.lowerBound > info.lowerBound + info.distance) {continue;}
-
-        auto p = this->edgeLerp(edge, stepSize * top.crossPos + posBase);
-        aabb = faceAABB(he.opposite().face(), this->worldPos);
-        collider.collectObjects(aabb);
-        if (he.opposite_face() == start_face) {
+    uint32_t best = Graph::NONE;
+    while (!ctx.heap.empty()) {
+        auto node = ctx.heap.pop().second;
+        auto &info = ctx.nodes[node];
+        auto he = info.halfedge, opp = Graph::opposite(he);
+        auto edge = node / nsteps, pos = node % nsteps;
+        TG_ASSERT(g.halfedgeFace[he] != Graph::NONE);
+        stats.expanded += 1;
+
+        auto p = g.edgeLerp(edge, stepSize * pos + posBase);
+        auto face = g.halfedgeFace[opp];
+        collider.collectObjects(g.faceAABB(face));
+        if (face == start_face) {
             if (!collider.segmentObstructed(tg::segment3(req.start, p))) {
-                best_he = he;
-                bestPos = top.crossPos;
+                best = node;
                 break;
             }
         }
-        for (auto h = he.opposite().next(); h != he.opposite(); h = h.next()) {
-            if (h.opposite().is_boundary()) {continue;}
-            auto edge_ = h.edge();
-            for (uint32_t i = 0; i < nsteps; ++i) {
-                Crossing crossing_ = {edge_, i};
-                auto p_ = this->edgeLerp(edge_, i * stepSize + posBase);
+        auto &links = g.faces[face];
+        for (auto i : {0, 1, 2}) {
+            auto h = links.halfedge[i];
+            if (h == opp || links.neighbor[i] == Graph::NONE) {continue;}
+            auto edge_ = Graph::edgeOf(h);
+            for (uint32_t j = 0; j < nsteps; ++j) {
+                auto node_ = edge_ * nsteps + j;
+                auto p_ = g.edgeLerp(edge_, j * stepSize + posBase);
                 if (collider.segmentObstructed(tg::segment3(p_, p))) {continue;}
                 auto lowerBound = info.lowerBound + tg::distance(p, p_);
-                auto iter = crossInfo.find(crossing_);
-                if (iter == crossInfo.end()) {  // open the crossing
+                if (!ctx.isOpen(node_)) {  // open the crossing
                     auto dist = tg::distance(p_, req.start);
-                    crossInfo.emplace(crossing_, CrossInfo({dist, lowerBound, he, top.crossPos}));
-                    workList.push({lowerBound + dist, h, i});
+                    ctx.open(node_) = {dist, lowerBound, h, node};
+                    ctx.heap.push(node_, lowerBound + dist);
                 } else {
-                    auto &info_ = iter->second;
+                    auto &info_ = ctx.nodes[node_];
                     if (info_.lowerBound > lowerBound) {  // lower bound improved
                         info_.lowerBound = lowerBound;
-                        info_.predecessor = he;
-                        info_.predPos = top.crossPos;
-                        workList.push({lowerBound + iter->second.distance, h, i});
+                        info_.halfedge = h;
+                        info_.predecessor = node;
+                        ctx.heap.push(node_, lowerBound + info_.distance);
                     }
                 }
-                nconnections += 1;
+                stats.connections += 1;
             }
         }
     }
-    glow::info() << crossInfo.size() << " crossings opened";
-    glow::info() << nconnections << " connections tested";
+    stats.opened = ctx.opened;
+    stats.scratchBytes = ctx.memoryBytes();
     std::vector<std::pair<pm::halfedge_index, float>> res;
-    while (best_he.is_valid()) {
-        auto pos = bestPos;
-        if (best_he.edge().vertexA() != best_he.vertex_to()) {
+    for (auto node = best; node != Graph::NONE; node = ctx.nodes[node].predecessor) {
+        auto he = ctx.nodes[node].halfedge;
+        auto pos = node % nsteps;
+        if (g.edgeA[Graph::edgeOf(he)] != g.halfedgeTo[he]) {
             pos = nsteps - 1 - pos;
         }
-        res.push_back({best_he.opposite().idx, pos * stepSize + posBase});
-        Crossing crossing = {best_he.edge(), bestPos};
-        auto &info = crossInfo[crossing];
-        best_he = this->mesh->handle_of(info.predecessor);
-        bestPos = info.predPos;
+        res.push_back({pm::halfedge_index(int(Graph::opposite(he))), pos * stepSize + posBase});
     }
     return res;
 }
 
+std::array<uint32_t, 3> NavMesh::canonicalTriangle(pm::face_handle f) {
+    auto h = f.any_halfedge();
+    TG_ASSERT(h.next().next().next() == h);
+    std::array<uint32_t, 3> res = {uint32_t(h.vertex_from().idx.value), uint32_t(h.vertex_to().idx.value), uint32_t(h.next().vertex_to().idx.value)};
+    std::rotate(res.begin(), std::min_element(res.begin(), res.end()), res.end());
+    return res;
+}
+
 Instance::Instance(const ECS::Rigid &wo, const Terrain::Instance &terrain) {
-    this->mesh->copy_from(*terrain.mesh);
-    this->localPos.copy_from(terrain.posAttr);
+    auto &source = *terrain.mesh;
     auto xform = wo.transform_mat();
-    for (auto v : this->mesh->all_vertices()) {
-        this->worldPos[v] = tg::pos3(xform * tg::vec4(this->localPos[v.idx], 1));
+    std::vector<tg::pos3> world(source.all_vertices().size());
+    for (auto v : source.vertices()) {world[v.idx.value] = tg::pos3(xform * tg::vec4(terrain.posAttr[v], 1));}
+
+    // one pass over the terrain faces, keeping those with a vertex above water
+    constexpr uint32_t NONE = -1;
+    std::vector<uint32_t> remap(world.size(), NONE);
+    std::vector<std::array<uint32_t, 3>> triangles;
+    triangles.reserve(source.faces().size());
+    for (auto f : source.faces()) {
+        auto tri = canonicalTriangle(f);
+        if (world[tri[0]].y < terrain.waterLevel && world[tri[1]].y < terrain.waterLevel && world[tri[2]].y < terrain.waterLevel) {continue;}
+        for (auto v : tri) {remap[v] = 0;}
+        triangles.push_back(tri);
     }
-    auto test = [&] (pm::vertex_handle v) {
-        return this->worldPos[v].y >= terrain.waterLevel;
-    };
-    for (auto f : this->mesh->faces()) {
-        bool keep = false;
-        for (auto v : f.vertices()) {
-            if (test(v)) {keep = true;}
-        }
-        if (!keep) {this->mesh->faces().remove(f);}
+    // used vertices keep their order, as with `compactify`, so the triangles stay canonical
+    uint32_t nv = 0;
+    for (auto &idx : remap) {
+        if (idx != NONE) {idx = nv++;}
+    }
+    for (uint32_t i = 0; i < remap.size(); ++i) {
+        if (remap[i] == NONE) {continue;}
+        auto v = this->mesh->vertices().add();
+        this->localPos[v] = terrain.posAttr[source.vertices()[i]];
+        this->worldPos[v] = world[i];
+    }
+    auto vertices = this->mesh->vertices();
+    for (auto &tri : triangles) {
+        this->mesh->faces().add(vertices[remap[tri[0]]], vertices[remap[tri[1]]], vertices[remap[tri[2]]]);
     }
 
-    // clean up edges and vertices that are only used by removed faces
-    for (auto e : this->mesh->edges()) {
-        if (e.halfedgeA().is_boundary() && e.halfedgeB().is_boundary()) {
-            this->mesh->edges().remove(e);
-        }
+    // the face tree only reads the finished mesh, like everything else from here on
+    auto faceTreeBuilt = std::async(std::launch::async, [this] {buildFaceTree();});
+    if (auto graph = Graph::build(*this->mesh, this->worldPos)) {
+        this->graph = std::make_shared<Graph>(std::move(*graph));
+        this->landmarks = std::make_shared<const Landmarks>(Landmarks::build(*this->graph));
     }
-    for (auto v : this->mesh->vertices()) {
-        if (v.is_isolated()) {this->mesh->vertices().remove(v);}
+    this->heightfield = Heightfield::build(*this, wo, terrain.segmentsAmount - 1, terrain.segmentSize);
+    faceTreeBuilt.wait();
+    if (!this->heightfield) {glow::warning() << "navmesh is not grid-aligned, using face tree for ray casts";}
+}
+
+void Instance::canonicalizeMesh() {
+    pm::Mesh canonical;
+    for (size_t i = 0; i < this->mesh->vertices().size(); ++i) {canonical.vertices().add();}
+    auto vertices = canonical.vertices();
+    for (auto f : this->mesh->faces()) {
+        auto tri = canonicalTriangle(f);
+        canonical.faces().add(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
     }
-    this->mesh->compactify();
+    // vertex indices don't change, so the positions can be put back by index
+    std::vector<std::pair<tg::pos3, tg::pos3>> positions;
+    for (auto v : this->mesh->vertices()) {positions.emplace_back(this->localPos[v], this->worldPos[v]);}
+    this->mesh->copy_from(canonical);
+    for (auto v : this->mesh->vertices()) {std::tie(this->localPos[v], this->worldPos[v]) = positions[v.idx.value];}
+}
+
+void Instance::buildFaceTree() {
+    this->faceTree.clear();
     for (auto f : this->mesh->faces()) {
         auto aabb = faceAABB(f, this->worldPos);
         decltype(faceTree)::RStarInserter::insert(this->faceTree, {aabb, f.idx});
     }
 }
 
+std::optional<tg::aabb3> Instance::applyCrater(const Terrain::Crater &crater) {
+    // the faces reaching into the crater's column, and their vertices
+    auto inColumn = [&] (const tg::aabb3 &aabb) {
+        return aabb.min.x <= crater.center.x + crater.radius && aabb.max.x >= crater.center.x - crater.radius
+            && aabb.min.z <= crater.center.z + crater.radius && aabb.max.z >= crater.center.z - crater.radius;
+    };
+    std::vector<pm::face_index> faces;
+    faceTree.visit([&] (const tg::aabb3 &aabb, int) {return inColumn(aabb);}, [&] (const FaceInfo &info) {
+        if (inColumn(info.aabb)) {faces.push_back(info.idx);}
+        return true;
+    });
+    std::vector<int> vertices;
+    for (auto f : faces) {
+        for (auto v : mesh->handle_of(f).vertices()) {vertices.push_back(v.idx.value);}
+    }
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    // the terrain is upright, so the dent is along Y in local and world space alike
+    constexpr auto inf = std::numeric_limits<float>::infinity();
+    tg::aabb3 world = {{inf, inf, inf}, {-inf, -inf, -inf}}, local = world;
+    auto extend = [] (tg::aabb3 &aabb, tg::pos3 p) {
+        aabb.min = tg::min(aabb.min, p);
+        aabb.max = tg::max(aabb.max, p);
+    };
+    bool moved = false;
+    for (auto idx : vertices) {
+        auto v = mesh->vertices()[idx];
+        extend(world, worldPos[v]);
+        extend(local, localPos[v]);
+        auto dent = crater.dent(worldPos[v]);
+        if (dent <= 0.f) {continue;}
+        worldPos[v].y -= dent;
+        localPos[v].y -= dent;
+        extend(world, worldPos[v]);
+        extend(local, localPos[v]);
+        moved = true;
+    }
+    if (!moved) {return std::nullopt;}
+
+    if (graph) {
+        auto &g = editGraph();
+        for (auto idx : vertices) {g.vy[idx] = worldPos[mesh->vertices()[idx]].y;}
+        std::vector<uint32_t> changed;
+        for (auto f : faces) {
+            for (auto h : g.faces[f.value].halfedge) {
+                auto e = Graph::edgeOf(h);
+                auto a = g.vertex(g.edgeA[e]), b = g.vertex(g.edgeB[e]);
+                g.edgeLength[e] = tg::distance(a, b);
+                g.edgeMid[e] = tg::lerp(a, b, .5f);
+            }
+            changed.push_back(uint32_t(f.value));
+        }
+        // every face with a moved vertex reaches into the column, so this covers all changed edges
+        g.logChanges(changed);
+    }
+    faceTree.refit([&] (const tg::aabb3 &aabb, int) {return inColumn(aabb);}, [&] (FaceInfo &info) {
+        if (!inColumn(info.aabb)) {return false;}
+        info.aabb = faceAABB(mesh->handle_of(info.idx), worldPos);
+        return true;
+    });
+    if (heightfield) {heightfield->refit(*this, local);}
+    if (hierarchy) {
+        auto &hier = editHierarchy();
+        // the clusters have to keep containing their faces
+        for (auto f : faces) {
+            auto aabb = faceAABB(mesh->handle_of(f), worldPos);
+            auto &bounds = hier.clusters[hier.faceCluster[f.value]].bounds;
+            extend(bounds, aabb.min);
+            extend(bounds, aabb.max);
+        }
+        hier.invalidate(world);
+    }
+    return world;
+}
+
 void System::editorUI(ECS::entity ent) {
     auto terr_iter = mECS.terrains.find(ent);
     if (terr_iter == mECS.terrains.end()) {
@@ -210,6 +402,7 @@ void System::editorUI(ECS::entity ent) {
         bool want_rendering = true;
         if (ImGui::Checkbox("NavMesh", &want_rendering) && !want_rendering) {
             mECS.navMeshes.erase(nav_iter);
+            mECS.navMeshVersion += 1;
         } else {
             auto &nav = nav_iter->second;
             ImGui::TextUnformatted("Placeholder NavMesh options");
@@ -232,6 +425,7 @@ void System::editorUI(ECS::entity ent) {
         bool want_rendering = false;
         if (ImGui::Checkbox("NavMesh", &want_rendering) && want_rendering) {
             mECS.navMeshes.emplace(ent, Instance(wo, terr));
+            mECS.navMeshVersion += 1;
         }
     }
 }
@@ -266,6 +460,11 @@ std::optional<float> Instance::intersectionTest(pm::face_handle f, const tg::ray
 }
 
 std::optional<std::pair<pm::face_index, float>> Instance::intersect(const tg::ray3 &ray) const {
+    if (heightfield) {return heightfield->intersect(*this, ray);}
+    return intersectTree(ray);
+}
+
+std::optional<std::pair<pm::face_index, float>> Instance::intersectTree(const tg::ray3 &ray) const {
     std::optional<std::pair<pm::face_index, float>> res;
     faceTree.visit([&] (const tg::aabb3 &a, decltype(faceTree)::level_t) {
         return tg::intersects(a, ray);
@@ -282,17 +481,88 @@ std::optional<std::pair<pm::face_index, float>> Instance::intersect(const tg::ra
 }
 
 std::optional<std::tuple<ECS::entity, pm::face_index, float>> System::intersect(const tg::ray3 &ray) {
+    updateIndex();
+    std::optional<std::tuple<ECS::entity, pm::face_index, float>> res;
+    auto limit = [&] {return res ? std::get<2>(*res) : std::numeric_limits<float>::infinity();};
+    mIndex.visit([&] (const tg::aabb3 &aabb, decltype(mIndex)::level_t) {
+        return Util::rayBoxEntry(ray, aabb, limit()) < limit();
+    }, [&] (const Bounds &bounds) {
+        if (!(Util::rayBoxEntry(ray, bounds.aabb, limit()) < limit())) {return true;}
+        auto hit = mECS.navMeshes.at(bounds.id).intersect(ray);
+        if (hit && hit->second < limit()) {res = {{bounds.id, hit->first, hit->second}};}
+        return true;
+    });
+    return res;
+}
+
+std::optional<std::tuple<ECS::entity, pm::face_index, float>> System::closestPoint(tg::pos3 pos) {
+    updateIndex();
     std::optional<std::tuple<ECS::entity, pm::face_index, float>> res;
-    for (auto &&nav_ : mECS.navMeshes) {
-        auto hit = nav_.second.intersect(ray);
-        if (hit && (!res || hit->second < std::get<2>(*res))) {
-            res = {{nav_.first, hit->first, hit->second}};
+    auto limit = [&] {return res ? std::get<2>(*res) : std::numeric_limits<float>::infinity();};
+    mIndex.visit([&] (const tg::aabb3 &aabb, decltype(mIndex)::level_t) {
+        return tg::distance(aabb, pos) < limit();
+    }, [&] (const Bounds &bounds) {
+        if (!(tg::distance(bounds.aabb, pos) < limit())) {return true;}
+        auto closest = mECS.navMeshes.at(bounds.id).closestPoint(pos);
+        if (closest && closest->second < limit()) {res = {{bounds.id, closest->first, closest->second}};}
+        return true;
+    });
+    return res;
+}
+
+bool Instance::reachable(pm::face_index from, pm::face_index to) const {
+    if (!graph) {return true;}
+    return searcher().reachable(uint32_t(from.value), uint32_t(to.value));
+}
+
+bool Searcher::reachable(uint32_t a, uint32_t b) const {
+    auto &g = graph;
+    if (a == b) {return true;}
+    if (g.faceComponent[a] != g.faceComponent[b]) {return false;}
+    if (!hierarchy || !hierarchy->regionsValid) {return true;}
+    auto &regions = hierarchy->edgeRegion;
+    for (auto ha : g.faces[a].halfedge) {
+        auto ra = regions[Graph::edgeOf(ha)];
+        if (ra == Hierarchy::NONE) {continue;}
+        for (auto hb : g.faces[b].halfedge) {
+            if (regions[Graph::edgeOf(hb)] == ra) {return true;}
         }
     }
+    return false;
+}
+
+std::optional<std::pair<pm::face_index, tg::pos3>> Instance::nearestReachable(pm::face_index from, tg::pos3 pos) const {
+    std::optional<std::pair<pm::face_index, tg::pos3>> res;
+    auto bestDist = tg::inf<float>;
+    // grow the search radius until something reachable is inside; `from`
+    // itself always is, so this ends
+    for (float radius = 2.f; !res && radius < 1e7f; radius *= 2) {
+        faceTree.visit([&] (const tg::aabb3 &a, decltype(faceTree)::level_t) {
+            return tg::distance(a, pos) <= std::min(radius, bestDist);
+        }, [&] (const FaceInfo &info) {
+            if (tg::distance(info.aabb, pos) > std::min(radius, bestDist)) {return true;}
+            if (!reachable(from, info.idx)) {return true;}
+            auto f = mesh->handle_of(info.idx);
+            auto h = f.any_halfedge();
+            auto tri = tg::triangle3(worldPos[h.vertex_from()], worldPos[h.vertex_to()], worldPos[h.next().vertex_to()]);
+            auto p = tg::project(pos, tri);
+            auto dist = tg::distance(p, pos);
+            if (dist < bestDist) {
+                bestDist = dist;
+                res = {info.idx, p};
+            }
+            return true;
+        });
+    }
     return res;
 }
 
 std::optional<std::pair<pm::face_index, float>> Instance::closestPoint(tg::pos3 pos) const {
+    if (heightfield) {return heightfield->closestPoint(*this, pos);}
+    return closestPointTree(pos);
+}
+
+std::optional<std::pair<pm::face_index, float>> Instance::closestPointTree(tg::pos3 pos) const {
     auto maxDist = 1.f;
     std::optional<std::pair<pm::face_index, float>> res;
     this->faceTree.visit([&, pos] (const tg::aabb3 &a, decltype(this->faceTree)::level_t) {
@@ -302,35 +572,80 @@ std::optional<std::pair<pm::face_index, float>> Instance::closestPoint(tg::pos3
         return dist < res->second;
     }, [&, pos] (const NavMesh::FaceInfo &a) {
         if (res && tg::distance(a.aabb, pos) > res->second) {return true;}
-        auto f = this->mesh->handle_of(a.idx);
-        auto iter1 = f.vertices().begin();
-        while (iter1 != f.vertices().end()) {
-            auto a = this->worldPos[*iter1];
-            auto iter2 = iter1;
-            while (true) {
-                ++iter2;
-                if (iter2 == f.vertices().end()) {break;}
-                auto b = this->worldPos[*iter2];
-                auto iter3 = iter2;
-                while (true) {
-                    ++iter3;
-                    if (iter3 == f.vertices().end()) {break;}
-                    auto c = this->worldPos[*iter3];
-                    auto dist = tg::distance(tg::triangle(a, b, c), pos);
-
-                    if (!res || dist < res->second) {
-                        res = {f.idx, dist};
-                        glow::info() << "replacing incumbent nearest";
-                    }
-                }
-            }
-            ++iter1;
+        auto dist = distanceTo(this->mesh->handle_of(a.idx), pos);
+        if (!res || dist < res->second) {res = {a.idx, dist};}
+        return true;
+    });
+    return res;
+}
+
+std::optional<pm::face_index> Instance::faceAt(tg::pos3 pos) const {
+    if (heightfield) {return heightfield->faceAt(*this, pos);}
+    return faceAtTree(pos);
+}
+
+std::optional<pm::face_index> Instance::faceAtTree(tg::pos3 pos) const {
+    std::optional<pm::face_index> res;
+    float best = std::numeric_limits<float>::infinity();
+    auto inColumn = [pos] (const tg::aabb3 &a) {
+        return a.min.x <= pos.x && pos.x <= a.max.x && a.min.z <= pos.z && pos.z <= a.max.z;
+    };
+    this->faceTree.visit([&] (const tg::aabb3 &a, decltype(this->faceTree)::level_t) {
+        return inColumn(a);
+    }, [&] (const NavMesh::FaceInfo &a) {
+        if (!inColumn(a.aabb)) {return true;}
+        auto height = heightAt(this->mesh->handle_of(a.idx), pos);
+        if (height && std::abs(*height - pos.y) < best) {
+            best = std::abs(*height - pos.y);
+            res = a.idx;
         }
         return true;
     });
     return res;
 }
 
+float Instance::distanceTo(pm::face_handle f, tg::pos3 pos) const {
+    auto res = std::numeric_limits<float>::infinity();
+    auto iter1 = f.vertices().begin();
+    while (iter1 != f.vertices().end()) {
+        auto a = this->worldPos[*iter1];
+        auto iter2 = iter1;
+        while (true) {
+            ++iter2;
+            if (iter2 == f.vertices().end()) {break;}
+            auto b = this->worldPos[*iter2];
+            auto iter3 = iter2;
+            while (true) {
+                ++iter3;
+                if (iter3 == f.vertices().end()) {break;}
+                auto c = this->worldPos[*iter3];
+                res = std::min(res, tg::distance(tg::triangle(a, b, c), pos));
+            }
+        }
+        ++iter1;
+    }
+    return res;
+}
+
+std::optional<float> Instance::heightAt(pm::face_handle f, tg::pos3 pos) const {
+    // fan around the first vertex, like the faces are triangulated
+    auto iter = f.vertices().begin();
+    auto a = this->worldPos[*iter];
+    ++iter;
+    auto b = this->worldPos[*iter];
+    for (++iter; iter != f.vertices().end(); ++iter) {
+        auto c = this->worldPos[*iter];
+        auto area = (b.x - a.x) * (c.z - a.z) - (b.z - a.z) * (c.x - a.x);
+        if (area != 0.f) {
+            auto u = ((c.x - b.x) * (pos.z - b.z) - (c.z - b.z) * (pos.x - b.x)) / area;
+            auto v = ((a.x - c.x) * (pos.z - c.z) - (a.z - c.z) * (pos.x - c.x)) / area;
+            if (u >= 0.f && v >= 0.f && u + v <= 1.f) {return u * a.y + v * b.y + (1.f - u - v) * c.y;}
+        }
+        b = c;
+    }
+    return std::nullopt;
+}
+
 tg::vec3 Instance::faceNormal(pm::face_index f) const {
     auto he = mesh->handle_of(f).any_halfedge();
     auto a = worldPos[he.prev().vertex_from()];
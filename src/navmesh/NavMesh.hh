@@ -1,5 +1,12 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include <typed-geometry/tg-lean.hh>
 #include <polymesh/Mesh.hh>
 #include <glow/fwd.hh>
@@ -7,8 +14,15 @@
 #include <ECS.hh>
 #include <ECS/Misc.hh>
 #include <obstacles/Collision.hh>
+#include "FlowField.hh"
+#include "Graph.hh"
+#include "Heightfield.hh"
+#include "Hierarchy.hh"
+#include "Landmarks.hh"
+#include "Portals.hh"
 
 namespace Terrain {
+    struct Crater;
     struct Instance;
 }
 
@@ -30,6 +44,56 @@ struct RouteRequest {
 
 using Route = std::vector<std::pair<pm::halfedge_index, float>>;
 
+/// counters of the last search, for debugging and benchmarks
+struct SearchStats {
+    size_t opened = 0, expanded = 0, connections = 0;
+    size_t scratchBytes = 0;  ///< size of the (reused) per-thread search memory
+    bool fellBack = false;  ///< the face search failed and the crossing search was used instead
+    bool unreachable = false;  ///< rejected without searching
+    /// collision queries of the collider; only counted by `Instance::navigate`,
+    /// where they include updating the hierarchy for the search
+    size_t obstructionTests = 0;
+};
+
+enum class SearchMode {
+    /// A* over `nsteps` sample points per edge
+    Crossings,
+    /// A* over the faces, then string-pulling through the corridor of portals
+    Corridor,
+    /// A* over cluster entrances, then the corridor search restricted to the clusters on the way
+    Hierarchical
+};
+
+struct SquadRequest;
+struct SquadRoutes;
+
+/// one search on read-only navmesh data. It doesn't touch the `Instance`,
+/// so searches can run on other threads while the main thread goes on
+struct Searcher {
+    const Graph &graph;
+    const Landmarks *landmarks = nullptr;  ///< null: straight-line heuristic only
+    /// needed by `SearchMode::Hierarchical`, and has to be up to date for it
+    const Hierarchy *hierarchy = nullptr;
+    /// use the obstacles baked into `hierarchy` in the corridor search where
+    /// they fit the unit, instead of collision queries
+    bool bakedObstacles = false;
+    SearchStats stats;
+
+    /// see `Instance::navigate`
+    Route navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode);
+    Route crossings(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider);
+    Route corridor(const RouteRequest &req, Obstacle::Collider &collider, const std::vector<uint8_t> *clusters = nullptr);
+    Route hierarchical(const RouteRequest &req, Obstacle::Collider &collider);
+    bool reachable(uint32_t fromFace, uint32_t toFace) const;
+    /// the searches of `Instance::planSquad`, after `Instance::placeSquad`
+    SquadRoutes squad(const SquadRequest &, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode);
+};
+
+class Replanner;
+
+/// vertex indices of a triangle in winding order, starting at the lowest
+std::array<uint32_t, 3> canonicalTriangle(pm::face_handle);
+
 struct Instance {
     std::unique_ptr<pm::Mesh> mesh = std::make_unique<pm::Mesh>();
     pm::vertex_attribute<tg::pos3> localPos{*mesh};
@@ -38,25 +102,165 @@ struct Instance {
     // navigation is really terrible if you have to keep converting coordinate spaces
     pm::vertex_attribute<tg::pos3> worldPos{*mesh};
     ECS::RTree<FaceInfo> faceTree;
+    /// what `navigate` searches on; missing if the mesh is not triangulated.
+    /// Shared with searches running on the `Planner`'s workers, so change it
+    /// only through `editGraph`
+    std::shared_ptr<Graph> graph;
+    /// built with the graph; used by the corridor and hierarchical searches
+    std::shared_ptr<const Landmarks> landmarks;
+    bool landmarkHeuristic = true;
+    /// let the corridor search use the obstacles baked into the hierarchy,
+    /// building it for the unit size of the first corridor search
+    bool bakedObstacles = true;
+    SearchStats lastSearch;
+    /// for `SearchMode::Hierarchical` and the obstacles baked into the faces,
+    /// built on demand. Searches on other threads may hold on to it, so
+    /// change it only through `editHierarchy`
+    std::shared_ptr<Hierarchy> hierarchy;
+    /// for groups going to the same place, see `flowField`
+    FlowFieldCache flowFields;
+    /// only present if the navmesh was derived from a terrain grid
+    std::optional<Heightfield> heightfield;
 
+    /// empty, to be filled by `loadCache`
+    Instance() = default;
+    /// the terrain's faces with a vertex above water, streamed into a new mesh.
+    /// The terrain has to be triangulated
     Instance(const ECS::Rigid &wo, const Terrain::Instance &terrain);
+    /// same as the constructor, but loaded from `cacheDir` if this terrain
+    /// was seen before, and stored there otherwise (see `Cache.hh`)
+    static Instance cached(const ECS::Rigid &wo, const Terrain::Instance &terrain, const std::string &cacheDir = "navmesh-cache");
+
+    /// rebuilds the mesh from its list of faces (see `canonicalTriangle`), so
+    /// that the halfedge indices only depend on the faces and not on how the
+    /// mesh came about
+    void canonicalizeMesh();
+    void buildFaceTree();
 
     tg::pos3 edgeLerp(const pm::edge_handle &edge, float param) const;
-    Route navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider);
+    /// the graph has to exist
+    Searcher searcher() const;
+    /// builds the hierarchy for the collider's unit size if there is none,
+    /// and recomputes what obstruction changes have made dirty
+    void updateHierarchy(Obstacle::Collider &collider);
+    /// copies the hierarchy first if a search still uses it
+    Hierarchy &editHierarchy();
+    /// copies the graph first if a search still uses it
+    Graph &editGraph();
+    /// lowers the ground for a crater in world space: the vertices in its
+    /// radius are moved down, and the graph, the face tree, the heightfield
+    /// and the hierarchy are refitted for the faces around it only. Returns
+    /// the (world-space) bounds of those faces before and after, or nothing if
+    /// no vertex moved. The landmark distances are kept, so the heuristic
+    /// can be off by about the change in edge lengths until they are rebuilt.
+    /// The changed faces go into the graph's log, for `Replanner`s to catch up
+    std::optional<tg::aabb3> applyCrater(const Terrain::Crater &);
+    /// flow field towards the face for units of the collider's size, from the
+    /// cache unless obstacles have changed since it was built
+    std::shared_ptr<const FlowField> flowField(pm::face_index goalFace, Obstacle::Collider &collider);
+    /// the field's way from `req.start` to `req.end` (in the goal face),
+    /// string-pulled. Empty if it doesn't lead there, like a failed search
+    Route flowRoute(const FlowField &, const RouteRequest &req, Obstacle::Collider &collider) const;
+    /// incremental search for a route that is kept while a unit follows it
+    /// (see `Replanner`). The hierarchy has to be for the collider's unit size
+    /// and is built on first use; the graph has to exist
+    Replanner replanner(const RouteRequest &req, Obstacle::Collider &collider);
+    /// repairs the replanner's search for the obstacles that changed since
+    /// the last call, and returns its route
+    Route replan(Replanner &, Obstacle::Collider &collider);
+    /// the part of `planSquad` that needs the `Instance`: each unit's place
+    /// in the formation at the goal, and where the shared corridor may start
+    SquadRequest placeSquad(const std::vector<std::pair<pm::face_index, tg::pos3>> &starts, pm::face_index goalFace, tg::pos3 goal) const;
+    /// routes for units starting at `starts` going to `goal` together, from one
+    /// shared corridor where possible (see `SquadRoutes`). The units' own searches
+    /// use `mode`, like `navigate`
+    SquadRoutes planSquad(const std::vector<std::pair<pm::face_index, tg::pos3>> &starts, pm::face_index goalFace, tg::pos3 goal,
+        uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode = SearchMode::Hierarchical);
+    /// `nsteps` is only used by the crossing search, which the corridor search
+    /// falls back to if it finds no unobstructed path
+    Route navigate(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode = SearchMode::Crossings);
+    Route navigateCrossings(const RouteRequest &req, uint32_t nsteps, Obstacle::Collider &collider);
+    /// empty if there is no corridor or the path through it is obstructed.
+    /// If `clusters` is given, only faces in clusters of `hierarchy` with a nonzero entry are searched
+    Route navigateCorridor(const RouteRequest &req, Obstacle::Collider &collider, const std::vector<uint8_t> *clusters = nullptr);
+    /// builds the hierarchy for the collider's unit size on first use
+    Route navigateHierarchical(const RouteRequest &req, Obstacle::Collider &collider);
+    /// moves the start of a route planned a while ago to `pos`, where the unit
+    /// is now: the crossings up to the face it stands in are dropped. False if
+    /// `pos` isn't in a face of the route any more, so it has to be planned again
+    bool reanchor(RouteRequest &req, Route &route, tg::pos3 pos) const;
+    /// O(1) check if a route can exist at all. Once the hierarchy has been
+    /// built, obstacles and the unit size are taken into account as well
+    bool reachable(pm::face_index from, pm::face_index to) const;
+    /// point closest to `pos` that can be reached from `from`
+    std::optional<std::pair<pm::face_index, tg::pos3>> nearestReachable(pm::face_index from, tg::pos3 pos) const;
+    /// face closest to `pos` and the distance to it. Uses the heightfield's
+    /// grid if available, otherwise the face tree
     std::optional<std::pair<pm::face_index, float>> closestPoint(tg::pos3 pos) const;
+    /// only exact for faces within 1 of `pos`
+    std::optional<std::pair<pm::face_index, float>> closestPointTree(tg::pos3 pos) const;
+    /// face straight above or below `pos` (the closest in height if there are
+    /// several), using the heightfield's grid if available
+    std::optional<pm::face_index> faceAt(tg::pos3 pos) const;
+    std::optional<pm::face_index> faceAtTree(tg::pos3 pos) const;
+    float distanceTo(pm::face_handle f, tg::pos3 pos) const;
+    /// height of the face at the ground-plane position of `pos`, if it is within the face there
+    std::optional<float> heightAt(pm::face_handle f, tg::pos3 pos) const;
     std::optional<float> intersectionTest(pm::face_handle f, const tg::ray3 &ray) const;
+    /// uses the heightfield if available, otherwise the face tree
     std::optional<std::pair<pm::face_index, float>> intersect(const tg::ray3 &ray) const;
+    std::optional<std::pair<pm::face_index, float>> intersectTree(const tg::ray3 &ray) const;
     /// CAUTION: result NOT normalized
     tg::vec3 faceNormal(pm::face_index f) const;
 };
 
+/// a point on one of the navmeshes
+struct Place {
+    ECS::entity nav;
+    pm::face_index face;
+    tg::pos3 pos;
+};
+
+/// the part of a route across navmeshes that is on one of them
+struct Leg {
+    ECS::entity nav;
+    RouteRequest req;
+    Route route;
+};
+
 class System final : public ECS::Editor {
     ECS::ECS &mECS;
 
+    struct Bounds {
+        tg::aabb3 aabb;
+        ECS::entity id;
+
+        tg::aabb3 getAABB() const {return aabb;}
+    };
+    /// world-space bounds of the instances, so queries only look at those they can hit
+    ECS::RTree<Bounds> mIndex;
+    std::vector<Portal> mPortals;
+    std::map<ECS::entity, std::vector<uint32_t>> mInstancePortals;
+    uint64_t mIndexedVersion = -1;  ///< `ECS::navMeshVersion` the index was built for
+
 public:
     System(ECS::ECS &ecs) : mECS{ecs} {}
     void editorUI(ECS::entity);
+    /// rebuilds the index and the portals if navmeshes were added or removed since
+    void updateIndex();
+    const std::vector<Portal> &portals() {
+        updateIndex();
+        return mPortals;
+    }
     std::optional<std::tuple<ECS::entity, pm::face_index, float>> intersect(const tg::ray3 &ray);
+    /// closest face on any navmesh, see `Instance::closestPoint`
+    std::optional<std::tuple<ECS::entity, pm::face_index, float>> closestPoint(tg::pos3 pos);
+    /// route that may cross over to other navmeshes through their portals:
+    /// the shortest chain of portals by straight-line distance whose faces
+    /// are reachable from each other, then a search per navmesh. A leg that
+    /// can't be found takes its link out and the chain is searched again.
+    /// Empty if there is no way
+    std::vector<Leg> navigate(const Place &from, const Place &to, Obstacle::Collider &, SearchMode mode = SearchMode::Corridor);
 };
 
 }
@@ -101,7 +101,11 @@ bool NavMesh::PathfinderTool::updatePath() {
     };
     auto up = rigid.rotation * tg::dir3(0, 1, 0);
     Obstacle::Collider collider(mECS, up * mHeight, mRadius);
-    auto res = nav.navigate(req, mNSteps, collider);
+    auto mode = SearchMode(mMode);
+    auto res = nav.navigate(req, mNSteps, collider, mode);
+    if (nav.lastSearch.fellBack) {glow::info() << "search failed, used crossings";}
+    glow::info() << nav.lastSearch.opened << (mode != SearchMode::Crossings && !nav.lastSearch.fellBack ? " nodes" : " crossings") << " opened, " << nav.lastSearch.expanded << " expanded";
+    glow::info() << nav.lastSearch.connections << " connections tested";
     glow::info() << collider.query.nFaceChecks << " face checks, " << collider.query.nAABBChecks << " AABB checks";
     std::vector<tg::pos3> pathVizVerts;
     pathVizVerts.reserve(res.size() * 2 + 2 + 4 * collider.query.rejected.size());
@@ -161,6 +165,11 @@ void NavMesh::PathfinderTool::updateUI() {
     if ((update |= ImGui::InputInt("#crossings per edge", &mNSteps, 1, 100))) {
         mNSteps = std::clamp(mNSteps, 1, 100);
     }
+    update |= ImGui::RadioButton("Crossings", &mMode, int(SearchMode::Crossings));
+    ImGui::SameLine();
+    update |= ImGui::RadioButton("Corridor + funnel", &mMode, int(SearchMode::Corridor));
+    ImGui::SameLine();
+    update |= ImGui::RadioButton("Hierarchical", &mMode, int(SearchMode::Hierarchical));
     update |= ImGui::InputFloat("Path width", &mRadius, 0.f, 10.f);
     update |= ImGui::InputFloat("Unit height", &mHeight, 0.f, 10.f);
     if (update) {updatePath();}
@@ -6,6 +6,7 @@
 #include <glow/fwd.hh>
 
 #include <Game.hh>
+#include "NavMesh.hh"
 
 namespace NavMesh {
 
@@ -26,6 +27,7 @@ class PathfinderTool final : public Game::Tool {
     std::array<std::optional<SelectedPoint>, 2> mPoints {};
     size_t mCurPoint = 0;
     int mNSteps = 3;
+    int mMode = int(SearchMode::Crossings);
     float mRadius = .5f, mHeight = 1.8f;
 
     bool updatePath();
@@ -0,0 +1,303 @@
+// SPDX-License-Identifier: MIT
+#include "Planner.hh"
+#include <limits>
+
+#include "Replanner.hh"
+
+using namespace NavMesh;
+
+Planner::Planner(size_t threads, size_t sliceBudget) : mSliceBudget(sliceBudget) {
+    for (size_t i = 0; i < threads; ++i) {mWorkers.emplace_back([this] {work();});}
+}
+
+Planner::~Planner() {
+    {
+        std::lock_guard lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for (auto &thread : mWorkers) {thread.join();}
+}
+
+Planner::Ticket Planner::submit(ECS::ECS &ecs, const Request &req, Callback done) {
+    Job job;
+    job.req = req;
+    job.done = std::move(done);
+    if (!prepare(ecs, job)) {return 0;}
+    job.result.req = req.route;
+    std::vector<ECS::entity> owners;
+    if (req.owner != ECS::INVALID) {owners.push_back(req.owner);}
+    return enqueue(std::move(job), owners);
+}
+
+Planner::Ticket Planner::submitSquad(ECS::ECS &ecs, const Request &req, const std::vector<ECS::entity> &owners, const SquadRequest &squad, Callback done) {
+    Job job;
+    job.req = req;
+    job.req.owner = ECS::INVALID;
+    job.done = std::move(done);
+    if (!prepare(ecs, job)) {return 0;}
+    job.squad = squad;
+    job.result.owners = owners;
+    return enqueue(std::move(job), owners);
+}
+
+bool Planner::prepare(ECS::ECS &ecs, Job &job) {
+    auto &req = job.req;
+    auto navIter = ecs.navMeshes.find(req.navId);
+    if (navIter == ecs.navMeshes.end() || !navIter->second.graph) {return false;}
+    auto &nav = navIter->second;
+    job.graph = nav.graph;
+    if (nav.landmarkHeuristic) {job.landmarks = nav.landmarks;}
+    job.bakedObstacles = nav.bakedObstacles;
+    if (!mObstructions || mObstructionVersion != ecs.obstructionVersion) {
+        mObstructions = Obstacle::ObstructionView::capture(ecs);
+        mObstructionVersion = ecs.obstructionVersion;
+    }
+    job.obstructions = mObstructions;
+    bool hierarchical = req.mode == SearchMode::Hierarchical || req.keepSearch;
+    if (hierarchical || (req.mode == SearchMode::Corridor && nav.bakedObstacles)) {
+        Obstacle::Collider collider(ecs, req.height, req.radius);
+        if (hierarchical || !nav.hierarchy || nav.hierarchy->fits(collider)) {
+            if (nav.hierarchy && nav.hierarchy->regionsValid) {
+                job.hierarchy = nav.hierarchy;
+            } else {
+                // same as `Instance::updateHierarchy`, but left to the workers
+                auto &update = mHierarchyUpdates[req.navId];
+                if (!update || update->graph != nav.graph || update->base != nav.hierarchy || update->obstructionVersion != mObstructionVersion) {
+                    update = std::make_shared<HierarchyUpdate>();
+                    update->graph = nav.graph;
+                    update->base = nav.hierarchy;
+                    update->obstructions = mObstructions;
+                    update->obstructionVersion = mObstructionVersion;
+                    update->height = req.height;
+                    update->radius = req.radius;
+                }
+                job.hierarchyUpdate = update;
+            }
+        } else {
+            job.hierarchy = nav.hierarchy;
+        }
+    }
+    return true;
+}
+
+Planner::Ticket Planner::enqueue(Job &&job, const std::vector<ECS::entity> &owners) {
+    for (auto owner : owners) {release(owner);}
+    auto ticket = mNextTicket++;
+    job.result.ticket = ticket;
+    job.result.owner = job.req.owner;
+    job.result.navId = job.req.navId;
+    for (auto owner : owners) {mOwnerTicket[owner] = ticket;}
+    auto &req = job.req;
+    auto &g = *job.graph;
+    if (req.sliced && req.mode == SearchMode::Corridor && !req.keepSearch && !job.squad && req.route.start_face != req.route.end_face
+        && g.faceComponent[req.route.start_face.value] == g.faceComponent[req.route.end_face.value]) {
+        // a hierarchy that is still being updated isn't waited for, the search does the collision queries then
+        auto baked = job.bakedObstacles ? job.hierarchy : nullptr;
+        auto id = mSlices.submit(job.graph, job.landmarks, job.obstructions, req.route, req.height, req.radius, baked);
+        mSliced.emplace(ticket, SlicedJob{std::move(job), id});
+        return ticket;
+    }
+    auto priority = req.priority;
+    {
+        std::lock_guard lock(mMutex);
+        mQueue.emplace(std::pair(-priority, ticket), std::move(job));
+    }
+    mWake.notify_one();
+    return ticket;
+}
+
+void Planner::release(ECS::entity owner) {
+    auto iter = mOwnerTicket.find(owner);
+    if (iter == mOwnerTicket.end()) {return;}
+    auto ticket = iter->second;
+    mOwnerTicket.erase(iter);
+    for (auto &[other, otherTicket] : mOwnerTicket) {
+        if (otherTicket == ticket) {return;}  // a squad member still waits for it
+    }
+    cancel(ticket);
+}
+
+bool Planner::cancel(Ticket ticket) {
+    if (auto iter = mSliced.find(ticket); iter != mSliced.end()) {
+        mSlices.remove(iter->second.id);
+        mSliced.erase(iter);
+        return true;
+    }
+    std::lock_guard lock(mMutex);
+    for (auto iter = mQueue.begin(); iter != mQueue.end(); ++iter) {
+        if (iter->first.second != ticket) {continue;}
+        mQueue.erase(iter);
+        return true;
+    }
+    if (mRunning.count(ticket)) {
+        mCancelled.insert(ticket);
+        return true;
+    }
+    return mDone.erase(ticket) > 0;
+}
+
+const std::shared_ptr<Hierarchy> &Planner::HierarchyUpdate::get() {
+    std::call_once(once, [this] {
+        Obstacle::Collider collider(obstructions, height, radius);
+        result = base ? std::make_shared<Hierarchy>(*base) : std::make_shared<Hierarchy>(Hierarchy::build(*graph, collider));
+        if (!result->regionsValid) {result->update(*graph, collider);}
+        ready = true;
+    });
+    return result;
+}
+
+void Planner::run(Job &job) {
+    auto &req = job.result.req;
+    job.result.replanner = std::move(job.req.replanner);
+    if (!job.squad && req.start_face == req.end_face) {return;}  // nothing to search, the unit can walk straight
+    if (job.hierarchyUpdate) {job.hierarchy = job.hierarchyUpdate->get();}
+    Obstacle::Collider collider(job.obstructions, job.req.height, job.req.radius);
+    if (job.req.keepSearch && job.hierarchy && job.hierarchy->fits(collider)) {
+        auto &planner = job.result.replanner;
+        if (planner && planner->request().end_face == req.end_face && planner->request().end == req.end) {
+            planner->moveStart(req.start_face, req.start);
+            planner->update(job.graph, *job.hierarchy, collider);
+        } else {
+            planner = std::make_shared<Replanner>(job.graph, *job.hierarchy, req, collider);
+        }
+        job.result.route = planner->route(*job.hierarchy, collider);
+        job.result.stats.expanded = planner->expanded;
+        return;
+    }
+    Searcher search{*job.graph, job.landmarks.get(), job.hierarchy.get(), job.bakedObstacles};
+    if (job.squad) {
+        job.result.squad = search.squad(*job.squad, job.req.nsteps, collider, job.req.mode);
+    } else {
+        job.result.route = search.navigate(req, job.req.nsteps, collider, job.req.mode);
+    }
+    job.result.stats = search.stats;
+}
+
+void Planner::work() {
+    std::unique_lock lock(mMutex);
+    while (true) {
+        mWake.wait(lock, [this] {return mStop || !mQueue.empty();});
+        if (mStop) {return;}
+        auto node = mQueue.extract(mQueue.begin());
+        auto ticket = node.key().second;
+        mRunning.insert(ticket);
+        lock.unlock();
+        run(node.mapped());
+        lock.lock();
+        mRunning.erase(ticket);
+        if (!mCancelled.erase(ticket)) {mDone.emplace(ticket, std::move(node.mapped()));}
+        if (mQueue.empty() && mRunning.empty()) {mIdle.notify_all();}
+    }
+}
+
+void Planner::tickSliced(size_t budget, std::vector<Ticket> &partial) {
+    if (mSliced.empty()) {return;}
+    mSlices.tick(budget);
+    for (auto iter = mSliced.begin(); iter != mSliced.end();) {
+        auto &[ticket, sliced] = *iter;
+        auto &job = sliced.job;
+        auto status = *mSlices.status(sliced.id);
+        if (status == CorridorStatus::Running) {
+            sliced.ticks += 1;
+            if (job.req.partialEvery && sliced.ticks % job.req.partialEvery == 0) {partial.push_back(ticket);}
+            ++iter;
+            continue;
+        }
+        job.result.stats = *mSlices.stats(sliced.id);
+        if (status == CorridorStatus::Found) {job.result.route = mSlices.route(sliced.id)->route;}
+        mSlices.remove(sliced.id);
+        {
+            std::lock_guard lock(mMutex);
+            if (job.result.route.empty()) {
+                // no corridor, or the path through it is obstructed: fall back
+                // on the crossings, like `Searcher::navigate`
+                job.req.mode = SearchMode::Crossings;
+                mQueue.emplace(std::pair(-job.req.priority, ticket), std::move(job));
+                mWake.notify_one();
+            } else {
+                mDone.emplace(ticket, std::move(job));
+            }
+        }
+        iter = mSliced.erase(iter);
+    }
+}
+
+void Planner::tick(ECS::ECS &ecs) {
+    std::vector<Ticket> partial;
+    tickSliced(mSliceBudget, partial);
+    std::map<Ticket, Job> done;
+    {
+        std::unique_lock lock(mMutex);
+        if (mWorkers.empty()) {
+            // no workers: search right here, in queue order
+            while (!mQueue.empty()) {
+                auto node = mQueue.extract(mQueue.begin());
+                lock.unlock();
+                run(node.mapped());
+                lock.lock();
+                mDone.emplace(node.key().second, std::move(node.mapped()));
+            }
+        }
+        std::swap(done, mDone);
+    }
+    // only if the navmesh still is what the update started from; otherwise
+    // the next submit starts over from what it is now
+    for (auto iter = mHierarchyUpdates.begin(); iter != mHierarchyUpdates.end();) {
+        auto &update = *iter->second;
+        if (!update.ready) {
+            ++iter;
+            continue;
+        }
+        auto navIter = ecs.navMeshes.find(iter->first);
+        if (navIter != ecs.navMeshes.end() && navIter->second.graph == update.graph && navIter->second.hierarchy == update.base
+            && ecs.obstructionVersion == update.obstructionVersion) {
+            navIter->second.hierarchy = update.result;
+        }
+        iter = mHierarchyUpdates.erase(iter);
+    }
+    for (auto &[ticket, job] : done) {
+        if (auto iter = mOwnerTicket.find(job.req.owner); iter != mOwnerTicket.end() && iter->second == ticket) {
+            mOwnerTicket.erase(iter);
+        }
+        for (auto &owner : job.result.owners) {
+            auto iter = mOwnerTicket.find(owner);
+            if (iter == mOwnerTicket.end() || iter->second != ticket) {
+                owner = ECS::INVALID;  // has been given another request since
+            } else {
+                mOwnerTicket.erase(iter);
+            }
+        }
+        if (job.done) {job.done(job.result);}
+    }
+    for (auto ticket : partial) {
+        auto iter = mSliced.find(ticket);
+        if (iter == mSliced.end()) {continue;}  // cancelled by one of the callbacks
+        auto &sliced = iter->second;
+        auto route = mSlices.route(sliced.id);
+        if (!route || route->route.empty()) {continue;}
+        auto result = sliced.job.result;
+        result.req = route->req;
+        result.route = route->route;
+        result.stats = *mSlices.stats(sliced.id);
+        result.complete = false;
+        // the callback may replace the request, which drops the job
+        auto callback = sliced.job.done;
+        if (callback) {callback(result);}
+    }
+}
+
+void Planner::flush(ECS::ECS &ecs) {
+    std::vector<Ticket> partial;
+    tickSliced(std::numeric_limits<size_t>::max(), partial);
+    {
+        std::unique_lock lock(mMutex);
+        if (!mWorkers.empty()) {mIdle.wait(lock, [this] {return mQueue.empty() && mRunning.empty();});}
+    }
+    tick(ecs);
+}
+
+size_t Planner::pending() const {
+    std::lock_guard lock(mMutex);
+    return mQueue.size() + mRunning.size() + mDone.size() + mSliced.size();
+}
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <ECS.hh>
+#include <obstacles/Collision.hh>
+#include "NavMesh.hh"
+#include "SliceScheduler.hh"
+#include "Squad.hh"
+
+namespace NavMesh {
+
+/// plans routes on worker threads, so that a long search doesn't stall the
+/// frame. Requests are queued by priority. The workers search on snapshots
+/// of the navmesh and the obstructions taken at `submit`, and finished routes
+/// are handed back on the main thread in `tick`, ordered by ticket.
+/// Building or updating the hierarchy a search needs happens on the workers
+/// too, once for all the searches submitted against the same snapshot; `tick`
+/// hands it to the navmesh if nothing has changed there since.
+/// With 0 threads, `tick` runs the queued searches itself, which makes the
+/// results and the tick they arrive in deterministic (for headless runs).
+/// `sliced` requests don't go to the workers: `tick` runs them a few
+/// expansions at a time through a `SliceScheduler`, within the planner's
+/// expansion budget, so no single one holds up the others
+class Planner {
+public:
+    using Ticket = uint64_t;
+    struct Result {
+        Ticket ticket;
+        ECS::entity owner, navId;
+        RouteRequest req;
+        Route route;
+        SearchStats stats;
+        /// for `submitSquad`: the members still waiting for this result (the
+        /// others are INVALID), and their routes in the same order
+        std::vector<ECS::entity> owners;
+        SquadRoutes squad;
+        std::shared_ptr<Replanner> replanner;  ///< for `Request::keepSearch`
+        /// false for the best route so far of a `sliced` search (see
+        /// `Request::partialEvery`); `req.end` is where it stops. The final
+        /// result comes later and replaces it
+        bool complete = true;
+    };
+    using Callback = std::function<void(const Result &)>;
+
+    struct Request {
+        ECS::entity owner = ECS::INVALID;  ///< a new request cancels the owner's previous one
+        ECS::entity navId;
+        RouteRequest route;
+        SearchMode mode = SearchMode::Hierarchical;
+        uint32_t nsteps = 5;
+        tg::vec3 height = {0, 1.5f, 0};
+        float radius = 1.f;
+        int priority = 0;  ///< higher goes first; same priority goes by ticket
+        /// keep the search state (see `Replanner`) in the result, so the route
+        /// can be repaired later instead of searched from scratch; `mode` is
+        /// ignored then. Continues from `replanner` if it goes to the same
+        /// goal. The job owns it until it is handed back in the result
+        bool keepSearch = false;
+        std::shared_ptr<Replanner> replanner;
+        /// how often the caller has submitted this request again, e. g. because
+        /// the result didn't fit any more; only counted, not used by the planner
+        uint32_t retries = 0;
+        /// with `SearchMode::Corridor` (and not `keepSearch`): search in slices,
+        /// see `Planner`
+        bool sliced = false;
+        /// for `sliced`: also hand the best route so far to `done` every that
+        /// many ticks while the search runs, so the unit can start walking; 0: only the final route
+        uint32_t partialEvery = 0;
+    };
+
+    /// `sliceBudget` is how many face expansions `tick` spends on all `sliced` searches together
+    explicit Planner(size_t threads, size_t sliceBudget = 2000);
+    ~Planner();
+
+    /// snapshots what the search needs right away, so later changes to the
+    /// world don't affect it. `done` is called from `tick`, unless cancelled.
+    /// Returns 0 if `req.navId` is not a navmesh
+    Ticket submit(ECS::ECS &, const Request &req, Callback done);
+    /// routes for `owners` going to the same goal together (see
+    /// `Instance::planSquad`), with the search settings of `req`. A later
+    /// request for one of the owners only takes that one out of the squad
+    Ticket submitSquad(ECS::ECS &, const Request &req, const std::vector<ECS::entity> &owners, const SquadRequest &, Callback done);
+    /// false if the result was already delivered (or the ticket is unknown)
+    bool cancel(Ticket);
+    /// delivers the results that are done, in ticket order, and publishes
+    /// the hierarchies the workers brought up to date
+    void tick(ECS::ECS &);
+    /// waits for all queued searches (and runs the sliced ones to the end) and delivers them
+    void flush(ECS::ECS &);
+    size_t pending() const;
+    /// if a route for `owner` has been submitted but not delivered yet
+    bool waiting(ECS::entity owner) const {return mOwnerTicket.count(owner) > 0;}
+
+private:
+    /// a navmesh's hierarchy brought up to date for one snapshot, by the
+    /// first job that needs it
+    struct HierarchyUpdate {
+        std::shared_ptr<const Graph> graph;
+        std::shared_ptr<const Hierarchy> base;  ///< null: build one
+        std::shared_ptr<const Obstacle::ObstructionView> obstructions;
+        uint64_t obstructionVersion;
+        tg::vec3 height;
+        float radius;
+        std::once_flag once;
+        std::shared_ptr<Hierarchy> result;
+        std::atomic<bool> ready = false;
+
+        /// does the work on the first call, waits for it on the others
+        const std::shared_ptr<Hierarchy> &get();
+    };
+    struct Job {
+        Request req;
+        Callback done;
+        std::shared_ptr<const Graph> graph;
+        std::shared_ptr<const Landmarks> landmarks;
+        std::shared_ptr<const Hierarchy> hierarchy;
+        std::shared_ptr<HierarchyUpdate> hierarchyUpdate;  ///< sets `hierarchy` when the job runs
+        std::shared_ptr<const Obstacle::ObstructionView> obstructions;
+        bool bakedObstacles;
+        std::optional<SquadRequest> squad;
+        Result result;
+    };
+
+    /// snapshots the navmesh and obstructions for the job; false if there is no navmesh
+    bool prepare(ECS::ECS &, Job &);
+    Ticket enqueue(Job &&, const std::vector<ECS::entity> &owners);
+    /// the owner's pending ticket is cancelled once no other owner waits for it
+    void release(ECS::entity owner);
+    void work();
+    static void run(Job &);
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWake, mIdle;
+    std::map<std::pair<int, Ticket>, Job> mQueue;  ///< key: (-priority, ticket)
+    std::map<Ticket, Job> mDone;
+    std::set<Ticket> mRunning, mCancelled;  ///< cancelled: running ones whose result is dropped
+    bool mStop = false;
+    std::vector<std::thread> mWorkers;
+
+    // main thread only
+    Ticket mNextTicket = 1;
+    std::map<ECS::entity, Ticket> mOwnerTicket;
+    std::shared_ptr<const Obstacle::ObstructionView> mObstructions;
+    uint64_t mObstructionVersion = 0;
+    std::map<ECS::entity, std::shared_ptr<HierarchyUpdate>> mHierarchyUpdates;  ///< by navmesh
+    struct SlicedJob {
+        Job job;
+        SliceScheduler::Id id;
+        uint32_t ticks = 0;
+    };
+    size_t mSliceBudget;
+    SliceScheduler mSlices;
+    std::map<Ticket, SlicedJob> mSliced;
+
+    /// moves the finished sliced searches to `mDone` (or to the queue, to
+    /// fall back on the crossings) and collects the ones due for a partial route
+    void tickSliced(size_t budget, std::vector<Ticket> &partial);
+};
+
+}
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: MIT
+#include "Portals.hh"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <set>
+
+#include <typed-geometry/tg.hh>
+
+#include <rtree/RStar.hh>
+#include <util/IndexedHeap.hh>
+#include "NavMesh.hh"
+
+using namespace NavMesh;
+
+namespace {
+constexpr uint32_t NONE = -1;
+
+/// ground-plane position on a 1 cm grid, so that shared ends compare equal
+using GridPos = std::pair<int64_t, int64_t>;
+
+struct BorderEdge {
+    uint32_t nav;  ///< index in the instance list
+    uint32_t halfedge;  ///< the one inside the face
+    uint32_t from, to;  ///< vertices of `halfedge`
+    tg::pos3 a, b;  ///< their positions
+};
+}
+
+static GridPos gridPos(tg::pos3 p) {
+    return {std::llround(double(p.x) * 100), std::llround(double(p.z) * 100)};
+}
+
+std::vector<Portal> NavMesh::findPortals(const std::vector<std::pair<ECS::entity, const Instance *>> &instances, float maxStep, uint32_t maxEdges) {
+    // border edges by their ends, in either direction
+    std::vector<BorderEdge> border;
+    std::map<std::pair<GridPos, GridPos>, std::vector<uint32_t>> byEnds;
+    for (uint32_t i = 0; i < instances.size(); ++i) {
+        auto &graph = instances[i].second->graph;
+        if (!graph) {continue;}
+        auto &g = *graph;
+        for (uint32_t h = 0; h < g.halfedgeFace.size(); ++h) {
+            auto inner = Graph::opposite(h);
+            if (g.halfedgeFace[h] != Graph::NONE || g.halfedgeFace[inner] == Graph::NONE) {continue;}
+            BorderEdge edge = {i, inner, g.halfedgeTo[h], g.halfedgeTo[inner], g.vertex(g.halfedgeTo[h]), g.vertex(g.halfedgeTo[inner])};
+            auto ends = std::minmax(gridPos(edge.a), gridPos(edge.b));
+            byEnds[{ends.first, ends.second}].push_back(uint32_t(border.size()));
+            border.push_back(edge);
+        }
+    }
+
+    // matching edges of two instances; the edge of the first one decides the geometry
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<std::pair<uint32_t, uint32_t>>> matches;
+    for (auto &[ends, edges] : byEnds) {
+        for (size_t i = 0; i < edges.size(); ++i) {
+            for (size_t j = i + 1; j < edges.size(); ++j) {
+                auto *p = &border[edges[i]], *q = &border[edges[j]];
+                if (p->nav == q->nav) {continue;}
+                if (p->nav > q->nav) {std::swap(p, q);}
+                // on a shared border, the two halfedges run in opposite directions
+                auto qa = gridPos(p->a) == gridPos(q->b) ? q->b : q->a, qb = gridPos(p->a) == gridPos(q->b) ? q->a : q->b;
+                if (std::abs(p->a.y - qa.y) > maxStep || std::abs(p->b.y - qb.y) > maxStep) {continue;}
+                matches[{p->nav, q->nav}].emplace_back(uint32_t(p - border.data()), uint32_t(q - border.data()));
+            }
+        }
+    }
+
+    // chain the matches along the border of the first instance and cut the chains into portals
+    std::vector<Portal> res;
+    for (auto &[navs, pairs] : matches) {
+        std::map<uint32_t, std::vector<uint32_t>> byVertex;
+        for (uint32_t i = 0; i < pairs.size(); ++i) {
+            auto &edge = border[pairs[i].first];
+            byVertex[edge.from].push_back(i);
+            byVertex[edge.to].push_back(i);
+        }
+        auto next = [&] (uint32_t i, uint32_t v) {
+            for (auto j : byVertex[v]) {
+                if (j != i) {return j;}
+            }
+            return NONE;
+        };
+        auto across = [&] (uint32_t i, uint32_t v) {
+            auto &edge = border[pairs[i].first];
+            return edge.from == v ? edge.to : edge.from;
+        };
+        std::vector<bool> done(pairs.size(), false);
+        std::vector<uint32_t> chain;
+        for (uint32_t first = 0; first < pairs.size(); ++first) {
+            if (done[first]) {continue;}
+            // back to one end of the chain (or once around, if it is closed)
+            auto cur = first;
+            auto v = border[pairs[first].first].from;
+            for (size_t steps = 0; steps < pairs.size(); ++steps) {
+                auto prev = next(cur, v);
+                if (prev == NONE || prev == first || done[prev]) {break;}
+                v = across(prev, v);
+                cur = prev;
+            }
+            // and forward to the other end
+            chain.clear();
+            v = across(cur, v);
+            while (cur != NONE && !done[cur]) {
+                done[cur] = true;
+                chain.push_back(cur);
+                cur = next(cur, v);
+                if (cur != NONE) {v = across(cur, v);}
+            }
+            for (size_t start = 0; start < chain.size(); start += maxEdges) {
+                auto count = std::min<size_t>(maxEdges, chain.size() - start);
+                auto [p, q] = pairs[chain[start + count / 2]];
+                auto &edge = border[p];
+                res.push_back({
+                    {instances[navs.first].first, instances[navs.second].first},
+                    {edge.halfedge, border[q].halfedge},
+                    tg::lerp(edge.a, edge.b, .5f),
+                    uint32_t(count)
+                });
+            }
+        }
+    }
+    return res;
+}
+
+void System::updateIndex() {
+    if (mIndexedVersion == mECS.navMeshVersion) {return;}
+    mIndex.clear();
+    std::vector<std::pair<ECS::entity, const Instance *>> instances;
+    for (auto &[id, nav] : mECS.navMeshes) {
+        if (nav.mesh->vertices().empty()) {continue;}
+        constexpr auto inf = std::numeric_limits<float>::infinity();
+        tg::aabb3 aabb = {{inf, inf, inf}, {-inf, -inf, -inf}};
+        for (auto v : nav.mesh->vertices()) {
+            aabb.min = tg::min(aabb.min, nav.worldPos[v]);
+            aabb.max = tg::max(aabb.max, nav.worldPos[v]);
+        }
+        decltype(mIndex)::RStarInserter::insert(mIndex, {aabb, id});
+        instances.emplace_back(id, &nav);
+    }
+    mPortals = findPortals(instances);
+    mInstancePortals.clear();
+    for (uint32_t i = 0; i < mPortals.size(); ++i) {
+        for (auto id : mPortals[i].nav) {mInstancePortals[id].push_back(i);}
+    }
+    mIndexedVersion = mECS.navMeshVersion;
+}
+
+std::vector<Leg> System::navigate(const Place &from, const Place &to, Obstacle::Collider &collider, SearchMode mode) {
+    updateIndex();
+    constexpr float INF = std::numeric_limits<float>::infinity();
+    constexpr uint32_t nsteps = 5;
+    // node `2p + s` is having crossed portal `p` onto its side `s`
+    auto nPortals = uint32_t(mPortals.size());
+    const uint32_t START = 2 * nPortals, GOAL = START + 1;
+    auto place = [&] (uint32_t node, bool leaving) -> Place {
+        if (node == START) {return from;}
+        if (node == GOAL) {return to;}
+        auto &portal = mPortals[node / 2];
+        auto side = leaving ? 1 - node % 2 : node % 2;  // we leave on the other side
+        auto &g = *mECS.navMeshes.at(portal.nav[side]).graph;
+        auto h = portal.halfedge[side];
+        return {portal.nav[side], pm::face_index(int(g.halfedgeFace[h])), g.edgeMid[Graph::edgeOf(h)]};
+    };
+
+    std::set<std::pair<uint32_t, uint32_t>> failed;
+    std::vector<float> cost;
+    std::vector<uint32_t> pred;
+    IndexedHeap<float> heap;
+    heap.reserve(GOAL + 1);
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        // A* over the portals, with straight lines between them
+        cost.assign(GOAL + 1, INF);
+        pred.assign(GOAL + 1, Graph::NONE);
+        heap.clear();
+        cost[START] = 0.f;
+        heap.push(START, tg::distance(from.pos, to.pos));
+        while (!heap.empty()) {
+            auto node = heap.pop().second;
+            if (node == GOAL) {break;}
+            auto here = place(node, false);
+            auto &nav = mECS.navMeshes.at(here.nav);
+            auto relax = [&] (uint32_t next, tg::pos3 pos) {
+                if (failed.count({node, next})) {return;}
+                auto c = cost[node] + tg::distance(here.pos, pos);
+                if (c < cost[next]) {
+                    cost[next] = c;
+                    pred[next] = node;
+                    heap.push(next, c + tg::distance(pos, to.pos));
+                }
+            };
+            if (here.nav == to.nav && nav.reachable(here.face, to.face)) {relax(GOAL, to.pos);}
+            auto iter = mInstancePortals.find(here.nav);
+            if (iter == mInstancePortals.end()) {continue;}
+            for (auto p : iter->second) {
+                if (node != START && p == node / 2) {continue;}
+                auto next = 2 * p + 1 - uint32_t(mPortals[p].side(here.nav));
+                auto exit = place(next, true);
+                if (nav.reachable(here.face, exit.face)) {relax(next, exit.pos);}
+            }
+        }
+        if (cost[GOAL] == INF) {return {};}
+
+        std::vector<uint32_t> chain = {GOAL};
+        while (chain.back() != START) {chain.push_back(pred[chain.back()]);}
+        std::reverse(chain.begin(), chain.end());
+        std::vector<Leg> res;
+        bool found = true;
+        for (size_t i = 0; i + 1 < chain.size(); ++i) {
+            auto a = place(chain[i], false), b = place(chain[i + 1], true);
+            Leg leg = {a.nav, {a.pos, b.pos, a.face, b.face}, {}};
+            if (a.face != b.face) {
+                leg.route = mECS.navMeshes.at(a.nav).navigate(leg.req, nsteps, collider, mode);
+                if (leg.route.empty()) {
+                    failed.insert({chain[i], chain[i + 1]});
+                    found = false;
+                    break;
+                }
+            }
+            res.push_back(std::move(leg));
+        }
+        if (found) {return res;}
+    }
+    return {};
+}
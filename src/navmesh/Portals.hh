@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <ECS.hh>
+
+namespace NavMesh {
+
+struct Instance;
+
+/// where two navmesh instances meet: a run of border edges of one that lie
+/// on border edges of the other. Long runs are split up, so that the
+/// portal positions are good enough for the search across instances
+struct Portal {
+    ECS::entity nav[2];
+    /// representative edge, as the halfedge inside the face of each instance
+    uint32_t halfedge[2];
+    tg::pos3 pos;  ///< midpoint of the representative edge
+    uint32_t edges;  ///< in the run
+
+    /// side of the portal on `nav`
+    int side(ECS::entity id) const {return nav[0] == id ? 0 : 1;}
+};
+
+/// border edges match if their ends are the same in the ground plane and
+/// at most `maxStep` apart in height. Runs are split into portals of at
+/// most `maxEdges` edges
+std::vector<Portal> findPortals(const std::vector<std::pair<ECS::entity, const Instance *>> &, float maxStep = 1.f, uint32_t maxEdges = 8);
+
+}
@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: MIT
+#include "Replanner.hh"
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+#include <typed-geometry/tg.hh>
+
+#include "Corridor.hh"
+
+using namespace NavMesh;
+
+namespace {
+constexpr float INF = std::numeric_limits<float>::infinity();
+}
+
+/// index of halfedge `h` in the face
+static int indexIn(const Graph::FaceLinks &links, uint32_t h) {
+    int i = 0;
+    while (links.halfedge[i] != h) {i += 1;}
+    return i;
+}
+
+Replanner::Replanner(std::shared_ptr<const Graph> graph, const Hierarchy &hier, const RouteRequest &req, Obstacle::Collider &collider)
+    : mGraph{std::move(graph)}, mReq{req}, mStartFace{uint32_t(req.start_face.value)}, mGoalFace{uint32_t(req.end_face.value)},
+    mRadius{collider.radius()} {
+    assert(hier.fits(collider));
+    restart(hier, collider);
+}
+
+void Replanner::restart(const Hierarchy &hier, Obstacle::Collider &collider) {
+    auto n = startNode() + 1;
+    mG.assign(n, INF);
+    mRhs.assign(n, INF);
+    mQueue.reserve(n);
+    mQueue.clear();
+    mKm = 0.f;
+    mVersion = hier.version;
+    mGraphVersion = mGraph->version;
+    mStartMoved = false;
+    endCosts(mStartFace, mReq.start, true, collider, mStartCost);
+    endCosts(mGoalFace, mReq.end, false, collider, mGoalCost);
+    mRhs[goalNode()] = 0.f;
+    mQueue.push(goalNode(), key(goalNode()));
+    expanded = 0;
+    computeShortestPath(hier);
+}
+
+void Replanner::endCosts(uint32_t face, tg::pos3 pos, bool leaving, Obstacle::Collider &collider, float *out) const {
+    auto &g = *mGraph;
+    auto &links = g.faces[face];
+    collider.collectObjects(g.faceAABB(face));
+    for (int i = 0; i < 3; ++i) {
+        auto e = Graph::edgeOf(links.halfedge[i]);
+        out[i] = INF;
+        if (links.neighbor[i] == Graph::NONE || g.edgeLength[e] <= 2 * mRadius) {continue;}
+        auto seg = leaving ? tg::segment3(pos, g.edgeMid[e]) : tg::segment3(g.edgeMid[e], pos);
+        if (!collider.segmentObstructed(seg)) {out[i] = tg::distance(pos, g.edgeMid[e]);}
+    }
+}
+
+tg::pos3 Replanner::point(uint32_t node) const {
+    if (node == goalNode()) {return mReq.end;}
+    if (node == startNode()) {return mReq.start;}
+    return mGraph->edgeMid[Graph::edgeOf(node)];
+}
+
+Replanner::Key Replanner::key(uint32_t node) const {
+    auto best = std::min(mG[node], mRhs[node]);
+    return {best + tg::distance(mReq.start, point(node)) + mKm, best};
+}
+
+template<typename F>
+void Replanner::forSuccessors(const Hierarchy &hier, uint32_t node, F &&fn) const {
+    auto &g = *mGraph;
+    if (node == goalNode()) {return;}
+    if (node == startNode()) {
+        if (mStartFace == mGoalFace) {fn(goalNode(), tg::distance(mReq.start, mReq.end));}
+        auto &links = g.faces[mStartFace];
+        for (int i = 0; i < 3; ++i) {fn(links.halfedge[i], mStartCost[i]);}
+        return;
+    }
+    auto face = g.halfedgeFace[Graph::opposite(node)];  // the one entered
+    if (face == Graph::NONE) {return;}
+    auto &links = g.faces[face];
+    auto in = indexIn(links, Graph::opposite(node));
+    if (face == mGoalFace) {fn(goalNode(), mGoalCost[in]);}
+    auto from = g.edgeMid[Graph::edgeOf(node)];
+    for (int j = 0; j < 3; ++j) {
+        if (j == in || links.neighbor[j] == Graph::NONE) {continue;}
+        auto e = Graph::edgeOf(links.halfedge[j]);
+        auto blocked = g.edgeLength[e] <= 2 * mRadius || hier.blocked(face, in, j);
+        fn(links.halfedge[j], blocked ? INF : tg::distance(from, g.edgeMid[e]));
+    }
+}
+
+template<typename F>
+void Replanner::forPredecessors(uint32_t node, F &&fn) const {
+    auto &g = *mGraph;
+    if (node == startNode()) {return;}
+    // the halfedges into the face the node leaves
+    auto face = node == goalNode() ? mGoalFace : g.halfedgeFace[node];
+    if (face == Graph::NONE) {return;}
+    for (auto h : g.faces[face].halfedge) {
+        if (h != node && g.halfedgeFace[Graph::opposite(h)] != Graph::NONE) {fn(Graph::opposite(h));}
+    }
+    if (face == mStartFace) {fn(startNode());}
+}
+
+void Replanner::updateNode(const Hierarchy &hier, uint32_t node) {
+    if (node != goalNode()) {
+        auto best = INF;
+        forSuccessors(hier, node, [&] (uint32_t next, float cost) {best = std::min(best, cost + mG[next]);});
+        mRhs[node] = best;
+    }
+    if (mG[node] != mRhs[node]) {
+        mQueue.push(node, key(node));
+    } else {
+        mQueue.remove(node);
+    }
+}
+
+void Replanner::computeShortestPath(const Hierarchy &hier) {
+    auto start = startNode();
+    while (!mQueue.empty() && (mQueue.top().first < key(start) || mRhs[start] != mG[start])) {
+        auto [oldKey, node] = mQueue.top();
+        auto newKey = key(node);
+        if (oldKey < newKey) {  // queued before the start moved
+            mQueue.push(node, newKey);
+            continue;
+        }
+        mQueue.pop();
+        expanded += 1;
+        if (mG[node] > mRhs[node]) {
+            mG[node] = mRhs[node];
+        } else {
+            mG[node] = INF;
+            updateNode(hier, node);
+        }
+        forPredecessors(node, [&] (uint32_t prev) {updateNode(hier, prev);});
+    }
+}
+
+void Replanner::moveStart(pm::face_index face, tg::pos3 pos) {
+    // the keys are distances from the start, so they are off by at most this much now
+    mKm += tg::distance(mReq.start, pos);
+    mReq.start = pos;
+    mReq.start_face = face;
+    mStartFace = uint32_t(face.value);
+    mStartMoved = true;
+}
+
+void Replanner::update(std::shared_ptr<const Graph> graph, const Hierarchy &hier, Obstacle::Collider &collider) {
+    expanded = 0;
+    restarted = false;
+    bool changed = hier.version != mVersion || graph->version != mGraphVersion;
+    if (graph != mGraph) {
+        // a rebuilt navmesh has nothing in common with the search
+        if (graph->numEdges() != mGraph->numEdges() || graph->version < mGraphVersion) {
+            changed = true;
+            mGraphVersion = -1;  // past any log
+        }
+        mGraph = std::move(graph);
+    }
+    if (changed) {
+        mChanged.clear();
+        if (hier.version < mVersion || !hier.changedSince(mVersion, mChanged) || !mGraph->changedSince(mGraphVersion, mChanged)) {
+            restart(hier, collider);
+            restarted = true;
+            return;
+        }
+        mVersion = hier.version;
+        mGraphVersion = mGraph->version;
+        std::sort(mChanged.begin(), mChanged.end());
+        mChanged.erase(std::unique(mChanged.begin(), mChanged.end()), mChanged.end());
+        // the costs inside a face (blocked or longer) start at the halfedges into it
+        auto &g = *mGraph;
+        for (auto face : mChanged) {
+            for (auto h : g.faces[face].halfedge) {
+                if (g.halfedgeFace[Graph::opposite(h)] != Graph::NONE) {updateNode(hier, Graph::opposite(h));}
+            }
+        }
+    }
+    // the ways from the start and to the goal are checked live, so obstacles
+    // that don't change the baked ones can still change them
+    if (mStartMoved || changed) {
+        float startCost[3];
+        endCosts(mStartFace, mReq.start, true, collider, startCost);
+        if (mStartMoved || !std::equal(startCost, startCost + 3, mStartCost)) {
+            std::copy(startCost, startCost + 3, mStartCost);
+            updateNode(hier, startNode());
+        }
+        mStartMoved = false;
+    }
+    if (changed) {
+        float goalCost[3];
+        endCosts(mGoalFace, mReq.end, false, collider, goalCost);
+        if (!std::equal(goalCost, goalCost + 3, mGoalCost)) {
+            std::copy(goalCost, goalCost + 3, mGoalCost);
+            forPredecessors(goalNode(), [&] (uint32_t prev) {updateNode(hier, prev);});
+        }
+    }
+    computeShortestPath(hier);
+}
+
+Route Replanner::route(const Hierarchy &hier, Obstacle::Collider &collider) const {
+    std::vector<uint32_t> halfedges;
+    auto node = startNode();
+    while (node != goalNode()) {
+        if (halfedges.size() > mGraph->numFaces()) {return {};}  // going in circles
+        auto best = node;
+        auto bestCost = INF;
+        forSuccessors(hier, node, [&] (uint32_t next, float cost) {
+            if (cost + mG[next] < bestCost) {
+                bestCost = cost + mG[next];
+                best = next;
+            }
+        });
+        if (best == node) {return {};}
+        if (best != goalNode()) {halfedges.push_back(best);}
+        node = best;
+    }
+    return pullCorridor(*mGraph, halfedges, mReq.start, mReq.end, mRadius, collider);
+}
+
+size_t Replanner::memoryBytes() const {
+    return (mG.capacity() + mRhs.capacity()) * sizeof(float) + mQueue.memoryBytes() + mChanged.capacity() * sizeof(uint32_t);
+}
+
+Replanner Instance::replanner(const RouteRequest &req, Obstacle::Collider &collider) {
+    assert(graph);
+    updateHierarchy(collider);
+    return Replanner(graph, *hierarchy, req, collider);
+}
+
+Route Instance::replan(Replanner &planner, Obstacle::Collider &collider) {
+    updateHierarchy(collider);
+    planner.update(graph, *hierarchy, collider);
+    return planner.route(*hierarchy, collider);
+}
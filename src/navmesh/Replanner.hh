@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <obstacles/Collision.hh>
+#include <util/IndexedHeap.hh>
+#include "NavMesh.hh"
+
+namespace NavMesh {
+
+/// search state of one route that is kept while a unit follows it, so that
+/// obstacle changes only repair the part of the search they affect instead
+/// of starting over (D* Lite, Koenig & Likhachev). The search runs backwards
+/// from the goal over the halfedges: node `h` is the midpoint of its edge on
+/// the way from its face into the one across. Costs are measured along the
+/// midpoints with the obstacles baked into the `Hierarchy`, like the flow
+/// fields, and the faces whose obstacles changed come from its log
+class Replanner {
+public:
+    /// the hierarchy has to be up to date and fit the collider
+    Replanner(std::shared_ptr<const Graph>, const Hierarchy &, const RouteRequest &, Obstacle::Collider &);
+
+    /// the unit has moved on to `pos` in `face`; takes effect with the next `update`
+    void moveStart(pm::face_index face, tg::pos3 pos);
+    /// repairs the search for the obstacle and geometry changes since the
+    /// last call, taking over `graph` (a later snapshot of the same navmesh),
+    /// or starts over if the logs of the hierarchy or the graph don't reach
+    /// back that far. The hierarchy has to be up to date with the graph
+    void update(std::shared_ptr<const Graph> graph, const Hierarchy &, Obstacle::Collider &);
+    /// string-pulled route from the current start. Empty if the goal can't be
+    /// reached or the pulled path is obstructed, like a failed search
+    Route route(const Hierarchy &, Obstacle::Collider &) const;
+    const RouteRequest &request() const {return mReq;}
+    const std::shared_ptr<const Graph> &graph() const {return mGraph;}
+    /// length along the edge midpoints, infinite if the goal can't be reached
+    float cost() const {return mG[startNode()];}
+    size_t memoryBytes() const;
+
+    /// nodes expanded by the last `update` (or the constructor), for benchmarks
+    size_t expanded = 0;
+    bool restarted = false;  ///< if the last `update` had to start over
+
+private:
+    using Key = std::pair<float, float>;
+
+    std::shared_ptr<const Graph> mGraph;
+    RouteRequest mReq;
+    uint32_t mStartFace, mGoalFace;
+    float mRadius;
+    uint64_t mVersion;  ///< of the hierarchy the search is up to date with
+    uint64_t mGraphVersion;  ///< same for the graph
+    bool mStartMoved = false;
+    /// from the start to the edges of its face, and from those of the goal
+    /// face to the goal; infinite where obstructed or too narrow
+    float mStartCost[3], mGoalCost[3];
+    float mKm = 0.f;  ///< how far the start has moved, which all keys are off by
+    std::vector<float> mG, mRhs;
+    IndexedHeap<Key> mQueue;
+    std::vector<uint32_t> mChanged;
+
+    uint32_t goalNode() const {return uint32_t(2 * mGraph->numEdges());}
+    uint32_t startNode() const {return goalNode() + 1;}
+    tg::pos3 point(uint32_t node) const;
+    Key key(uint32_t node) const;
+
+    void restart(const Hierarchy &, Obstacle::Collider &);
+    /// costs between `pos` and the edges of `face`, going towards the edges if `leaving`
+    void endCosts(uint32_t face, tg::pos3 pos, bool leaving, Obstacle::Collider &, float *out) const;
+    template<typename F>
+    void forSuccessors(const Hierarchy &, uint32_t node, F &&fn) const;
+    template<typename F>
+    void forPredecessors(uint32_t node, F &&fn) const;
+    void updateNode(const Hierarchy &, uint32_t node);
+    void computeShortestPath(const Hierarchy &);
+};
+
+}
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <util/IndexedHeap.hh>
+
+namespace NavMesh {
+
+/// scratch memory for searches over dense node ids, reused between queries so
+/// that they don't allocate once the arrays have grown to size. Node data is
+/// only valid if the node was opened in the current generation, so starting a
+/// new search doesn't have to clear anything
+template<class Node>
+struct SearchContext {
+    uint32_t generation = 0;
+    std::vector<uint32_t> stamp;
+    std::vector<Node> nodes;
+    IndexedHeap<float> heap;
+    size_t opened = 0;
+
+    void begin(size_t nNodes) {
+        if (stamp.size() < nNodes) {
+            stamp.resize(nNodes, 0);
+            nodes.resize(nNodes);
+        }
+        heap.reserve(nNodes);
+        heap.clear();
+        opened = 0;
+        if (++generation == 0) {  // wrapped around: stamps from 2^32 searches ago would look current
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+    }
+    bool isOpen(uint32_t node) const {return stamp[node] == generation;}
+    Node &open(uint32_t node) {
+        stamp[node] = generation;
+        opened += 1;
+        return nodes[node];
+    }
+    Node &node(uint32_t id) {return nodes[id];}
+    const Node &node(uint32_t id) const {return nodes[id];}
+    void push(uint32_t node, float key) {heap.push(node, key);}
+    std::pair<float, uint32_t> pop() {return heap.pop();}
+    bool queueEmpty() const {return heap.empty();}
+    size_t memoryBytes() const {
+        return stamp.capacity() * sizeof(uint32_t) + nodes.capacity() * sizeof(Node) + heap.memoryBytes();
+    }
+
+    /// each thread has its own context per node type
+    static SearchContext &local() {
+        thread_local SearchContext ctx;
+        return ctx;
+    }
+};
+
+/// same interface as `SearchContext`, for searches that are kept around for a
+/// while and only touch a small part of the graph: memory grows with the nodes
+/// opened instead of the graph size. `open` may move the other nodes
+template<class Node>
+struct SparseSearchContext {
+    std::unordered_map<uint32_t, uint32_t> slots;  ///< node id → index into `nodes`
+    std::vector<Node> nodes;
+    std::vector<uint32_t> ids;  ///< node id of each slot
+    IndexedHeap<float> heap;  ///< over slots
+    size_t opened = 0;
+
+    void begin(size_t) {
+        slots.clear();
+        nodes.clear();
+        ids.clear();
+        heap.clear();
+        opened = 0;
+    }
+    bool isOpen(uint32_t node) const {return slots.count(node) != 0;}
+    Node &open(uint32_t node) {
+        auto [iter, inserted] = slots.emplace(node, uint32_t(nodes.size()));
+        if (inserted) {
+            nodes.emplace_back();
+            ids.push_back(node);
+            heap.reserve(nodes.size());
+        }
+        opened += 1;
+        return nodes[iter->second];
+    }
+    Node &node(uint32_t id) {return nodes[slots.at(id)];}
+    const Node &node(uint32_t id) const {return nodes[slots.at(id)];}
+    void push(uint32_t node, float key) {heap.push(slots.at(node), key);}
+    std::pair<float, uint32_t> pop() {
+        auto [key, slot] = heap.pop();
+        return {key, ids[slot]};
+    }
+    bool queueEmpty() const {return heap.empty();}
+    size_t memoryBytes() const {
+        // about what the hash map needs per entry: the node, its key and value, and a bucket
+        return slots.size() * (sizeof(void *) + 2 * sizeof(uint32_t)) + slots.bucket_count() * sizeof(void *)
+            + nodes.capacity() * sizeof(Node) + ids.capacity() * sizeof(uint32_t) + heap.memoryBytes();
+    }
+};
+
+}
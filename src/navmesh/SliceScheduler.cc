@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: MIT
+#include "SliceScheduler.hh"
+#include <algorithm>
+#include <vector>
+
+using namespace NavMesh;
+
+SliceScheduler::Id SliceScheduler::submit(std::shared_ptr<const Graph> graph, std::shared_ptr<const Landmarks> landmarks, std::shared_ptr<const Obstacle::ObstructionView> view,
+    const RouteRequest &req, tg::vec3 height, float radius, std::shared_ptr<const Hierarchy> baked
+) {
+    auto id = mNext++;
+    auto query = std::make_unique<Query>(std::move(view), height, radius);
+    query->graph = std::move(graph);
+    query->landmarks = std::move(landmarks);
+    query->baked = std::move(baked);
+    query->search.emplace(query->ctx, *query->graph, query->landmarks.get(), req, radius,
+        query->baked.get(), nullptr, query->baked.get());
+    mQueries.emplace(id, std::move(query));
+    return id;
+}
+
+size_t SliceScheduler::tick(size_t budget) {
+    size_t used = 0;
+    std::vector<std::pair<Id, Query *>> active;
+    while (used < budget) {
+        // round robin, starting after the last one served
+        active.clear();
+        for (auto iter = mQueries.upper_bound(mLastServed); iter != mQueries.end(); ++iter) {
+            if (iter->second->search->status() == CorridorStatus::Running) {active.emplace_back(iter->first, iter->second.get());}
+        }
+        for (auto iter = mQueries.begin(); iter != mQueries.end() && iter->first <= mLastServed; ++iter) {
+            if (iter->second->search->status() == CorridorStatus::Running) {active.emplace_back(iter->first, iter->second.get());}
+        }
+        if (active.empty()) {break;}
+        auto share = std::max<size_t>(1, (budget - used) / active.size());
+        for (auto [id, query] : active) {
+            if (used >= budget) {break;}
+            used += query->search->expand(query->collider, std::min(share, budget - used));
+            mLastServed = id;
+        }
+    }
+    return used;
+}
+
+std::optional<CorridorStatus> SliceScheduler::status(Id id) const {
+    auto iter = mQueries.find(id);
+    if (iter == mQueries.end()) {return std::nullopt;}
+    return iter->second->search->status();
+}
+
+std::optional<PartialRoute> SliceScheduler::route(Id id) {
+    auto iter = mQueries.find(id);
+    if (iter == mQueries.end()) {return std::nullopt;}
+    auto &query = *iter->second;
+    return query.search->partial(query.collider);
+}
+
+std::optional<SearchStats> SliceScheduler::stats(Id id) const {
+    auto iter = mQueries.find(id);
+    if (iter == mQueries.end()) {return std::nullopt;}
+    return iter->second->search->stats();
+}
+
+void SliceScheduler::remove(Id id) {
+    mQueries.erase(id);
+}
+
+size_t SliceScheduler::running() const {
+    return std::count_if(mQueries.begin(), mQueries.end(), [] (auto &pair) {
+        return pair.second->search->status() == CorridorStatus::Running;
+    });
+}
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+
+#include <obstacles/Collision.hh>
+#include "Corridor.hh"
+
+namespace NavMesh {
+
+/// runs many corridor searches (`Searcher::corridor`, not the hierarchical
+/// search) a few expansions at a time on the calling thread, so that a single
+/// long query can't take more than its share of a tick. Every `tick` splits
+/// its expansion budget evenly over the running searches; what searches
+/// leave over by finishing goes to the others in the same tick. Where the
+/// budget doesn't go around, the searches that went short come first next tick.
+/// Each search keeps only the faces it opened. The `Planner` runs its
+/// `sliced` requests through one
+class SliceScheduler {
+public:
+    using Id = uint32_t;
+
+    /// the search keeps its own copy of what it needs. With `baked`, the
+    /// obstacles baked into its faces are used where they are up to date,
+    /// like `Instance::navigateCorridor` does
+    Id submit(std::shared_ptr<const Graph>, std::shared_ptr<const Landmarks>, std::shared_ptr<const Obstacle::ObstructionView>,
+        const RouteRequest &, tg::vec3 height, float radius, std::shared_ptr<const Hierarchy> baked = nullptr);
+    /// spends up to `budget` expansions in total and returns how many it used
+    size_t tick(size_t budget);
+    /// nullopt for unknown ids
+    std::optional<CorridorStatus> status(Id) const;
+    /// the final route once the search is done, the best so far before
+    std::optional<PartialRoute> route(Id);
+    std::optional<SearchStats> stats(Id) const;
+    void remove(Id);
+    size_t running() const;
+
+private:
+    struct Query {
+        std::shared_ptr<const Graph> graph;
+        std::shared_ptr<const Landmarks> landmarks;
+        std::shared_ptr<const Hierarchy> baked;
+        Obstacle::Collider collider;
+        SparseSearchContext<FaceNode> ctx;
+        std::optional<SparseCorridorSearch> search;
+
+        Query(std::shared_ptr<const Obstacle::ObstructionView> view, tg::vec3 height, float radius) : collider(std::move(view), height, radius) {}
+    };
+    std::map<Id, std::unique_ptr<Query>> mQueries;
+    Id mNext = 1;
+    Id mLastServed = 0;  ///< the next tick starts after this one
+};
+
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: MIT
+#include "Squad.hh"
+#include <algorithm>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+
+#include <typed-geometry/tg.hh>
+
+#include "Corridor.hh"
+
+using namespace NavMesh;
+
+static float area2(tg::pos3 a, tg::pos3 b, tg::pos3 c) {
+    return (b.x - a.x) * (c.z - a.z) - (b.z - a.z) * (c.x - a.x);
+}
+
+/// walks in a straight line over the faces in the ground plane, from `from`
+/// in `face` towards `to`, and writes the halfedges it crosses (in the face
+/// being left) to `out`. Returns the face where `to` is, or the first one for
+/// which `stop` is true; NONE if the way leaves the mesh or passes an edge
+/// too narrow for `radius`
+template<typename F>
+static uint32_t walk(const Graph &g, uint32_t face, tg::pos3 from, tg::pos3 to, float radius, std::vector<uint32_t> &out, F &&stop) {
+    auto entry = Graph::NONE;
+    for (size_t steps = 0; steps < g.numFaces(); ++steps) {
+        if (stop(face)) {return face;}
+        auto &links = g.faces[face];
+        int exit = -1;
+        float exitParam = -std::numeric_limits<float>::infinity();
+        for (int i = 0; i < 3; ++i) {
+            auto h = links.halfedge[i];
+            if (h == entry) {continue;}
+            auto a = g.vertex(g.halfedgeTo[Graph::opposite(h)]), b = g.vertex(g.halfedgeTo[h]);
+            auto sa = area2(from, to, a), sb = area2(from, to, b);
+            if ((sa > 0.f && sb > 0.f) || (sa < 0.f && sb < 0.f)) {continue;}  // the line misses the edge
+            auto da = area2(a, b, from), db = area2(a, b, to);
+            if (da == db) {continue;}  // parallel
+            // the line leaves through the edge it crosses furthest ahead
+            auto param = da / (da - db);
+            if (param > exitParam) {
+                exitParam = param;
+                exit = i;
+            }
+        }
+        if (exit < 0 || exitParam >= 1.f) {return face;}
+        auto h = links.halfedge[exit];
+        if (links.neighbor[exit] == Graph::NONE || g.edgeLength[Graph::edgeOf(h)] <= 2 * radius) {return Graph::NONE;}
+        out.push_back(h);
+        entry = Graph::opposite(h);
+        face = links.neighbor[exit];
+    }
+    return Graph::NONE;
+}
+
+SquadRequest Instance::placeSquad(const std::vector<std::pair<pm::face_index, tg::pos3>> &starts, pm::face_index goalFace, tg::pos3 goal) const {
+    SquadRequest res;
+    res.goalFace = goalFace;
+    res.goal = goal;
+    res.reqs.resize(starts.size());
+    if (!graph || starts.empty()) {return res;}
+
+    // the units' places around the goal, keeping the formation where there is room
+    auto centroid = tg::pos3::zero;
+    for (auto &[face, pos] : starts) {centroid += tg::vec3(pos) / float(starts.size());}
+    for (size_t i = 0; i < starts.size(); ++i) {
+        auto &req = res.reqs[i];
+        std::tie(req.start_face, req.start) = starts[i];
+        req.end_face = goalFace;
+        req.end = goal;
+        auto target = goal + (req.start - centroid);
+        auto face = faceAt(target);
+        if (!face || !reachable(req.start_face, *face)) {continue;}
+        auto height = heightAt(mesh->handle_of(*face), target);
+        if (!height) {continue;}
+        req.end_face = *face;
+        req.end = {target.x, *height, target.z};
+    }
+
+    // the shared corridor, from the centroid if it is on the navmesh, otherwise from the unit closest to it
+    auto centroidFace = faceAt(centroid);
+    auto centroidHeight = centroidFace ? heightAt(mesh->handle_of(*centroidFace), centroid) : std::nullopt;
+    if (centroidHeight) {res.shared.push_back({{centroid.x, *centroidHeight, centroid.z}, goal, *centroidFace, goalFace});}
+    auto closest = std::min_element(starts.begin(), starts.end(), [&] (auto &a, auto &b) {
+        return tg::distance_sqr(a.second, centroid) < tg::distance_sqr(b.second, centroid);
+    });
+    res.shared.push_back({closest->second, goal, closest->first, goalFace});
+    return res;
+}
+
+SquadRoutes Instance::planSquad(const std::vector<std::pair<pm::face_index, tg::pos3>> &starts, pm::face_index goalFace, tg::pos3 goal,
+    uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode) {
+    auto squad = placeSquad(starts, goalFace, goal);
+    if (!graph) {
+        SquadRoutes res;
+        res.reqs = squad.reqs;
+        res.routes.resize(squad.reqs.size());
+        return res;
+    }
+    if (mode == SearchMode::Hierarchical || (mode == SearchMode::Corridor && bakedObstacles && (!hierarchy || hierarchy->fits(collider)))) {
+        updateHierarchy(collider);
+    }
+    return searcher().squad(squad, nsteps, collider, mode);
+}
+
+SquadRoutes Searcher::squad(const SquadRequest &squad, uint32_t nsteps, Obstacle::Collider &collider, SearchMode mode) {
+    SquadRoutes res;
+    res.reqs = squad.reqs;
+    res.routes.resize(squad.reqs.size());
+    if (squad.reqs.empty()) {return res;}
+    auto &g = graph;
+    auto radius = collider.radius();
+    auto goalFace = squad.goalFace;
+    auto goal = squad.goal;
+
+    Route shared;
+    RouteRequest sharedReq = {};
+    for (auto &candidate : squad.shared) {
+        sharedReq = candidate;
+        if (sharedReq.start_face == goalFace) {break;}
+        shared = navigate(sharedReq, nsteps, collider, mode);
+        if (!shared.empty()) {break;}
+    }
+    res.sharedCorridor = !squad.shared.empty() && (!shared.empty() || sharedReq.start_face == goalFace);
+
+    // position of each face in the corridor
+    std::vector<uint32_t> corridor;
+    std::unordered_map<uint32_t, size_t> corridorIndex;
+    if (res.sharedCorridor) {
+        corridorIndex.emplace(uint32_t(sharedReq.start_face.value), 0);
+        for (auto &[h, param] : shared) {
+            corridor.push_back(uint32_t(h.value));
+            corridorIndex.emplace(g.halfedgeFace[Graph::opposite(uint32_t(h.value))], corridor.size());
+        }
+    }
+    auto inCorridor = [&] (uint32_t face) {return corridorIndex.count(face) > 0;};
+
+    std::vector<uint32_t> head, tail, halfedges, faces;
+    for (size_t i = 0; i < res.reqs.size(); ++i) {
+        auto &req = res.reqs[i];
+        auto &route = res.routes[i];
+        if (req.start_face == req.end_face) {
+            res.derived += 1;
+            continue;
+        }
+        if (res.sharedCorridor) {
+            // into the corridor towards its start, and out of it from the unit's goal backwards
+            head.clear();
+            tail.clear();
+            auto join = walk(g, uint32_t(req.start_face.value), req.start, sharedReq.start, radius, head, inCorridor);
+            auto leave = walk(g, uint32_t(req.end_face.value), req.end, sharedReq.end, radius, tail, inCorridor);
+            if (join != Graph::NONE && leave != Graph::NONE && inCorridor(join) && inCorridor(leave)
+                && corridorIndex[join] <= corridorIndex[leave]) {
+                halfedges = head;
+                halfedges.insert(halfedges.end(), corridor.begin() + corridorIndex[join], corridor.begin() + corridorIndex[leave]);
+                for (auto iter = tail.rbegin(); iter != tail.rend(); ++iter) {halfedges.push_back(Graph::opposite(*iter));}
+                // the walks may meet outside the corridor; a corridor can't pass a face twice
+                faces.clear();
+                for (auto h : halfedges) {faces.push_back(g.halfedgeFace[h]);}
+                faces.push_back(uint32_t(req.end_face.value));
+                std::sort(faces.begin(), faces.end());
+                if (std::adjacent_find(faces.begin(), faces.end()) == faces.end()) {
+                    route = pullCorridor(g, halfedges, req.start, req.end, radius, collider);
+                }
+            }
+            if (!route.empty()) {
+                res.derived += 1;
+                continue;
+            }
+        }
+        res.searched += 1;
+        route = navigate(req, nsteps, collider, mode);
+        if (route.empty() && req.end_face != goalFace) {
+            // no way to the unit's place in the formation, so at least get to the goal
+            req.end_face = goalFace;
+            req.end = goal;
+            if (req.start_face != goalFace) {route = navigate(req, nsteps, collider, mode);}
+        }
+    }
+    return res;
+}
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <vector>
+
+#include "NavMesh.hh"
+
+namespace NavMesh {
+
+/// what `Instance::placeSquad` works out on the main thread for a squad's
+/// searches, which can then run on another thread (`Searcher::squad`)
+struct SquadRequest {
+    /// per unit: from its start to its place in the formation at the goal,
+    /// or to the goal itself where there is no room for it
+    std::vector<RouteRequest> reqs;
+    /// where the shared corridor may start, in order of preference: the
+    /// centroid (if it is on the navmesh), then the unit closest to it
+    std::vector<RouteRequest> shared;
+    pm::face_index goalFace;
+    tg::pos3 goal;
+};
+
+/// routes for a group of units going to the same place (see `Instance::planSquad`).
+/// One corridor is searched for the group's centroid, and each unit joins it
+/// with a straight walk over the faces from its start and leaves it towards its
+/// place in the formation at the goal. That only takes string-pulling and the
+/// collision checks of the pulled path, so only the units for which it fails
+/// (a wall or obstacle between them and the corridor) need a search of their own
+struct SquadRoutes {
+    /// per unit, in the order of the starts. The goals keep the units'
+    /// offsets from the centroid where there is room for them
+    std::vector<RouteRequest> reqs;
+    /// empty where nothing was found, like a failed search (or if the unit
+    /// is already in its goal face)
+    std::vector<Route> routes;
+    bool sharedCorridor = false;  ///< if the corridor search found one
+    size_t derived = 0;  ///< units whose route came from the shared corridor
+    size_t searched = 0;  ///< units that needed a search of their own
+};
+
+}
@@ -14,11 +14,20 @@ void Collider::collectObjects(const tg::aabb3 &aabb_) {
     );
     aabb.min -= mRadius;
     aabb.max += mRadius;
-    mECS.obstructions.visit([aabb] (const tg::aabb3 &a, int) {
+    if (mView) {
+        mView->tree.visit([aabb] (const tg::aabb3 &a, int) {
+            return tg::intersects(a, aabb);
+        }, [&] (const ObstructionView::Object &a) {
+            if (tg::intersects(a.aabb, aabb)) {mObjects.emplace_back(a.rigid, *a.mesh);}
+            return true;
+        });
+        return;
+    }
+    mECS->obstructions.visit([aabb] (const tg::aabb3 &a, int) {
         return tg::intersects(a, aabb);
     }, [&] (const Obstruction &a) {
         if (!tg::intersects(a.aabb, aabb)) {return true;}
-        auto join = ECS::Join(mECS.obstacles, mECS.instancedRigids);
+        auto join = ECS::Join(mECS->obstacles, mECS->instancedRigids);
         auto iter = join.find(a.id);
         if (iter == join.end()) {return true;}
         auto [obstacleType, rigid, id] = *iter;
@@ -122,7 +131,24 @@ bool CollisionMesh::collides(CollisionQuery &query) const {
     return foundCollision;
 }
 
-Collider::Collider(ECS::ECS &ecs, tg::vec3 height, float radius) : mECS{ecs}, mHeight{height}, mRadius{radius} {
+std::shared_ptr<const ObstructionView> ObstructionView::capture(ECS::ECS &ecs) {
+    auto res = std::make_shared<ObstructionView>();
+    for (auto &&tup : ECS::Join(ecs.obstacles, ecs.instancedRigids)) {
+        auto &[type, rigid, id] = tup;
+        decltype(res->tree)::RStarInserter::insert(res->tree, {type.worldBounds(rigid), rigid, type.collisionMesh.get()});
+    }
+    return res;
+}
+
+Collider::Collider(ECS::ECS &ecs, tg::vec3 height, float radius) : mECS{&ecs}, mHeight{height}, mRadius{radius} {
+    buildQueryMesh();
+}
+
+Collider::Collider(std::shared_ptr<const ObstructionView> view, tg::vec3 height, float radius) : mView{std::move(view)}, mHeight{height}, mRadius{radius} {
+    buildQueryMesh();
+}
+
+void Collider::buildQueryMesh() {
     for (auto i : Util::IntRange(0, 8)) {query.mesh.vertices().add();}
     static constexpr std::initializer_list<std::array<int, 4>> arr {
         {0, 2, 3, 1},  // front
@@ -1,8 +1,11 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <memory>
+
 #include <polymesh/Mesh.hh>
 
 #include <ECS.hh>
+#include <ECS/Misc.hh>
 
 namespace Obstacle {
 
@@ -43,19 +46,40 @@ struct Obstruction {
     tg::aabb3 getAABB() const {return aabb;}
 };
 
+/// copy of the obstructions that doesn't refer back to the ECS, so colliders
+/// can be used on other threads. The collision meshes belong to the obstacle
+/// types, which live as long as the `Obstacle::System`
+struct ObstructionView {
+    struct Object {
+        tg::aabb3 aabb;
+        ECS::Rigid rigid;
+        const CollisionMesh *mesh;
+
+        tg::aabb3 getAABB() const {return aabb;}
+    };
+    ECS::RTree<Object> tree;
+
+    static std::shared_ptr<const ObstructionView> capture(ECS::ECS &);
+};
+
 class Collider {
-    ECS::ECS &mECS;
+    ECS::ECS *mECS = nullptr;
+    std::shared_ptr<const ObstructionView> mView;  ///< used instead of the ECS if set
     tg::vec3 mHeight;
     float mRadius;
 
     std::vector<std::pair<ECS::Rigid, const CollisionMesh &>> mObjects;
 
+    void buildQueryMesh();
 
 public:
     CollisionQuery query;
 
     Collider(ECS::ECS &ecs, tg::vec3 height = {0, 1.5f, 0}, float radius = 1.f);
+    Collider(std::shared_ptr<const ObstructionView> view, tg::vec3 height = {0, 1.5f, 0}, float radius = 1.f);
 
+    float radius() const {return mRadius;}
+    tg::vec3 height() const {return mHeight;}
     void collectObjects(const tg::aabb3 &);
     bool segmentObstructed(const tg::segment3 &);
 };
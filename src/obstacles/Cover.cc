@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: MIT
+#include "Cover.hh"
+#include <cmath>
+#include <set>
+
+#include <typed-geometry/tg.hh>
+
+#include <ECS/Join.hh>
+#include <navmesh/NavMesh.hh>
+#include <rtree/RStar.hh>
+#include "Obstacle.hh"
+
+using namespace Obstacle;
+
+int CoverPoint::sector(tg::vec3 dir) {
+    // sector `i` is centered on the direction at `i` × 360° / SECTORS
+    auto turns = std::atan2(dir.z, dir.x) / (2 * tg::pi_scalar<float>);
+    auto s = int(std::floor(turns * SECTORS + .5f));
+    return (s % SECTORS + SECTORS) % SECTORS;
+}
+
+static tg::vec3 sectorDir(int s) {
+    auto angle = 2 * tg::pi_scalar<float> * float(s) / CoverPoint::SECTORS;
+    return {std::cos(angle), 0, std::sin(angle)};
+}
+
+/// height of the navmesh face straight above or below `pos`, the closest in height over all navmeshes
+static std::optional<float> groundAt(ECS::ECS &ecs, tg::pos3 pos) {
+    std::optional<float> res;
+    for (auto &[id, nav] : ecs.navMeshes) {
+        auto face = nav.faceAt(pos);
+        if (!face) {continue;}
+        auto height = nav.heightAt(nav.mesh->handle_of(*face), pos);
+        if (height && (!res || std::abs(*height - pos.y) < std::abs(*res - pos.y))) {res = height;}
+    }
+    return res;
+}
+
+/// sectors out of `sectors` in which a shot at `height` above `pos` hits an obstacle within reach
+static uint8_t blockedSectors(ECS::ECS &ecs, const CoverParams &params, tg::pos3 pos, float height, uint8_t sectors) {
+    uint8_t res = 0;
+    for (int s = 0; s < CoverPoint::SECTORS; ++s) {
+        if (!(sectors & (1 << s))) {continue;}
+        tg::ray3 ray = {pos + tg::vec3(0, height, 0), tg::dir3(sectorDir(s))};
+        if (rayCast(ecs, ray, params.reach)) {res |= uint8_t(1 << s);}
+    }
+    return res;
+}
+
+/// puts the point on the ground and finds the directions it protects from;
+/// false if it isn't cover (any more)
+static bool survey(ECS::ECS &ecs, const CoverParams &params, CoverPoint &point) {
+    auto ground = groundAt(ecs, point.pos);
+    if (!ground) {return false;}
+    point.pos.y = *ground;
+    // not inside (or under) another obstacle
+    auto nearest = closest(ecs, point.pos + tg::vec3(0, params.crouchingHeight, 0));
+    if (nearest && nearest->second < .5f * params.clearance) {return false;}
+    point.crouching = blockedSectors(ecs, params, point.pos, params.crouchingHeight, 0xff);
+    // only counted as high cover where it is low cover as well
+    point.standing = blockedSectors(ecs, params, point.pos, params.standingHeight, point.crouching);
+    return point.crouching != 0;
+}
+
+/// adds the points around one obstacle; returns how many
+static size_t coverAround(ECS::ECS &ecs, const CoverParams &params, const Type &type, const ECS::Rigid &rigid, ECS::entity id) {
+    auto bounds = type.worldBounds(rigid);
+    auto far = tg::distance(bounds.min, bounds.max) + params.clearance;
+    size_t count = 0;
+    for (int k = 0; k < params.pointsPerObstacle; ++k) {
+        auto angle = 2 * tg::pi_scalar<float> * float(k) / params.pointsPerObstacle;
+        tg::vec3 out = {std::cos(angle), 0, std::sin(angle)};
+        // from outside towards the obstacle, to find its surface
+        tg::ray3 ray = {rigid.translation + far * out + tg::vec3(0, params.crouchingHeight, 0), tg::dir3(-out)};
+        auto hit = rayCast(ecs, ray, far);
+        if (!hit) {continue;}
+        CoverPoint point = {ray[hit->second] + params.clearance * out, 0, 0, id};
+        if (!survey(ecs, params, point)) {continue;}
+        decltype(ecs.cover)::RStarInserter::insert(ecs.cover, point);
+        count += 1;
+    }
+    return count;
+}
+
+size_t Obstacle::buildCover(ECS::ECS &ecs, const CoverParams &params) {
+    ecs.cover.clear();
+    size_t count = 0;
+    for (auto &&tup : ECS::Join(ecs.obstacles, ecs.instancedRigids)) {
+        auto &[type, rigid, id] = tup;
+        count += coverAround(ecs, params, type, rigid, id);
+    }
+    ecs.coverStale.reset();
+    return count;
+}
+
+size_t Obstacle::updateCover(ECS::ECS &ecs, const tg::aabb3 &box, const CoverParams &params) {
+    // shots are cast `reach` far, so points that far away can see the change
+    auto margin = params.reach + params.clearance;
+    auto reached = tg::aabb3(box.min - tg::vec3(margin, margin, margin), box.max + tg::vec3(margin, margin, margin));
+    std::set<ECS::entity> covered;
+    ecs.cover.refit([&] (const tg::aabb3 &aabb, int) {return tg::intersects(aabb, reached);}, [&] (CoverPoint &point) {
+        if (!tg::intersects(point.getAABB(), reached)) {return false;}
+        covered.insert(point.obstacle);
+        auto oldPos = point.pos;
+        if (!ecs.obstacles.count(point.obstacle) || !survey(ecs, params, point)) {point.crouching = point.standing = 0;}
+        return point.pos != oldPos;
+    });
+    size_t count = 0;
+    for (auto &&tup : ECS::Join(ecs.obstacles, ecs.instancedRigids)) {
+        auto &[type, rigid, id] = tup;
+        if (covered.count(id) || !tg::intersects(type.worldBounds(rigid), box)) {continue;}
+        count += coverAround(ecs, params, type, rigid, id);
+    }
+    return count;
+}
+
+std::optional<float> Obstacle::coverScore(const CoverPoint &point, tg::pos3 pos, float radius, tg::pos3 threat, bool upright) {
+    auto dist = tg::distance(point.pos, pos);
+    auto threatDir = threat - point.pos;
+    if (dist > radius || !point.protects(threatDir, upright)) {return std::nullopt;}
+    auto s = CoverPoint::sector(threatDir);
+    auto mask = upright ? point.standing : point.crouching;
+    auto flanks = int(bool(mask & (1 << ((s + 1) % CoverPoint::SECTORS))))
+        + int(bool(mask & (1 << ((s + CoverPoint::SECTORS - 1) % CoverPoint::SECTORS))));
+    return (point.protects(threatDir, true) ? 1.f : 0.f) + .5f * float(flanks) - dist / radius;
+}
+
+std::optional<CoverPoint> Obstacle::bestCover(const ECS::ECS &ecs, tg::pos3 pos, float radius, tg::pos3 threat, bool upright) {
+    // the most a point can score before the distance is taken off
+    constexpr float maxScore = 2.f;
+    std::optional<CoverPoint> res;
+    auto best = -maxScore;
+    ecs.cover.visit([&] (const tg::aabb3 &aabb, int) {
+        return tg::distance(aabb, pos) <= std::min(radius, (maxScore - best) * radius);
+    }, [&] (const CoverPoint &point) {
+        auto score = coverScore(point, pos, radius, threat, upright);
+        if (!score || *score <= best) {return true;}
+        // obstacles may have been removed since the points were generated
+        if (!ecs.obstacles.count(point.obstacle)) {return true;}
+        res = point;
+        best = *score;
+        return true;
+    });
+    return res;
+}
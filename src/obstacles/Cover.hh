@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <ECS.hh>
+
+namespace Obstacle {
+
+/// a place to stand next to an obstacle, on a navmesh, and the directions
+/// from which the obstacles around it block shots at a unit standing there
+struct CoverPoint {
+    static constexpr int SECTORS = 8;
+
+    tg::pos3 pos;  ///< on the ground, world space
+    /// bit `i` is set if shots from the directions in sector `i` (seen from
+    /// the point) are blocked at crouching or standing height
+    uint8_t crouching, standing;
+    ECS::entity obstacle;  ///< the one the point was generated for
+
+    /// with a bit of volume, which the R* heuristics need
+    tg::aabb3 getAABB() const {return {pos - tg::vec3(.1f, .1f, .1f), pos + tg::vec3(.1f, .1f, .1f)};}
+    /// sector of the ground-plane direction, counter-clockwise from +X
+    static int sector(tg::vec3 dir);
+    /// if shots from `threatDir` (pointing from the point towards the shooter) are blocked
+    bool protects(tg::vec3 threatDir, bool upright) const {return (upright ? standing : crouching) & (1 << sector(threatDir));}
+};
+
+struct CoverParams {
+    int pointsPerObstacle = 8;
+    /// between the obstacle's surface and the point, a bit more than a unit's radius
+    float clearance = .6f;
+    /// obstacles further away than this don't count as cover
+    float reach = 3.f;
+    /// where shots are tested, above the ground
+    float crouchingHeight = .8f, standingHeight = 1.5f;
+};
+
+/// fills `ecs.cover` with points around every obstacle: a ring of candidates
+/// at the obstacle's surface, moved onto the navmeshes below them and kept if
+/// they aren't inside another obstacle and block shots from some direction.
+/// The directions are found by ray casts, so this is meant to run once after
+/// the obstacles are placed. Returns the number of points
+size_t buildCover(ECS::ECS &, const CoverParams & = {});
+/// brings the points around `box` up to date after obstacles there were added
+/// or removed, or the ground moved (see `ECS::coverChanged`): the points in
+/// reach are moved onto the ground and cast again, and obstacles in the box
+/// without points get theirs. Points that stopped being cover stay in the
+/// index but don't protect from anything. Returns the number of points added
+size_t updateCover(ECS::ECS &, const tg::aabb3 &box, const CoverParams & = {});
+
+/// how good `point` is for a unit at `pos` to take cover from a shooter at
+/// `threat` (higher is better), or nothing if it is further than `radius`
+/// away or doesn't block the shooter (at standing height if `upright`).
+/// Blocking at standing height and in the directions next to the shooter's
+/// (in case they move) count for more than the way there
+std::optional<float> coverScore(const CoverPoint &point, tg::pos3 pos, float radius, tg::pos3 threat, bool upright = false);
+/// the cover point within `radius` of `pos` with the best `coverScore`
+std::optional<CoverPoint> bestCover(const ECS::ECS &, tg::pos3 pos, float radius, tg::pos3 threat, bool upright = false);
+
+}
@@ -1,6 +1,8 @@
 // SPDX-License-Identifier: MIT
 #include "Obstacle.hh"
+#include <algorithm>
 #include <cinttypes>
+#include <iterator>
 #include <random>
 #include "../../extern/typed-geometry/src/typed-geometry/feature/quat.hh"
 
@@ -9,61 +11,52 @@
 
 #include <ECS/Join.hh>
 #include <Game.hh>
+#include <MathUtil.hh>
 #include <Util.hh>
 #include <animation/AnimatorManager.hh>
 #include <rendering/MeshViz.hh>
 #include <rtree/RStar.hh>
 #include <terrain/Terrain.hh>
 #include <terrain/TerrainMaterial.hh>
+#include <util/SparseDiscreteDistribution.hh>
 #include <environment/Parrot.hh>
+#include "Cover.hh"
 
 using namespace Obstacle;
 
+const std::array<TypeTemplate, 3> Obstacle::typeTemplates = {{{
+    0, "../data/meshes/palm1.obj", "../data/meshes/palm1_collider.obj",
+    .1f, true, {0.f, 1.f, 1.f}
+}, {
+    1, "../data/meshes/rock1.obj", "../data/meshes/rock1_collider.obj",
+    0.f, true, {1.f, .6f, .6f}
+}, {
+    2, "../data/meshes/brokenwall1.obj", "../data/meshes/brokenwall1_collider.obj",
+    0.f, false, {.3f, .2f, .2f}
+}}};
+
 System::System(Game& game) : mECS{game.mECS}, mSharedResources(game.mSharedResources) {
     auto &tex = game.mSharedResources.colorPaletteTex;
     auto &shaderFlat = game.mSharedResources.flatInstanced;
     auto &shaderWind = game.mSharedResources.flatWindy;
 
-    struct TypeTemplate {
-        const int id;
-        const char *meshPath, *colliderPath;
-        const glow::SharedProgram &shader;
-        float windHeightFraction;
-        bool highCover;
-        std::array<float, TerrainMaterial::NumMaterials> weights;
-    };
-    for (const auto &templ : std::initializer_list<TypeTemplate> {{
-        0, "../data/meshes/palm1.obj", "../data/meshes/palm1_collider.obj",
-        shaderWind, .1f, true, {0.f, 1.f, 1.f}
-    }, {
-        1, "../data/meshes/rock1.obj", "../data/meshes/rock1_collider.obj",
-        shaderFlat, 0.f, true, {1.f, .6f, .6f}
-    }, {
-        2, "../data/meshes/brokenwall1.obj", "../data/meshes/brokenwall1_collider.obj",
-        shaderFlat, 0.f, false, {.3f, .2f, .2f}
-    }}) {
+    for (const auto &templ : typeTemplates) {
         auto &vaoInfo = mInstancedRenderer.loadVaoForRendering(
-            templ.shader, tex, templ.meshPath
+            templ.windHeightFraction > 0 ? shaderWind : shaderFlat, tex, templ.meshPath
         );
         if (templ.windHeightFraction > 0) {
             auto &settings = vaoInfo.windSettings;
             settings.startFromHeight = settings.objectHeight * templ.windHeightFraction;
         }
-        auto idx = mTypes.size();
         auto &type = mTypes.emplace_back(vaoInfo);
         type.id = templ.id;
         type.highCover = templ.highCover;
         type.collisionMesh = std::make_unique<CollisionMesh>();
-        initObstacleCollider(*type.collisionMesh, templ.colliderPath);
-        for (auto t : Util::IntRange(TerrainMaterial::NumMaterials)) {
-            auto w = templ.weights[t];
-            if (w > 0)  {mTypesForTerrain[t].values.emplace_back(w, idx);}
-        }
+        loadCollisionMesh(*type.collisionMesh, templ.colliderPath);
     }
-    for (auto &tt : mTypesForTerrain) {tt.update();}
 }
 
-void System::initObstacleCollider(CollisionMesh &collider, const char *meshName) const {
+void Obstacle::loadCollisionMesh(CollisionMesh &collider, const char *meshName) {
     pm::obj_reader<float> reader(meshName, collider.mesh);
     auto &pos = collider.position;
     pos = reader.get_positions().to<tg::pos3>();
@@ -94,89 +87,101 @@ void System::initObstacleCollider(CollisionMesh &collider, const char *meshName)
     }
 }
 
-void System::spawnObstacles(ECS::Rigid &wo, Terrain::Instance &terr, std::mt19937& rng)
-{
-    auto xform = wo.transform_mat();
+tg::aabb3 Type::worldBounds(const ECS::Rigid &rigid) const {
+    tg::aabb3 aabb = {rigid.translation, rigid.translation};
+    auto mat = tg::mat4x3(rigid);
+    for (auto v : collisionMesh->mesh.all_vertices()) {
+        auto p = tg::pos(mat * tg::vec4(collisionMesh->position[v], 1));
+        aabb = tg::aabb3 {tg::min(aabb.min, p), tg::max(aabb.max, p)};
+    }
+    return aabb;
+}
 
-    for(auto &obstaclePos : randomlySelectedObstaclePositions(terr, rng)) {
-        if(obstaclePos.y < terr.waterLevel) {continue;}
+void Obstacle::placeObstacles(const ECS::Rigid &wo, const Terrain::Instance &terr, std::mt19937 &rng, float density, const std::function<void(const Placement &)> &place) {
+    std::array<SparseDiscreteDistribution<size_t, float>, TerrainMaterial::NumMaterials> typesForTerrain;
+    for (size_t idx = 0; idx < typeTemplates.size(); ++idx) {
+        for (auto t : Util::IntRange(TerrainMaterial::NumMaterials)) {
+            auto w = typeTemplates[idx].weights[t];
+            if (w > 0)  {typesForTerrain[t].values.emplace_back(w, idx);}
+        }
+    }
+    for (auto &tt : typesForTerrain) {tt.update();}
+
+    std::vector<tg::pos3> possiblePositions = terr.posAttr.to_vector();
+    std::vector<tg::pos3> chosenPositions;
+    std::sample(
+        possiblePositions.begin(),
+        possiblePositions.end(),
+        std::back_inserter(chosenPositions),
+        size_t(possiblePositions.size() * density),
+        rng
+    );
+
+    auto xform = wo.transform_mat();
+    for (auto &obstaclePos : chosenPositions) {
+        if (obstaclePos.y < terr.waterLevel) {continue;}
         auto material = terr.getMaterialForPosition(obstaclePos);
-        auto &type = mTypes.at(mTypesForTerrain[material](rng));
+        auto type = typesForTerrain[material](rng);
 
         tg::quat randomRotation = tg::quat::from_axis_angle(tg::dir3::pos_y, tg::angle::from_degree(std::uniform_int_distribution<int>(0, 360)(rng)));
         auto worldPos = tg::pos3(xform * tg::vec4(obstaclePos.x, obstaclePos.y, obstaclePos.z, 1));
-        ECS::Rigid rig = {worldPos, wo.rotation * randomRotation};
+        place({type, {worldPos, wo.rotation * randomRotation}});
+    }
+}
 
-        tg::aabb3 aabb = {worldPos, worldPos};
-        auto mat = tg::mat4x3(rig);
-        auto &collider = *type.collisionMesh;
-        for (auto v : collider.mesh.all_vertices()) {
-            auto p = tg::pos(mat * tg::vec4(collider.position[v], 1));
-            aabb = tg::aabb3 {tg::min(aabb.min, p), tg::max(aabb.max, p)};
-        }
+std::optional<ParrotStart> Obstacle::rollParrot(size_t type, std::mt19937 &rng, float density) {
+    if (typeTemplates[type].id != 1) {return std::nullopt;}
+    auto isParrotSpawn = std::uniform_real_distribution<>{0.0, 1.0}(rng);
+    if (isParrotSpawn > density) {return std::nullopt;}
+    ParrotStart res;
+    res.flying = std::uniform_int_distribution{1, 10}(rng) >= 9;
+    res.animationTime = std::uniform_real_distribution{0.0f, 3.0f}(rng);
+    return res;
+}
+
+void System::spawnObstacles(ECS::Rigid &wo, Terrain::Instance &terr, std::mt19937& rng)
+{
+    placeObstacles(wo, terr, rng, obstacleDensity, [&] (const Placement &placement) {
+        auto &type = mTypes.at(placement.type);
+        auto &rig = placement.rigid;
+        auto aabb = type.worldBounds(rig);
 
         ECS::entity ent = mECS.newEntity();
         mECS.obstacles.emplace(ent, type);
         mECS.instancedRigids.emplace(ent, rig);
         mECS.editables.emplace(ent, this);
         decltype(mECS.obstructions)::RStarInserter::insert(mECS.obstructions, {aabb, ent});
+        mECS.obstructionChanged(aabb);
 
-        if (type.id == 1)
-        {
-            auto isParrotSpawn = std::uniform_real_distribution<>{0.0, 1.0}(rng);
-            if (isParrotSpawn <= parrotDensity)
-            {
-                spawnParrot(wo, randomRotation, worldPos, rng);
-            }
-        }
-    }
+        if (auto parrot = rollParrot(placement.type, rng, parrotDensity)) {spawnParrot(rig, *parrot);}
+    });
 
     for (auto &&tup : ECS::Join(mECS.instancedRigids, mECS.obstacles)) {
         auto &[rig, type, id] = tup;
         type.vaoInfo.instanceData.emplace_back(rig, id);
     }
     mInstancedRenderer.updateBuffers();
+    buildCover(mECS);
 }
 
-void System::spawnParrot(const ECS::Rigid& wo,
-                         const tg::quat& randomRotation,
-                         const tg::pos3& worldPos,
-                         std::mt19937& rng)
+void System::spawnParrot(const ECS::Rigid& rigid, const ParrotStart &start)
 {
     // Add Parrot to rocks.
     ECS::entity parrotEnt = mECS.newEntity();
-    ECS::Rigid rigid = {worldPos, wo.rotation * randomRotation};
     mECS.riggedRigids.emplace(parrotEnt, rigid);
     std::string startAnim = mSharedResources.ANIM_PARROT_IDLE;
-    if (std::uniform_int_distribution{1, 10}(rng) >= 9)
+    if (start.flying)
     {
         startAnim = mSharedResources.ANIM_PARROT_FLY;
     }
     auto parrotInstance = RiggedMesh::Instance(&mSharedResources.mParrotMesh, startAnim);
     AnimatorManager::start(parrotInstance.animator);
-    parrotInstance.animator->mAnimationTime = std::uniform_real_distribution{0.0f, 3.0f}(rng);
+    parrotInstance.animator->mAnimationTime = start.animationTime;
     mECS.riggedMeshes.emplace(parrotEnt, parrotInstance);
     mECS.parrots.emplace(parrotEnt, Parrot::Instance());
 }
 
 
-std::vector<tg::pos3> System::randomlySelectedObstaclePositions(Terrain::Instance& terr, std::mt19937& rng) const
-{
-    std::vector<tg::pos3> possible_positions = terr.posAttr.to_vector();
-    std::vector<tg::pos3> chosen_positions;
-
-    size_t obstacleAmount = possible_positions.size() * obstacleDensity;
-
-    std::sample(
-        possible_positions.begin(),
-        possible_positions.end(),
-        std::back_inserter(chosen_positions),
-        obstacleAmount,
-        rng
-        );
-    return chosen_positions;
-}
-
 void System::renderMain(MainRenderPass& pass) {
     mInstancedRenderer.render(pass);
 }
@@ -207,12 +212,18 @@ void System::editorUI(ECS::entity ent) {
 }
 
 System::QueryResult System::rayCast(const tg::ray3 &ray) const {
-    QueryResult res;
-    mECS.obstructions.visit([ray] (const tg::aabb3 &aabb, int level) {
-        return tg::intersects(aabb, ray);
+    return Obstacle::rayCast(mECS, ray);
+}
+
+System::QueryResult Obstacle::rayCast(ECS::ECS &ecs, const tg::ray3 &ray, float maxDist) {
+    System::QueryResult res;
+    // boxes entered after the nearest hit so far can't contain a nearer one
+    auto limit = [&] {return res ? res->second : maxDist;};
+    ecs.obstructions.visit([&] (const tg::aabb3 &aabb, int level) {
+        return Util::rayBoxEntry(ray, aabb, limit()) < limit();
     }, [&] (const Obstruction &obstruction) {
-        if (!tg::intersects(obstruction.aabb, ray)) {return true;}
-        auto join = ECS::Join(mECS.obstacles, mECS.instancedRigids);
+        if (!(Util::rayBoxEntry(ray, obstruction.aabb, limit()) < limit())) {return true;}
+        auto join = ECS::Join(ecs.obstacles, ecs.instancedRigids);
         auto obstacleIter = join.find(obstruction.id);
         if (obstacleIter == join.end()) {return true;}
         auto [type, rigid, id] = *obstacleIter;
@@ -222,11 +233,10 @@ System::QueryResult System::rayCast(const tg::ray3 &ray) const {
             tg::pos3(mat * tg::vec4(ray.origin, 1)),
             tg::dir3(mat * tg::vec4(ray.dir, 0))
         );
-        collider.faceTree.visit([localRay] (const tg::aabb3 &aabb, int level) {
-            auto res = tg::intersects(localRay, aabb);
-            return res;
+        collider.faceTree.visit([&] (const tg::aabb3 &aabb, int level) {
+            return Util::rayBoxEntry(localRay, aabb, limit()) < limit();
         }, [&] (const IndexedFace &face) {
-            if (!tg::intersects(localRay, face.aabb)) {return true;}
+            if (!(Util::rayBoxEntry(localRay, face.aabb, limit()) < limit())) {return true;}
             auto handle = collider.mesh.handle_of(face.idx);
             auto vIter = handle.vertices().begin();
             auto vEnd = handle.vertices().end();
@@ -237,7 +247,7 @@ System::QueryResult System::rayCast(const tg::ray3 &ray) const {
             while (vIter != vEnd) {
                 auto p2 = collider.position[*vIter];
                 auto hit = tg::intersection_parameter(localRay, tg::triangle3(p0, p1, p2));
-                if (hit.any() && (!res || res->second > hit.first())) {
+                if (hit.any() && hit.first() < limit()) {
                     res = {{obstruction.id, hit.first()}};
                 }
                 ++vIter;
@@ -251,12 +261,16 @@ System::QueryResult System::rayCast(const tg::ray3 &ray) const {
 }
 
 System::QueryResult System::closest(const tg::pos3 &pos) const {
-    QueryResult res;
-    mECS.obstructions.visit([pos, &res] (const tg::aabb3 &aabb, int level) {
+    return Obstacle::closest(mECS, pos);
+}
+
+System::QueryResult Obstacle::closest(ECS::ECS &ecs, const tg::pos3 &pos) {
+    System::QueryResult res;
+    ecs.obstructions.visit([pos, &res] (const tg::aabb3 &aabb, int level) {
         return !res || tg::distance(aabb, pos) < res->second;
     }, [&] (const Obstruction &obstruction) {
         if (res && tg::distance(obstruction.aabb, pos) >= res->second) {return true;}
-        auto join = ECS::Join(mECS.obstacles, mECS.instancedRigids);
+        auto join = ECS::Join(ecs.obstacles, ecs.instancedRigids);
         auto obstacleIter = join.find(obstruction.id);
         if (obstacleIter == join.end()) {return true;}
         auto [type, rigid, id] = *obstacleIter;
@@ -1,6 +1,10 @@
 // SPDX-License-Identifier: MIT
 #pragma once
+#include <array>
+#include <functional>
+#include <limits>
 #include <optional>
+#include <random>
 
 #include <polymesh/Mesh.hh>
 #include <glow/objects.hh>
@@ -10,7 +14,6 @@
 #include <animation/rigged/RiggedMesh.hh>
 #include <rendering/InstancedRenderer.hh>
 #include <terrain/TerrainMaterial.hh>
-#include <util/SparseDiscreteDistribution.hh>
 #include "../../extern/typed-geometry/src/typed-geometry/feature/quat.hh"
 #include "../../extern/typed-geometry/src/typed-geometry/types/pos.hh"
 #include "Collision.hh"
@@ -26,7 +29,44 @@ struct Type {
 
     Type(InstancedRenderer::VaoInfo &vaoInfo) : vaoInfo{vaoInfo} {}
     Type(Type &&) = default;
+
+    /// bounds of the collision mesh when placed at `rigid`
+    tg::aabb3 worldBounds(const ECS::Rigid &rigid) const;
+};
+
+/// what makes up an obstacle type apart from its rendering data
+struct TypeTemplate {
+    int id;
+    const char *meshPath, *colliderPath;
+    float windHeightFraction;  ///< 0: not moved by the wind
+    bool highCover;
+    /// how likely the type is to be picked on each terrain material
+    std::array<float, TerrainMaterial::NumMaterials> weights;
 };
+extern const std::array<TypeTemplate, 3> typeTemplates;
+
+/// an obstacle of type `typeTemplates[type]`
+struct Placement {
+    size_t type;
+    ECS::Rigid rigid;
+};
+/// places obstacles on a random `density` fraction of the vertices of a terrain placed at `wo`,
+/// leaving out those under water. `place` is called right after the draws for each obstacle
+/// and may draw from the generator itself (parrots do), so callers that make the same draws
+/// get the same obstacles for the same seed. Doesn't need the `System` (or a GL context)
+void placeObstacles(const ECS::Rigid &wo, const Terrain::Instance &, std::mt19937 &, float density, const std::function<void(const Placement &)> &place);
+
+/// how a parrot sitting on an obstacle starts out
+struct ParrotStart {
+    bool flying;
+    float animationTime;
+};
+constexpr float defaultParrotDensity = .45f;
+/// whether an obstacle of type `typeTemplates[type]` gets a parrot. Makes the same draws
+/// as the game, so headless callers can keep their generator in step with it
+std::optional<ParrotStart> rollParrot(size_t type, std::mt19937 &, float density = defaultParrotDensity);
+/// reads a collider mesh and builds its trees
+void loadCollisionMesh(CollisionMesh &, const char *path);
 
 class System final : public ECS::Editor {
     ECS::ECS &mECS;
@@ -35,15 +75,11 @@ class System final : public ECS::Editor {
     InstancedRenderer mInstancedRenderer;
 
     float obstacleDensity = 0.1f;
-    float parrotDensity = 0.45;
+    float parrotDensity = defaultParrotDensity;
 
-    std::vector<Type> mTypes;
-    std::array<SparseDiscreteDistribution<size_t, float>, TerrainMaterial::NumMaterials> mTypesForTerrain;
+    std::vector<Type> mTypes;  ///< in the order of `typeTemplates`
 
-    std::vector<tg::pos3> randomlySelectedObstaclePositions(Terrain::Instance& terr, std::mt19937& engine) const;
-    void initObstacleCollider(CollisionMesh &collider, const char *meshName) const;
-
-    void spawnParrot(const ECS::Rigid& wo, const tg::quat& randomRotation, const tg::pos3& worldPos, std::mt19937& rng);
+    void spawnParrot(const ECS::Rigid& rigid, const ParrotStart &start);
 
 public:
     std::map<glow::SharedVertexArray, CollisionMesh> obstacleColliders;
@@ -58,4 +94,10 @@ public:
     QueryResult rayCast(const tg::ray3 &ray) const;
     QueryResult closest(const tg::pos3 &pos) const;
 };
+
+/// nearest obstacle collider hit by the ray, ignoring hits beyond `maxDist`.
+/// Only uses components, so it also works without the system (and a GL context)
+System::QueryResult rayCast(ECS::ECS &, const tg::ray3 &ray, float maxDist = std::numeric_limits<float>::infinity());
+/// nearest obstacle collider to `pos` and the distance to it; like `rayCast`, only uses components
+System::QueryResult closest(ECS::ECS &, const tg::pos3 &pos);
 }
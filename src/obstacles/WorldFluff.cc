@@ -8,6 +8,8 @@
 #include <MathUtil.hh>
 #include <Util.hh>
 #include <ECS/Join.hh>
+#include <obstacles/Collision.hh>
+#include <rtree/RStar.hh>
 #include <terrain/Terrain.hh>
 #include <terrain/TerrainMaterial.hh>
 
@@ -62,10 +64,23 @@ void System::spawnFluff(ECS::Rigid &wo, Terrain::Instance &terr, std::mt19937& r
         auto worldPos = tg::pos3(xform * tg::vec4(fluffPosition.x, fluffPosition.y, fluffPosition.z, 1));
 
         ECS::entity ent = mECS.newEntity();
-        mECS.instancedRigids.emplace(ent, ECS::Rigid(
+        auto &rig = mECS.instancedRigids.emplace(ent, ECS::Rigid(
             worldPos, wo.rotation * alignToNormal * randomRotation
-        ));
+        )).first->second;
         mECS.worldFluffs.emplace(ent, type);
+
+        auto &bounds = type.vaoInfo.bounds;
+        auto mat = tg::mat4x3(rig);
+        tg::aabb3 aabb = {worldPos, worldPos};
+        for (auto corner : {0, 1, 2, 3, 4, 5, 6, 7}) {
+            auto p = tg::pos3(mat * tg::vec4(
+                corner & 1 ? bounds.max.x : bounds.min.x,
+                corner & 2 ? bounds.max.y : bounds.min.y,
+                corner & 4 ? bounds.max.z : bounds.min.z, 1
+            ));
+            aabb = {tg::min(aabb.min, p), tg::max(aabb.max, p)};
+        }
+        decltype(mECS.fluffBounds)::RStarInserter::insert(mECS.fluffBounds, {aabb, ent});
     }
 
     for (auto &&tup : ECS::Join(mECS.instancedRigids, mECS.worldFluffs)) {
@@ -62,6 +62,7 @@ InstancedRenderer::VaoInfo& InstancedRenderer::loadVaoForRendering(const glow::S
     vaoInfo->vao = vao;
     vaoInfo->instancedDataBuffer = fluffTransformations;
     vaoInfo->windSettings = meshWindSettings;
+    vaoInfo->bounds = {tg::pos3(mesh.minExtents), tg::pos3(mesh.maxExtents)};
 
     auto &shaderInfo = shaderInfos[shader];
     shaderInfo.albedoTex = albedoTex;
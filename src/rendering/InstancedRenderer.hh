@@ -16,6 +16,8 @@ struct InstancedRenderer {
         glow::SharedArrayBuffer instancedDataBuffer;
         Wind::PerMeshSettings windSettings;
         std::vector<InstanceData> instanceData;
+        /// bounding box of the mesh in object space
+        tg::aabb3 bounds;
     };
 
     struct ShaderInfo {
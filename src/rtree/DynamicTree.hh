@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include <typed-geometry/tg.hh>
+
+/// bounding volume hierarchy for objects that move around a lot.
+/// Unlike `RTree`, every object is a leaf of a binary tree and can be moved
+/// or removed in O(log n). Leaves store 'fat' AABBs that are larger than the
+/// object, so small movements don't change the tree at all. The tree is kept
+/// balanced using AVL-style rotations. (Modeled after the dynamic tree in Box2D)
+template<typename T>
+class DynamicTree {
+public:
+    using proxy_t = int32_t;
+    static constexpr proxy_t NONE = -1;
+
+protected:
+    struct Node {
+        tg::aabb3 aabb;
+        T data;
+        proxy_t parent = NONE, child1 = NONE, child2 = NONE;
+        int32_t height = 0;  ///< 0 for leaves, -1 for free nodes
+        bool moved = false;
+
+        bool isLeaf() const {return child1 == NONE;}
+    };
+
+    std::vector<Node> mNodes;
+    proxy_t mRoot = NONE, mFreeList = NONE;
+    size_t mLeaves = 0;
+    std::vector<proxy_t> mMoved;
+
+    static tg::aabb3 union_(const tg::aabb3 &a, const tg::aabb3 &b) {
+        return {tg::min(a.min, b.min), tg::max(a.max, b.max)};
+    }
+    static float surface(const tg::aabb3 &a) {
+        auto d = a.max - a.min;
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+    static bool contains(const tg::aabb3 &outer, const tg::aabb3 &inner) {
+        return outer.min.x <= inner.min.x && outer.min.y <= inner.min.y && outer.min.z <= inner.min.z
+            && inner.max.x <= outer.max.x && inner.max.y <= outer.max.y && inner.max.z <= outer.max.z;
+    }
+
+    proxy_t allocateNode() {
+        if (mFreeList == NONE) {
+            mNodes.emplace_back();
+            return proxy_t(mNodes.size() - 1);
+        }
+        auto res = mFreeList;
+        mFreeList = mNodes[res].child1;
+        mNodes[res] = Node();
+        return res;
+    }
+    void freeNode(proxy_t idx) {
+        mNodes[idx] = Node();
+        mNodes[idx].child1 = mFreeList;
+        mNodes[idx].height = -1;
+        mFreeList = idx;
+    }
+
+    /// recompute bounds and height of `idx` from its children
+    void refit(proxy_t idx) {
+        auto &node = mNodes[idx];
+        auto &a = mNodes[node.child1], &b = mNodes[node.child2];
+        node.aabb = union_(a.aabb, b.aabb);
+        node.height = 1 + std::max(a.height, b.height);
+    }
+    /// walks up from `idx` to the root, rebalancing and refitting
+    void fixUpwards(proxy_t idx) {
+        while (idx != NONE) {
+            idx = balance(idx);
+            refit(idx);
+            idx = mNodes[idx].parent;
+        }
+    }
+    void replaceChild(proxy_t parent, proxy_t oldChild, proxy_t newChild) {
+        if (parent == NONE) {
+            mRoot = newChild;
+        } else if (mNodes[parent].child1 == oldChild) {
+            mNodes[parent].child1 = newChild;
+        } else {
+            mNodes[parent].child2 = newChild;
+        }
+    }
+
+    /// performs a left or right rotation if `a` is imbalanced, returns the new root of the subtree
+    proxy_t balance(proxy_t a) {
+        auto &A = mNodes[a];
+        if (A.isLeaf() || A.height < 2) {return a;}
+        auto b = A.child1, c = A.child2;
+        auto diff = mNodes[c].height - mNodes[b].height;
+        if (diff > 1) {return rotate(a, c, false);}
+        if (diff < -1) {return rotate(a, b, true);}
+        return a;
+    }
+    /// moves child `up` of `a` into its place. `left` is whether `up` is `a.child1`
+    proxy_t rotate(proxy_t a, proxy_t up, bool left) {
+        auto &A = mNodes[a], &U = mNodes[up];
+        auto f = U.child1, g = U.child2;
+        U.child1 = a;
+        U.parent = A.parent;
+        A.parent = up;
+        replaceChild(U.parent, a, up);
+        // the taller grandchild stays below `up`, the other one goes to `a`
+        auto keep = mNodes[f].height > mNodes[g].height ? f : g;
+        auto give = keep == f ? g : f;
+        U.child2 = keep;
+        (left ? A.child1 : A.child2) = give;
+        mNodes[give].parent = a;
+        refit(a);
+        refit(up);
+        return up;
+    }
+
+    void insertLeaf(proxy_t leaf) {
+        mNodes[leaf].moved = true;
+        mMoved.push_back(leaf);
+        if (mRoot == NONE) {
+            mRoot = leaf;
+            mNodes[leaf].parent = NONE;
+            return;
+        }
+        // find the best sibling using the surface area heuristic
+        auto leafAABB = mNodes[leaf].aabb;
+        auto idx = mRoot;
+        while (!mNodes[idx].isLeaf()) {
+            auto &node = mNodes[idx];
+            auto area = surface(node.aabb);
+            auto combinedArea = surface(union_(node.aabb, leafAABB));
+            // cost of making a new parent for this node and the new leaf
+            auto cost = 2.f * combinedArea;
+            // minimum cost of pushing the leaf further down the tree
+            auto inheritance = 2.f * (combinedArea - area);
+            auto descendCost = [&] (proxy_t child) {
+                auto &c = mNodes[child];
+                auto enlarged = surface(union_(c.aabb, leafAABB));
+                return (c.isLeaf() ? enlarged : enlarged - surface(c.aabb)) + inheritance;
+            };
+            auto cost1 = descendCost(node.child1), cost2 = descendCost(node.child2);
+            if (cost < cost1 && cost < cost2) {break;}
+            idx = cost1 < cost2 ? node.child1 : node.child2;
+        }
+
+        auto sibling = idx;
+        auto oldParent = mNodes[sibling].parent;
+        auto newParent = allocateNode();
+        auto &np = mNodes[newParent];
+        np.parent = oldParent;
+        np.child1 = sibling;
+        np.child2 = leaf;
+        replaceChild(oldParent, sibling, newParent);
+        mNodes[sibling].parent = newParent;
+        mNodes[leaf].parent = newParent;
+        fixUpwards(newParent);
+    }
+
+    void removeLeaf(proxy_t leaf) {
+        if (leaf == mRoot) {
+            mRoot = NONE;
+            return;
+        }
+        auto parent = mNodes[leaf].parent;
+        auto grandParent = mNodes[parent].parent;
+        auto sibling = mNodes[parent].child1 == leaf ? mNodes[parent].child2 : mNodes[parent].child1;
+        replaceChild(grandParent, parent, sibling);
+        mNodes[sibling].parent = grandParent;
+        freeNode(parent);
+        fixUpwards(grandParent);
+    }
+
+    static bool rayHits(const tg::aabb3 &a, const tg::pos3 &origin, const tg::vec3 &invDir, float maxT) {
+        float tmin = 0.f, tmax = maxT;
+        for (auto axis : {0, 1, 2}) {
+            auto t0 = (a.min[axis] - origin[axis]) * invDir[axis];
+            auto t1 = (a.max[axis] - origin[axis]) * invDir[axis];
+            if (t0 > t1) {std::swap(t0, t1);}
+            // NaN (0 * inf) means the ray is parallel and inside the slab, and is ignored by min/max
+            tmin = std::max(tmin, t0);
+            tmax = std::min(tmax, t1);
+        }
+        return tmin <= tmax;
+    }
+
+public:
+    /// how much leaf AABBs are enlarged in each direction
+    float margin = .5f;
+    /// leaf AABBs are additionally extended by this multiple of the displacement given to `move`
+    float displacementFactor = 4.f;
+
+    /// inserts a new object with the given (tight) bounding box
+    proxy_t insert(const tg::aabb3 &aabb, const T &data) {
+        auto idx = allocateNode();
+        auto &node = mNodes[idx];
+        node.aabb = {aabb.min - tg::vec3(margin), aabb.max + tg::vec3(margin)};
+        node.data = data;
+        node.height = 0;
+        mLeaves += 1;
+        insertLeaf(idx);
+        return idx;
+    }
+    void remove(proxy_t idx) {
+        assert(mNodes[idx].isLeaf() && mNodes[idx].height == 0);
+        removeLeaf(idx);
+        // may stay in `mMoved`, `updatePairs` skips it
+        freeNode(idx);
+        mLeaves -= 1;
+    }
+    /// updates the bounding box of an object. Only touches the tree if `aabb`
+    /// is no longer contained in the fat AABB of the leaf, returns whether it did
+    bool move(proxy_t idx, const tg::aabb3 &aabb, const tg::vec3 &displacement = tg::vec3::zero) {
+        assert(mNodes[idx].isLeaf() && mNodes[idx].height == 0);
+        if (contains(mNodes[idx].aabb, aabb)) {return false;}
+        removeLeaf(idx);
+        tg::aabb3 fat = {aabb.min - tg::vec3(margin), aabb.max + tg::vec3(margin)};
+        // predict the movement for the next few updates
+        auto d = displacementFactor * displacement;
+        fat.min += tg::min(d, tg::vec3::zero);
+        fat.max += tg::max(d, tg::vec3::zero);
+        mNodes[idx].aabb = fat;
+        auto wasMoved = mNodes[idx].moved;
+        insertLeaf(idx);
+        if (wasMoved) {mMoved.pop_back();}  // already in the buffer
+        return true;
+    }
+
+    const T &data(proxy_t idx) const {return mNodes[idx].data;}
+    T &data(proxy_t idx) {return mNodes[idx].data;}
+    const tg::aabb3 &fatAABB(proxy_t idx) const {return mNodes[idx].aabb;}
+    size_t size() const {return mLeaves;}
+    int32_t height() const {return mRoot == NONE ? 0 : mNodes[mRoot].height;}
+
+    void clear() {
+        mNodes.clear();
+        mMoved.clear();
+        mRoot = mFreeList = NONE;
+        mLeaves = 0;
+    }
+
+    /// same interface as `RTree::visit`: `check(aabb)` decides whether to
+    /// descend into a node, `visit(proxy)` is called for each leaf that
+    /// passed the check and returns whether to continue
+    template<typename Check, typename Visit>
+    bool visit(Check &&check, Visit &&visit) const {
+        if (mRoot == NONE) {return true;}
+        // depth-first traversal never needs more stack than the height of the tree + 1
+        proxy_t local[128];
+        std::vector<proxy_t> heap;
+        auto stack = local;
+        if (mNodes[mRoot].height >= 127) {
+            heap.resize(mNodes[mRoot].height + 1);
+            stack = heap.data();
+        }
+        size_t top = 0;
+        stack[top++] = mRoot;
+        while (top > 0) {
+            auto idx = stack[--top];
+            auto &node = mNodes[idx];
+            if (!check(node.aabb)) {continue;}
+            if (node.isLeaf()) {
+                if (!visit(idx)) {return false;}
+            } else {
+                stack[top++] = node.child1;
+                stack[top++] = node.child2;
+            }
+        }
+        return true;
+    }
+
+    /// calls `callback(proxy)` for each object whose fat AABB intersects `aabb`
+    template<typename Callback>
+    void query(const tg::aabb3 &aabb, Callback &&callback) const {
+        visit([&] (const tg::aabb3 &a) {return tg::intersects(a, aabb);}, callback);
+    }
+
+    /// calls `callback(proxy)` for each object whose fat AABB is hit by the ray
+    /// closer than `maxT`. The callback returns the distance at which the object
+    /// itself was hit (or infinity), which is used to prune the remaining search
+    template<typename Callback>
+    void rayCast(const tg::ray3 &ray, float maxT, Callback &&callback) const {
+        tg::vec3 invDir(1.f / ray.dir.x, 1.f / ray.dir.y, 1.f / ray.dir.z);
+        visit([&] (const tg::aabb3 &a) {return rayHits(a, ray.origin, invDir, maxT);}, [&] (proxy_t idx) {
+            maxT = std::min(maxT, float(callback(idx)));
+            return true;
+        });
+    }
+
+    /// broadphase: calls `callback(a, b)` once for every pair of objects with
+    /// overlapping fat AABBs where at least one was inserted or moved since the
+    /// last call. Pairs are reported in a deterministic order
+    template<typename Callback>
+    void updatePairs(Callback &&callback) {
+        std::vector<std::pair<proxy_t, proxy_t>> pairs;
+        // removed proxies are left in the buffer, and their nodes may have been
+        // reused (and possibly moved again)
+        std::sort(mMoved.begin(), mMoved.end());
+        mMoved.erase(std::unique(mMoved.begin(), mMoved.end()), mMoved.end());
+        mMoved.erase(std::remove_if(mMoved.begin(), mMoved.end(), [&] (proxy_t q) {
+            return mNodes[q].height != 0 || !mNodes[q].moved;
+        }), mMoved.end());
+        for (auto q : mMoved) {
+            auto &aabb = mNodes[q].aabb;
+            query(aabb, [&] (proxy_t p) {
+                // if both moved, only report the pair from the smaller index
+                if (p != q && !(mNodes[p].moved && p < q)) {
+                    pairs.emplace_back(std::min(p, q), std::max(p, q));
+                }
+                return true;
+            });
+        }
+        for (auto q : mMoved) {mNodes[q].moved = false;}
+        mMoved.clear();
+        std::sort(pairs.begin(), pairs.end());
+        for (auto [a, b] : pairs) {callback(a, b);}
+    }
+
+    /// for debugging: checks the structural invariants, returns false if any are violated
+    bool validate() const {
+        size_t leaves = 0;
+        bool ok = true;
+        auto check = [&] (auto &self, proxy_t idx, proxy_t parent) -> int32_t {
+            auto &node = mNodes[idx];
+            ok &= node.parent == parent;
+            if (node.isLeaf()) {
+                leaves += 1;
+                ok &= node.height == 0;
+                return 0;
+            }
+            auto h1 = self(self, node.child1, idx), h2 = self(self, node.child2, idx);
+            ok &= node.height == 1 + std::max(h1, h2);
+            ok &= contains(node.aabb, mNodes[node.child1].aabb) && contains(node.aabb, mNodes[node.child2].aabb);
+            return node.height;
+        };
+        if (mRoot != NONE) {check(check, mRoot, NONE);}
+        return ok && leaves == mLeaves;
+    }
+};
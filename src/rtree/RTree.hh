@@ -107,6 +107,23 @@ protected:
         }
         return true;
     }
+    template<typename Check, typename Update>
+    bool refitNode(Check &check, Update &update, Node &node, level_t level) {
+        if (node.size == 0 || !check(node.rect, level)) {return false;}
+        bool changed = false;
+        if (level > 0) {
+            for (size_t i = 0; i < node.size; ++i) {
+                changed |= refitNode(check, update, node.children[i], level - 1);
+            }
+            if (changed) {boundInner(node);}
+        } else {
+            for (size_t i = 0; i < node.size; ++i) {
+                changed |= update(node.objects[i]);
+            }
+            if (changed) {boundLeaf(node);}
+        }
+        return changed;
+    }
 
 public:
     RTree(const Domain &domain = {}, const Allocator &alloc = {}) : mDomain{domain}, mAllocator{alloc}, mNodeAllocator{alloc} {}
@@ -159,5 +176,13 @@ public:
     void visit(Check &&check, Visit &&visit) const {
         this->visit(visitor<Check, Visit>(std::forward<Check>(check), std::forward<Visit>(visit)));
     }
+    /// lets `update` change the objects in the nodes accepted by `check` in
+    /// place (it returns whether it did), and recomputes the bounds of the
+    /// nodes above the changed ones. Nothing is moved between nodes, so this
+    /// is for small changes of the objects' bounds
+    template<typename Check, typename Update>
+    void refit(Check &&check, Update &&update) {
+        refitNode(check, update, mRoot, mDepth);
+    }
     level_t depth() const {return mDepth;}
 };
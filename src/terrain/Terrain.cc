@@ -1,9 +1,12 @@
 // SPDX-License-Identifier: MIT
 #include "Terrain.hh"
+#include <algorithm>
 #include <cinttypes>
+#include <cmath>
 
 #include <polymesh/algorithms/delaunay.hh>
 #include <polymesh/algorithms/triangulate.hh>
+#include <glow/gl.hh>
 #include <glow/glow.hh>
 #include <glow/objects/ArrayBuffer.hh>
 #include <glow/objects/ElementArrayBuffer.hh>
@@ -19,6 +22,7 @@
 #include <MathUtil.hh>
 #include <ECS/Join.hh>
 #include <ECS/Misc.hh>
+#include <combat/Combat.hh>
 #include <navmesh/NavMesh.hh>
 #include <rendering/MainRenderPass.hh>
 #include <rendering/MeshViz.hh>
@@ -28,7 +32,7 @@
 
 using namespace Terrain;
 
-Instance::Instance(std::mt19937 &rng) {
+Instance::Instance(std::mt19937 &rng, uint32_t segments) {
     this->noiseOffset = std::uniform_real_distribution<float> {0.f, 10000.f}(rng);
 
     this->noiseScale = 120;
@@ -39,7 +43,7 @@ Instance::Instance(std::mt19937 &rng) {
     // smaller noise four roughing up terrain
     this->roughnessNoise = SimplexNoise(10/ noiseScale, 0.5f, 1.99f, 0.5f);
 
-    this->segmentsAmount = 200;
+    this->segmentsAmount = segments;
     this->segmentSize = 4;
     this->center = tg::pos2((float)segmentsAmount*segmentSize / 2, (float)segmentsAmount*segmentSize / 2);
 
@@ -96,10 +100,48 @@ Rendering::Rendering(const Instance &terr) {
     for (auto f : terr.mesh->faces()) {
         for (auto h : f.halfedges()) {indices.push_back(h.vertex_to().idx.value);}
     }
-    auto buf = glow::ArrayBuffer::create("aHeight", heights);
+    this->heights = glow::ArrayBuffer::create("aHeight", heights);
     auto idxbuf = glow::ElementArrayBuffer::create(indices);
     auto colorbuf = glow::ArrayBuffer::create("color", colors);
-    this->vao = glow::VertexArray::create({buf, colorbuf}, idxbuf);
+    this->vao = glow::VertexArray::create({this->heights, colorbuf}, idxbuf);
+}
+
+void Rendering::updateHeights(const Instance &terr, const GridRect &rect) {
+    if (rect.empty()) {return;}
+    std::vector<float> row(rect.z1 - rect.z0 + 1);
+    auto bound = heights->bind();
+    for (auto x = rect.x0; x <= rect.x1; ++x) {
+        // vertices are stored by rows of constant x, see the constructor of `Instance`
+        auto first = x * terr.segmentsAmount + rect.z0;
+        for (uint32_t i = 0; i < row.size(); ++i) {
+            row[i] = terr.posAttr[terr.mesh->vertices()[first + i]].y;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(first * sizeof(float)), GLsizeiptr(row.size() * sizeof(float)), row.data());
+    }
+}
+
+GridRect Instance::applyCrater(const Crater &crater) {
+    // grid vertices within the crater's square, clamped to the grid
+    auto range = [&] (float center) {
+        auto lo = int64_t(std::ceil((center - crater.radius) / segmentSize));
+        auto hi = int64_t(std::floor((center + crater.radius) / segmentSize));
+        return std::pair {std::max(lo, int64_t(0)), std::min(hi, int64_t(segmentsAmount) - 1)};
+    };
+    auto [x0, x1] = range(crater.center.x);
+    auto [z0, z1] = range(crater.center.z);
+    GridRect rect;
+    for (auto x = x0; x <= x1; ++x) {
+        for (auto z = z0; z <= z1; ++z) {
+            auto &pos = posAttr[mesh->vertices()[uint32_t(x) * segmentsAmount + uint32_t(z)]];
+            auto dent = crater.dent(pos);
+            if (dent <= 0.f) {continue;}
+            pos.y -= dent;
+            if (rect.empty()) {rect = {uint32_t(x), uint32_t(x), uint32_t(z), uint32_t(z)};}
+            rect.x0 = std::min(rect.x0, uint32_t(x)), rect.x1 = std::max(rect.x1, uint32_t(x));
+            rect.z0 = std::min(rect.z0, uint32_t(z)), rect.z1 = std::max(rect.z1, uint32_t(z));
+        }
+    }
+    return rect;
 }
 
 TerrainMaterial::ID Instance::getMaterialForPosition(tg::pos3 pos) const {
@@ -171,6 +213,26 @@ void System::renderMain(MainRenderPass &pass, const float minAlpha) {
     }
 }
 
+void System::crater(const Crater &hit) {
+    for (auto &&tup : ECS::Join(mECS.staticRigids, mECS.terrains)) {
+        auto &[wo, terr, id] = tup;
+        // every point of a grid cell is within 1/√2 segments of a corner, so
+        // this always moves a vertex, and the navmesh sees the same crater
+        auto crater = hit;
+        crater.radius = std::max(crater.radius, .75f * terr.segmentSize);
+        auto rect = terr.applyCrater({~wo * crater.center, crater.radius, crater.depth});
+        if (rect.empty()) {continue;}
+        auto rend = mECS.terrainRenderings.find(id);
+        if (rend != mECS.terrainRenderings.end()) {rend->second.updateHeights(terr, rect);}
+        auto nav = mECS.navMeshes.find(id);
+        if (nav == mECS.navMeshes.end()) {continue;}
+        auto changed = nav->second.applyCrater(crater);
+        if (!changed) {continue;}
+        mECS.coverChanged(*changed);
+        if (mECS.combatSys) {mECS.combatSys->replanCrossing(id, *changed);}
+    }
+}
+
 void System::renderingEditorUI(ECS::entity ent, Instance &terr) {
     auto rend_iter = mECS.terrainRenderings.find(ent);
     if (rend_iter != mECS.terrainRenderings.end()) {
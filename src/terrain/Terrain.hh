@@ -20,6 +20,26 @@ struct TerrainMaterial;
 
 namespace Terrain {
 
+/// a bowl-shaped dent in the ground, as left by laser hits
+struct Crater {
+    tg::pos3 center;
+    float radius, depth;
+
+    /// how far the ground at `pos` is pushed down; only the distance in the ground plane counts
+    float dent(tg::pos3 pos) const {
+        auto dx = pos.x - center.x, dz = pos.z - center.z;
+        auto d2 = (dx * dx + dz * dz) / (radius * radius);
+        return d2 < 1.f ? depth * (1.f - d2) : 0.f;
+    }
+};
+
+/// vertices `x0..x1` × `z0..z1` (inclusive) of the terrain grid
+struct GridRect {
+    uint32_t x0 = 1, x1 = 0, z0 = 1, z1 = 0;
+
+    bool empty() const {return x0 > x1 || z0 > z1;}
+};
+
 struct Instance {
     std::unique_ptr<pm::Mesh> mesh;
     pm::vertex_attribute<tg::pos3> posAttr;
@@ -38,17 +58,23 @@ struct Instance {
     float waterdepth = 20;
     float beachSteepness = 0.6f;
 
-    Instance(std::mt19937 &);
+    /// an island on a grid of `segments` × `segments` vertices
+    Instance(std::mt19937 &, uint32_t segments = 200);
     float getElevationAtPos(float xPos, float zPos) const;
     tg::pos3 getVertexPositionForSegment(int x, int z) const;
     float getIslandFalloff(float xPos, float zPos) const;
     TerrainMaterial::ID getMaterialForPosition(tg::pos3 pos) const;
+    /// lowers the ground for a crater in local space; returns the vertices that moved
+    GridRect applyCrater(const Crater &);
 };
 
 struct Rendering {
     glow::SharedVertexArray vao;
+    glow::SharedArrayBuffer heights;
 
     Rendering(const Instance &);
+    /// uploads the heights of the given vertices only, one row of the grid at a time
+    void updateHeights(const Instance &, const GridRect &);
 };
 
 class System final : public ECS::Editor {
@@ -60,6 +86,9 @@ public:
     void renderMain(MainRenderPass &, const float minAlpha);
     void editorUI(ECS::entity);
     void renderingEditorUI(ECS::entity, Instance &);
+    /// dents the terrains under a crater in world space, and passes the
+    /// change on to their rendering and navmesh, and to the units whose routes cross it
+    void crater(const Crater &);
 };
 
 }
@@ -0,0 +1,121 @@
+// SPDX-License-Identifier: MIT
+#include "Trigger.hh"
+#include <algorithm>
+#include <cmath>
+
+#include <typed-geometry/tg.hh>
+
+#include <ECS/Misc.hh>
+#include <combat/Combat.hh>
+#include <effects/Effects.hh>
+#include <environment/Parrot.hh>
+
+using namespace Trigger;
+
+Volume Volume::sphere(ECS::entity owner, const tg::pos3 &center, float radius, uint32_t mask) {
+    Volume res;
+    res.shape = Shape::Sphere;
+    res.center = center;
+    res.radius = radius;
+    res.mask = mask;
+    res.owner = owner;
+    return res;
+}
+
+Volume Volume::box(ECS::entity owner, const tg::aabb3 &box, uint32_t mask) {
+    Volume res;
+    res.shape = Shape::Box;
+    res.center = tg::lerp(box.min, box.max, .5f);
+    res.halfExtent = .5f * (box.max - box.min);
+    res.mask = mask;
+    res.owner = owner;
+    return res;
+}
+
+Volume Volume::cylinder(ECS::entity owner, const tg::pos3 &center, float radius, float halfHeight, uint32_t mask) {
+    Volume res;
+    res.shape = Shape::Cylinder;
+    res.center = center;
+    res.radius = radius;
+    res.halfExtent = {radius, halfHeight, radius};
+    res.mask = mask;
+    res.owner = owner;
+    return res;
+}
+
+tg::aabb3 Volume::aabb() const {
+    auto extent = shape == Shape::Sphere ? tg::vec3(radius) : halfExtent;
+    return {center - extent, center + extent};
+}
+
+bool Volume::contains(const tg::pos3 &pos) const {
+    if (shape == Shape::Sphere) {return tg::distance_sqr(pos, center) <= radius * radius;}
+    auto d = pos - center;
+    if (shape == Shape::Cylinder) {return d.x * d.x + d.z * d.z <= radius * radius && std::abs(d.y) <= halfExtent.y;}
+    return std::abs(d.x) <= halfExtent.x && std::abs(d.y) <= halfExtent.y && std::abs(d.z) <= halfExtent.z;
+}
+
+ECS::entity System::spawn(const Volume &vol) {
+    auto ent = mECS.newEntity();
+    mECS.triggers.emplace(ent, vol);
+    return ent;
+}
+
+std::optional<std::pair<Category, tg::pos3>> System::locate(ECS::entity id, const Volume &vol, const ECS::Snapshot &snap) const {
+    if (vol.mask & Humanoids) {
+        auto iter = snap.humanoids.find(id);
+        if (iter != snap.humanoids.end()) {return {{Humanoids, iter->second.base.translation}};}
+    }
+    if ((vol.mask & Parrots) && mECS.parrots.count(id)) {
+        auto iter = mECS.riggedRigids.find(id);
+        if (iter != mECS.riggedRigids.end()) {return {{Parrots, iter->second.translation}};}
+    }
+    if (vol.mask & Lasers) {
+        auto iter = mECS.scatterLasers.find(id);
+        if (iter != mECS.scatterLasers.end()) {
+            // the point of the laser closest to the center
+            auto &seg = iter->second.seg;
+            auto dir = seg.pos1 - seg.pos0;
+            auto lenSq = tg::length_sqr(dir);
+            auto param = lenSq > 0.f ? std::clamp(tg::dot(vol.center - seg.pos0, dir) / lenSq, 0.f, 1.f) : 0.f;
+            return {{Lasers, seg.pos0 + param * dir}};
+        }
+    }
+    return std::nullopt;
+}
+
+void System::update(const ECS::Snapshot &snap) {
+    events.clear();
+    for (auto [a, b] : mECS.dynamicPairs) {
+        bool aVol = mECS.triggers.count(a), bVol = mECS.triggers.count(b);
+        if (aVol == bVol) {continue;}  // volumes don't trigger each other
+        if (bVol) {std::swap(a, b);}
+        mCandidates.try_emplace({a, b}, false);
+    }
+
+    auto &tree = mECS.dynamicTree;
+    for (auto iter = mCandidates.begin(); iter != mCandidates.end();) {
+        auto [vol, other] = iter->first;
+        auto volIter = mECS.triggers.find(vol);
+        auto volProxy = mECS.dynamicProxies.find(vol), otherProxy = mECS.dynamicProxies.find(other);
+        bool near = volIter != mECS.triggers.end()
+            && volProxy != mECS.dynamicProxies.end() && otherProxy != mECS.dynamicProxies.end()
+            && tg::intersects(tree.fatAABB(volProxy->second), tree.fatAABB(otherProxy->second));
+        bool inside = false;
+        if (near) {
+            auto loc = locate(other, volIter->second, snap);
+            inside = loc && volIter->second.contains(loc->second);
+        }
+        if (inside != iter->second) {
+            auto owner = volIter != mECS.triggers.end() ? volIter->second.owner : ECS::INVALID;
+            events.push_back({vol, owner, other, inside});
+            iter->second = inside;
+        }
+        // the pair will be reported by the broadphase again if the boxes start overlapping again
+        if (near) {
+            ++iter;
+        } else {
+            iter = mCandidates.erase(iter);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include <typed-geometry/tg-lean.hh>
+
+#include <ECS.hh>
+
+namespace Trigger {
+
+/// kinds of objects a volume can react to, see `Volume::mask`
+enum Category : uint32_t {
+    Humanoids = 1,
+    Parrots = 2,
+    Lasers = 4
+};
+
+/// static sphere or box that reports objects entering and leaving it.
+/// Volumes are entities of their own, `owner` is the entity they belong to
+struct Volume {
+    enum class Shape {Sphere, Box, Cylinder} shape = Shape::Sphere;
+    tg::pos3 center;
+    float radius = 1.f;  ///< for spheres and cylinders
+    tg::vec3 halfExtent;  ///< for boxes (axis-aligned); `y` is the half height of cylinders
+    uint32_t mask = Humanoids;
+    ECS::entity owner = ECS::INVALID;
+
+    static Volume sphere(ECS::entity owner, const tg::pos3 &center, float radius, uint32_t mask = Humanoids);
+    static Volume box(ECS::entity owner, const tg::aabb3 &box, uint32_t mask = Humanoids);
+    /// upright cylinder: an XZ distance check limited to `center.y ± halfHeight`
+    static Volume cylinder(ECS::entity owner, const tg::pos3 &center, float radius, float halfHeight, uint32_t mask = Humanoids);
+
+    tg::aabb3 aabb() const;
+    bool contains(const tg::pos3 &) const;
+};
+
+struct Event {
+    ECS::entity volume, owner, other;
+    bool enter;  ///< false: `other` left the volume (or was deleted)
+};
+
+/// turns the broadphase pairs of `ECS::dynamicTree` into enter/exit events.
+/// Volumes and objects are kept in the same tree; a pair becomes a candidate
+/// when the broadphase reports it and stays one until the fat bounding boxes
+/// separate, so the work per tick is proportional to the number of objects
+/// near volumes plus the number of objects that moved out of their fat boxes
+class System {
+    ECS::ECS &mECS;
+    /// (volume, other) → whether other is currently inside
+    std::map<std::pair<ECS::entity, ECS::entity>, bool> mCandidates;
+
+    std::optional<std::pair<Category, tg::pos3>> locate(ECS::entity, const Volume &, const ECS::Snapshot &) const;
+
+public:
+    /// events generated by the last `update`, in deterministic order
+    std::vector<Event> events;
+
+    System(ECS::ECS &ecs) : mECS{ecs} {}
+
+    ECS::entity spawn(const Volume &);
+    /// call after `ECS::updateDynamicTree`
+    void update(const ECS::Snapshot &);
+    size_t candidates() const {return mCandidates.size();}
+};
+
+}
@@ -0,0 +1,98 @@
+// SPDX-License-Identifier: MIT
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/// binary min-heap of dense node ids with decrease-key. Every node is in the
+/// heap at most once; `push` on a queued node updates its key instead.
+/// Memory is kept between uses: `clear` only touches the queued nodes
+template<class Key>
+class IndexedHeap {
+    static constexpr uint32_t NONE = -1;
+
+    std::vector<std::pair<Key, uint32_t>> mHeap;
+    std::vector<uint32_t> mSlot;  ///< position of each node in `mHeap`, NONE if not queued
+
+    void place(size_t pos, std::pair<Key, uint32_t> entry) {
+        mHeap[pos] = entry;
+        mSlot[entry.second] = uint32_t(pos);
+    }
+    void siftUp(size_t pos) {
+        auto entry = mHeap[pos];
+        while (pos > 0) {
+            auto parent = (pos - 1) / 2;
+            if (!(entry.first < mHeap[parent].first)) {break;}
+            place(pos, mHeap[parent]);
+            pos = parent;
+        }
+        place(pos, entry);
+    }
+    void siftDown(size_t pos) {
+        auto entry = mHeap[pos];
+        while (true) {
+            auto child = 2 * pos + 1;
+            if (child >= mHeap.size()) {break;}
+            if (child + 1 < mHeap.size() && mHeap[child + 1].first < mHeap[child].first) {child += 1;}
+            if (!(mHeap[child].first < entry.first)) {break;}
+            place(pos, mHeap[child]);
+            pos = child;
+        }
+        place(pos, entry);
+    }
+
+public:
+    /// makes room for node ids below `nodes`
+    void reserve(size_t nodes) {
+        if (mSlot.size() < nodes) {mSlot.resize(nodes, NONE);}
+    }
+    void clear() {
+        for (auto &entry : mHeap) {mSlot[entry.second] = NONE;}
+        mHeap.clear();
+    }
+    bool empty() const {return mHeap.empty();}
+    size_t size() const {return mHeap.size();}
+    bool contains(uint32_t node) const {return mSlot[node] != NONE;}
+    const std::pair<Key, uint32_t> &top() const {return mHeap.front();}
+
+    /// inserts the node, or changes its key if it is already queued
+    void push(uint32_t node, Key key) {
+        auto slot = mSlot[node];
+        if (slot == NONE) {
+            mHeap.emplace_back(key, node);
+            siftUp(mHeap.size() - 1);
+        } else if (key < mHeap[slot].first) {
+            mHeap[slot].first = key;
+            siftUp(slot);
+        } else {
+            mHeap[slot].first = key;
+            siftDown(slot);
+        }
+    }
+    std::pair<Key, uint32_t> pop() {
+        auto res = mHeap.front();
+        mSlot[res.second] = NONE;
+        auto last = mHeap.back();
+        mHeap.pop_back();
+        if (!mHeap.empty()) {
+            mHeap.front() = last;
+            siftDown(0);
+        }
+        return res;
+    }
+    void remove(uint32_t node) {
+        auto slot = mSlot[node];
+        if (slot == NONE) {return;}
+        mSlot[node] = NONE;
+        auto last = mHeap.back();
+        mHeap.pop_back();
+        if (slot == mHeap.size()) {return;}
+        mHeap[slot] = last;
+        siftUp(slot);
+        siftDown(mSlot[last.second]);
+    }
+    size_t memoryBytes() const {
+        return mHeap.capacity() * sizeof(mHeap[0]) + mSlot.capacity() * sizeof(uint32_t);
+    }
+};
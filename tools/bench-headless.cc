@@ -0,0 +1,256 @@
+// SPDX-License-Identifier: MIT
+// headless micro-benchmarks: the ones from the benchmark panel that bring
+// their own data (generated terrains, agents, movers), and the ones checking
+// their results against a reference, which run on a generated island instead
+// of the loaded scene. No window or GL context needed. They report through the
+// log, like in the game; the exit status is non-zero if any check found mismatches
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <typed-geometry/tg.hh>
+
+#include <ECS.hh>
+#include <bench/Bench.hh>
+#include <combat/Combat.hh>
+#include <navmesh/NavMesh.hh>
+#include <obstacles/Obstacle.hh>
+#include <obstacles/WorldFluff.hh>
+#include <rendering/InstancedRenderer.hh>
+#include <rtree/RStar.hh>
+#include <terrain/Terrain.hh>
+
+namespace {
+/// the scene of `Game::terrainScene` in a headless ECS: a generated island with
+/// its navmesh and, for the benchmarks that need them, obstacles, fluff and
+/// humanoids, all without rendering data
+struct Scene {
+    ECS::ECS ecs;
+    ECS::Snapshot snap;
+    ECS::Rigid wo = {{0, 0, 0}, tg::quat::from_axis_angle(tg::dir3(0, 1, 0), 135_deg)};
+    ECS::entity terrainId;
+    // the ECS refers to the types
+    std::vector<std::unique_ptr<InstancedRenderer::VaoInfo>> vaoInfos;
+    std::vector<Obstacle::Type> obstacleTypes;
+    std::vector<WorldFluff::Type> fluffTypes;
+
+    Scene(std::mt19937 &rng, uint32_t segments = 200) {
+        ecs.simSnap = &snap;
+        terrainId = ecs.newEntity();
+        ecs.staticRigids.emplace(terrainId, wo);
+        auto &terr = ecs.terrains.emplace(terrainId, Terrain::Instance(rng, segments)).first->second;
+        ecs.navMeshes.emplace(terrainId, NavMesh::Instance(wo, terr));
+        ecs.navMeshVersion += 1;
+    }
+    Scene(const Scene &) = delete;
+
+    NavMesh::Instance &nav() {return ecs.navMeshes.at(terrainId);}
+    tg::pos3 randomPlace(std::mt19937 &rng) {
+        auto &g = *nav().graph;
+        return g.faceCentroid(uint32_t(std::uniform_int_distribution<size_t>(0, g.numFaces() - 1)(rng)));
+    }
+
+    /// like `Obstacle::System`; the colliders are loaded from `../data`
+    void placeObstacles(std::mt19937 &rng, float density = .1f) {
+        obstacleTypes.reserve(Obstacle::typeTemplates.size());
+        for (auto &templ : Obstacle::typeTemplates) {
+            auto &type = obstacleTypes.emplace_back(*vaoInfos.emplace_back(std::make_unique<InstancedRenderer::VaoInfo>()));
+            type.id = templ.id;
+            type.highCover = templ.highCover;
+            type.collisionMesh = std::make_unique<Obstacle::CollisionMesh>();
+            Obstacle::loadCollisionMesh(*type.collisionMesh, templ.colliderPath);
+        }
+        Obstacle::placeObstacles(wo, ecs.terrains.at(terrainId), rng, density, [&] (const Obstacle::Placement &placement) {
+            auto &type = obstacleTypes[placement.type];
+            auto aabb = type.worldBounds(placement.rigid);
+            auto ent = ecs.newEntity();
+            ecs.obstacles.emplace(ent, type);
+            ecs.instancedRigids.emplace(ent, placement.rigid);
+            decltype(ecs.obstructions)::RStarInserter::insert(ecs.obstructions, {aabb, ent});
+            ecs.obstructionChanged(aabb);
+        });
+    }
+
+    /// boxes of a few sizes standing on random faces, instead of the fluff meshes
+    void placeFluff(std::mt19937 &rng, size_t n) {
+        for (float size : {.3f, .8f, 2.f}) {
+            auto &vaoInfo = *vaoInfos.emplace_back(std::make_unique<InstancedRenderer::VaoInfo>());
+            vaoInfo.bounds = {{-size, 0, -size}, {size, 2 * size, size}};
+            fluffTypes.emplace_back(vaoInfo);
+        }
+        std::uniform_int_distribution<size_t> typeDistr(0, fluffTypes.size() - 1);
+        std::uniform_real_distribution<float> angleDistr(0.f, 360.f);
+        for (size_t i = 0; i < n; ++i) {
+            auto &type = fluffTypes[typeDistr(rng)];
+            auto pos = randomPlace(rng);
+            auto ent = ecs.newEntity();
+            auto &rig = ecs.instancedRigids.emplace(ent, ECS::Rigid(
+                pos, tg::quat::from_axis_angle(tg::dir3(0, 1, 0), tg::angle32::from_degree(angleDistr(rng)))
+            )).first->second;
+            ecs.worldFluffs.emplace(ent, type);
+            auto &bounds = type.vaoInfo.bounds;
+            auto mat = tg::mat4x3(rig);
+            tg::aabb3 aabb = {pos, pos};
+            for (auto corner : {0, 1, 2, 3, 4, 5, 6, 7}) {
+                auto p = tg::pos3(mat * tg::vec4(
+                    corner & 1 ? bounds.max.x : bounds.min.x,
+                    corner & 2 ? bounds.max.y : bounds.min.y,
+                    corner & 4 ? bounds.max.z : bounds.min.z, 1
+                ));
+                aabb = {tg::min(aabb.min, p), tg::max(aabb.max, p)};
+            }
+            decltype(ecs.fluffBounds)::RStarInserter::insert(ecs.fluffBounds, {aabb, ent});
+        }
+    }
+
+    /// standing on random faces, in the dynamic tree
+    void placeHumanoids(std::mt19937 &rng, size_t n) {
+        Combat::MobileUnit mobTempl;
+        mobTempl.radius = .5f;
+        mobTempl.heightVector = wo.rotation * tg::vec3(0, 1.8f, 0);
+        for (size_t i = 0; i < n; ++i) {
+            auto id = ecs.newEntity();
+            ecs.mobileUnits.emplace(id, mobTempl);
+            snap.humanoids[id].base.translation = randomPlace(rng);
+        }
+        ECS::Snapshot prev;
+        ecs.updateDynamicTree(prev, snap);
+    }
+};
+
+struct Entry {
+    const char *name;
+    /// names of the parameters, for the usage message
+    const char *params;
+    /// what the benchmark panel uses; also gives the number of parameters
+    std::vector<size_t> defaults;
+    /// returns the number of mismatches its checks found
+    std::function<size_t(std::mt19937 &, const std::vector<size_t> &)> run;
+    /// loads the obstacle colliders, so it has to run from `bin/`
+    bool needsData = false;
+};
+
+const std::vector<Entry> entries = {
+    {"crowd", "AGENTS:TICKS", {1000, 600}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {Bench::crowdAvoidance(rng, p[0], p[1]); return size_t(0);}},
+    {"dynamicTree", "OBJECTS:TICKS", {10000, 300}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {Bench::dynamicTreeChurn(rng, p[0], p[1]); return size_t(0);}},
+    {"triggers", "PARROTS:HUMANOIDS:TICKS", {5000, 500, 300}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {Bench::parrotTriggers(rng, p[0], p[1], p[2]); return size_t(0);}},
+    {"navmeshBuild", "", {}, [] (std::mt19937 &rng, const std::vector<size_t> &) {Bench::navmeshBuild(rng); return size_t(0);}},
+    {"islands", "QUERIES", {1000}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {Bench::navmeshIslands(rng, p[0]); return size_t(0);}},
+    {"craterStorm", "IMPACTS", {1000}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {Bench::craterStorm(rng, p[0]); return size_t(0);}},
+    {"picking", "RAYS:FLUFF:HUMANOIDS", {1000, 2000, 50}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {
+        Scene scene(rng);
+        scene.placeObstacles(rng);
+        scene.placeFluff(rng, p[1]);
+        scene.placeHumanoids(rng, p[2]);
+        return Bench::picking(scene.ecs, rng, p[0]);
+    }, true},
+    {"routePlanner", "QUERIES", {200}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {
+        Scene scene(rng);
+        scene.placeObstacles(rng);
+        return Bench::routePlanner(scene.ecs, rng, p[0]);
+    }, true},
+    {"slicedSearch", "QUERIES", {256}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {
+        Scene scene(rng);
+        scene.placeObstacles(rng);
+        return Bench::slicedSearch(scene.ecs, rng, p[0]);
+    }, true},
+    {"pointLocation", "QUERIES", {1000}, [] (std::mt19937 &rng, const std::vector<size_t> &p) {
+        Scene scene(rng);
+        return Bench::pointLocation(scene.ecs, rng, p[0]);
+    }},
+};
+
+struct Run {
+    const Entry *entry;
+    std::vector<size_t> params;
+};
+
+struct Config {
+    uint32_t seed = 1;
+    std::vector<Run> runs;
+};
+
+/// `name[:param]...`, e. g. `crowd` or `crowd:5000:600`; missing parameters take the defaults
+std::optional<Run> parseRun(const std::string &arg) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        auto end = arg.find(':', start);
+        parts.push_back(arg.substr(start, end - start));
+        if (end == std::string::npos) {break;}
+        start = end + 1;
+    }
+    for (auto &entry : entries) {
+        if (parts[0] != entry.name) {continue;}
+        if (parts.size() - 1 > entry.defaults.size()) {return {};}
+        Run res = {&entry, entry.defaults};
+        for (size_t i = 1; i < parts.size(); ++i) {
+            char *end;
+            res.params[i - 1] = std::strtoul(parts[i].c_str(), &end, 10);
+            if (parts[i].empty() || *end) {return {};}
+        }
+        return res;
+    }
+    return {};
+}
+
+std::optional<Config> parseArgs(int argc, char **argv) {
+    Config res;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--seed") {
+            if (i + 1 == argc) {return {};}
+            std::string value = argv[++i];
+            char *end;
+            res.seed = uint32_t(std::strtoul(value.c_str(), &end, 10));
+            if (value.empty() || *end) {return {};}
+            continue;
+        }
+        auto run = parseRun(arg);
+        if (!run) {return {};}
+        res.runs.push_back(*run);
+    }
+    if (res.runs.empty()) {return {};}
+    return res;
+}
+}
+
+int main(int argc, char **argv) {
+    auto config = parseArgs(argc, argv);
+    if (!config) {
+        std::cerr << "usage: " << argv[0] << " [--seed N] BENCH[:PARAM]...\n";
+        for (auto &entry : entries) {
+            std::cerr << "  " << entry.name;
+            if (!entry.defaults.empty()) {
+                std::cerr << ":" << entry.params << " (default";
+                for (auto param : entry.defaults) {std::cerr << " " << param;}
+                std::cerr << ")";
+            }
+            std::cerr << "\n";
+        }
+        std::cerr.flush();
+        return EXIT_FAILURE;
+    }
+    for (auto &run : config->runs) {
+        // the obstacle colliders are found relative to it, like in the game
+        if (run.entry->needsData && !std::filesystem::exists("../data")) {
+            std::cerr << run.entry->name << ": working directory must be set to 'bin/'" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    size_t mismatches = 0;
+    for (auto &run : config->runs) {
+        // every run starts from the seed, so it doesn't depend on the ones before
+        std::mt19937 rng(config->seed);
+        auto found = run.entry->run(rng, run.params);
+        if (found > 0) {std::cerr << run.entry->name << ": " << found << " mismatches" << std::endl;}
+        mismatches += found;
+    }
+    return mismatches > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
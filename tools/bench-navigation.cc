@@ -0,0 +1,275 @@
+// SPDX-License-Identifier: MIT
+// headless pathfinding benchmark: generates the island for a seed, builds its
+// navmesh, places the obstacles like the game does and runs batches of route
+// queries on it, without a window or GL context. Reports the latencies,
+// node expansions and collision queries of each batch as JSON
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <typed-geometry/tg.hh>
+#include <glow/common/log.hh>
+
+#include <ECS.hh>
+#include <bench/Bench.hh>
+#include <combat/Combat.hh>
+#include <combat/Walking.hh>
+#include <navmesh/NavMesh.hh>
+#include <obstacles/Obstacle.hh>
+#include <rendering/InstancedRenderer.hh>
+#include <rtree/RStar.hh>
+#include <terrain/Terrain.hh>
+
+namespace {
+enum class Query {Navigate, PlanRoute, PlanWalk};
+
+struct Batch {
+    Query query;
+    NavMesh::SearchMode mode;  ///< only for `Query::Navigate`; the others search like the game
+    size_t count;
+};
+
+struct Config {
+    uint32_t seed = 1;
+    uint32_t segments = 200;
+    float density = .1f;  ///< of obstacles, what `Obstacle::System` uses
+    std::string out = "bench-navigation.json";
+    std::vector<Batch> batches;
+};
+
+struct Result {
+    Batch batch;
+    size_t found = 0;
+    Bench::Samples micros, expanded, obstructionTests;
+};
+
+const char *queryName(Query query) {
+    switch (query) {
+    case Query::Navigate: return "navigate";
+    case Query::PlanRoute: return "planRoute";
+    case Query::PlanWalk: return "planWalk";
+    }
+    return "";
+}
+
+const char *modeName(NavMesh::SearchMode mode) {
+    switch (mode) {
+    case NavMesh::SearchMode::Crossings: return "crossings";
+    case NavMesh::SearchMode::Corridor: return "corridor";
+    case NavMesh::SearchMode::Hierarchical: return "hierarchical";
+    }
+    return "";
+}
+
+/// `query[:mode]:count`, e. g. `navigate:corridor:1000` or `planWalk:200`
+std::optional<Batch> parseBatch(const std::string &arg) {
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (true) {
+        auto end = arg.find(':', start);
+        parts.push_back(arg.substr(start, end - start));
+        if (end == std::string::npos) {break;}
+        start = end + 1;
+    }
+    Batch res = {Query::Navigate, NavMesh::SearchMode::Hierarchical, 0};
+    if (parts[0] == "navigate") {
+        if (parts.size() != 3) {return {};}
+        if (parts[1] == "crossings") {res.mode = NavMesh::SearchMode::Crossings;}
+        else if (parts[1] == "corridor") {res.mode = NavMesh::SearchMode::Corridor;}
+        else if (parts[1] == "hierarchical") {res.mode = NavMesh::SearchMode::Hierarchical;}
+        else {return {};}
+    } else if (parts[0] == "planRoute" || parts[0] == "planWalk") {
+        if (parts.size() != 2) {return {};}
+        res.query = parts[0] == "planRoute" ? Query::PlanRoute : Query::PlanWalk;
+    } else {
+        return {};
+    }
+    char *end;
+    res.count = std::strtoul(parts.back().c_str(), &end, 10);
+    if (parts.back().empty() || *end) {return {};}
+    return res;
+}
+
+std::optional<Config> parseArgs(int argc, char **argv) {
+    Config res;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 == argc) {return {};}
+        std::string value = argv[++i];
+        char *end;
+        if (arg == "--seed") {
+            res.seed = uint32_t(std::strtoul(value.c_str(), &end, 10));
+        } else if (arg == "--segments") {
+            res.segments = uint32_t(std::strtoul(value.c_str(), &end, 10));
+        } else if (arg == "--density") {
+            res.density = std::strtof(value.c_str(), &end);
+        } else if (arg == "--out") {
+            res.out = value;
+            continue;
+        } else if (arg == "--batch") {
+            auto batch = parseBatch(value);
+            if (!batch) {return {};}
+            res.batches.push_back(*batch);
+            continue;
+        } else {
+            return {};
+        }
+        if (value.empty() || *end) {return {};}
+    }
+    if (res.batches.empty()) {
+        res.batches = {
+            {Query::Navigate, NavMesh::SearchMode::Crossings, 200},
+            {Query::Navigate, NavMesh::SearchMode::Corridor, 1000},
+            {Query::Navigate, NavMesh::SearchMode::Hierarchical, 1000},
+            {Query::PlanRoute, NavMesh::SearchMode::Hierarchical, 500},
+            {Query::PlanWalk, NavMesh::SearchMode::Hierarchical, 200}
+        };
+    }
+    return res;
+}
+
+void writeSamples(std::ostream &out, const char *name, Bench::Samples &samples) {
+    out << "\"" << name << "\": {\"mean\": " << samples.mean()
+        << ", \"p50\": " << samples.percentile(.5)
+        << ", \"p95\": " << samples.percentile(.95)
+        << ", \"p99\": " << samples.percentile(.99) << "}";
+}
+}
+
+int main(int argc, char **argv) {
+    auto config = parseArgs(argc, argv);
+    if (!config) {
+        std::cerr << "usage: " << argv[0] << " [--seed N] [--segments N] [--density F] [--out FILE] [--batch QUERY:COUNT]...\n"
+            << "  QUERY: navigate:crossings, navigate:corridor, navigate:hierarchical, planRoute, planWalk" << std::endl;
+        return EXIT_FAILURE;
+    }
+    // the obstacle colliders are found relative to it, like in the game
+    if (!std::filesystem::exists("../data")) {
+        std::cerr << "Working directory must be set to 'bin/'" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const tg::vec3 height = {0, 1.8f, 0};
+    constexpr float radius = .5f;
+    constexpr uint32_t nsteps = 5;
+
+    // the scene of `Game::terrainScene`, in a headless ECS
+    ECS::ECS ecs;
+    ECS::Snapshot snap;
+    ecs.simSnap = &snap;
+    std::mt19937 rng(config->seed);
+    ECS::Rigid wo({0, 0, 0}, tg::quat::from_axis_angle(tg::dir3(0, 1, 0), 135_deg));
+    std::optional<Terrain::Instance> terr;
+    auto terrainMicros = Bench::timeMicros([&] {terr.emplace(rng, config->segments);});
+    auto navId = ecs.newEntity();
+    std::optional<NavMesh::Instance> built;
+    auto navmeshMicros = Bench::timeMicros([&] {built.emplace(wo, *terr);});
+    auto &navItem = *ecs.navMeshes.emplace(navId, std::move(*built)).first;
+    auto &nav = navItem.second;
+    ecs.navMeshVersion += 1;
+
+    // obstacle types without their rendering data
+    std::vector<std::unique_ptr<InstancedRenderer::VaoInfo>> vaoInfos;
+    std::vector<Obstacle::Type> types;
+    types.reserve(Obstacle::typeTemplates.size());  // the ECS refers to them
+    for (auto &templ : Obstacle::typeTemplates) {
+        auto &type = types.emplace_back(*vaoInfos.emplace_back(std::make_unique<InstancedRenderer::VaoInfo>()));
+        type.id = templ.id;
+        type.highCover = templ.highCover;
+        type.collisionMesh = std::make_unique<Obstacle::CollisionMesh>();
+        Obstacle::loadCollisionMesh(*type.collisionMesh, templ.colliderPath);
+    }
+    size_t nObstacles = 0;
+    auto obstacleMicros = Bench::timeMicros([&] {
+        Obstacle::placeObstacles(wo, *terr, rng, config->density, [&] (const Obstacle::Placement &placement) {
+            auto &type = types[placement.type];
+            auto aabb = type.worldBounds(placement.rigid);
+            auto ent = ecs.newEntity();
+            ecs.obstacles.emplace(ent, type);
+            ecs.instancedRigids.emplace(ent, placement.rigid);
+            decltype(ecs.obstructions)::RStarInserter::insert(ecs.obstructions, {aabb, ent});
+            ecs.obstructionChanged(aabb);
+            nObstacles += 1;
+            // no parrots without rendering, but keep the generator in step with the game
+            if (Obstacle::rollParrot(placement.type, rng)) {ecs.newEntity();}
+        });
+    });
+
+    Combat::MobileUnit mobTempl;
+    mobTempl.cruiseSpeed = 10.f;
+    mobTempl.acceleration = 7.f;
+    mobTempl.radius = radius;
+    mobTempl.heightVector = wo.rotation * height;
+
+    auto &g = *nav.graph;
+    std::uniform_int_distribution<int> faceDistr(0, int(g.numFaces()) - 1);
+    std::vector<Result> results;
+    for (auto &batch : config->batches) {
+        // every batch asks the same queries, so they can be compared
+        std::mt19937 queryRng(config->seed);
+        auto &res = results.emplace_back();
+        res.batch = batch;
+        for (size_t i = 0; i < batch.count; ++i) {
+            NavMesh::RouteRequest req;
+            do {
+                req.start_face = pm::face_index(faceDistr(queryRng));
+                req.end_face = pm::face_index(faceDistr(queryRng));
+            } while (req.start_face == req.end_face);
+            req.start = g.faceCentroid(uint32_t(req.start_face.value));
+            req.end = g.faceCentroid(uint32_t(req.end_face.value));
+
+            bool found = false;
+            if (batch.query == Query::Navigate) {
+                Obstacle::Collider collider(ecs, height, radius);
+                res.micros.add(Bench::timeMicros([&] {found = !nav.navigate(req, nsteps, collider, batch.mode).empty();}));
+            } else {
+                auto mob = mobTempl;
+                Combat::Humanoid hum;
+                res.micros.add(Bench::timeMicros([&] {
+                    found = mob.planRoute(navItem, req, ecs);
+                    if (!found || batch.query != Query::PlanWalk) {return;}
+                    // what the command tool does once the route arrives
+                    Combat::MovementContext ctx {ecs, hum, mob, nav};
+                    auto up = tg::dir3(wo.rotation * tg::vec3(0, 1, 0));
+                    auto start = Combat::HumanoidPos::fromStance(hum.baseStance, {req.start, wo.rotation});
+                    ctx.setFeet(start, hum.baseStance);
+                    ctx.planWalk(start, up, req.end - req.start);
+                }));
+            }
+            res.found += found;
+            res.expanded.add(double(nav.lastSearch.expanded));
+            res.obstructionTests.add(double(nav.lastSearch.obstructionTests));
+        }
+    }
+
+    std::ofstream out(config->out);
+    out << "{\n  \"seed\": " << config->seed << ", \"segments\": " << config->segments
+        << ", \"faces\": " << g.numFaces() << ", \"obstacles\": " << nObstacles << ",\n"
+        << "  \"setupMillis\": {\"terrain\": " << terrainMicros / 1000 << ", \"navmesh\": " << navmeshMicros / 1000
+        << ", \"obstacles\": " << obstacleMicros / 1000 << "},\n  \"batches\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        auto &res = results[i];
+        out << (i ? ",\n" : "\n") << "    {\"query\": \"" << queryName(res.batch.query) << "\"";
+        if (res.batch.query == Query::Navigate) {out << ", \"mode\": \"" << modeName(res.batch.mode) << "\"";}
+        out << ", \"queries\": " << res.batch.count << ", \"found\": " << res.found << ",\n      ";
+        writeSamples(out, "latencyMicros", res.micros);
+        out << ",\n      ";
+        writeSamples(out, "expanded", res.expanded);
+        out << ",\n      ";
+        writeSamples(out, "obstructionTests", res.obstructionTests);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+    if (!out) {
+        std::cerr << "could not write " << config->out << std::endl;
+        return EXIT_FAILURE;
+    }
+    glow::info() << "wrote " << config->out;
+    return EXIT_SUCCESS;
+}